@@ -0,0 +1,191 @@
+//
+//	Dept. Software Convergence, Kyung Hee University
+//	Prof. Daeho Lee, nize@khu.ac.kr
+//
+
+#include "KhuGleEvaluation.h"
+#include <algorithm>
+#include <thread>
+
+#pragma warning(disable:4996)
+
+#define _CRTDBG_MAP_ALLOC
+#include <cstdlib>
+#include <crtdbg.h>
+
+#ifdef _DEBUG
+#ifndef DBG_NEW
+#define DBG_NEW new ( _NORMAL_BLOCK , __FILE__ , __LINE__ )
+#define new DBG_NEW
+#endif
+#endif  // _DEBUG
+
+static bool ScoreGreater(const CKgScoredSample &a, const CKgScoredSample &b)
+{
+	return a.Score > b.Score;
+}
+
+CKhuGleRocCurve::CKhuGleRocCurve()
+{
+	Clear();
+}
+
+void CKhuGleRocCurve::Clear()
+{
+	m_Samples.clear();
+	m_Bins.clear();
+	m_Roc.clear();
+	m_PrecisionRecall.clear();
+	m_Threshold.clear();
+
+	m_PositiveTotal = m_NegativeTotal = 0.;
+	m_Auc = m_AveragePrecision = 0.;
+}
+
+void CKhuGleRocCurve::AddSample(int nLabel, double Score, double Weight)
+{
+	m_Samples.push_back(CKgScoredSample(nLabel, Score, Weight));
+}
+
+void CKhuGleRocCurve::ParallelSort(std::vector<CKgScoredSample> &Samples, int nThreadCnt)
+{
+	int nSize = (int)Samples.size();
+	if(nThreadCnt <= 0) nThreadCnt = (int)std::thread::hardware_concurrency();
+	if(nThreadCnt <= 0) nThreadCnt = 1;
+	if(nThreadCnt > nSize/4096) nThreadCnt = nSize/4096;
+
+	if(nThreadCnt <= 1)
+	{
+		std::sort(Samples.begin(), Samples.end(), ScoreGreater);
+		return;
+	}
+
+	std::vector<int> Bound(nThreadCnt+1);
+	for(int i = 0 ; i <= nThreadCnt ; ++i)
+		Bound[i] = (int)((long long)nSize*i/nThreadCnt);
+
+	std::vector<std::thread> Threads;
+	for(int i = 0 ; i < nThreadCnt ; ++i)
+		Threads.push_back(std::thread([&Samples, &Bound, i]() {
+			std::sort(Samples.begin()+Bound[i], Samples.begin()+Bound[i+1], ScoreGreater);
+		}));
+	for(auto &Thread : Threads) Thread.join();
+
+	for(int nStep = 1 ; nStep < nThreadCnt ; nStep *= 2)
+	{
+		Threads.clear();
+		for(int i = 0 ; i+nStep < nThreadCnt ; i += 2*nStep)
+		{
+			int nBegin = Bound[i], nMiddle = Bound[i+nStep];
+			int nEnd = Bound[std::min(i+2*nStep, nThreadCnt)];
+			Threads.push_back(std::thread([&Samples, nBegin, nMiddle, nEnd]() {
+				std::inplace_merge(Samples.begin()+nBegin, Samples.begin()+nMiddle, Samples.begin()+nEnd, ScoreGreater);
+			}));
+		}
+		for(auto &Thread : Threads) Thread.join();
+	}
+}
+
+void CKhuGleRocCurve::MergeBins(std::vector<CKgScoreBin> &Bins, const std::vector<CKgScoreBin> &Other)
+{
+	std::vector<CKgScoreBin> Merged;
+	Merged.reserve(Bins.size()+Other.size());
+
+	size_t i = 0, j = 0;
+	while(i < Bins.size() || j < Other.size())
+	{
+		CKgScoreBin Bin;
+		if(j >= Other.size() || (i < Bins.size() && Bins[i].Score > Other[j].Score))
+			Bin = Bins[i++];
+		else if(i >= Bins.size() || Other[j].Score > Bins[i].Score)
+			Bin = Other[j++];
+		else
+		{
+			Bin = Bins[i++];
+			Bin.PositiveWeight += Other[j].PositiveWeight;
+			Bin.NegativeWeight += Other[j++].NegativeWeight;
+		}
+		Merged.push_back(Bin);
+	}
+
+	Bins.swap(Merged);
+}
+
+void CKhuGleRocCurve::Compute(int nThreadCnt)
+{
+	if(!m_Samples.empty())
+	{
+		ParallelSort(m_Samples, nThreadCnt);
+
+		std::vector<CKgScoreBin> NewBins;
+		for(auto &Sample : m_Samples)
+		{
+			if(NewBins.empty() || NewBins.back().Score != Sample.Score)
+				NewBins.push_back({Sample.Score, 0., 0.});
+
+			if(Sample.nLabel == 1)
+				NewBins.back().PositiveWeight += Sample.Weight;
+			else
+				NewBins.back().NegativeWeight += Sample.Weight;
+		}
+
+		m_Samples.clear();
+		m_Samples.shrink_to_fit();
+
+		MergeBins(m_Bins, NewBins);
+	}
+
+	BuildCurves();
+}
+
+void CKhuGleRocCurve::Merge(const CKhuGleRocCurve &Shard)
+{
+	MergeBins(m_Bins, Shard.m_Bins);
+	m_Samples.insert(m_Samples.end(), Shard.m_Samples.begin(), Shard.m_Samples.end());
+}
+
+void CKhuGleRocCurve::BuildCurves()
+{
+	m_Roc.clear();
+	m_PrecisionRecall.clear();
+	m_Threshold.clear();
+	m_Auc = m_AveragePrecision = 0.;
+
+	m_PositiveTotal = m_NegativeTotal = 0.;
+	for(auto &Bin : m_Bins)
+	{
+		m_PositiveTotal += Bin.PositiveWeight;
+		m_NegativeTotal += Bin.NegativeWeight;
+	}
+
+	if(m_Bins.empty()) return;
+
+	m_Roc.reserve(m_Bins.size()+1);
+	m_PrecisionRecall.reserve(m_Bins.size());
+	m_Threshold.reserve(m_Bins.size());
+
+	m_Roc.push_back({0., 0.});
+
+	double TP = 0., FP = 0.;
+	double TprPrev = 0., FprPrev = 0., RecallPrev = 0.;
+	for(auto &Bin : m_Bins)
+	{
+		TP += Bin.PositiveWeight;
+		FP += Bin.NegativeWeight;
+
+		double Tpr = m_PositiveTotal > 0 ? TP/m_PositiveTotal : 0.;
+		double Fpr = m_NegativeTotal > 0 ? FP/m_NegativeTotal : 0.;
+		double Precision = TP+FP > 0 ? TP/(TP+FP) : 1.;
+
+		m_Roc.push_back({Tpr, Fpr});
+		m_PrecisionRecall.push_back({Precision, Tpr});
+		m_Threshold.push_back(Bin.Score);
+
+		m_Auc += (Fpr-FprPrev)*(Tpr+TprPrev)/2.;
+		m_AveragePrecision += (Tpr-RecallPrev)*Precision;
+
+		TprPrev = Tpr;
+		FprPrev = Fpr;
+		RecallPrev = Tpr;
+	}
+}
@@ -0,0 +1,50 @@
+//
+//	Dept. Software Convergence, Kyung Hee University
+//	Prof. Daeho Lee, nize@khu.ac.kr
+//
+#pragma once
+
+#include <vector>
+#include <utility>
+
+struct CKgScoredSample {
+	double Score;
+	double Weight;
+	int nLabel;
+
+	CKgScoredSample() : Score(0.), Weight(1.), nLabel(0) {}
+	CKgScoredSample(int l, double s, double w = 1.) : Score(s), Weight(w), nLabel(l) {}
+};
+
+// Weighted positive/negative mass of every sample sharing one score
+struct CKgScoreBin {
+	double Score;
+	double PositiveWeight, NegativeWeight;
+};
+
+class CKhuGleRocCurve
+{
+public:
+	std::vector<CKgScoredSample> m_Samples;
+	std::vector<CKgScoreBin> m_Bins;			// distinct scores, descending
+
+	double m_PositiveTotal, m_NegativeTotal;
+
+	std::vector<std::pair<double, double>> m_Roc;				// {TPR, FPR}
+	std::vector<std::pair<double, double>> m_PrecisionRecall;	// {Precision, Recall}
+	std::vector<double> m_Threshold;
+	double m_Auc, m_AveragePrecision;
+
+	CKhuGleRocCurve();
+
+	void Clear();
+	void AddSample(int nLabel, double Score, double Weight = 1.);
+	void Compute(int nThreadCnt = 0);
+	void Merge(const CKhuGleRocCurve &Shard);
+
+	static void ParallelSort(std::vector<CKgScoredSample> &Samples, int nThreadCnt);
+	static void MergeBins(std::vector<CKgScoreBin> &Bins, const std::vector<CKgScoreBin> &Other);
+
+protected:
+	void BuildCurves();
+};
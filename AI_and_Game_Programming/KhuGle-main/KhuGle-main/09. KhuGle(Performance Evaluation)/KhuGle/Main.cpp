@@ -4,6 +4,7 @@
 //
 #include "KhuGleWin.h"
 #include "KhuGleSignal.h"
+#include "KhuGleEvaluation.h"
 #include <iostream>
 #include <random>
 #include <chrono>
@@ -87,6 +88,7 @@ class CKhuGleRocLayer : public CKhuGleLayer
 public:
 	std::vector<std::pair<int, double>> m_Data;
 	std::vector<std::pair<double, double>> m_Positive;
+	CKhuGleRocCurve m_RocCurve;
 
 	CKhuGleRocLayer(int nW, int nH, KgColor24 bgColor, CKgPoint ptPos = CKgPoint(0, 0))
 		: CKhuGleLayer(nW, nH, bgColor, ptPos)
@@ -128,31 +130,12 @@ void CKhuGleRocLayer::MakeData()
 
 void CKhuGleRocLayer::ComputePositives()
 {
-	m_Positive.clear();
+	m_RocCurve.Clear();
+	for(auto &Data : m_Data)
+		m_RocCurve.AddSample(Data.first, Data.second);
+	m_RocCurve.Compute();
 
-	for(int nThreshold = 0 ; nThreshold <= 100 ; nThreshold += 1)
-	{
-		double TP = 0, FP = 0;
-		int nPositiveCnt = 0;
-		for(auto &Data : m_Data)
-		{
-			if(Data.second >= nThreshold/100.)
-			{
-				if(Data.first == 1)
-					TP++;
-				else
-					FP++;
-			}
-
-			if(Data.first == 1)
-				nPositiveCnt++;
-		}
-
-		TP /= nPositiveCnt;
-		FP /= (m_Data.size()-nPositiveCnt);
-
-		m_Positive.push_back({TP, FP});
-	}
+	m_Positive = m_RocCurve.m_Roc;
 }
 
 void CKhuGleRocLayer::DrawBackgroundImage()
@@ -238,6 +221,10 @@ void CPerformance::Update()
 	m_pScene->Render();
 	DrawSceneTextPos("Performance Evaluation", CKgPoint(0, 0));
 
+	char AucText[100];
+	sprintf(AucText, "AUC %.4f  AP %.4f", m_pRocLayer->m_RocCurve.m_Auc, m_pRocLayer->m_RocCurve.m_AveragePrecision);
+	DrawSceneTextPos(AucText, CKgPoint(230, 250));
+
 	CKhuGleWin::Update();
 }
 
@@ -5,6 +5,12 @@
 
 #include "KhuDaNet.h"
 #include <cmath>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <string>
+#include <sstream>
 
 #pragma warning(disable:4996)
 
@@ -24,11 +30,18 @@ CKhuDaNet::CKhuDaNet()
 	m_nInputSize = m_nOutputSize = 0;
 
 	m_Information = new char[MAX_INFORMATION_STRING_SIZE];
+
+	m_Generator.seed((unsigned int)std::chrono::system_clock::now().time_since_epoch().count());
+	m_pCheckpointNetwork = nullptr;
+	m_bCheckpointOk = true;
 }
 
 
 CKhuDaNet::~CKhuDaNet()
 {
+	WaitCheckpoint();
+	if(m_pCheckpointNetwork) delete m_pCheckpointNetwork;
+
 	ClearAllLayers();
 
 	delete [] m_Information;
@@ -78,7 +91,7 @@ void CKhuDaNet::ClearAllLayers()
 {
 	for(std::vector<CKhuDaNetLayer*>::reverse_iterator Iter = m_Layers.rbegin(); Iter != m_Layers.rend(); ++Iter)
 	{
-		delete [] *Iter;
+		delete *Iter;
 		*Iter = 0;
 	}
 
@@ -115,7 +128,12 @@ void CKhuDaNet::AddLayer(CKhuDaNetLayerOption LayerOptionInput)
 void CKhuDaNet::InitWeight()
 {
 	for(auto &Layer : m_Layers)
-		Layer->InitWeight();
+		Layer->InitWeight(m_Generator);
+}
+
+void CKhuDaNet::SetOptimizer(CKhuDaNetOptimizerOption OptimizerOption)
+{
+	m_Optimizer.SetOption(OptimizerOption);
 }
 
 void CKhuDaNet::AllocDeltaWeight()
@@ -196,8 +214,162 @@ int CKhuDaNet::TrainBatch(double **Input, double **Output, int nBatchSize, doubl
 
 	*pLoss /= nBatchSize;
 
+	m_Optimizer.BeginStep();
 	for(auto &Layer : m_Layers)
-		Layer->UpdateWeight(nBatchSize);
+		Layer->UpdateWeight(nBatchSize, &m_Optimizer);
+
+	return nTP;
+}
+
+void CKhuDaNet::CloneKhuDaNet(CKhuDaNet *pSource)
+{
+	ClearAllLayers();
+
+	for(auto &Layer : pSource->m_Layers)
+		AddLayer(Layer->m_LayerOption);
+
+	for(int s = 0 ; s < (int)m_Layers.size() ; ++s)
+	{
+		m_Layers[s]->CopyWeight(pSource->m_Layers[s]);
+
+		int nStateCnt = pSource->m_Layers[s]->m_nOptimizerStateCnt;
+		if(nStateCnt)
+		{
+			m_Layers[s]->m_OptimizerState = new double[nStateCnt];
+			memcpy(m_Layers[s]->m_OptimizerState, pSource->m_Layers[s]->m_OptimizerState, nStateCnt*sizeof(double));
+		}
+		m_Layers[s]->m_nOptimizerStateCnt = nStateCnt;
+	}
+
+	m_Optimizer = pSource->m_Optimizer;
+	m_Generator = pSource->m_Generator;
+}
+
+double CKhuDaNet::VerifyWinograd(double *Input)
+{
+	if(!IsNetwork()) return 0.;
+
+	Forward(Input);
+
+	double MaxError = 0;
+	for(auto &Layer : m_Layers)
+	{
+		double Error = Layer->VerifyWinograd();
+		if(Error > MaxError) MaxError = Error;
+	}
+
+	return MaxError;
+}
+
+int CKhuDaNet::Evaluate(double **Input, int *Label, int nCnt, CKhuDaNetEvaluation *pEvaluation, 
+	int nTopK, int nBatchSize, int nThreadCnt)
+{
+	if(!IsNetwork() || nCnt <= 0) return 0;
+
+	auto StartTime = std::chrono::steady_clock::now();
+
+	int nClassCnt = (m_nOutputSize > 1) ? m_nOutputSize : 2;
+	if(nTopK < 1) nTopK = 1;
+	if(nBatchSize < 1) nBatchSize = 1;
+
+	if(nThreadCnt <= 0) nThreadCnt = (int)std::thread::hardware_concurrency();
+	if(nThreadCnt <= 0) nThreadCnt = 1;
+	if(nThreadCnt > (nCnt+nBatchSize-1)/nBatchSize) nThreadCnt = (nCnt+nBatchSize-1)/nBatchSize;
+
+	// Forward keeps its activations inside the layers, so every worker needs its own replica
+	std::vector<CKhuDaNet *> Replica(nThreadCnt, this);
+	for(int t = 1 ; t < nThreadCnt ; ++t)
+	{
+		Replica[t] = new CKhuDaNet;
+		Replica[t]->CloneKhuDaNet(this);
+	}
+
+	std::vector<std::vector<int>> Confusion(nThreadCnt, std::vector<int>(nClassCnt*nClassCnt, 0));
+	std::vector<int> TopKHit(nThreadCnt, 0);
+	std::atomic<int> nNextBatch(0);
+
+	auto Worker = [&](int t) {
+		CKhuDaNet *pNetwork = Replica[t];
+		double *Score = pNetwork->m_Layers[pNetwork->m_Layers.size()-1]->m_Node;
+
+		while(true)
+		{
+			int nStart = nNextBatch.fetch_add(nBatchSize);
+			if(nStart >= nCnt) break;
+			int nEnd = (nStart+nBatchSize < nCnt) ? nStart+nBatchSize : nCnt;
+
+			for(int n = nStart ; n < nEnd ; ++n)
+			{
+				int nPredicted = pNetwork->Forward(Input[n]);
+				if(m_nOutputSize == 1) nPredicted = (Score[0] > 0.5) ? 1 : 0;
+
+				int nRank = 0;
+				if(m_nOutputSize > 1)
+				{
+					for(int k = 0 ; k < m_nOutputSize ; ++k)
+						if(Score[k] > Score[Label[n]]) nRank++;
+				}
+				else if(nPredicted != Label[n])
+					nRank = 1;
+
+				if(nRank < nTopK) TopKHit[t]++;
+				Confusion[t][Label[n]*nClassCnt+nPredicted]++;
+			}
+		}
+	};
+
+	std::vector<std::thread> Threads;
+	for(int t = 1 ; t < nThreadCnt ; ++t)
+		Threads.push_back(std::thread(Worker, t));
+	Worker(0);
+	for(auto &Thread : Threads) Thread.join();
+
+	for(int t = 1 ; t < nThreadCnt ; ++t)
+		delete Replica[t];
+
+	pEvaluation->nClassCnt = nClassCnt;
+	pEvaluation->nSampleCnt = nCnt;
+	pEvaluation->nTopK = nTopK;
+	pEvaluation->ConfusionMatrix.assign(nClassCnt*nClassCnt, 0);
+	pEvaluation->Precision.assign(nClassCnt, 0.);
+	pEvaluation->Recall.assign(nClassCnt, 0.);
+	pEvaluation->F1.assign(nClassCnt, 0.);
+
+	int nTopKHit = 0;
+	for(int t = 0 ; t < nThreadCnt ; ++t)
+	{
+		for(int k = 0 ; k < nClassCnt*nClassCnt ; ++k)
+			pEvaluation->ConfusionMatrix[k] += Confusion[t][k];
+		nTopKHit += TopKHit[t];
+	}
+
+	int nTP = 0;
+	pEvaluation->MacroF1 = 0;
+	for(int c = 0 ; c < nClassCnt ; ++c)
+	{
+		int nActual = 0, nPredicted = 0;
+		for(int k = 0 ; k < nClassCnt ; ++k)
+		{
+			nActual += pEvaluation->ConfusionMatrix[c*nClassCnt+k];
+			nPredicted += pEvaluation->ConfusionMatrix[k*nClassCnt+c];
+		}
+
+		int nDiagonal = pEvaluation->ConfusionMatrix[c*nClassCnt+c];
+		nTP += nDiagonal;
+
+		pEvaluation->Precision[c] = nPredicted ? (double)nDiagonal/nPredicted : 0.;
+		pEvaluation->Recall[c] = nActual ? (double)nDiagonal/nActual : 0.;
+		if(pEvaluation->Precision[c]+pEvaluation->Recall[c] > 0)
+			pEvaluation->F1[c] = 2*pEvaluation->Precision[c]*pEvaluation->Recall[c]/(pEvaluation->Precision[c]+pEvaluation->Recall[c]);
+
+		pEvaluation->MacroF1 += pEvaluation->F1[c]/nClassCnt;
+	}
+
+	pEvaluation->Accuracy = (double)nTP/nCnt;
+	pEvaluation->TopKAccuracy = (double)nTopKHit/nCnt;
+
+	pEvaluation->ElapsedTime = std::chrono::duration<double>(std::chrono::steady_clock::now()-StartTime).count();
+	pEvaluation->ImagesPerSecond = pEvaluation->ElapsedTime > 0 ? nCnt/pEvaluation->ElapsedTime : 0.;
 
 	return nTP;
 }
@@ -208,6 +380,13 @@ void CKhuDaNet::SaveKhuDaNet(char *Filename)
 
 	if(!fp) return;
 
+	SaveKhuDaNet(fp);
+
+	fclose(fp);
+}
+
+void CKhuDaNet::SaveKhuDaNet(FILE *fp)
+{
 	fwrite("KhuDaNet", sizeof(char), 8, fp);
 
 	int Cnt = m_Layers.size();
@@ -248,8 +427,6 @@ void CKhuDaNet::SaveKhuDaNet(char *Filename)
 
 		pBackwardLayer = Layer;
 	}
-
-	fclose(fp);
 }
 
 void CKhuDaNet::LoadKhuDaNet(char *Filename)
@@ -259,13 +436,22 @@ void CKhuDaNet::LoadKhuDaNet(char *Filename)
 	FILE *fp = fopen(Filename, "rb");
 
 	if(!fp) return;
-	
+
+	LoadKhuDaNet(fp);
+
+	fclose(fp);
+}
+
+bool CKhuDaNet::LoadKhuDaNet(FILE *fp)
+{
+	ClearAllLayers();
+
 	char Buf[10];
 	int nLayerCnt;
 
-	fread(Buf, sizeof(char), 8, fp);
+	if(fread(Buf, sizeof(char), 8, fp) != 8 || memcmp(Buf, "KhuDaNet", 8) != 0) return false;
 
-	fread(&nLayerCnt, sizeof(int), 1, fp);
+	if(fread(&nLayerCnt, sizeof(int), 1, fp) != 1 || nLayerCnt < 0) return false;
 
 	for(int s = 0 ; s < nLayerCnt ; ++s)
 	{
@@ -320,7 +506,132 @@ void CKhuDaNet::LoadKhuDaNet(char *Filename)
 		pBackwardLayer = m_Layers[s];
 	}
 
+	return !feof(fp) && !ferror(fp);
+}
+
+bool CKhuDaNet::SaveCheckpoint(char *Filename, CKhuDaNetTrainState TrainState, bool bAsync)
+{
+	// an asynchronous write reports its result here, with the next save
+	bool bPrevOk = WaitCheckpoint();
+
+	if(!m_pCheckpointNetwork) m_pCheckpointNetwork = new CKhuDaNet;
+	m_pCheckpointNetwork->CloneKhuDaNet(this);
+
+	std::string Path(Filename);
+	CKhuDaNet *pSnapshot = m_pCheckpointNetwork;
+
+	auto Write = [pSnapshot, Path, TrainState]() -> bool {
+		std::string TempPath = Path + ".tmp";
+		FILE *fp = fopen(TempPath.c_str(), "wb");
+		if(!fp) return false;
+
+		fwrite("KhuDaCkp", sizeof(char), 8, fp);
+
+		pSnapshot->SaveKhuDaNet(fp);
+
+		fwrite(&(pSnapshot->m_Optimizer.m_OptimizerOption), sizeof(CKhuDaNetOptimizerOption), 1, fp);
+		fwrite(&(pSnapshot->m_Optimizer.m_nStep), sizeof(int), 1, fp);
+		for(auto &Layer : pSnapshot->m_Layers)
+		{
+			fwrite(&(Layer->m_nOptimizerStateCnt), sizeof(int), 1, fp);
+			if(Layer->m_nOptimizerStateCnt)
+				fwrite(Layer->m_OptimizerState, sizeof(double), Layer->m_nOptimizerStateCnt, fp);
+		}
+
+		std::stringstream GeneratorState;
+		GeneratorState << pSnapshot->m_Generator;
+		std::string Generator = GeneratorState.str();
+		int nLen = (int)Generator.size();
+		fwrite(&nLen, sizeof(int), 1, fp);
+		fwrite(Generator.c_str(), sizeof(char), nLen, fp);
+
+		fwrite(&TrainState, sizeof(CKhuDaNetTrainState), 1, fp);
+
+		bool bOk = !ferror(fp);
+		fclose(fp);
+
+		// keep the previous checkpoint until the new one is completely on disk
+		if(bOk)
+		{
+			remove(Path.c_str());
+			bOk = (rename(TempPath.c_str(), Path.c_str()) == 0);
+		}
+
+		return bOk;
+	};
+
+	if(!bAsync)
+		return Write() && bPrevOk;
+
+	m_CheckpointThread = std::thread([this, Write]() { m_bCheckpointOk = Write(); });
+
+	return bPrevOk;
+}
+
+bool CKhuDaNet::LoadCheckpoint(char *Filename, CKhuDaNetTrainState *pTrainState)
+{
+	WaitCheckpoint();
+
+	FILE *fp = fopen(Filename, "rb");
+	if(!fp) return false;
+
+	// read into a scratch network so a damaged file leaves this one untouched
+	CKhuDaNet Loaded;
+
+	char Buf[10];
+	if(fread(Buf, sizeof(char), 8, fp) != 8 || memcmp(Buf, "KhuDaCkp", 8) != 0 || !Loaded.LoadKhuDaNet(fp))
+	{
+		fclose(fp);
+		return false;
+	}
+
+	bool bOk = true;
+
+	bOk = bOk && fread(&(Loaded.m_Optimizer.m_OptimizerOption), sizeof(CKhuDaNetOptimizerOption), 1, fp) == 1;
+	bOk = bOk && fread(&(Loaded.m_Optimizer.m_nStep), sizeof(int), 1, fp) == 1;
+	for(auto &Layer : Loaded.m_Layers)
+	{
+		int nStateCnt = 0;
+		bOk = bOk && fread(&nStateCnt, sizeof(int), 1, fp) == 1 && nStateCnt >= 0;
+		if(!bOk) break;
+
+		if(Layer->m_OptimizerState) delete [] Layer->m_OptimizerState;
+		Layer->m_OptimizerState = nStateCnt ? new double[nStateCnt] : nullptr;
+		Layer->m_nOptimizerStateCnt = nStateCnt;
+		if(nStateCnt)
+			bOk = bOk && fread(Layer->m_OptimizerState, sizeof(double), nStateCnt, fp) == (size_t)nStateCnt;
+	}
+
+	int nLen = 0;
+	bOk = bOk && fread(&nLen, sizeof(int), 1, fp) == 1 && nLen > 0;
+	if(bOk)
+	{
+		std::string Generator(nLen, ' ');
+		bOk = fread(&Generator[0], sizeof(char), nLen, fp) == (size_t)nLen;
+
+		std::stringstream GeneratorState(Generator);
+		GeneratorState >> Loaded.m_Generator;
+	}
+
+	bOk = bOk && fread(pTrainState, sizeof(CKhuDaNetTrainState), 1, fp) == 1;
+
 	fclose(fp);
+
+	if(bOk)
+		CloneKhuDaNet(&Loaded);
+
+	return bOk;
+}
+
+bool CKhuDaNet::WaitCheckpoint()
+{
+	if(m_CheckpointThread.joinable())
+		m_CheckpointThread.join();
+
+	bool bOk = m_bCheckpointOk;
+	m_bCheckpointOk = true;
+
+	return bOk;
 }
 
 int CKhuDaNet::ArgMax(double *List, int nCnt)
@@ -372,6 +683,41 @@ void CKhuDaNet::free_dmatrix1d(double **Image, int nH, int nW)
 	delete [] Image;
 }
 
+double ****CKhuDaNet::dmatrix4d(int nCnt, int nDepth, int nH, int nW) 
+{
+	double ****Temp;
+
+	Temp = new double ***[nCnt];
+
+	double *Block = new double [nCnt*nDepth*nH*nW];
+	for(int i = 0 ; i < nCnt ; ++i)
+	{
+		Temp[i] = new double **[nDepth];
+		for(int j = 0 ; j < nDepth ; ++j)
+		{
+			Temp[i][j] = new double *[nH];
+			for(int y = 0 ; y < nH ; ++y)
+				Temp[i][j][y] = Block + ((i*nDepth+j)*nH+y)*nW;
+		}
+	}
+
+	return Temp;
+}
+
+void CKhuDaNet::free_dmatrix4d(double ****Image, int nCnt, int nDepth, int nH, int nW)
+{
+	delete [] Image[0][0][0];
+
+	for(int i = 0 ; i < nCnt ; ++i)
+	{
+		for(int j = 0 ; j < nDepth ; ++j)
+			delete [] Image[i][j];
+		delete [] Image[i];
+	}
+
+	delete [] Image;
+}
+
 double CKhuDaNet::Identify(double x)
 {
 	return x;
@@ -5,10 +5,32 @@
 
 #pragma once
 #include "KhuDaNetLayer.h"
+#include <cstdio>
 #include <vector>
+#include <random>
+#include <thread>
 
 #define MAX_INFORMATION_STRING_SIZE	1000
 
+struct CKhuDaNetTrainState
+{
+	int nEpochCnt;
+	int nBatchCnt;
+};
+
+struct CKhuDaNetEvaluation
+{
+	int nClassCnt;
+	int nSampleCnt;
+	int nTopK;
+
+	std::vector<int> ConfusionMatrix;		// [actual*nClassCnt + predicted]
+	std::vector<double> Precision, Recall, F1;
+
+	double Accuracy, TopKAccuracy, MacroF1;
+	double ElapsedTime, ImagesPerSecond;
+};
+
 class CKhuDaNet
 {
 public:
@@ -16,6 +38,12 @@ public:
 	virtual ~CKhuDaNet();
 
 	std::vector<CKhuDaNetLayer*> m_Layers;
+	CKhuDaNetOptimizer m_Optimizer;
+	std::default_random_engine m_Generator;
+
+	CKhuDaNet *m_pCheckpointNetwork;
+	std::thread m_CheckpointThread;
+	bool m_bCheckpointOk;
 
 	int m_nInputSize, m_nOutputSize;
 	char *m_Information;
@@ -27,16 +55,28 @@ public:
 	void AddLayer(CKhuDaNetLayerOption LayerOptionInput);
 	void AllocDeltaWeight();
 	void InitWeight();
+	void SetOptimizer(CKhuDaNetOptimizerOption OptimizerOption);
 	int Forward(double *Input, double *Probability = 0);
 	int TrainBatch(double **Input, double **Output, int nBatchSize, double *pLoss);
+	int Evaluate(double **Input, int *Label, int nCnt, CKhuDaNetEvaluation *pEvaluation, 
+		int nTopK = 5, int nBatchSize = 64, int nThreadCnt = 0);
+	void CloneKhuDaNet(CKhuDaNet *pSource);
+	double VerifyWinograd(double *Input);
 	void SaveKhuDaNet(char *Filename);
 	void LoadKhuDaNet(char *Filename);
+	void SaveKhuDaNet(FILE *fp);
+	bool LoadKhuDaNet(FILE *fp);
+	bool SaveCheckpoint(char *Filename, CKhuDaNetTrainState TrainState, bool bAsync = true);
+	bool LoadCheckpoint(char *Filename, CKhuDaNetTrainState *pTrainState);
+	bool WaitCheckpoint();
 
 	static int ArgMax(double *List, int nCnt);
 	static double **dmatrix(int nH, int nW);
 	static void free_dmatrix(double **Image, int nH, int nW);
 	static double **dmatrix1d(int nH, int nW);
 	static void free_dmatrix1d(double **Image, int nH, int nW);
+	static double ****dmatrix4d(int nCnt, int nDepth, int nH, int nW);
+	static void free_dmatrix4d(double ****Image, int nCnt, int nDepth, int nH, int nW);
 	static double Identify(double x);
 	static double DifferentialIdentify(double x);
 	static double BinaryStep(double x);
@@ -26,6 +26,64 @@
 #endif
 #endif  // _DEBUG
 
+static const double WinogradBT2[4*4] = {
+	1,  0, -1,  0,
+	0,  1,  1,  0,
+	0, -1,  1,  0,
+	0,  1,  0, -1 };
+static const double WinogradG2[4*3] = {
+	1,    0,   0,
+	0.5,  0.5, 0.5,
+	0.5, -0.5, 0.5,
+	0,    0,   1 };
+static const double WinogradAT2[2*4] = {
+	1, 1,  1,  0,
+	0, 1, -1, -1 };
+
+static const double WinogradBT4[6*6] = {
+	4,  0, -5,  0, 1, 0,
+	0, -4, -4,  1, 1, 0,
+	0,  4, -4, -1, 1, 0,
+	0, -2, -1,  2, 1, 0,
+	0,  2, -1, -2, 1, 0,
+	0,  4,  0, -5, 0, 1 };
+static const double WinogradG4[6*3] = {
+	1./4,     0,      0,
+	-1./6,  -1./6,  -1./6,
+	-1./6,   1./6,  -1./6,
+	1./24,   1./12,  1./6,
+	1./24,  -1./12,  1./6,
+	0,        0,      1 };
+static const double WinogradAT4[4*6] = {
+	1, 1,  1, 1,  1, 0,
+	0, 1, -1, 2, -2, 0,
+	0, 1,  1, 4,  4, 0,
+	0, 1, -1, 8, -8, 1 };
+
+// Out(nRow x nCol) = Left(nRow x nK) * In(nK x nK) * Left'
+static void WinogradSandwich(const double *Left, const double *In, double *Out, int nRow, int nK)
+{
+	double Temp[6*6];
+
+	for(int r = 0 ; r < nRow ; ++r)
+		for(int c = 0 ; c < nK ; ++c)
+		{
+			double Sum = 0;
+			for(int k = 0 ; k < nK ; ++k)
+				Sum += Left[r*nK+k]*In[k*nK+c];
+			Temp[r*nK+c] = Sum;
+		}
+
+	for(int r = 0 ; r < nRow ; ++r)
+		for(int c = 0 ; c < nRow ; ++c)
+		{
+			double Sum = 0;
+			for(int k = 0 ; k < nK ; ++k)
+				Sum += Temp[r*nK+k]*Left[c*nK+k];
+			Out[r*nRow+c] = Sum;
+		}
+}
+
 CKhuDaNetLayerOption::CKhuDaNetLayerOption(unsigned int nLayerTypeIntput, int nImageCntInput, int nNodeCntIput, 
 	int nWidthInput, int nHeightInput, int nKernelSizeInput, 
 	int nActicationFnInput, double dLearningRateInput) 
@@ -43,6 +101,19 @@ CKhuDaNetLayerOption::CKhuDaNetLayerOption(unsigned int nLayerTypeIntput, int nI
 
 CKhuDaNetLayer::CKhuDaNetLayer(CKhuDaNetLayerOption m_LayerOptionInput, CKhuDaNetLayer *pBackwardLayerInput) : m_LayerOption(m_LayerOptionInput), m_bTrained(false)
 {
+	m_OptimizerState = nullptr;
+	m_nOptimizerStateCnt = 0;
+
+	m_nWinogradTile = 0;
+	m_bWinogradWeight = false;
+	if((m_LayerOption.nLayerType & KDN_LT_CON) && !(m_LayerOption.nLayerType & KDN_LT_INPUT) && m_LayerOption.nKernelSize == 3)
+	{
+		if(m_LayerOption.nW >= 8 && m_LayerOption.nH >= 8)
+			m_nWinogradTile = 4;
+		else if(m_LayerOption.nW >= 2 && m_LayerOption.nH >= 2)
+			m_nWinogradTile = 2;
+	}
+
 	if(m_LayerOption.nActicationFn == KDN_AF_IDENTIFY)
 	{
 		Activation = CKhuDaNet::Identify;
@@ -114,13 +185,8 @@ CKhuDaNetLayer::CKhuDaNetLayer(CKhuDaNetLayerOption m_LayerOptionInput, CKhuDaNe
 		for(int i = 0 ; i < m_LayerOption.nImageCnt ; ++i)
 			m_NodeCnnImage[i] = CKhuDaNet::dmatrix1d(m_LayerOption.nH, m_LayerOption.nW);
 
-		m_CnnWeight = new double ***[m_LayerOption.nImageCnt];
-		for(int i = 0 ; i < m_LayerOption.nImageCnt ; ++i)
-		{
-			m_CnnWeight[i] = new double **[m_pBackwardLayer->m_LayerOption.nImageCnt];
-			for(int j = 0 ; j < m_pBackwardLayer->m_LayerOption.nImageCnt ; ++j)
-				m_CnnWeight[i][j] = CKhuDaNet::dmatrix1d(m_LayerOption.nKernelSize, m_LayerOption.nKernelSize);
-		}
+		m_CnnWeight = CKhuDaNet::dmatrix4d(m_LayerOption.nImageCnt, m_pBackwardLayer->m_LayerOption.nImageCnt, 
+			m_LayerOption.nKernelSize, m_LayerOption.nKernelSize);
 
 		m_Bias = new double[m_LayerOption.nImageCnt];
 	}
@@ -135,6 +201,8 @@ CKhuDaNetLayer::CKhuDaNetLayer(CKhuDaNetLayerOption m_LayerOptionInput, CKhuDaNe
 
 CKhuDaNetLayer::~CKhuDaNetLayer()
 {
+	if(m_OptimizerState) delete [] m_OptimizerState;
+
 	if((m_LayerOption.nLayerType & KDN_LT_OUTPUT) && (m_LayerOption.nLayerType & KDN_LT_FC))
 	{
 		delete [] m_Loss;
@@ -175,13 +243,8 @@ CKhuDaNetLayer::~CKhuDaNetLayer()
 			CKhuDaNet::free_dmatrix1d(m_NodeCnnImage[i], m_LayerOption.nH, m_LayerOption.nW);
 		delete [] m_NodeCnnImage;
 
-		for(int i = 0 ; i < m_LayerOption.nImageCnt ; ++i)
-		{
-			for(int j = 0 ; j < m_pBackwardLayer->m_LayerOption.nImageCnt ; ++j)
-				CKhuDaNet::free_dmatrix1d(m_CnnWeight[i][j], m_LayerOption.nKernelSize, m_LayerOption.nKernelSize);
-			delete [] m_CnnWeight[i];
-		}
-		delete [] m_CnnWeight;
+		CKhuDaNet::free_dmatrix4d(m_CnnWeight, m_LayerOption.nImageCnt, m_pBackwardLayer->m_LayerOption.nImageCnt, 
+			m_LayerOption.nKernelSize, m_LayerOption.nKernelSize);
 
 		delete [] m_Bias;
 
@@ -191,13 +254,8 @@ CKhuDaNetLayer::~CKhuDaNetLayer()
 				CKhuDaNet::free_dmatrix1d(m_DeltaCnnImage[i], m_LayerOption.nH, m_LayerOption.nW);
 			delete [] m_DeltaCnnImage;
 
-			for(int i = 0 ; i < m_LayerOption.nImageCnt ; ++i)
-			{
-				for(int j = 0 ; j < m_pBackwardLayer->m_LayerOption.nImageCnt ; ++j)
-					CKhuDaNet::free_dmatrix1d(m_DeltaCnnWeight[i][j], m_LayerOption.nKernelSize, m_LayerOption.nKernelSize);
-				delete [] m_DeltaCnnWeight[i];
-			}
-			delete [] m_DeltaCnnWeight;
+			CKhuDaNet::free_dmatrix4d(m_DeltaCnnWeight, m_LayerOption.nImageCnt, m_pBackwardLayer->m_LayerOption.nImageCnt, 
+				m_LayerOption.nKernelSize, m_LayerOption.nKernelSize);
 
 			delete [] m_DeltaBias;
 		}
@@ -249,13 +307,8 @@ void CKhuDaNetLayer::AllocDeltaWeight()
 			for(int i = 0 ; i < m_LayerOption.nImageCnt ; ++i)
 				m_DeltaCnnImage[i] = CKhuDaNet::dmatrix1d(m_LayerOption.nH, m_LayerOption.nW);
 
-			m_DeltaCnnWeight = new double ***[m_LayerOption.nImageCnt];
-			for(int i = 0 ; i < m_LayerOption.nImageCnt ; ++i)
-			{
-				m_DeltaCnnWeight[i] = new double **[m_pBackwardLayer->m_LayerOption.nImageCnt];
-				for(int j = 0 ; j < m_pBackwardLayer->m_LayerOption.nImageCnt ; ++j)
-					m_DeltaCnnWeight[i][j] = CKhuDaNet::dmatrix1d(m_LayerOption.nKernelSize, m_LayerOption.nKernelSize);
-			}
+			m_DeltaCnnWeight = CKhuDaNet::dmatrix4d(m_LayerOption.nImageCnt, m_pBackwardLayer->m_LayerOption.nImageCnt, 
+				m_LayerOption.nKernelSize, m_LayerOption.nKernelSize);
 
 			m_DeltaBias = new double[m_LayerOption.nImageCnt];
 		}
@@ -273,10 +326,9 @@ void CKhuDaNetLayer::AllocDeltaWeight()
 	m_bTrained = true;
 }
 
-void CKhuDaNetLayer::InitWeight()
+void CKhuDaNetLayer::InitWeight(std::default_random_engine &Generator)
 {
-	static unsigned int seed = (unsigned int)std::chrono::system_clock::now().time_since_epoch().count();
-	static std::default_random_engine generator(seed);
+	m_bWinogradWeight = false;
 
 	if(m_LayerOption.nLayerType & KDN_LT_INPUT)
 		return;
@@ -298,7 +350,7 @@ void CKhuDaNetLayer::InitWeight()
 			{
 				for(int j = 0 ; j < m_pBackwardLayer->m_LayerOption.nNodeCnt ; ++j)
 				{
-					m_Weight[i][j] = distribution(generator);
+					m_Weight[i][j] = distribution(Generator);
 				}
 			}
 			else if((m_pBackwardLayer->m_LayerOption.nLayerType & KDN_LT_CON) || (m_pBackwardLayer->m_LayerOption.nLayerType & KDN_LT_POOL))
@@ -308,7 +360,7 @@ void CKhuDaNetLayer::InitWeight()
 					for(int y = 0 ; y < m_pBackwardLayer->m_LayerOption.nH ; ++y)
 						for(int x = 0 ; x < m_pBackwardLayer->m_LayerOption.nW ; ++x)
 						{
-							m_Weight[i][nSequenceIndex] = distribution(generator);
+							m_Weight[i][nSequenceIndex] = distribution(Generator);
 							
 							++nSequenceIndex;
 						}
@@ -328,7 +380,7 @@ void CKhuDaNetLayer::InitWeight()
 				for(int y = 0 ; y < m_LayerOption.nKernelSize ; ++y)
 					for(int x = 0 ; x < m_LayerOption.nKernelSize ; ++x)
 					{
-						m_CnnWeight[i][j][y][x] = distribution(generator);
+						m_CnnWeight[i][j][y][x] = distribution(Generator);
 					}
 
 			m_Bias[i] = 0;
@@ -368,6 +420,11 @@ int CKhuDaNetLayer::ComputeLayer(double *Probability)
 			m_Node[i] = Activation(Sum + m_Bias[i]);
 		}
 	}
+	else if((m_LayerOption.nLayerType & KDN_LT_CON) && m_nWinogradTile &&
+		((m_pBackwardLayer->m_LayerOption.nLayerType & KDN_LT_CON) || (m_pBackwardLayer->m_LayerOption.nLayerType & KDN_LT_POOL)))
+	{
+		ComputeWinogradLayer();
+	}
 	else if((m_LayerOption.nLayerType & KDN_LT_CON) && 
 		((m_pBackwardLayer->m_LayerOption.nLayerType & KDN_LT_CON) || (m_pBackwardLayer->m_LayerOption.nLayerType & KDN_LT_POOL)))
 	{
@@ -427,6 +484,112 @@ int CKhuDaNetLayer::ComputeLayer(double *Probability)
 	return nMaxNode;
 }
 
+void CKhuDaNetLayer::TransformWinogradWeight()
+{
+	int nAlpha = m_nWinogradTile+2;
+	int nInputCnt = m_pBackwardLayer->m_LayerOption.nImageCnt;
+	const double *G = (m_nWinogradTile == 4) ? WinogradG4 : WinogradG2;
+
+	m_WinogradWeight.resize(m_LayerOption.nImageCnt*nInputCnt*nAlpha*nAlpha);
+
+	for(int i = 0 ; i < m_LayerOption.nImageCnt ; ++i)
+		for(int j = 0 ; j < nInputCnt ; ++j)
+		{
+			double *U = &m_WinogradWeight[(i*nInputCnt+j)*nAlpha*nAlpha];
+			double Temp[6*3];
+
+			for(int r = 0 ; r < nAlpha ; ++r)
+				for(int c = 0 ; c < 3 ; ++c)
+					Temp[r*3+c] = G[r*3]*m_CnnWeight[i][j][0][c] + G[r*3+1]*m_CnnWeight[i][j][1][c] + G[r*3+2]*m_CnnWeight[i][j][2][c];
+
+			for(int r = 0 ; r < nAlpha ; ++r)
+				for(int c = 0 ; c < nAlpha ; ++c)
+					U[r*nAlpha+c] = Temp[r*3]*G[c*3] + Temp[r*3+1]*G[c*3+1] + Temp[r*3+2]*G[c*3+2];
+		}
+
+	m_bWinogradWeight = true;
+}
+
+void CKhuDaNetLayer::ComputeWinogradLayer()
+{
+	if(!m_bWinogradWeight)
+		TransformWinogradWeight();
+
+	int nTile = m_nWinogradTile;
+	int nAlpha = nTile+2;
+	int nAlpha2 = nAlpha*nAlpha;
+	int nInputCnt = m_pBackwardLayer->m_LayerOption.nImageCnt;
+	int nInputW = m_pBackwardLayer->m_LayerOption.nW, nInputH = m_pBackwardLayer->m_LayerOption.nH;
+	int nTileX = (m_LayerOption.nW+nTile-1)/nTile, nTileY = (m_LayerOption.nH+nTile-1)/nTile;
+	int nTileCnt = nTileX*nTileY;
+	const double *BT = (nTile == 4) ? WinogradBT4 : WinogradBT2;
+	const double *AT = (nTile == 4) ? WinogradAT4 : WinogradAT2;
+
+	m_WinogradInput.resize(nInputCnt*nTileCnt*nAlpha2);
+
+	for(int j = 0 ; j < nInputCnt ; ++j)
+		for(int ty = 0 ; ty < nTileY ; ++ty)
+			for(int tx = 0 ; tx < nTileX ; ++tx)
+			{
+				double Patch[6*6];
+				for(int r = 0 ; r < nAlpha ; ++r)
+					for(int c = 0 ; c < nAlpha ; ++c)
+					{
+						int y = ty*nTile+r, x = tx*nTile+c;
+						Patch[r*nAlpha+c] = (y < nInputH && x < nInputW) ? m_pBackwardLayer->m_NodeCnnImage[j][y][x] : 0.;
+					}
+
+				WinogradSandwich(BT, Patch, &m_WinogradInput[(j*nTileCnt+ty*nTileX+tx)*nAlpha2], nAlpha, nAlpha);
+			}
+
+	for(int i = 0 ; i < m_LayerOption.nImageCnt ; ++i)
+		for(int t = 0 ; t < nTileCnt ; ++t)
+		{
+			double M[6*6] = {0, };
+			for(int j = 0 ; j < nInputCnt ; ++j)
+			{
+				const double *U = &m_WinogradWeight[(i*nInputCnt+j)*nAlpha2];
+				const double *V = &m_WinogradInput[(j*nTileCnt+t)*nAlpha2];
+				for(int k = 0 ; k < nAlpha2 ; ++k)
+					M[k] += U[k]*V[k];
+			}
+
+			double Y[4*4];
+			WinogradSandwich(AT, M, Y, nTile, nAlpha);
+
+			int y0 = (t/nTileX)*nTile, x0 = (t%nTileX)*nTile;
+			for(int r = 0 ; r < nTile && y0+r < m_LayerOption.nH ; ++r)
+				for(int c = 0 ; c < nTile && x0+c < m_LayerOption.nW ; ++c)
+					m_NodeCnnImage[i][y0+r][x0+c] = Activation(Y[r*nTile+c] + m_Bias[i]);
+		}
+}
+
+// Largest difference between the Winograd output and the direct convolution for the current input
+double CKhuDaNetLayer::VerifyWinograd()
+{
+	if(!m_nWinogradTile) return 0.;
+
+	ComputeWinogradLayer();
+
+	double MaxError = 0;
+	for(int i = 0 ; i < m_LayerOption.nImageCnt ; ++i)
+		for(int y = 0 ; y < m_LayerOption.nH ; ++y)
+			for(int x = 0 ; x < m_LayerOption.nW ; ++x)
+			{
+				double Sum = 0;
+				for(int j = 0 ; j < m_pBackwardLayer->m_LayerOption.nImageCnt ; ++j)
+					for(int dy = 0 ; dy < m_LayerOption.nKernelSize ; ++dy)
+						for(int dx = 0 ; dx < m_LayerOption.nKernelSize ; ++dx)
+							Sum += 
+								m_pBackwardLayer->m_NodeCnnImage[j][y+dy][x+dx]*m_CnnWeight[i][j][dy][dx];
+
+				double Error = fabs(Activation(Sum + m_Bias[i]) - m_NodeCnnImage[i][y][x]);
+				if(Error > MaxError) MaxError = Error;
+			}
+
+	return MaxError;
+}
+
 void CKhuDaNetLayer::ComputeDelta(double *Output)
 {
 	if(m_LayerOption.nLayerType & KDN_LT_INPUT)
@@ -644,50 +807,98 @@ void CKhuDaNetLayer::ComputeDeltaWeight(bool bReset)
 	}
 }
 
-void CKhuDaNetLayer::UpdateWeight(int nBatchSize)
+int CKhuDaNetLayer::GetWeightCnt()
 {
 	if(m_LayerOption.nLayerType & KDN_LT_INPUT)
+		return 0;
+
+	if(m_LayerOption.nLayerType & KDN_LT_FC)
+	{
+		if((m_pBackwardLayer->m_LayerOption.nLayerType & KDN_LT_CON) || (m_pBackwardLayer->m_LayerOption.nLayerType & KDN_LT_POOL))
+			return m_LayerOption.nNodeCnt*m_pBackwardLayer->m_LayerOption.nImageCnt*m_pBackwardLayer->m_LayerOption.nW*m_pBackwardLayer->m_LayerOption.nH;
+
+		return m_LayerOption.nNodeCnt*m_pBackwardLayer->m_LayerOption.nNodeCnt;
+	}
+	else if(m_LayerOption.nLayerType & KDN_LT_CON)
+		return m_LayerOption.nImageCnt*m_pBackwardLayer->m_LayerOption.nImageCnt*m_LayerOption.nKernelSize*m_LayerOption.nKernelSize;
+
+	return 0;
+}
+
+int CKhuDaNetLayer::GetBiasCnt()
+{
+	if(m_LayerOption.nLayerType & KDN_LT_INPUT)
+		return 0;
+
+	if(m_LayerOption.nLayerType & KDN_LT_FC)
+		return m_LayerOption.nNodeCnt;
+	else if(m_LayerOption.nLayerType & KDN_LT_CON)
+		return m_LayerOption.nImageCnt;
+
+	return 0;
+}
+
+void CKhuDaNetLayer::UpdateWeight(int nBatchSize, CKhuDaNetOptimizer *pOptimizer)
+{
+	int nWeightCnt = GetWeightCnt();
+	int nBiasCnt = GetBiasCnt();
+
+	if(nWeightCnt == 0)
 		return;
 
+	double *Weight, *DeltaWeight;
 	if(m_LayerOption.nLayerType & KDN_LT_FC)
 	{
-		if(m_pBackwardLayer->m_LayerOption.nLayerType & KDN_LT_FC)
-		{
-			for(int i = 0 ; i < m_LayerOption.nNodeCnt ; ++i)
-			{
-				for(int j = 0 ; j < m_pBackwardLayer->m_LayerOption.nNodeCnt ; ++j )
-					m_Weight[i][j] += m_LayerOption.dLearningRate * m_DeltaWeight[i][j]/nBatchSize;
+		Weight = m_Weight[0];
+		DeltaWeight = m_DeltaWeight[0];
+	}
+	else
+	{
+		Weight = m_CnnWeight[0][0][0];
+		DeltaWeight = m_DeltaCnnWeight[0][0][0];
+	}
 
-				m_Bias[i] += m_LayerOption.dLearningRate * m_DeltaBias[i]/nBatchSize;
-			}
-		}
-		else if((m_pBackwardLayer->m_LayerOption.nLayerType & KDN_LT_CON) || (m_pBackwardLayer->m_LayerOption.nLayerType & KDN_LT_POOL))
-		{
-			for(int i = 0 ; i < m_LayerOption.nNodeCnt ; ++i)
-			{
-				for(int j = 0 ; j < m_pBackwardLayer->m_LayerOption.nImageCnt*m_pBackwardLayer->m_LayerOption.nW*m_pBackwardLayer->m_LayerOption.nH ; ++j )
-					m_Weight[i][j] += m_LayerOption.dLearningRate * m_DeltaWeight[i][j]/nBatchSize;
+	int nStateCnt = pOptimizer->GetStateCnt()*(nWeightCnt+nBiasCnt);
+	if(nStateCnt != m_nOptimizerStateCnt)
+	{
+		if(m_OptimizerState) delete [] m_OptimizerState;
+		m_OptimizerState = nStateCnt ? new double[nStateCnt] : nullptr;
+		if(m_OptimizerState) memset(m_OptimizerState, 0, nStateCnt*sizeof(double));
+		m_nOptimizerStateCnt = nStateCnt;
+	}
 
-				m_Bias[i] += m_LayerOption.dLearningRate * m_DeltaBias[i]/nBatchSize;
-			}
-		}
+	pOptimizer->Update(Weight, DeltaWeight, m_OptimizerState, nWeightCnt, 
+		nBatchSize, m_LayerOption.dLearningRate, true);
+	m_bWinogradWeight = false;
+
+	pOptimizer->Update(m_Bias, m_DeltaBias, m_OptimizerState ? m_OptimizerState+pOptimizer->GetStateCnt()*nWeightCnt : nullptr, nBiasCnt, 
+		nBatchSize, m_LayerOption.dLearningRate, false);
+}
+
+void CKhuDaNetLayer::CopyWeight(CKhuDaNetLayer *pSource)
+{
+	if(m_LayerOption.nLayerType & KDN_LT_INPUT)
+		return;
+
+	if(m_LayerOption.nLayerType & KDN_LT_FC)
+	{
+		int nBackwardCnt = m_pBackwardLayer->m_LayerOption.nNodeCnt;
+		if((m_pBackwardLayer->m_LayerOption.nLayerType & KDN_LT_CON) || (m_pBackwardLayer->m_LayerOption.nLayerType & KDN_LT_POOL))
+			nBackwardCnt = m_pBackwardLayer->m_LayerOption.nImageCnt*m_pBackwardLayer->m_LayerOption.nW*m_pBackwardLayer->m_LayerOption.nH;
+
+		memcpy(m_Weight[0], pSource->m_Weight[0], m_LayerOption.nNodeCnt*nBackwardCnt*sizeof(double));
+		memcpy(m_Bias, pSource->m_Bias, m_LayerOption.nNodeCnt*sizeof(double));
 	}
 	else if(m_LayerOption.nLayerType & KDN_LT_CON)
 	{
 		for(int i = 0 ; i < m_LayerOption.nImageCnt ; ++i)
-		{
 			for(int j = 0 ; j < m_pBackwardLayer->m_LayerOption.nImageCnt ; ++j)
-			{
-				for(int dy = 0 ; dy < m_LayerOption.nKernelSize ; ++dy)
-					for(int dx = 0 ; dx < m_LayerOption.nKernelSize ; ++dx)
-					{
-						m_CnnWeight[i][j][dy][dx] += m_LayerOption.dLearningRate * m_DeltaCnnWeight[i][j][dy][dx]/nBatchSize;
-					}
-			}
+				memcpy(m_CnnWeight[i][j][0], pSource->m_CnnWeight[i][j][0], m_LayerOption.nKernelSize*m_LayerOption.nKernelSize*sizeof(double));
 
-			m_Bias[i] += m_LayerOption.dLearningRate * m_DeltaBias[i]/nBatchSize;
-		}
+		memcpy(m_Bias, pSource->m_Bias, m_LayerOption.nImageCnt*sizeof(double));
 	}
+
+	m_bWinogradWeight = false;
 }
 
 double CKhuDaNetLayer::GetLoss()
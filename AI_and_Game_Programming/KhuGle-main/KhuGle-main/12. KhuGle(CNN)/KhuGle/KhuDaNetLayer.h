@@ -5,6 +5,10 @@
 
 #pragma once
 
+#include "KhuDaNetOptimizer.h"
+#include <random>
+#include <vector>
+
 #define KDN_LT_FC			0x0001
 #define KDN_LT_CON			0x0002
 #define KDN_LT_POOL			0x0004
@@ -63,6 +67,14 @@ public:
 	
 	double *m_DeltaBias;
 
+	double *m_OptimizerState;
+	int m_nOptimizerStateCnt;
+
+	int m_nWinogradTile;					// 0: direct, 2: F(2x2,3x3), 4: F(4x4,3x3)
+	bool m_bWinogradWeight;
+	std::vector<double> m_WinogradWeight;	// G*g*G' per (output, input) image pair
+	std::vector<double> m_WinogradInput;	// B'*d*B per (input image, tile)
+
 	double (*Activation)(double);
 	double (*DifferentialActivation)(double);
 
@@ -70,11 +82,17 @@ public:
 	virtual ~CKhuDaNetLayer();
 
 	void AllocDeltaWeight();
-	void InitWeight();
+	void InitWeight(std::default_random_engine &Generator);
 	int ComputeLayer(double *Probability = 0);
+	void ComputeWinogradLayer();
+	void TransformWinogradWeight();
+	double VerifyWinograd();
 	void ComputeDelta(double *Output);
 	void ComputeDeltaWeight(bool bReset);
-	void UpdateWeight(int nBatchSize);
+	void UpdateWeight(int nBatchSize, CKhuDaNetOptimizer *pOptimizer);
+	int GetWeightCnt();
+	int GetBiasCnt();
+	void CopyWeight(CKhuDaNetLayer *pSource);
 	double GetLoss();
 };
 
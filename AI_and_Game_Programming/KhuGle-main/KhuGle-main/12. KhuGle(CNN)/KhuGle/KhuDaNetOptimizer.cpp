@@ -0,0 +1,136 @@
+//
+//	Dept. Software Convergence, Kyung Hee University
+//	Prof. Daeho Lee, nize@khu.ac.kr
+//
+
+#include "KhuDaNetOptimizer.h"
+#include <cmath>
+
+#pragma warning(disable:4996)
+
+#define _CRTDBG_MAP_ALLOC
+#include <cstdlib>
+#include <crtdbg.h>
+
+#ifdef _DEBUG
+#ifndef DBG_NEW
+#define DBG_NEW new ( _NORMAL_BLOCK , __FILE__ , __LINE__ )
+#define new DBG_NEW
+#endif
+#endif  // _DEBUG
+
+CKhuDaNetOptimizerOption::CKhuDaNetOptimizerOption(int nOptimizerInput, double dWeightDecayInput,
+	double dMomentumInput, double dBeta1Input, double dBeta2Input, double dEpsilonInput)
+{
+	nOptimizer = nOptimizerInput;
+	dWeightDecay = dWeightDecayInput;
+	dMomentum = dMomentumInput;
+	dBeta1 = dBeta1Input;
+	dBeta2 = dBeta2Input;
+	dEpsilon = dEpsilonInput;
+
+	nSchedule = KDN_LR_CONSTANT;
+	nWarmupStep = 0;
+	nStepSize = 1;
+	dGamma = 1.;
+}
+
+CKhuDaNetOptimizer::CKhuDaNetOptimizer()
+{
+	m_nStep = 0;
+}
+
+void CKhuDaNetOptimizer::SetOption(CKhuDaNetOptimizerOption OptimizerOptionInput)
+{
+	m_OptimizerOption = OptimizerOptionInput;
+	m_nStep = 0;
+}
+
+void CKhuDaNetOptimizer::SetSchedule(int nSchedule, int nStepSize, double dGamma, int nWarmupStep)
+{
+	m_OptimizerOption.nSchedule = nSchedule;
+	m_OptimizerOption.nStepSize = (nStepSize > 0) ? nStepSize : 1;
+	m_OptimizerOption.dGamma = dGamma;
+	m_OptimizerOption.nWarmupStep = nWarmupStep;
+}
+
+void CKhuDaNetOptimizer::BeginStep()
+{
+	m_nStep++;
+}
+
+int CKhuDaNetOptimizer::GetStateCnt()
+{
+	if(m_OptimizerOption.nOptimizer == KDN_OPT_MOMENTUM) return 1;
+	if(m_OptimizerOption.nOptimizer == KDN_OPT_ADAM || m_OptimizerOption.nOptimizer == KDN_OPT_ADAMW) return 2;
+
+	return 0;
+}
+
+double CKhuDaNetOptimizer::GetLearningRateScale()
+{
+	double Scale = 1.;
+
+	if(m_nStep <= m_OptimizerOption.nWarmupStep)
+		return (double)m_nStep/(m_OptimizerOption.nWarmupStep+1);
+
+	int nStep = m_nStep - m_OptimizerOption.nWarmupStep;
+
+	if(m_OptimizerOption.nSchedule == KDN_LR_STEP)
+		Scale = pow(m_OptimizerOption.dGamma, nStep/m_OptimizerOption.nStepSize);
+	else if(m_OptimizerOption.nSchedule == KDN_LR_COSINE)
+	{
+		double Progress = (double)nStep/m_OptimizerOption.nStepSize;
+		if(Progress > 1.) Progress = 1.;
+		Scale = m_OptimizerOption.dGamma + (1.-m_OptimizerOption.dGamma)*0.5*(1.+cos(3.14159265358979*Progress));
+	}
+
+	return Scale;
+}
+
+// Weight += Rate*Delta/nBatchSize is the plain SGD step (Delta is the accumulated negative gradient);
+// every optimizer does its whole update, decay included, in a single sweep over the layer's buffers.
+void CKhuDaNetOptimizer::Update(double *Weight, double *Delta, double *State, int nCnt,
+	int nBatchSize, double dLearningRate, bool bDecay)
+{
+	const double Rate = dLearningRate*GetLearningRateScale();
+	const double Decay = bDecay ? m_OptimizerOption.dWeightDecay : 0.;
+	const double InvBatch = 1./nBatchSize;
+
+	if(m_OptimizerOption.nOptimizer == KDN_OPT_MOMENTUM)
+	{
+		const double Momentum = m_OptimizerOption.dMomentum;
+		double *Velocity = State;
+
+		for(int i = 0 ; i < nCnt ; ++i)
+		{
+			Velocity[i] = Momentum*Velocity[i] + Delta[i]*InvBatch - Decay*Weight[i];
+			Weight[i] += Rate*Velocity[i];
+		}
+	}
+	else if(m_OptimizerOption.nOptimizer == KDN_OPT_ADAM || m_OptimizerOption.nOptimizer == KDN_OPT_ADAMW)
+	{
+		const double Beta1 = m_OptimizerOption.dBeta1;
+		const double Beta2 = m_OptimizerOption.dBeta2;
+		const double Epsilon = m_OptimizerOption.dEpsilon;
+		const double Correction1 = 1./(1.-pow(Beta1, m_nStep));
+		const double Correction2 = 1./(1.-pow(Beta2, m_nStep));
+		const double L2 = (m_OptimizerOption.nOptimizer == KDN_OPT_ADAM) ? Decay : 0.;
+		const double Decoupled = (m_OptimizerOption.nOptimizer == KDN_OPT_ADAMW) ? Rate*Decay : 0.;
+		double *Moment1 = State;
+		double *Moment2 = State + nCnt;
+
+		for(int i = 0 ; i < nCnt ; ++i)
+		{
+			double Gradient = L2*Weight[i] - Delta[i]*InvBatch;
+			Moment1[i] = Beta1*Moment1[i] + (1.-Beta1)*Gradient;
+			Moment2[i] = Beta2*Moment2[i] + (1.-Beta2)*Gradient*Gradient;
+			Weight[i] -= Rate*(Moment1[i]*Correction1)/(sqrt(Moment2[i]*Correction2)+Epsilon) + Decoupled*Weight[i];
+		}
+	}
+	else
+	{
+		for(int i = 0 ; i < nCnt ; ++i)
+			Weight[i] += Rate*(Delta[i]*InvBatch - Decay*Weight[i]);
+	}
+}
@@ -0,0 +1,46 @@
+//
+//	Dept. Software Convergence, Kyung Hee University
+//	Prof. Daeho Lee, nize@khu.ac.kr
+//
+
+#pragma once
+
+#define KDN_OPT_SGD				0
+#define KDN_OPT_MOMENTUM		1
+#define KDN_OPT_ADAM			2
+#define KDN_OPT_ADAMW			3
+
+#define KDN_LR_CONSTANT			0
+#define KDN_LR_STEP				1
+#define KDN_LR_COSINE			2
+
+struct CKhuDaNetOptimizerOption{
+	CKhuDaNetOptimizerOption(int nOptimizerInput = KDN_OPT_SGD, double dWeightDecayInput = 0.,
+		double dMomentumInput = 0.9, double dBeta1Input = 0.9, double dBeta2Input = 0.999, double dEpsilonInput = 1e-8);
+	int nOptimizer;
+	double dWeightDecay;
+	double dMomentum;
+	double dBeta1, dBeta2, dEpsilon;
+
+	int nSchedule;
+	int nWarmupStep;
+	int nStepSize;			// KDN_LR_STEP: decay period, KDN_LR_COSINE: total steps
+	double dGamma;			// KDN_LR_STEP: decay factor, KDN_LR_COSINE: final scale
+};
+
+class CKhuDaNetOptimizer
+{
+public:
+	CKhuDaNetOptimizerOption m_OptimizerOption;
+	int m_nStep;
+
+	CKhuDaNetOptimizer();
+
+	void SetOption(CKhuDaNetOptimizerOption OptimizerOptionInput);
+	void SetSchedule(int nSchedule, int nStepSize, double dGamma, int nWarmupStep = 0);
+	void BeginStep();
+	int GetStateCnt();
+	double GetLearningRateScale();
+	void Update(double *Weight, double *Delta, double *State, int nCnt,
+		int nBatchSize, double dLearningRate, bool bDecay);
+};
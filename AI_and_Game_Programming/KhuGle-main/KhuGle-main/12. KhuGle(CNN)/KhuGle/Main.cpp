@@ -5,6 +5,8 @@
 #include "KhuGleWin.h"
 #include "KhuGleSignal.h"
 #include <iostream>
+#include <thread>
+#include <atomic>
 
 #include "KhuDaNetLayer.h"
 #include "KhuDaNet.h"
@@ -86,8 +88,17 @@ public:
 	CKhuDaNet m_CnnNetwork;
 	bool m_bTrainingRun;
 
+	CKhuDaNet m_TestNetwork;
+	CKhuDaNetEvaluation m_TestEvaluation;
+	std::thread m_TestThread;
+	std::atomic<bool> m_bTestDone;
+	bool m_bTestRunning;
+	int m_nTestEpoch;
+
 	char m_ExePath[MAX_PATH];
+	char m_CheckpointPath[MAX_PATH];
 	int m_nBatchCnt, m_nEpochCnt, m_nBatch;
+	int m_nCheckpointPeriod;
 	int m_nMnistTrainTotal, m_nMnistTestTotal;
 
 	double **m_MnistTrainInput, **m_MnistTestInput;
@@ -97,6 +108,8 @@ public:
 	~CCnnTest();
 	void LoadMnistTrain();
 	void LoadMnistTest();
+	void StartTest();
+	void CheckTest(bool bWait = false);
 	void Update();
 };
 
@@ -129,6 +142,19 @@ CCnnTest::CCnnTest(int nW, int nH, char *ExePath) : CKhuGleWin(nW, nH)
 	m_nBatchCnt = 0;
 	m_nEpochCnt = 0;
 	m_nBatch = 100;
+	m_nCheckpointPeriod = 100;
+
+	sprintf(m_CheckpointPath, "%s\\KhuDaNet.ckpt", m_ExePath);
+
+	CKhuDaNetTrainState TrainState;
+	if(m_CnnNetwork.LoadCheckpoint(m_CheckpointPath, &TrainState))
+	{
+		m_nBatchCnt = TrainState.nBatchCnt;
+		m_nEpochCnt = TrainState.nEpochCnt;
+
+		std::cout << "Resumed from checkpoint (epoch " << m_nEpochCnt+1 << ", batch " << m_nBatchCnt << ")" << std::endl;
+	}
+
 	m_nMnistTrainTotal = 60000;
 	m_nMnistTestTotal = 10000;
 
@@ -162,10 +188,19 @@ CCnnTest::CCnnTest(int nW, int nH, char *ExePath) : CKhuGleWin(nW, nH)
 	LoadMnistTest();
 
 	m_bTrainingRun = false;
+	m_bTestRunning = false;
+	m_bTestDone = false;
+	m_nTestEpoch = 0;
 }
 
 CCnnTest::~CCnnTest()
 {
+	if(m_TestThread.joinable())
+		m_TestThread.join();
+
+	if(!m_CnnNetwork.WaitCheckpoint())
+		std::cout << "Checkpoint save failed: " << m_CheckpointPath << std::endl;
+
 	int i;
 	if(m_MnistTrainInput){
 		for(i = 0 ; i < m_nMnistTrainTotal ; i++)
@@ -188,8 +223,44 @@ CCnnTest::~CCnnTest()
 		delete [] m_MnistTestOutput;
 }
 
+void CCnnTest::StartTest()
+{
+	// an epoch can end before the previous evaluation does; finish and report it first
+	CheckTest(true);
+
+	m_TestNetwork.CloneKhuDaNet(&m_CnnNetwork);
+
+	m_nTestEpoch = m_nEpochCnt;
+	m_bTestRunning = true;
+	m_bTestDone = false;
+	m_TestThread = std::thread([this]() {
+		m_TestNetwork.Evaluate(m_MnistTestInput, m_MnistTestOutput, m_nMnistTestTotal, &m_TestEvaluation);
+		m_bTestDone = true;
+	});
+}
+
+void CCnnTest::CheckTest(bool bWait)
+{
+	if(!m_bTestRunning || (!bWait && !m_bTestDone)) return;
+
+	m_TestThread.join();
+	m_bTestRunning = false;
+
+	char Msg[256];
+	sprintf(Msg, "Test accuracy: %7.3lf, top-%d: %7.3lf, macro F1: %5.3lf (%.0lf images/s), ep(%2d)\n", 
+		m_TestEvaluation.Accuracy*100., m_TestEvaluation.nTopK, m_TestEvaluation.TopKAccuracy*100., 
+		m_TestEvaluation.MacroF1, m_TestEvaluation.ImagesPerSecond, m_nTestEpoch);
+	std::cout << Msg << std::endl;
+
+	m_pTestGraphLayer->m_Data[0].push_back(m_TestEvaluation.Accuracy*100);
+	m_pTestGraphLayer->m_nCurrentCnt++;
+	m_pTestGraphLayer->DrawBackgroundImage();
+}
+
 void CCnnTest::Update()
 {
+	CheckTest();
+
 	if(m_bKeyPressed['S'])
 	{
 		m_bTrainingRun = !m_bTrainingRun;
@@ -246,21 +317,13 @@ void CCnnTest::Update()
 	{
 		m_nEpochCnt++;
 
-		int nTP = 0;
-		int i;
-
-		for(i = 0 ; i < m_nMnistTestTotal ; i++)
-		{
-			int nResult = m_CnnNetwork.Forward(m_MnistTestInput[i]);
-			if(m_MnistTestOutput[i] == nResult) nTP++;
-		}
-
-		sprintf(Msg, "Test accuracy: %7.3lf\n", (double)nTP/(double)m_nMnistTestTotal*100.);
-		std::cout << Msg << std::endl;
+		StartTest();
+	}
 
-		m_pTestGraphLayer->m_Data[0].push_back((double)nTP/(double)m_nMnistTestTotal*100);
-		m_pTestGraphLayer->m_nCurrentCnt++;
-		m_pTestGraphLayer->DrawBackgroundImage();
+	if(m_nBatchCnt%m_nCheckpointPeriod == 0 || nIndex+m_nBatch == m_nMnistTrainTotal)
+	{
+		if(!m_CnnNetwork.SaveCheckpoint(m_CheckpointPath, {m_nEpochCnt, m_nBatchCnt}))
+			std::cout << "Checkpoint save failed: " << m_CheckpointPath << std::endl;
 	}
 
 	m_pTrainGraphLayer->m_Data[0].push_back((double)nTP/(double)m_nBatch*100);
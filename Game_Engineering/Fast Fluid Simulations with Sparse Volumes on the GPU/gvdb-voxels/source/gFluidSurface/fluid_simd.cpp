@@ -0,0 +1,56 @@
+//-----------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+//-----------------------------------------------------------------------------
+
+// Scalar build of the SIMD CPU kernels, and run-time selection of the ISA
+
+#include "fluid_simd.h"
+
+#if defined(_MSC_VER) && ( defined(_M_X64) || defined(_M_IX86) )
+	#include <intrin.h>
+	#include <immintrin.h>
+#endif
+
+#define SIMD_WIDTH		1
+#define SIMD_NAME		"Scalar"
+#define SIMD_KERNELS	getSIMDKernelsScalar
+#include "fluid_simd_kernels.h"
+
+// CPU and OS support for AVX2 / AVX-512F (the OS must save the wider registers)
+static void getCPUFeatures ( bool& avx2, bool& avx512 )
+{
+	avx2 = avx512 = false;
+#if defined(_MSC_VER) && ( defined(_M_X64) || defined(_M_IX86) )
+	int r[4];
+	__cpuid ( r, 0 );
+	if ( r[0] < 7 ) return;
+	__cpuid ( r, 1 );
+	if ( (r[2] & (1 << 27)) == 0 || (r[2] & (1 << 28)) == 0 ) return;		// OSXSAVE, AVX
+	unsigned long long xcr0 = _xgetbv ( 0 );
+	__cpuidex ( r, 7, 0 );
+	avx2 = (xcr0 & 0x06) == 0x06 && (r[1] & (1 << 5)) != 0;
+	avx512 = (xcr0 & 0xE6) == 0xE6 && (r[1] & (1 << 16)) != 0;
+#elif defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+	__builtin_cpu_init ();
+	avx2 = __builtin_cpu_supports ( "avx2" ) != 0;
+	avx512 = __builtin_cpu_supports ( "avx512f" ) != 0;
+#endif
+}
+
+SIMDKernels getSIMDKernels ()
+{
+	bool avx2, avx512;
+	getCPUFeatures ( avx2, avx512 );
+	SIMDKernels k;
+	if ( avx512 ) {
+		k = getSIMDKernelsAVX512 ();
+		if ( k.width > 0 ) return k;
+	}
+	if ( avx2 ) {
+		k = getSIMDKernelsAVX2 ();
+		if ( k.width > 0 ) return k;
+	}
+	return getSIMDKernelsScalar ();
+}
@@ -0,0 +1,57 @@
+//-----------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+//-----------------------------------------------------------------------------
+
+// SIMD CPU kernels (RUN_CPU_SIMD).
+//
+// The kernels are compiled once per vector ISA, each in its own translation unit
+// with its own arch flags (fluid_simd.cpp scalar, fluid_simd_avx2.cpp,
+// fluid_simd_avx512.cpp), and getSIMDKernels picks the widest one the CPU runs.
+// The ISA units share no inline code with the rest of the program, so nothing
+// compiled for a wider ISA can be linked into the common path.
+
+#ifndef DEF_FLUID_SIMD
+	#define DEF_FLUID_SIMD
+
+	// Structure-of-arrays streams
+	#define SOA_POSX			0
+	#define SOA_POSY			1
+	#define SOA_POSZ			2
+	#define SOA_VELX			3
+	#define SOA_VELY			4
+	#define SOA_VELZ			5
+	#define SOA_PRESS			6
+	#define SOA_DENSITY			7
+	#define SOA_MAX				6		// owned streams, press/density alias FPRESS/FDENSITY
+
+	#define SIMD_CELL_UNDEF		0xFFFFFFFFu		// GRID_UNDEF
+
+	// Sorted grid and streams the kernels read
+	struct SIMDGrid {
+		float**			soa;			// SOA_* streams
+		unsigned int*	gcell;			// FGCELL
+		unsigned int*	gcnt;			// FGRIDCNT
+		unsigned int*	goff;			// FGRIDOFF
+		int				res[3];			// grid resolution
+		int				ext[3];			// cells searched on each side
+		float			d2, r2;			// simscale squared, smoothing radius squared
+	};
+
+	// One ISA's kernels, run over particles [start, end)
+	struct SIMDKernels {
+		const char*		name;
+		int				width;			// floats per vector, 0 = not built or not supported
+		void ( *pressure ) ( const SIMDGrid& g, int start, int end, float mass, float rest, float istiff,
+							 float* press, float* density, float& nbr );
+		void ( *force ) ( const SIMDGrid& g, int start, int end, float mR, float pkern, float vterm,
+						  const float* press, const float* density, float* force );	// force: xyz per particle
+	};
+
+	SIMDKernels getSIMDKernels ();				// widest kernels this CPU supports
+	SIMDKernels getSIMDKernelsScalar ();
+	SIMDKernels getSIMDKernelsAVX2 ();
+	SIMDKernels getSIMDKernelsAVX512 ();
+
+#endif
@@ -0,0 +1,24 @@
+//-----------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+//-----------------------------------------------------------------------------
+
+// AVX2 build of the SIMD CPU kernels, compiled with AVX2 flags (see CMakeLists.txt)
+
+#include "fluid_simd.h"
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+	#define SIMD_WIDTH		8
+	#define SIMD_NAME		"AVX2"
+	#define SIMD_OP(op)		_mm256_##op##_ps
+	#define SIMD_KERNELS	getSIMDKernelsAVX2
+	#include "fluid_simd_kernels.h"
+#else
+SIMDKernels getSIMDKernelsAVX2 ()
+{
+	SIMDKernels k = { "AVX2", 0, 0x0, 0x0 };		// compiler without AVX2 flags
+	return k;
+}
+#endif
@@ -0,0 +1,24 @@
+//-----------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+//-----------------------------------------------------------------------------
+
+// AVX-512 build of the SIMD CPU kernels, compiled with AVX-512 flags (see CMakeLists.txt)
+
+#include "fluid_simd.h"
+
+#if defined(__AVX512F__)
+	#include <immintrin.h>
+	#define SIMD_WIDTH		16
+	#define SIMD_NAME		"AVX-512"
+	#define SIMD_OP(op)		_mm512_##op##_ps
+	#define SIMD_KERNELS	getSIMDKernelsAVX512
+	#include "fluid_simd_kernels.h"
+#else
+SIMDKernels getSIMDKernelsAVX512 ()
+{
+	SIMDKernels k = { "AVX-512", 0, 0x0, 0x0 };		// compiler without AVX-512 flags
+	return k;
+}
+#endif
@@ -0,0 +1,217 @@
+//-----------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+//-----------------------------------------------------------------------------
+
+// Body of the SIMD CPU kernels, included once by each ISA translation unit.
+// The includer defines SIMD_WIDTH (16, 8 or 1), SIMD_NAME, SIMD_KERNELS (name of
+// the getter) and, for vector widths, SIMD_OP. Everything here has internal
+// linkage and uses no shared inline functions (see fluid_simd.h).
+//
+// After the counting sort a row of adjacent cells is one contiguous particle range, so neighbor
+// batches load straight from the structure-of-arrays copies of FPOS/FVEVAL, no gathers needed.
+// Self-pairs are rejected by dsq > 0, as in the CUDA kernels.
+
+#include <math.h>
+#include "fluid_simd.h"
+
+namespace {
+
+#if SIMD_WIDTH == 16
+	typedef __m512	vfloat;
+	typedef __mmask16 vmask;
+	inline vfloat vset ( float a )					{ return _mm512_set1_ps ( a ); }
+	inline vmask vtail ( int n )					{ return (vmask) ( (1u << n) - 1 ); }
+	inline vfloat vload ( const float* p, vmask m )	{ return _mm512_maskz_loadu_ps ( m, p ); }
+	inline vmask vinside ( vfloat dsq, vfloat r2, vmask m )	{ return _mm512_mask_cmp_ps_mask ( _mm512_cmp_ps_mask ( dsq, r2, _CMP_LE_OQ ), dsq, _mm512_setzero_ps(), _CMP_GT_OQ ) & m; }
+	inline vfloat vselect ( vmask m, vfloat a )		{ return _mm512_maskz_mov_ps ( m, a ); }
+	inline float vsum ( vfloat a )					{ return _mm512_reduce_add_ps ( a ); }
+#elif SIMD_WIDTH == 8
+	typedef __m256	vfloat;
+	typedef __m256	vmask;
+	inline vfloat vset ( float a )					{ return _mm256_set1_ps ( a ); }
+	inline vmask vtail ( int n )					{ return _mm256_cmp_ps ( _mm256_setr_ps ( 0, 1, 2, 3, 4, 5, 6, 7 ), _mm256_set1_ps ( (float) n ), _CMP_LT_OQ ); }
+	inline vfloat vload ( const float* p, vmask m )	{ return _mm256_maskload_ps ( p, _mm256_castps_si256 ( m ) ); }
+	inline vmask vinside ( vfloat dsq, vfloat r2, vmask m )	{ return _mm256_and_ps ( _mm256_and_ps ( _mm256_cmp_ps ( dsq, r2, _CMP_LE_OQ ), _mm256_cmp_ps ( dsq, _mm256_setzero_ps(), _CMP_GT_OQ ) ), m ); }
+	inline vfloat vselect ( vmask m, vfloat a )		{ return _mm256_and_ps ( m, a ); }
+	inline float vsum ( vfloat a ) {
+		__m128 s = _mm_add_ps ( _mm256_castps256_ps128 ( a ), _mm256_extractf128_ps ( a, 1 ) );
+		s = _mm_add_ps ( s, _mm_movehl_ps ( s, s ) );
+		s = _mm_add_ss ( s, _mm_shuffle_ps ( s, s, 1 ) );
+		return _mm_cvtss_f32 ( s );
+	}
+#endif
+
+#if SIMD_WIDTH > 1
+	inline vfloat vadd ( vfloat a, vfloat b )		{ return SIMD_OP(add) ( a, b ); }
+	inline vfloat vsub ( vfloat a, vfloat b )		{ return SIMD_OP(sub) ( a, b ); }
+	inline vfloat vmul ( vfloat a, vfloat b )		{ return SIMD_OP(mul) ( a, b ); }
+	inline vfloat vdiv ( vfloat a, vfloat b )		{ return SIMD_OP(div) ( a, b ); }
+	inline vfloat vsqrt ( vfloat a )				{ return SIMD_OP(sqrt) ( a ); }
+	inline vfloat vlen2 ( vfloat x, vfloat y, vfloat z )	{ return vadd ( vmul ( x, x ), vadd ( vmul ( y, y ), vmul ( z, z ) ) ); }
+#endif
+
+inline int imin ( int a, int b )	{ return a < b ? a : b; }
+inline int imax ( int a, int b )	{ return a > b ? a : b; }
+
+// Search box of a particle's cell, clipped to the grid
+inline void searchBox ( const SIMDGrid& g, unsigned int c, int* lo, int* hi )
+{
+	int xz = g.res[0] * g.res[2];
+	int gc[3];
+	gc[1] = c / xz;				c -= gc[1] * xz;
+	gc[2] = c / g.res[0];		c -= gc[2] * g.res[0];
+	gc[0] = c;
+	for (int k=0; k < 3; k++ ) {
+		lo[k] = imax ( 0, gc[k] - g.ext[k] );
+		hi[k] = imin ( g.res[k] - 1, gc[k] + g.ext[k] );
+	}
+}
+
+// Poly6 sum and neighbor count over particles [jfirst, jlast)
+inline void PressureBatch ( float** soa, unsigned int jfirst, unsigned int jlast, float ix, float iy, float iz, float d2, float r2, float& sum, float& cnt )
+{
+	const float *px = soa[SOA_POSX], *py = soa[SOA_POSY], *pz = soa[SOA_POSZ];
+	unsigned int j = jfirst;
+#if SIMD_WIDTH > 1
+	vfloat vx = vset ( ix ), vy = vset ( iy ), vz = vset ( iz );
+	vfloat vd2 = vset ( d2 ), vr2 = vset ( r2 ), one = vset ( 1.0f );
+	vfloat vsumc = vset ( 0 ), vcnt = vset ( 0 );
+	for ( ; j < jlast; j += SIMD_WIDTH ) {
+		vmask m = vtail ( imin ( (int) (jlast - j), SIMD_WIDTH ) );
+		vfloat dx = vsub ( vx, vload ( px + j, m ) );
+		vfloat dy = vsub ( vy, vload ( py + j, m ) );
+		vfloat dz = vsub ( vz, vload ( pz + j, m ) );
+		vfloat dsq = vmul ( vd2, vlen2 ( dx, dy, dz ) );
+		vfloat c = vsub ( vr2, dsq );
+		m = vinside ( dsq, vr2, m );
+		vsumc = vadd ( vsumc, vselect ( m, vmul ( vmul ( c, c ), c ) ) );
+		vcnt = vadd ( vcnt, vselect ( m, one ) );
+	}
+	sum += vsum ( vsumc );
+	cnt += vsum ( vcnt );
+#else
+	float dx, dy, dz, dsq, c;
+	for ( ; j < jlast; j++ ) {
+		dx = ix - px[j];
+		dy = iy - py[j];
+		dz = iz - pz[j];
+		dsq = d2*(dx*dx + dy*dy + dz*dz);
+		if ( dsq <= r2 && dsq > 0 ) {
+			c = r2 - dsq;
+			sum += c * c * c;
+			cnt += 1.0f;
+		}
+	}
+#endif
+}
+
+// Pressure and viscosity force over particles [jfirst, jlast)
+inline void ForceBatch ( float** soa, unsigned int jfirst, unsigned int jlast, const float* ipos, const float* iveleval, float ipress, float idensity,
+						 float d2, float r2, float mR, float pkern, float vterm, float* force )
+{
+	const float *px = soa[SOA_POSX], *py = soa[SOA_POSY], *pz = soa[SOA_POSZ];
+	const float *vx = soa[SOA_VELX], *vy = soa[SOA_VELY], *vz = soa[SOA_VELZ];
+	const float *ppress = soa[SOA_PRESS], *pdensity = soa[SOA_DENSITY];
+	unsigned int j = jfirst;
+#if SIMD_WIDTH > 1
+	vfloat ix = vset ( ipos[0] ), iy = vset ( ipos[1] ), iz = vset ( ipos[2] );
+	vfloat ivx = vset ( iveleval[0] ), ivy = vset ( iveleval[1] ), ivz = vset ( iveleval[2] );
+	vfloat vd2 = vset ( d2 ), vr2 = vset ( r2 ), vmR = vset ( mR ), vpkern = vset ( pkern ), vvterm = vset ( vterm );
+	vfloat vipress = vset ( ipress ), vidensity = vset ( idensity );
+	vfloat fx = vset ( 0 ), fy = vset ( 0 ), fz = vset ( 0 );
+	for ( ; j < jlast; j += SIMD_WIDTH ) {
+		vmask m = vtail ( imin ( (int) (jlast - j), SIMD_WIDTH ) );
+		vfloat dx = vsub ( ix, vload ( px + j, m ) );
+		vfloat dy = vsub ( iy, vload ( py + j, m ) );
+		vfloat dz = vsub ( iz, vload ( pz + j, m ) );
+		vfloat dsq = vmul ( vd2, vlen2 ( dx, dy, dz ) );
+		m = vinside ( dsq, vr2, m );
+		vfloat dist = vsqrt ( dsq );
+		vfloat c = vsub ( vmR, dist );
+		vfloat pterm = vdiv ( vmul ( vmul ( vpkern, c ), vadd ( vipress, vload ( ppress + j, m ) ) ), dist );
+		vfloat dterm = vmul ( vmul ( c, vidensity ), vload ( pdensity + j, m ) );
+		// lanes outside the radius (or self, dist 0) may hold inf/nan, select drops them
+		fx = vadd ( fx, vselect ( m, vmul ( vadd ( vmul ( pterm, dx ), vmul ( vvterm, vsub ( vload ( vx + j, m ), ivx ) ) ), dterm ) ) );
+		fy = vadd ( fy, vselect ( m, vmul ( vadd ( vmul ( pterm, dy ), vmul ( vvterm, vsub ( vload ( vy + j, m ), ivy ) ) ), dterm ) ) );
+		fz = vadd ( fz, vselect ( m, vmul ( vadd ( vmul ( pterm, dz ), vmul ( vvterm, vsub ( vload ( vz + j, m ), ivz ) ) ), dterm ) ) );
+	}
+	force[0] += vsum ( fx );
+	force[1] += vsum ( fy );
+	force[2] += vsum ( fz );
+#else
+	float dx, dy, dz, dsq, dist, c, pterm, dterm;
+	for ( ; j < jlast; j++ ) {
+		dx = ipos[0] - px[j];
+		dy = ipos[1] - py[j];
+		dz = ipos[2] - pz[j];
+		dsq = d2*(dx*dx + dy*dy + dz*dz);
+		if ( dsq <= r2 && dsq > 0 ) {
+			dist = sqrtf(dsq);
+			c = mR - dist;
+			pterm = pkern * c * ( ipress + ppress[j] ) / dist;
+			dterm = c * idensity * pdensity[j];
+			force[0] += ( pterm * dx + vterm * ( vx[j] - iveleval[0] ) ) * dterm;
+			force[1] += ( pterm * dy + vterm * ( vy[j] - iveleval[1] ) ) * dterm;
+			force[2] += ( pterm * dz + vterm * ( vz[j] - iveleval[2] ) ) * dterm;
+		}
+	}
+#endif
+}
+
+void PressureRange ( const SIMDGrid& g, int start, int end, float mass, float rest, float istiff,
+					 float* ppress, float* pdensity, float& nbr )
+{
+	int lo[3], hi[3];
+	float sum, cnt = 0;
+	for (int i=start; i < end; i++ ) {
+		if ( g.gcell[i] == SIMD_CELL_UNDEF ) continue;
+		searchBox ( g, g.gcell[i], lo, hi );
+		sum = 0.0;
+		for (int y=lo[1]; y <= hi[1]; y++ ) {
+			for (int z=lo[2]; z <= hi[2]; z++ ) {
+				int row = (y*g.res[2] + z)*g.res[0];
+				PressureBatch ( g.soa, g.goff[row + lo[0]], g.goff[row + hi[0]] + g.gcnt[row + hi[0]],
+								g.soa[SOA_POSX][i], g.soa[SOA_POSY][i], g.soa[SOA_POSZ][i], g.d2, g.r2, sum, cnt );
+			}
+		}
+		sum *= mass;
+		if ( sum == 0.0 ) sum = 1.0;
+		ppress[i] = ( sum - rest ) * istiff;
+		pdensity[i] = 1.0f / sum;
+	}
+	nbr = cnt;
+}
+
+void ForceRange ( const SIMDGrid& g, int start, int end, float mR, float pkern, float vterm,
+				  const float* ppress, const float* pdensity, float* pforce )
+{
+	int lo[3], hi[3];
+	float ipos[3], iveleval[3];
+	for (int i=start; i < end; i++ ) {
+		float* force = pforce + 3*(size_t) i;
+		force[0] = force[1] = force[2] = 0;
+		if ( g.gcell[i] == SIMD_CELL_UNDEF ) continue;
+		for (int k=0; k < 3; k++ ) {
+			ipos[k] = g.soa[SOA_POSX + k][i];
+			iveleval[k] = g.soa[SOA_VELX + k][i];
+		}
+		searchBox ( g, g.gcell[i], lo, hi );
+		for (int y=lo[1]; y <= hi[1]; y++ ) {
+			for (int z=lo[2]; z <= hi[2]; z++ ) {
+				int row = (y*g.res[2] + z)*g.res[0];
+				ForceBatch ( g.soa, g.goff[row + lo[0]], g.goff[row + hi[0]] + g.gcnt[row + hi[0]], ipos, iveleval, ppress[i], pdensity[i],
+							 g.d2, g.r2, mR, pkern, vterm, force );
+			}
+		}
+	}
+}
+
+}
+
+SIMDKernels SIMD_KERNELS ()
+{
+	SIMDKernels k = { SIMD_NAME, SIMD_WIDTH, PressureRange, ForceRange };
+	return k;
+}
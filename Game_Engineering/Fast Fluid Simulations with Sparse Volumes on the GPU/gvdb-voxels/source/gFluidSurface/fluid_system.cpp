@@ -9,6 +9,8 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <algorithm>
+#include <thread>
 #include <cuda.h>	
 #include "cutil_math.h"			// cutil32.lib
 
@@ -26,6 +28,9 @@ extern bool gProfileRend;
 
 #define SCAN_BLOCKSIZE		512				// must match value in fluid_system_cuda.cu
 
+#define SIMD_ALIGN			64
+#define SIMD_PAD			16
+
 // #define FLUID_INTEGRITY						// debugging, enable this to check fluid integrity 
 
 bool cuCheck (CUresult launch_stat, char* method, char* apicall, char* arg, bool bDebug)
@@ -70,8 +75,16 @@ FluidSystem::FluidSystem ()
 	m_Frame = 0;
 	m_Module = 0;
 	m_Thresh = 0;	
+	m_bAdaptFromGPU = false;
 	m_NeighborTable = 0x0;
 	m_NeighborDist = 0x0;		
+	m_NeighborRefPos = 0x0;
+	m_GridCntAtomic = 0x0;
+	m_SoAMax = 0;
+	m_SIMD = getSIMDKernels ();
+	memset ( m_SoA, 0, sizeof(m_SoA) );
+	memset ( m_SoABase, 0, sizeof(m_SoABase) );
+	m_NumThreads = std::max ( 1, (int) std::thread::hardware_concurrency() );
 	for (int n=0; n < FUNC_MAX; n++ ) m_Func[n] = (CUfunction) -1;
 	m_Toggle [ PDEBUG ]		=	false;
 	m_Toggle [ PUSE_GRID ]	=	false;
@@ -84,6 +97,9 @@ FluidSystem::~FluidSystem() {
 	if (mSaveNdx != 0x0) free(mSaveNdx);
 	if (mSaveCnt != 0x0) free(mSaveCnt);
 	if (mSaveNeighbors != 0x0)	free(mSaveNeighbors);
+	if (m_GridCntAtomic != 0x0) delete [] m_GridCntAtomic;
+	for (int n=0; n < SOA_MAX; n++ ) if (m_SoABase[n] != 0x0) free(m_SoABase[n]);
+	m_Cache.Close ();
 
 	if (m_Module != 0) {
 		cuCheck(cuModuleUnload(m_Module), "~FluidSystem()", "cuModuleUnload", "m_Module", mbDebug);
@@ -142,6 +158,8 @@ void FluidSystem::Start ( int num )
 	#endif
 
 	m_Time = 0;
+	m_FrameRemain = 0;
+	m_bAdaptFromGPU = false;
 
 	ClearNeighborTable ();
 	mNumPoints = 0;			// reset count
@@ -204,6 +222,8 @@ void FluidSystem::Exit ()
 	for (int n=0; n < MAX_BUF; n++ ) {
 		if ( m_Fluid.bufC(n) != 0x0 )
 			free ( m_Fluid.bufC(n) );
+		if ( m_FluidTemp.bufC(n) != 0x0 )
+			free ( m_FluidTemp.bufC(n) );			// CPU sort buffers
 	}
 
 	//cudaExit ();
@@ -219,6 +239,10 @@ void FluidSystem::AllocateBuffer ( int buf_id, int stride, int cpucnt, int gpucn
 			free(src_buf);
 		}
 		m_Fluid.setBuf(buf_id, dest_buf);
+		if ((gpumode == GPU_TEMP || gpumode == GPU_DUAL) && m_FluidTemp.bufC(buf_id) != 0x0) {
+			free(m_FluidTemp.bufC(buf_id));			// CPU sort buffer, reallocated on next CountingSortFullCPU
+			m_FluidTemp.setBuf(buf_id, 0x0);
+		}
 	}
 	if (gpumode == GPU_SINGLE || gpumode == GPU_DUAL )	{
 		if (m_Fluid.gpuptr(buf_id) != 0x0) cuCheck(cuMemFree(m_Fluid.gpu(buf_id)), "AllocateBuffer", "cuMemFree", "Fluid.gpu", mbDebug);
@@ -281,6 +305,10 @@ void FluidSystem::AllocateGrid()
 
 	// Update GPU access pointers
 	cuCheck(cuMemcpyHtoD(cuFBuf, &m_Fluid, sizeof(FBufs)), "AllocateGrid", "cuMemcpyHtoD", "cuFBuf", mbDebug);
+
+	// Cell counters for the multi-threaded CPU insert
+	if ( m_GridCntAtomic != 0x0 ) delete [] m_GridCntAtomic;
+	m_GridCntAtomic = new std::atomic<uint> [ cnt ];
 	cuCheck(cuCtxSynchronize(), "AllocateParticles", "cuCtxSynchronize", "", mbDebug);
 }
 
@@ -499,6 +527,35 @@ void FluidSystem::Run ()
 		m_Param[PMODE] = RUN_VALIDATE;
 	#endif	
 
+	if ( isAdaptive () && m_Param[PFRAME_DT] > 0 ) {
+		// Sub-step until the output frame time is reached exactly
+		double frame_end = m_Time + double(m_Param[PFRAME_DT]);
+		int steps = 0;
+		m_FrameRemain = m_Param[PFRAME_DT];
+		while ( m_FrameRemain > 0 ) {
+			RunStep ();						// AdaptTimeStep clips the step to m_FrameRemain
+			m_Time += m_StepDT;
+			steps++;
+		}
+		m_Time = (float) frame_end;
+		m_Param[PSTAT_SUBSTEPS] = (float) steps;
+	} else {
+		m_FrameRemain = 0;
+		RunStep ();
+		m_Time += m_StepDT;
+		m_Param[PSTAT_SUBSTEPS] = 1;
+	}
+	if ( m_bAdaptFromGPU ) {			// the renderer reads positions and colors from the GPU
+		cuCheck ( cuMemcpyHtoD ( m_Fluid.gpu(FPOS), m_Fluid.bufC(FPOS), mNumPoints *sizeof(float)*3 ), "Run", "cuMemcpyHtoD", "FPOS", mbDebug );
+		cuCheck ( cuMemcpyHtoD ( m_Fluid.gpu(FCLR), m_Fluid.bufC(FCLR), mNumPoints *sizeof(uint) ), "Run", "cuMemcpyHtoD", "FCLR", mbDebug );
+	}
+
+	AdvanceTime ();
+}
+
+void FluidSystem::RunStep ()
+{
+	m_StepDT = m_DT;					// AdaptTimeStep may replace it for this step
 	switch ( (int) m_Param[PMODE] ) {
 	case RUN_SEARCH:	
 		InsertParticles ();				// Insert into grid
@@ -510,15 +567,33 @@ void FluidSystem::Run ()
 		//ComputeForceSlow ();
 		Advance ();
 		break;
-	case RUN_CPU_GRID:					// CPU fast, GRID-accelerated 
-		InsertParticles ();
-		ComputePressureGrid ();
-		ComputeForceGrid ();
-		Advance ();
+	case RUN_CPU_GRID:					// CPU fast, GRID-accelerated, multi-threaded /w deep copy sort
+		if ( NeedNeighborRebuild () ) {	// sort only when neighbor lists are rebuilt, so list indices stay valid
+			InsertParticlesCPU ();
+			PrefixSumCellsCPU ();
+			CountingSortFullCPU ();
+			BuildNeighborsCPU ();
+		}
+		ComputePressureNbrCPU ();
+		ComputeForceNbrCPU ();
+		AdaptTimeStep ();
+		AdvanceCPU ();
+		break;
+	case RUN_CPU_SIMD:					// CPU SIMD, sorted GRID-accelerated, structure-of-arrays kernels
+		InsertParticlesCPU ();
+		PrefixSumCellsCPU ();
+		CountingSortFullCPU ();
+		ComputePressureSIMD ();
+		ComputeForceSIMD ();
+		AdaptTimeStep ();
+		AdvanceCPU ();
 		break;
 	case RUN_VALIDATE:					// GPU Validation
 		ValidateCUDA();
 		break;
+	case RUN_PLAYBACK:					// Read recorded frames
+		RunPlayback ();
+		break;
 	case RUN_GPU_FULL:					// Full CUDA pathway, GRID-accelerted GPU, /w deep copy sort		
 		InsertParticlesCUDA ( 0x0, 0x0, 0x0 );		
 		PrefixSumCellsCUDA ( 0x0, 1 );		
@@ -528,19 +603,15 @@ void FluidSystem::Run ()
 		#endif				
 		ComputePressureCUDA();		
 		ComputeForceCUDA ();			
-		AdvanceCUDA ( m_Time, m_DT, m_Param[PSIMSCALE] );							
+		AdvanceCUDA ( m_Time, m_StepDT, m_Param[PSIMSCALE] );							
 		//EmitParticlesCUDA ( m_Time, (int) m_Vec[PEMIT_RATE].x );					
 		TransferFromCUDA ();	// return for rendering			
 		break;	
 	};
-
-	AdvanceTime ();
 }
 
 void FluidSystem::AdvanceTime ()
 {
-	m_Time += m_DT;
-	
 	m_Frame += m_FrameRange.z;
 
 	if ( m_Frame > m_FrameRange.y && m_FrameRange.y != -1 ) {
@@ -549,6 +620,7 @@ void FluidSystem::AdvanceTime ()
 		mbRecord = false;
 		mbRecordBricks = false;
 		m_Toggle[ PCAPTURE ] = false;
+		m_Cache.Close ();				// flush pending frames and write the index
 		
 		nvprintf ( "Exiting.\n" );
 		exit ( 1 );
@@ -585,6 +657,11 @@ void FluidSystem::DrawDomain ()
 }
 
 void FluidSystem::Advance ()
+{
+	AdvanceRange ( 0, NumPoints() );
+}
+
+void FluidSystem::AdvanceRange ( int start, int end )
 {
 	Vector3DF norm, z;
 	Vector3DF dir, accel;
@@ -606,16 +683,16 @@ void FluidSystem::Advance ()
 	ss = m_Param[PSIMSCALE];
 
 	// Get particle buffers
-	Vector3DF*	ppos =		m_Fluid.bufV3(FPOS);
-	Vector3DF*	pvel =		m_Fluid.bufV3(FVEL);
-	Vector3DF*	pveleval =	m_Fluid.bufV3(FVEVAL);
-	Vector3DF*	pforce =	m_Fluid.bufV3(FFORCE);
-	uint*		pclr =		m_Fluid.bufI(FCLR);
-	float*		ppress =	m_Fluid.bufF(FPRESS);
-	float*		pdensity =	m_Fluid.bufF(FDENSITY);
+	Vector3DF*	ppos =		m_Fluid.bufV3(FPOS) + start;
+	Vector3DF*	pvel =		m_Fluid.bufV3(FVEL) + start;
+	Vector3DF*	pveleval =	m_Fluid.bufV3(FVEVAL) + start;
+	Vector3DF*	pforce =	m_Fluid.bufV3(FFORCE) + start;
+	uint*		pclr =		m_Fluid.bufI(FCLR) + start;
+	float*		ppress =	m_Fluid.bufF(FPRESS) + start;
+	float*		pdensity =	m_Fluid.bufF(FDENSITY) + start;
 
 	// Advance each particle
-	for ( int n=0; n < NumPoints(); n++ ) {
+	for ( int n=start; n < end; n++ ) {
 
 		if ( m_Fluid.bufI(FGCELL)[n] == GRID_UNDEF) continue;
 
@@ -728,14 +805,14 @@ void FluidSystem::Advance ()
 
 		// Leapfrog Integration ----------------------------
 		vnext = accel;							
-		vnext *= m_DT;
+		vnext *= m_StepDT;
 		vnext += *pvel;						// v(t+1/2) = v(t-1/2) + a(t) dt
 
 		*pveleval = *pvel;
 		*pveleval += vnext;
 		*pveleval *= 0.5;					// v(t+1) = [v(t-1/2) + v(t+1/2)] * 0.5		used to compute forces later
 		*pvel = vnext;
-		vnext *= m_DT/ss;
+		vnext *= m_StepDT/ss;
 		*ppos += vnext;						// p(t+1) = p(t) + v(t+1/2) dt
 
 		/*if ( m_Param[PCLR_MODE]==1.0 ) {
@@ -796,10 +873,15 @@ void FluidSystem::ClearNeighborTable ()
 {
 	if ( m_NeighborTable != 0x0 )	free (m_NeighborTable);
 	if ( m_NeighborDist != 0x0)		free (m_NeighborDist );
+	if ( m_NeighborRefPos != 0x0 )	free (m_NeighborRefPos );
 	m_NeighborTable = 0x0;
 	m_NeighborDist = 0x0;
+	m_NeighborRefPos = 0x0;
 	m_NeighborNum = 0;
 	m_NeighborMax = 0;
+	m_NeighborRefMax = 0;
+	m_NeighborPnts = 0;
+	m_NeighborFresh = false;
 }
 
 void FluidSystem::ResetNeighbors ()
@@ -1311,6 +1393,684 @@ void FluidSystem::ComputeForceGridNC ()
 }
 
 
+//---------------------------------------------------------------- Multi-threaded CPU pipeline
+// Mirrors the CUDA path (insert, prefix sum, counting sort) so each cell's particles are contiguous.
+// Particles are split into m_NumThreads fixed chunks; InsertParticlesCPU and CountingSortFullCPU
+// must use the same chunking so that out-of-grid particles keep a deterministic order.
+
+template <class Func>
+static void RunThreads ( int num, int threads, Func func )
+{
+	if ( threads > num ) threads = num;
+	if ( threads <= 1 ) {
+		if ( num > 0 ) func ( 0, 0, num );
+		return;
+	}
+	std::vector<std::thread> pool;
+	for (int t=1; t < threads; t++ )
+		pool.push_back ( std::thread ( func, t, int( xlong(num)*t/threads ), int( xlong(num)*(t+1)/threads ) ) );
+	func ( 0, 0, int( num / threads ) );
+	for (int t=0; t < (int) pool.size(); t++ )
+		pool[t].join ();
+}
+
+void FluidSystem::SetNumThreads ( int n )
+{
+	m_NumThreads = ( n > 0 ) ? n : std::max ( 1, (int) std::thread::hardware_concurrency() );
+}
+
+int FluidSystem::getChunkCnt ()
+{
+	return std::max ( 1, std::min ( m_NumThreads, NumPoints() ) );
+}
+
+void FluidSystem::InsertParticlesCPU ()
+{
+	std::atomic<uint>* gcnt = m_GridCntAtomic;
+	RunThreads ( m_GridTotal, m_NumThreads, [gcnt] ( int t, int start, int end ) {
+		for (int c=start; c < end; c++ ) gcnt[c].store ( 0, std::memory_order_relaxed );
+	} );
+
+	int xns = m_GridRes.x - m_GridSrch;
+	int yns = m_GridRes.y - m_GridSrch;
+	int zns = m_GridRes.z - m_GridSrch;
+
+	m_ChunkOutside.assign ( getChunkCnt(), 0 );
+
+	RunThreads ( NumPoints(), getChunkCnt(), [&] ( int t, int start, int end ) {
+		Vector3DI gc;
+		Vector3DF* ppos =	m_Fluid.bufV3(FPOS);
+		uint* pgcell =		m_Fluid.bufI(FGCELL);
+		uint* pgndx =		m_Fluid.bufI(FGNDX);
+		int outside = 0;
+		for (int n=start; n < end; n++ ) {
+			int gs = getGridCell ( ppos[n], gc );
+			if ( gc.x >= 1 && gc.x <= xns && gc.y >= 1 && gc.y <= yns && gc.z >= 1 && gc.z <= zns ) {
+				pgcell[n] = gs;
+				pgndx[n] = gcnt[gs].fetch_add ( 1, std::memory_order_relaxed );
+			} else {
+				pgcell[n] = GRID_UNDEF;
+				pgndx[n] = outside++;
+			}
+		}
+		m_ChunkOutside[t] = outside;
+	} );
+}
+
+void FluidSystem::PrefixSumCellsCPU ()
+{
+	int threads = std::max ( 1, std::min ( m_NumThreads, m_GridTotal / 4096 ) );
+	std::vector<uint> blockSum ( threads, 0 ), blockOccupy ( threads, 0 );
+	std::atomic<uint>* gcnt = m_GridCntAtomic;
+	uint* mgcnt = m_Fluid.bufI(FGRIDCNT);
+	uint* mgoff = m_Fluid.bufI(FGRIDOFF);
+
+	// Per-block totals, then an exclusive scan of the block totals, then per-block scans
+	RunThreads ( m_GridTotal, threads, [&] ( int t, int start, int end ) {
+		uint sum = 0, occupy = 0;
+		for (int c=start; c < end; c++ ) {
+			mgcnt[c] = gcnt[c].load ( std::memory_order_relaxed );
+			sum += mgcnt[c];
+			if ( mgcnt[c] > 0 ) occupy++;
+		}
+		blockSum[t] = sum;
+		blockOccupy[t] = occupy;
+	} );
+
+	uint total = 0, occupy = 0;
+	for (int t=0; t < threads; t++ ) {
+		uint sum = blockSum[t];
+		blockSum[t] = total;
+		total += sum;
+		occupy += blockOccupy[t];
+	}
+
+	RunThreads ( m_GridTotal, threads, [&] ( int t, int start, int end ) {
+		uint sum = blockSum[t];
+		for (int c=start; c < end; c++ ) {
+			mgoff[c] = sum;
+			sum += mgcnt[c];
+		}
+	} );
+
+	m_GridInside = total;
+	m_Param[ PSTAT_OCCUPY ] = float(occupy);
+	m_Param[ PSTAT_GRIDCNT ] = float(total);
+}
+
+void FluidSystem::CountingSortFullCPU ()
+{
+	// Buffers carried through the sort. Sorted data is written to m_FluidTemp, then the two are swapped.
+	const int sortBuf[11] = { FPOS, FVEL, FVEVAL, FFORCE, FPRESS, FDENSITY, FAGE, FCLR, FSTATE, FGCELL, FGNDX };
+	const int sortStride[11] = { sizeof(Vector3DF), sizeof(Vector3DF), sizeof(Vector3DF), sizeof(Vector3DF), sizeof(float), sizeof(float),
+								sizeof(unsigned short), sizeof(uint), sizeof(uint), sizeof(uint), sizeof(uint) };
+	for (int b=0; b < 11; b++ ) {
+		if ( m_FluidTemp.bufC(sortBuf[b]) == 0x0 )
+			m_FluidTemp.setBuf ( sortBuf[b], (char*) malloc ( mMaxPoints * sortStride[b] ) );
+	}
+
+	// Out-of-grid particles are placed after all gridded ones, in chunk order
+	std::vector<uint> outsideOff ( m_ChunkOutside.size() );
+	uint sum = m_GridInside;
+	for (int t=0; t < (int) m_ChunkOutside.size(); t++ ) {
+		outsideOff[t] = sum;
+		sum += m_ChunkOutside[t];
+	}
+
+	uint* mgrid = m_Fluid.bufI(FGRID);
+	uint* mgcnt = m_Fluid.bufI(FGRIDCNT);
+	uint* mgoff = m_Fluid.bufI(FGRIDOFF);
+
+	// Scatter source indices into sorted slots (FGRID holds the permutation for now)
+	RunThreads ( NumPoints(), getChunkCnt(), [&] ( int t, int start, int end ) {
+		uint* pgcell = m_Fluid.bufI(FGCELL);
+		uint* pgndx = m_Fluid.bufI(FGNDX);
+		for (int n=start; n < end; n++ ) {
+			if ( pgcell[n] != GRID_UNDEF )
+				mgrid [ mgoff[pgcell[n]] + pgndx[n] ] = n;
+			else
+				mgrid [ outsideOff[t] + pgndx[n] ] = n;
+		}
+	} );
+
+	// Atomic insert order is arbitrary, restore source order within each cell so results are reproducible
+	RunThreads ( m_GridTotal, m_NumThreads, [&] ( int t, int start, int end ) {
+		for (int c=start; c < end; c++ ) {
+			if ( mgcnt[c] > 1 )
+				std::sort ( mgrid + mgoff[c], mgrid + mgoff[c] + mgcnt[c] );
+		}
+	} );
+
+	// Gather particle data into sorted order
+	RunThreads ( NumPoints(), m_NumThreads, [&] ( int t, int start, int end ) {
+		Vector3DF* spos = m_Fluid.bufV3(FPOS);		Vector3DF* dpos = m_FluidTemp.bufV3(FPOS);
+		Vector3DF* svel = m_Fluid.bufV3(FVEL);		Vector3DF* dvel = m_FluidTemp.bufV3(FVEL);
+		Vector3DF* sveval = m_Fluid.bufV3(FVEVAL);	Vector3DF* dveval = m_FluidTemp.bufV3(FVEVAL);
+		Vector3DF* sforce = m_Fluid.bufV3(FFORCE);	Vector3DF* dforce = m_FluidTemp.bufV3(FFORCE);
+		float* spress = m_Fluid.bufF(FPRESS);		float* dpress = m_FluidTemp.bufF(FPRESS);
+		float* sdens = m_Fluid.bufF(FDENSITY);		float* ddens = m_FluidTemp.bufF(FDENSITY);
+		ushort* sage = (ushort*) m_Fluid.bufC(FAGE);	ushort* dage = (ushort*) m_FluidTemp.bufC(FAGE);
+		uint* sclr = m_Fluid.bufI(FCLR);			uint* dclr = m_FluidTemp.bufI(FCLR);
+		uint* sstate = m_Fluid.bufI(FSTATE);		uint* dstate = m_FluidTemp.bufI(FSTATE);
+		uint* sgcell = m_Fluid.bufI(FGCELL);		uint* dgcell = m_FluidTemp.bufI(FGCELL);
+		uint* dgndx = m_FluidTemp.bufI(FGNDX);
+
+		for (int n=start; n < end; n++ ) {
+			uint i = mgrid[n];
+			uint icell = sgcell[i];
+			dpos[n] = spos[i];
+			dvel[n] = svel[i];
+			dveval[n] = sveval[i];
+			dforce[n] = sforce[i];
+			dpress[n] = spress[i];
+			ddens[n] = sdens[i];
+			dage[n] = sage[i];
+			dclr[n] = sclr[i];
+			dstate[n] = sstate[i];
+			dgcell[n] = icell;
+			dgndx[n] = ( icell != GRID_UNDEF ) ? n - mgoff[icell] : 0;
+			mgrid[n] = n;						// full sort, grid indexing becomes identity
+		}
+	} );
+
+	for (int b=0; b < 11; b++ )
+		std::swap ( m_Fluid.mcpu[ sortBuf[b] ], m_FluidTemp.mcpu[ sortBuf[b] ] );
+}
+
+// Neighbor lists - built once from the sorted grid, reused across steps while every particle
+// has moved less than half of the Verlet skin (PNBR_SKIN, sim units). Skin 0 rebuilds every step.
+void FluidSystem::ReserveNeighbors ( int cnt )
+{
+	if ( cnt <= m_NeighborMax ) return;
+	m_NeighborMax = cnt + cnt / 4;
+	if ( m_NeighborTable != 0x0 )	free ( m_NeighborTable );
+	if ( m_NeighborDist != 0x0 )	free ( m_NeighborDist );
+	m_NeighborTable = (int*) malloc ( m_NeighborMax * sizeof(int) );
+	m_NeighborDist = (float*) malloc ( m_NeighborMax * sizeof(float) );
+}
+
+bool FluidSystem::NeedNeighborRebuild ()
+{
+	float skin = m_Param[PNBR_SKIN];
+	if ( skin <= 0 || m_NeighborRefPos == 0x0 || m_NeighborPnts != NumPoints() ) return true;
+
+	// Largest displacement since the last build (parallel max-reduction)
+	float limit = 0.5f * skin / m_Param[PSIMSCALE];
+	std::vector<float> maxMove ( m_NumThreads, 0 );
+	RunThreads ( NumPoints(), m_NumThreads, [&] ( int t, int start, int end ) {
+		Vector3DF* ppos = m_Fluid.bufV3(FPOS);
+		float dmax = 0, dx, dy, dz;
+		for (int i=start; i < end; i++ ) {
+			dx = ppos[i].x - m_NeighborRefPos[i].x;
+			dy = ppos[i].y - m_NeighborRefPos[i].y;
+			dz = ppos[i].z - m_NeighborRefPos[i].z;
+			dmax = std::max ( dmax, dx*dx + dy*dy + dz*dz );
+		}
+		maxMove[t] = dmax;
+	} );
+	float dmax = 0;
+	for (int t=0; t < m_NumThreads; t++ ) dmax = std::max ( dmax, maxMove[t] );
+
+	return dmax > limit*limit;
+}
+
+void FluidSystem::BuildNeighborsCPU ()
+{
+	float d = m_Param[PSIMSCALE];
+	float d2 = d*d;
+	float rb = m_Param[PSMOOTHRADIUS] + std::max ( 0.0f, m_Param[PNBR_SKIN] );
+	float rb2 = rb*rb;
+	Vector3DI ext;								// cells to search on each side
+	ext.x = (int) ceil ( rb / d * m_GridDelta.x );
+	ext.y = (int) ceil ( rb / d * m_GridDelta.y );
+	ext.z = (int) ceil ( rb / d * m_GridDelta.z );
+
+	int threads = std::max ( 1, std::min ( m_NumThreads, NumPoints() ) );
+	std::vector< std::vector<int> > tableNdx ( threads );
+	std::vector< std::vector<float> > tableDist ( threads );
+	std::vector<double> srchCnt ( threads, 0 );
+
+	RunThreads ( NumPoints(), threads, [&] ( int t, int start, int end ) {
+		Vector3DF* ppos =	m_Fluid.bufV3(FPOS);
+		uint* pgcell =		m_Fluid.bufI(FGCELL);
+		uint* pnbrndx =		m_Fluid.bufI(FNBRNDX);
+		uint* pnbrcnt =		m_Fluid.bufI(FNBRCNT);
+		uint* mgcnt =		m_Fluid.bufI(FGRIDCNT);
+		uint* mgoff =		m_Fluid.bufI(FGRIDOFF);
+		std::vector<int>& ndx = tableNdx[t];
+		std::vector<float>& dist = tableDist[t];
+		ndx.reserve ( m_NeighborNum / threads + 1024 );
+		dist.reserve ( m_NeighborNum / threads + 1024 );
+		Vector3DI gc;
+		Vector3DF ipos;
+		float dx, dy, dz, dsq;
+		xlong srch = 0;
+
+		for (int i=start; i < end; i++ ) {
+			pnbrndx[i] = (uint) ndx.size();
+			if ( pgcell[i] != GRID_UNDEF ) {
+				ipos = ppos[i];
+				gc = getCell ( pgcell[i] );
+				int x0 = std::max ( 0, gc.x - ext.x ), x1 = std::min ( m_GridRes.x - 1, gc.x + ext.x );
+				int y0 = std::max ( 0, gc.y - ext.y ), y1 = std::min ( m_GridRes.y - 1, gc.y + ext.y );
+				int z0 = std::max ( 0, gc.z - ext.z ), z1 = std::min ( m_GridRes.z - 1, gc.z + ext.z );
+				for (int y=y0; y <= y1; y++ ) {
+					for (int z=z0; z <= z1; z++ ) {
+						// sorted particles of a cell row [x0,x1] are one contiguous range
+						int row = (y*m_GridRes.z + z)*m_GridRes.x;
+						uint jfirst = mgoff[row + x0];
+						uint jlast = mgoff[row + x1] + mgcnt[row + x1];
+						for (uint j = jfirst; j < jlast; j++ ) {
+							if ( j == (uint) i ) continue;
+							dx = ipos.x - ppos[j].x;
+							dy = ipos.y - ppos[j].y;
+							dz = ipos.z - ppos[j].z;
+							dsq = d2*(dx*dx + dy*dy + dz*dz);
+							if ( dsq <= rb2 ) {
+								ndx.push_back ( j );
+								dist.push_back ( sqrt(dsq) );
+							}
+						}
+						srch += jlast - jfirst;
+					}
+				}
+			}
+			pnbrcnt[i] = (uint) ndx.size() - pnbrndx[i];
+		}
+		srchCnt[t] = double(srch);
+	} );
+
+	// Concatenate per-thread tables
+	std::vector<int> base ( threads );
+	int total = 0;
+	double srch = 0;
+	for (int t=0; t < threads; t++ ) {
+		base[t] = total;
+		total += (int) tableNdx[t].size();
+		srch += srchCnt[t];
+	}
+	ReserveNeighbors ( total );
+	m_NeighborNum = total;
+
+	if ( m_NeighborRefPos == 0x0 || m_NeighborRefMax < mMaxPoints ) {
+		if ( m_NeighborRefPos != 0x0 ) free ( m_NeighborRefPos );
+		m_NeighborRefPos = (Vector3DF*) malloc ( mMaxPoints * sizeof(Vector3DF) );
+		m_NeighborRefMax = mMaxPoints;
+	}
+
+	RunThreads ( NumPoints(), threads, [&] ( int t, int start, int end ) {
+		if ( !tableNdx[t].empty() ) {
+			memcpy ( m_NeighborTable + base[t], &tableNdx[t][0], tableNdx[t].size() * sizeof(int) );
+			memcpy ( m_NeighborDist + base[t], &tableDist[t][0], tableDist[t].size() * sizeof(float) );
+		}
+		uint* pnbrndx = m_Fluid.bufI(FNBRNDX);
+		for (int i=start; i < end; i++ )
+			pnbrndx[i] += base[t];
+		memcpy ( m_NeighborRefPos + start, m_Fluid.bufV3(FPOS) + start, (end - start) * sizeof(Vector3DF) );
+	} );
+
+	m_NeighborPnts = NumPoints();
+	m_NeighborFresh = true;
+	m_Param [ PSTAT_SRCH ] = float(srch);
+	if ( m_Param[PSTAT_SRCH] > m_Param [ PSTAT_SRCHMAX ] ) m_Param [ PSTAT_SRCHMAX ] = m_Param[PSTAT_SRCH];
+}
+
+// Compute Pressures - Cached neighbor lists. Distances are recomputed when lists are reused (Verlet skin).
+void FluidSystem::ComputePressureNbrCPU ()
+{
+	float d2 = m_Param[PSIMSCALE] * m_Param[PSIMSCALE];
+	float r2 = m_R2;
+	float mass = m_Param[PMASS] * m_Poly6Kern;
+	float rest = m_Param[PRESTDENSITY];
+	float istiff = m_Param[PINTSTIFF];
+	bool fresh = m_NeighborFresh;
+	std::vector<double> nbrCnt ( m_NumThreads, 0 );
+
+	RunThreads ( NumPoints(), m_NumThreads, [&] ( int t, int start, int end ) {
+		Vector3DF* ppos =	m_Fluid.bufV3(FPOS);
+		float* ppress =		m_Fluid.bufF(FPRESS);
+		float* pdensity =	m_Fluid.bufF(FDENSITY);
+		uint* pnbrndx =		m_Fluid.bufI(FNBRNDX);
+		uint* pnbrcnt =		m_Fluid.bufI(FNBRCNT);
+		uint* pgcell =		m_Fluid.bufI(FGCELL);
+		Vector3DF ipos;
+		float dx, dy, dz, dsq, c, sum;
+		xlong nbr = 0;
+
+		for (int i=start; i < end; i++ ) {
+			if ( pgcell[i] == GRID_UNDEF ) continue;
+			sum = 0.0;
+			int* jndx = m_NeighborTable + pnbrndx[i];
+			float* jdist = m_NeighborDist + pnbrndx[i];
+			int jcnt = pnbrcnt[i];
+			if ( fresh ) {
+				for (int n=0; n < jcnt; n++ ) {
+					dsq = jdist[n]*jdist[n];
+					if ( dsq <= r2 ) {			// lists built with a skin also hold pairs beyond the radius
+						c = r2 - dsq;
+						sum += c * c * c;
+						nbr++;
+					}
+				}
+			} else {
+				ipos = ppos[i];
+				for (int n=0; n < jcnt; n++ ) {
+					dx = ipos.x - ppos[jndx[n]].x;
+					dy = ipos.y - ppos[jndx[n]].y;
+					dz = ipos.z - ppos[jndx[n]].z;
+					dsq = d2*(dx*dx + dy*dy + dz*dz);
+					if ( dsq <= r2 ) {
+						c = r2 - dsq;
+						sum += c * c * c;
+						nbr++;
+					}
+				}
+			}
+			sum *= mass;
+			if ( sum == 0.0 ) sum = 1.0;
+			ppress[i] = ( sum - rest ) * istiff;
+			pdensity[i] = 1.0f / sum;
+		}
+		nbrCnt[t] = double(nbr);
+	} );
+
+	double nbr = 0;
+	for (int t=0; t < m_NumThreads; t++ ) nbr += nbrCnt[t];
+	m_Param [ PSTAT_NBR ] = float(nbr);
+	if ( m_Param[PSTAT_NBR] > m_Param [ PSTAT_NBRMAX ] ) m_Param [ PSTAT_NBRMAX ] = m_Param[PSTAT_NBR];
+}
+
+// Compute Forces - Cached neighbor lists
+void FluidSystem::ComputeForceNbrCPU ()
+{
+	float d = m_Param[PSIMSCALE];
+	float d2 = d*d;
+	float r2 = m_R2;
+	float mR = m_Param[PSMOOTHRADIUS];
+	float pkern = d * -0.5f * m_SpikyKern;
+	float vterm = m_LapKern * m_Param[PVISC];
+	bool fresh = m_NeighborFresh;
+
+	RunThreads ( NumPoints(), m_NumThreads, [&] ( int t, int start, int end ) {
+		Vector3DF* ppos =	m_Fluid.bufV3(FPOS);
+		Vector3DF* pveleval = m_Fluid.bufV3(FVEVAL);
+		Vector3DF* pforce =	m_Fluid.bufV3(FFORCE);
+		float* ppress =		m_Fluid.bufF(FPRESS);
+		float* pdensity =	m_Fluid.bufF(FDENSITY);
+		uint* pnbrndx =		m_Fluid.bufI(FNBRNDX);
+		uint* pnbrcnt =		m_Fluid.bufI(FNBRCNT);
+		Vector3DF force, ipos, iveleval;
+		float dx, dy, dz, dsq, dist, c, pterm, dterm, ipress, idensity;
+
+		for (int i=start; i < end; i++ ) {
+			force.Set ( 0, 0, 0 );
+			ipos = ppos[i];
+			iveleval = pveleval[i];
+			ipress = ppress[i];
+			idensity = pdensity[i];
+			int* jndx = m_NeighborTable + pnbrndx[i];
+			float* jdist = m_NeighborDist + pnbrndx[i];
+			int jcnt = pnbrcnt[i];
+
+			for (int n=0; n < jcnt; n++ ) {
+				int j = jndx[n];
+				dx = ( ipos.x - ppos[j].x );		// dist in cm
+				dy = ( ipos.y - ppos[j].y );
+				dz = ( ipos.z - ppos[j].z );
+				if ( fresh ) {
+					dist = jdist[n];
+					if ( dist*dist > r2 ) continue;
+				} else {
+					dsq = d2*(dx*dx + dy*dy + dz*dz);
+					if ( dsq > r2 ) continue;
+					dist = sqrt(dsq);
+				}
+				if ( dist <= 0 ) continue;
+				c = (mR-dist);
+				pterm = pkern * c * ( ipress + ppress[j] ) / dist;
+				dterm = c * idensity * pdensity[j];
+				force.x += ( pterm * dx + vterm * ( pveleval[j].x - iveleval.x) ) * dterm;
+				force.y += ( pterm * dy + vterm * ( pveleval[j].y - iveleval.y) ) * dterm;
+				force.z += ( pterm * dz + vterm * ( pveleval[j].z - iveleval.z) ) * dterm;
+			}
+			pforce[i] = force;
+		}
+	} );
+
+	m_NeighborFresh = false;			// positions advance after this, stored distances go stale
+}
+
+//---------------------------------------------------------------- SIMD CPU kernels (RUN_CPU_SIMD)
+// The kernels themselves are in fluid_simd_kernels.h, built per ISA and picked at run time.
+
+Vector3DI FluidSystem::getSearchExtent ( float radius )
+{
+	Vector3DI ext;								// cells to search on each side, radius in sim units
+	float d = m_Param[PSIMSCALE];
+	ext.x = (int) ceil ( radius / d * m_GridDelta.x );
+	ext.y = (int) ceil ( radius / d * m_GridDelta.y );
+	ext.z = (int) ceil ( radius / d * m_GridDelta.z );
+	return ext;
+}
+
+std::string FluidSystem::getSIMDStr ()
+{
+	char buf[64];
+	sprintf ( buf, "%s, %d-wide", m_SIMD.name, m_SIMD.width );
+	return buf;
+}
+
+SIMDGrid FluidSystem::getSIMDGrid ()
+{
+	SIMDGrid g;
+	Vector3DI ext = getSearchExtent ( m_Param[PSMOOTHRADIUS] );
+	g.soa = m_SoA;
+	g.gcell = m_Fluid.bufI(FGCELL);
+	g.gcnt = m_Fluid.bufI(FGRIDCNT);
+	g.goff = m_Fluid.bufI(FGRIDOFF);
+	g.res[0] = m_GridRes.x;		g.res[1] = m_GridRes.y;		g.res[2] = m_GridRes.z;
+	g.ext[0] = ext.x;			g.ext[1] = ext.y;			g.ext[2] = ext.z;
+	g.d2 = m_Param[PSIMSCALE] * m_Param[PSIMSCALE];
+	g.r2 = m_R2;
+	return g;
+}
+
+void FluidSystem::AllocateSoA ( int cnt )
+{
+	if ( cnt <= m_SoAMax ) return;
+	for (int n=0; n < SOA_MAX; n++ ) {
+		if ( m_SoABase[n] != 0x0 ) free ( m_SoABase[n] );
+		m_SoABase[n] = (char*) malloc ( (cnt + SIMD_PAD) * sizeof(float) + SIMD_ALIGN );
+		m_SoA[n] = (float*) ( ( (size_t) m_SoABase[n] + SIMD_ALIGN - 1 ) & ~ (size_t) (SIMD_ALIGN - 1) );
+	}
+	m_SoAMax = cnt;
+}
+
+void FluidSystem::TransferToSoA ( bool bPos, bool bVel )
+{
+	AllocateSoA ( mMaxPoints );
+	RunThreads ( NumPoints(), m_NumThreads, [&] ( int t, int start, int end ) {
+		Vector3DF* ppos = m_Fluid.bufV3(FPOS);
+		Vector3DF* pveleval = m_Fluid.bufV3(FVEVAL);
+		for (int n=start; n < end; n++ ) {
+			if ( bPos ) {
+				m_SoA[SOA_POSX][n] = ppos[n].x;
+				m_SoA[SOA_POSY][n] = ppos[n].y;
+				m_SoA[SOA_POSZ][n] = ppos[n].z;
+			}
+			if ( bVel ) {
+				m_SoA[SOA_VELX][n] = pveleval[n].x;
+				m_SoA[SOA_VELY][n] = pveleval[n].y;
+				m_SoA[SOA_VELZ][n] = pveleval[n].z;
+			}
+		}
+	} );
+}
+
+void FluidSystem::ComputePressureSIMD ()
+{
+	float mass = m_Param[PMASS] * m_Poly6Kern;
+	float rest = m_Param[PRESTDENSITY];
+	float istiff = m_Param[PINTSTIFF];
+	std::vector<float> nbrCnt ( m_NumThreads, 0 );
+
+	TransferToSoA ( true, true );
+	SIMDGrid g = getSIMDGrid ();
+
+	RunThreads ( NumPoints(), m_NumThreads, [&] ( int t, int start, int end ) {
+		m_SIMD.pressure ( g, start, end, mass, rest, istiff, m_Fluid.bufF(FPRESS), m_Fluid.bufF(FDENSITY), nbrCnt[t] );
+	} );
+
+	double nbr = 0;
+	for (int t=0; t < m_NumThreads; t++ ) nbr += nbrCnt[t];
+	m_Param [ PSTAT_NBR ] = float(nbr);
+	if ( m_Param[PSTAT_NBR] > m_Param [ PSTAT_NBRMAX ] ) m_Param [ PSTAT_NBRMAX ] = m_Param[PSTAT_NBR];
+}
+
+void FluidSystem::ComputeForceSIMD ()
+{
+	float d = m_Param[PSIMSCALE];
+	float mR = m_Param[PSMOOTHRADIUS];
+	float pkern = d * -0.5f * m_SpikyKern;
+	float vterm = m_LapKern * m_Param[PVISC];
+
+	// Pressure and density are already separate float buffers, alias them as SoA streams
+	m_SoA[SOA_PRESS] = m_Fluid.bufF(FPRESS);
+	m_SoA[SOA_DENSITY] = m_Fluid.bufF(FDENSITY);
+	SIMDGrid g = getSIMDGrid ();
+
+	RunThreads ( NumPoints(), m_NumThreads, [&] ( int t, int start, int end ) {
+		m_SIMD.force ( g, start, end, mR, pkern, vterm, m_Fluid.bufF(FPRESS), m_Fluid.bufF(FDENSITY), (float*) m_Fluid.bufV3(FFORCE) );
+	} );
+
+	m_SoA[SOA_PRESS] = 0x0;
+	m_SoA[SOA_DENSITY] = 0x0;
+}
+
+// Particles/second of the CPU grid pipeline vs. the SIMD pipeline, same scene and step count
+void FluidSystem::BenchmarkCPU ( int num, int steps )
+{
+	float ms[2];
+	int mode[2] = { RUN_CPU_GRID, RUN_CPU_SIMD };
+	float skin = m_Param[PNBR_SKIN];		// the benchmark runs without neighbor lists
+
+	nvprintf ( "CPU BENCHMARK: %d particles, %d steps, %d threads, %s\n", num, steps, m_NumThreads, getSIMDStr().c_str() );
+	for (int m=0; m < 2; m++ ) {
+		srand ( 2564 );
+		Start ( num );
+		m_Param[PMODE] = (float) mode[m];
+		m_Param[PNBR_SKIN] = 0;
+		Run ();							// warm up, first-touch allocations
+		PERF_START ();
+		for (int s=0; s < steps; s++ )
+			Run ();
+		ms[m] = PERF_STOP ();
+		nvprintf ( "  %-24s %10.2f ms/step  %14.0f particles/sec\n", getModeStr().c_str(), ms[m] / steps, double(NumPoints()) * steps / (ms[m] / 1000.0) );
+	}
+	nvprintf ( "  Speedup: %.2fx\n", ms[0] / ms[1] );
+	m_Param[PNBR_SKIN] = skin;
+}
+
+void FluidSystem::AdvanceCPU ()
+{
+	RunThreads ( NumPoints(), m_NumThreads, [this] ( int t, int start, int end ) {
+		AdvanceRange ( start, end );
+	} );
+}
+
+//---------------------------------------------------------------- Adaptive time stepping
+bool FluidSystem::isAdaptive ()
+{
+	int mode = (int) m_Param[PMODE];
+	return m_Toggle[PADAPT_DT] && ( mode == RUN_CPU_GRID || mode == RUN_CPU_SIMD );
+}
+
+// Largest stable step for the current velocities and forces:
+//   CFL		dt < cfl * h / (c + |v|max)		c = sqrt(PINTSTIFF), sound speed of the pressure equation
+//   force		dt < 0.25 * sqrt ( h / |a|max )
+//   viscosity	dt < 0.125 * h^2 / nu			nu = PVISC / PRESTDENSITY
+//   walls		dt < cfl * 2 / sqrt(PEXTSTIFF)	boundary penalties are stiff springs
+float FluidSystem::ComputeStableDT ()
+{
+	std::vector<float> vmax ( m_NumThreads, 0 ), fmax ( m_NumThreads, 0 );
+
+	RunThreads ( NumPoints(), m_NumThreads, [&] ( int t, int start, int end ) {
+		Vector3DF* pvel =	m_Fluid.bufV3(FVEL);
+		Vector3DF* pforce =	m_Fluid.bufV3(FFORCE);
+		uint* pcell =		m_Fluid.bufI(FGCELL);
+		float v2 = 0, f2 = 0, d;
+		for (int n=start; n < end; n++ ) {
+			if ( pcell[n] == GRID_UNDEF ) continue;
+			d = pvel[n].x*pvel[n].x + pvel[n].y*pvel[n].y + pvel[n].z*pvel[n].z;
+			if ( d > v2 ) v2 = d;
+			d = pforce[n].x*pforce[n].x + pforce[n].y*pforce[n].y + pforce[n].z*pforce[n].z;
+			if ( d > f2 ) f2 = d;
+		}
+		vmax[t] = v2;
+		fmax[t] = f2;
+	} );
+	float v2 = *std::max_element ( vmax.begin(), vmax.end() );
+	float f2 = *std::max_element ( fmax.begin(), fmax.end() );
+
+	float h = m_Param[PSMOOTHRADIUS];
+	float cfl = m_Param[PCFL];
+	float vel = std::min ( sqrtf(v2), m_Param[PVEL_LIMIT] );				// Advance clamps to these limits
+	float accel = sqrtf(f2) * m_Param[PMASS] + (float) m_Vec[PPLANE_GRAV_DIR].Length() * m_Param[PGRAV];
+	accel = std::min ( accel, m_Param[PACCEL_LIMIT] );
+
+	float dt = cfl * h / ( sqrtf(m_Param[PINTSTIFF]) + vel );
+	if ( accel > 0 )				dt = std::min ( dt, 0.25f * sqrtf ( h / accel ) );
+	if ( m_Param[PVISC] > 0 )		dt = std::min ( dt, 0.125f * h*h * m_Param[PRESTDENSITY] / m_Param[PVISC] );
+	if ( m_Param[PEXTSTIFF] > 0 )	dt = std::min ( dt, cfl * 2.0f / sqrtf(m_Param[PEXTSTIFF]) );
+
+	return std::max ( m_Param[PDT_MIN], std::min ( dt, m_Param[PDT_MAX] ) );
+}
+
+// Called between the force and advance passes, so the step is chosen from current forces.
+// When sub-stepping an output frame, the last two steps split the remainder evenly
+// rather than ending on a sliver.
+void FluidSystem::AdaptTimeStep ()
+{
+	if ( !isAdaptive () ) return;
+
+	float dt = ComputeStableDT ();
+	m_Param[PSTAT_DT] = dt;
+
+	if ( m_FrameRemain > 0 ) {
+		if ( dt >= m_FrameRemain ) {
+			dt = (float) m_FrameRemain;
+			m_FrameRemain = 0;
+		} else {
+			if ( 2*dt > m_FrameRemain ) dt = (float) (m_FrameRemain * 0.5);
+			m_FrameRemain -= dt;
+		}
+	}
+	m_StepDT = dt;						// m_DT keeps the configured fixed step
+}
+
+// Adaptive stepping runs on the CPU pathways. Turning it on from the CUDA pathway moves the
+// simulation to the CPU grid and keeps the GPU positions and colors current each frame;
+// turning it off hands the state back to CUDA.
+void FluidSystem::SetAdaptive ( bool on, float frame_dt )
+{
+	int mode = (int) m_Param[PMODE];
+	m_Param[PFRAME_DT] = frame_dt;
+	if ( on == m_Toggle[PADAPT_DT] ) return;
+	m_Toggle[PADAPT_DT] = on;
+
+	if ( on && mode == RUN_GPU_FULL ) {
+		TransferFromCUDA ();
+		cuCheck ( cuMemcpyDtoH ( m_Fluid.bufC(FVEVAL), m_Fluid.gpu(FVEVAL), mNumPoints *sizeof(float)*3 ), "SetAdaptive", "cuMemcpyDtoH", "FVEVAL", mbDebug );
+		ClearNeighborTable ();
+		m_Param[PMODE] = RUN_CPU_GRID;
+		m_bAdaptFromGPU = true;
+	} else if ( !on && m_bAdaptFromGPU ) {
+		TransferToCUDA ();
+		m_Param[PMODE] = RUN_GPU_FULL;
+		m_bAdaptFromGPU = false;
+	}
+}
+
 void FluidSystem::SetupRender ()
 {
 	glEnable ( GL_TEXTURE_2D );
@@ -1748,17 +2508,50 @@ void FluidSystem::Draw ( int frame, Camera3D& cam, float rad )
 void FluidSystem::StartRecord ()
 {
 	mbRecord = !mbRecord;	
+	if ( !mbRecord ) m_Cache.Close ();
 }
 void FluidSystem::StartRecordBricks ()
 {
 	mbRecordBricks = !mbRecordBricks;
 }
 
+static bool hasExtension ( const std::string& name, const char* ext )
+{
+	size_t len = strlen ( ext );
+	return name.size() >= len && name.compare ( name.size() - len, len, ext ) == 0;
+}
+
+// Recorded points file: the in/out file when set, otherwise the default cache
+std::string FluidSystem::getPointsName ( bool bIn, int frame )
+{
+	std::string name = bIn ? m_InFile : m_OutFile;
+	if ( name.empty() ) return "jet.pcache";
+	return getResolvedName ( bIn, frame );
+}
+
 void FluidSystem::SavePoints ( int frame )
 {
-	char buf[256];
-	sprintf ( buf, "jet%04d.pts", frame );
-	FILE* fp = fopen ( buf, "wb" );
+	std::string name = getPointsName ( false, frame );
+
+	// Sequence of .pts files, one uncompressed file per frame
+	if ( hasExtension ( name, ".pts" ) ) {
+		SavePointsPTS ( name );
+		return;
+	}
+	// Particle cache, written on a background thread
+	if ( !m_Cache.isWriting() || m_Cache.getName() != name ) {
+		if ( !m_Cache.OpenWrite ( name ) ) { mbRecord = false; return; }
+	}
+	m_Cache.PushFrame ( frame, NumPoints(), m_Fluid.bufV3(FPOS), m_Fluid.bufV3(FVEL), m_Fluid.bufI(FCLR) );
+}
+
+void FluidSystem::SavePointsPTS ( std::string name )
+{
+	FILE* fp = fopen ( name.c_str(), "wb" );
+	if ( fp == 0x0 ) {
+		nvprintf ( "ERROR: Creating %s\n", name.c_str() );
+		return;
+	}
 
 	int numpnt = NumPoints();
 	int numfield = 3;
@@ -1786,8 +2579,6 @@ void FluidSystem::SavePoints ( int frame )
 	fwrite ( m_Fluid.bufC(FCLR),  numpnt*sizeof(unsigned char)*4, 1, fp );
 
 	fclose ( fp );
-
-	fflush ( fp );
 }
 
 float FluidSystem::Sample ( Vector3DF p )
@@ -2024,7 +2815,7 @@ std::string FluidSystem::getResolvedName ( bool bIn, int frame )
 		}
 	}
 
-	if ( datastr.at(1) != ':' ) {		
+	if ( datastr.size() < 2 || datastr.at(1) != ':' ) {		
 		datastr = m_WorkPath + datastr;		// use relative path
 	}
 	
@@ -2033,13 +2824,15 @@ std::string FluidSystem::getResolvedName ( bool bIn, int frame )
 
 void FluidSystem::RunPlayback ()
 {	
-	char buf[1024];
-	sprintf ( buf, "%s", getResolvedName ( true, m_Frame).c_str() );	// input filename
-	
+	std::string name = getPointsName ( true, m_Frame );		// input filename
+	if ( !hasExtension ( name, ".pts" ) ) {
+		RunPlaybackCache ( name );
+		return;
+	}
 
-	FILE* fp = fopen ( buf, "rb" );
+	FILE* fp = fopen ( name.c_str(), "rb" );
 	if ( fp == 0x0 ) {
-		nvprintf ( "WARNING: File not found %s\n", buf );
+		nvprintf ( "WARNING: File not found %s\n", name.c_str() );
 		return;
 	}
 
@@ -2087,6 +2880,27 @@ void FluidSystem::RunPlayback ()
 
 }
 
+void FluidSystem::RunPlaybackCache ( std::string name )
+{
+	if ( !m_Cache.isReading() || m_Cache.getName() != name ) {
+		if ( !m_Cache.OpenRead ( name ) ) return;
+	}
+	int slot = m_Cache.FindFrame ( m_Frame );
+	if ( slot < 0 ) {
+		nvprintf ( "WARNING: Frame %d not in %s\n", m_Frame, name.c_str() );
+		return;
+	}
+	mNumPoints = m_Cache.getFramePoints ( slot );
+
+	if ( mNumPoints > mMaxPoints ) {
+		m_Param [PNUM] = (float) mNumPoints;
+		AllocateParticles ( mNumPoints );
+		FluidSetupCUDA ( NumPoints(), m_GridSrch, *(int3*)& m_GridRes, *(float3*)& m_GridSize, *(float3*)& m_GridDelta, *(float3*)& m_GridMin, *(float3*)& m_GridMax, m_GridTotal, (int) m_Vec[PEMIT_RATE].x );		
+	}
+	if ( !m_Cache.ReadFrame ( slot, m_Fluid.bufV3(FPOS), m_Fluid.bufV3(FVEL), m_Fluid.bufI(FCLR) ) )
+		nvprintf ( "ERROR: Corrupt frame %d in %s\n", m_Frame, name.c_str() );
+}
+
 
 
 std::string FluidSystem::getModeStr ()
@@ -2098,6 +2912,7 @@ std::string FluidSystem::getModeStr ()
 	case RUN_VALIDATE:		sprintf ( buf, "VALIDATE GPU to CPU");		break;
 	case RUN_CPU_SLOW:		sprintf ( buf, "SIMULATE CPU Slow");		break;
 	case RUN_CPU_GRID:		sprintf ( buf, "SIMULATE CPU Grid");		break;	
+	case RUN_CPU_SIMD:		sprintf ( buf, "SIMULATE CPU SIMD (%s)", getSIMDStr().c_str() );	break;
 	case RUN_GPU_FULL:		sprintf ( buf, "SIMULATE CUDA Full Sort" );	break;	
 	case RUN_PLAYBACK:		sprintf ( buf, "PLAYBACK" ); break;
 	};
@@ -2234,6 +3049,7 @@ void FluidSystem::SetupDefaultParams ()
 
 	m_Time = 0.0f;							// Start at T=0
 	m_DT = 0.003f;	
+	m_StepDT = m_DT;
 
 	m_Param [ PSIMSCALE ] =		0.005f;			// unit size
 	m_Param [ PVISC ] =			0.50f;			// pascal-second (Pa.s) = 1 kg m^-1 s^-1  (see wikipedia page on viscosity)
@@ -2255,6 +3071,12 @@ void FluidSystem::SetupDefaultParams ()
 	m_Param [ PFORCE_MIN ] =	0.0f;
 	m_Param [ PFORCE_MAX ] =	0.0f;
 	m_Param [ PFORCE_FREQ ] =	16.0f;
+	m_Param [ PNBR_SKIN ] =		0.0f;			// m, Verlet skin for CPU neighbor lists (0 = rebuild every step)
+	m_Param [ PCFL ] =			0.4f;			// Courant number for adaptive steps
+	m_Param [ PDT_MIN ] =		0.0001f;		// s
+	m_Param [ PDT_MAX ] =		0.01f;			// s
+	m_Param [ PFRAME_DT ] =		0.0f;			// s, output frame time (0 = one adaptive step per Run)
+	m_Toggle [ PADAPT_DT ] = false;
 	m_Toggle [ PWRAP_X ] = false;
 	m_Toggle [ PWALL_BARRIER ] = false;
 	m_Toggle [ PLEVY_BARRIER ] = false;
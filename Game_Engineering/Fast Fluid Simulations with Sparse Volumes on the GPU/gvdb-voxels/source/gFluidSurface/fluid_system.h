@@ -12,6 +12,7 @@
 
 	#include <iostream>
 	#include <vector>
+	#include <atomic>
 	#include <stdio.h>
 	#include <stdlib.h>
 	#include <math.h>	
@@ -19,9 +20,11 @@
 	#include "fluid.h"
 	#include "gvdb_vec.h"
 	#include "gvdb_camera.h"
+	#include "particle_cache.h"
+	#include "fluid_simd.h"					// SOA_* streams, SIMD kernels
 	using namespace nvdb;
 
-	#define MAX_PARAM			50
+	#define MAX_PARAM			64
 	#define GRID_UCHAR			0xFF
 	#define GRID_UNDEF			4294967295	
 
@@ -38,6 +41,7 @@
 	#define RUN_CPU_GRID		4	
 	#define RUN_GPU_FULL		5
 	#define RUN_PLAYBACK		6
+	#define RUN_CPU_SIMD		7
 
 	// Scalar params
 	#define PMODE				0
@@ -88,6 +92,13 @@
 	#define PTIME_TOGPU			45
 	#define PTIME_FROMGPU		46
 	#define PFORCE_FREQ			47	
+	#define PNBR_SKIN			48
+	#define PCFL				49
+	#define PDT_MIN				50
+	#define PDT_MAX				51
+	#define PFRAME_DT			52
+	#define PSTAT_DT			53
+	#define PSTAT_SUBSTEPS		54
 
 	// Vector params
 	#define PVOLMIN				0
@@ -116,6 +127,7 @@
 	#define PPLANE_GRAV_ON		11	
 	#define PPROFILE			12
 	#define PCAPTURE			13
+	#define PADAPT_DT			14
 
 	#define BFLUID				2
 
@@ -198,11 +210,14 @@
 
 		// Simulation
 		void Run ();		
+		void RunStep ();
 		void ValidateCUDA ();		
 		void RunPlayback ();
+		void RunPlaybackCache ( std::string name );
 		void AdvanceTime ();
 		
 		void Advance ();
+		void AdvanceRange ( int start, int end );
 		void EmitParticles ();
 		void Exit ();
 		void TransferToCUDA ();
@@ -211,6 +226,13 @@
 		float Sample ( Vector3DF p );
 		double GetDT()		{ return m_DT; }
 
+		// Adaptive time stepping (CPU grid and SIMD modes)
+		bool isAdaptive ();
+		void SetAdaptive ( bool on, float frame_dt );		// frame_dt: output frame time, 0 = one step per Run
+		float ComputeStableDT ();
+		void AdaptTimeStep ();
+		double GetStepDT()	{ return m_StepDT; }
+
 		// Debugging
 		void SaveResults ();
 		void CaptureVideo (int width, int height);
@@ -246,6 +268,30 @@
 		void ComputeForceGrid ();				// O(kn) - spatial grid
 		void ComputeForceGridNC ();				// O(cn) - neighbor table		
 
+		// Multi-threaded CPU pathway (RUN_CPU_GRID), mirrors the CUDA counting sort
+		void SetNumThreads ( int n );
+		int getNumThreads ()		{ return m_NumThreads; }
+		int getChunkCnt ();
+		void InsertParticlesCPU ();
+		void PrefixSumCellsCPU ();
+		void CountingSortFullCPU ();
+		void AdvanceCPU ();
+		bool NeedNeighborRebuild ();
+		void ReserveNeighbors ( int cnt );
+		void BuildNeighborsCPU ();
+		void ComputePressureNbrCPU ();			// O(cn) - cached neighbor lists
+		void ComputeForceNbrCPU ();
+
+		// SIMD CPU pathway (RUN_CPU_SIMD), AVX-512, AVX2 or scalar kernels picked at run time
+		Vector3DI getSearchExtent ( float radius );
+		std::string getSIMDStr ();
+		SIMDGrid getSIMDGrid ();
+		void AllocateSoA ( int cnt );
+		void TransferToSoA ( bool bPos, bool bVel );
+		void ComputePressureSIMD ();
+		void ComputeForceSIMD ();
+		void BenchmarkCPU ( int num, int steps );
+
 		void FluidSetupCUDA (  int num, int gsrch, int3 res, float3 size, float3 delta, float3 gmin, float3 gmax, int total, int chk );
 		void FluidParamCUDA ( float ss, float sr, float pr, float mass, float rest, float3 bmin, float3 bmax, float estiff, float istiff, float visc, float damp, float fmin, float fmax, float ffreq, float gslope, float gx, float gy, float gz, float al, float vl, int emit );
 
@@ -271,6 +317,8 @@
 		void StartRecordBricks ();
 		void StartPlayback ();
 		void SavePoints ( int frame );
+		void SavePointsPTS ( std::string name );
+		std::string getPointsName ( bool bIn, int frame );
 		void SaveBricks ( int frame );
 
 		int getMode ()		{ return (int) m_Param[PMODE]; }
@@ -319,8 +367,11 @@
 
 		// Time
 		int							m_Frame;		
-		float						m_DT;
-		float						m_Time;	
+		float						m_DT;					// configured fixed step
+		float						m_StepDT;				// step in use, m_DT or the adaptive step
+		bool						m_bAdaptFromGPU;		// adaptive CPU stepping entered from RUN_GPU_FULL
+		float						m_Time;
+		double						m_FrameRemain;			// simulated time left in the output frame (adaptive)	
 
 		// CUDA Kernels
 		CUmodule					m_Module;
@@ -357,17 +408,34 @@
 		int						m_GridAdjCnt;
 		int						m_GridAdj[216];
 
+		// Multi-threaded CPU sort
+		int						m_NumThreads;
+		std::atomic<uint>*		m_GridCntAtomic;		// per-cell insert counters
+		std::vector<uint>		m_ChunkOutside;			// out-of-grid particles per insert chunk
+		uint					m_GridInside;			// particles inside the grid after insert
+
+		// SIMD structure-of-arrays copies of FPOS/FVEVAL
+		float*					m_SoA[SOA_DENSITY+1];	// aligned streams
+		char*					m_SoABase[SOA_MAX];		// allocations
+		int						m_SoAMax;
+		SIMDKernels				m_SIMD;					// kernels for this CPU
+
 		// Acceleration Neighbor Table
 		int						m_NeighborNum;
 		int						m_NeighborMax;
 		int*					m_NeighborTable;
 		float*					m_NeighborDist;
+		Vector3DF*				m_NeighborRefPos;		// positions at last build (Verlet skin test)
+		int						m_NeighborRefMax;
+		int						m_NeighborPnts;
+		bool					m_NeighborFresh;		// stored distances match current positions
 
 		int						mVBO[3];
 
 		// Record/Playback
 		bool					mbRecord;		
 		bool					mbRecordBricks;
+		ParticleCache			m_Cache;				// .pcache recording and playback
 		int						mSpherePnts;
 		int						mTex[1];		
 
@@ -44,6 +44,7 @@ public:
 	virtual void shutdown() override;
 
 	void		info(int id);
+	void		export_mesh ();		// write fluid surface of the current frame
 	void		draw_fluid ();		// draw fluid system
 	void		draw_topology ();	// draw gvdb topology
 	void		simulate ();		// simulation material deposition
@@ -66,6 +67,7 @@ public:
 	int			gl_screen_tex;
 	int			mouse_down;	
 	float		m_time;				// simulation time	
+	float		m_frame_dt;			// simulated time per displayed frame with adaptive steps
 	bool		m_show_gui;
 	bool		m_render_optix;
 	bool		m_show_fluid;	
@@ -191,6 +193,7 @@ bool Sample::init()
 	mouse_down = -1;
 	gl_screen_tex = -1;
 	m_time = 0;	
+	m_frame_dt = 1.0f / 60.0f;
 	m_simulate = true;
 	m_show_gui = true;
 	m_show_fluid = false;
@@ -247,6 +250,14 @@ bool Sample::init()
 	#endif
 
 	fluid.Initialize ();
+
+	#ifdef TEST_CPUBENCH
+		fluid.BenchmarkCPU ( 100000, 10 );
+		fluid.BenchmarkCPU ( 1000000, 10 );
+		fluid.BenchmarkCPU ( 4000000, 5 );
+		exit(-2);
+	#endif
+
 	fluid.Start ( m_numpnts );
 
 	Vector3DF ctr = (fluid.GetGridMax() + fluid.GetGridMin()) * Vector3DF(0.5,0.5,0.5);
@@ -498,6 +509,14 @@ void Sample::info (int id)
 	nvprintf("%d: %d,%d,%d\n", id, val.x, val.y, val.z);
 }
 
+void Sample::export_mesh ()
+{
+	char fname[256];
+	sprintf ( fname, "fluid_surface_%04d.obj", m_frame );
+	if ( gvdb.WriteMesh ( fname, 0, gvdb.getScene()->mVThreshold.x ) )
+		nvprintf ( "Wrote %s\n", fname );
+}
+
 void Sample::keyboardchar(unsigned char key, int mods, int x, int y)
 {
 	switch ( key ) {
@@ -509,6 +528,11 @@ void Sample::keyboardchar(unsigned char key, int mods, int x, int y)
 	case ' ':  m_simulate = !m_simulate; break;
 	case ',': m_id--; info(m_id);  break;
 	case '.': m_id++; info(m_id);  break;
+	case 'm': export_mesh(); break;
+	case 'a':					// adaptive CFL sub-steps, m_frame_dt of simulated time per frame
+		fluid.SetAdaptive ( !fluid.GetToggle(PADAPT_DT), m_frame_dt );
+		nvprintf ( "Adaptive time step %s (%s)\n", fluid.GetToggle(PADAPT_DT) ? "on" : "off", fluid.getModeStr().c_str() );
+		break;
 	};
 }
 
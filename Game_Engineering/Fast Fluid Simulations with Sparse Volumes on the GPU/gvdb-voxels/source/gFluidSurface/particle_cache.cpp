@@ -0,0 +1,454 @@
+//-----------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+//-----------------------------------------------------------------------------
+
+#include <string.h>
+#include <math.h>
+#include "main.h"
+#include "particle_cache.h"
+#include "gvdb_compress.h"
+
+#ifdef _WIN32
+	#define pc_fseek		_fseeki64
+	#define pc_ftell		_ftelli64
+#else
+	#define pc_fseek		fseeko
+	#define pc_ftell		ftello
+#endif
+
+#define PCACHE_POS_BITS		16
+#define PCACHE_VEL_BITS		16
+
+ParticleCache::ParticleCache ()
+{
+	m_File = 0x0;
+	m_Mode = 0;
+	m_Offset = 0;
+	m_RawBytes = 0;
+	m_FileBytes = 0;
+	m_Quit = false;
+	m_MaxQueue = 4;
+	m_Request = -1;
+	m_ReadySlot = -1;
+}
+
+ParticleCache::~ParticleCache ()
+{
+	Close ();
+}
+
+//---------------------------------------------------------------- Frame encoding
+static inline uint zigzag ( int v )			{ return (uint(v) << 1) ^ uint(v >> 31); }
+static inline int unzigzag ( uint v )		{ return int(v >> 1) ^ -int(v & 1); }
+
+static inline uchar* putVarint ( uchar* p, uint v )
+{
+	while ( v >= 0x80 ) { *p++ = uchar(v | 0x80); v >>= 7; }
+	*p++ = uchar(v);
+	return p;
+}
+static inline const uchar* getVarint ( const uchar* p, const uchar* end, uint& v )
+{
+	v = 0;
+	for (int shift=0; p < end && shift < 35; shift += 7 ) {
+		uchar b = *p++;
+		v |= uint(b & 0x7F) << shift;
+		if ( !(b & 0x80) ) return p;
+	}
+	return 0x0;
+}
+
+void ParticleCache::EncodeFrame ( Frame& f, std::vector<uchar>& out )
+{
+	PCacheChunk hdr;
+	memset ( &hdr, 0, sizeof(hdr) );
+	hdr.magic = PCACHE_CHUNK;
+	hdr.frame = f.frame;
+	hdr.num = f.num;
+
+	// Frame bounding box and velocity range (non-finite values are ignored)
+	float bmin[3] = { 1.0e30f, 1.0e30f, 1.0e30f }, bmax[3] = { -1.0e30f, -1.0e30f, -1.0e30f };
+	float vmax = 0;
+	for (int n=0; n < f.num; n++ ) {
+		const float* p = &f.pos[n].x;
+		const float* v = &f.vel[n].x;
+		for (int a=0; a < 3; a++ ) {
+			if ( p[a] < bmin[a] ) bmin[a] = p[a];
+			if ( p[a] > bmax[a] ) bmax[a] = p[a];
+			if ( fabs(v[a]) > vmax && fabs(v[a]) < 1.0e30f ) vmax = fabs(v[a]);
+		}
+	}
+	for (int a=0; a < 3; a++ ) {
+		if ( bmin[a] > bmax[a] ) bmin[a] = bmax[a] = 0;
+		hdr.bmin[a] = bmin[a];
+		hdr.bmax[a] = bmax[a];
+	}
+	const float qmax = float( (1 << PCACHE_POS_BITS) - 1 );
+	const float vq = float( (1 << (PCACHE_VEL_BITS-1)) - 1 );
+	hdr.vel_step = vmax / vq;
+
+	// Quantize and delta-encode positions and velocities, one axis at a time
+	std::vector<uchar> raw[PCACHE_STREAMS];
+	raw[PCACHE_POS].resize ( size_t(f.num) * 3 * 5 );
+	raw[PCACHE_VEL].resize ( size_t(f.num) * 3 * 5 );
+	uchar* pp = raw[PCACHE_POS].data();
+	uchar* pv = raw[PCACHE_VEL].data();
+	for (int a=0; a < 3; a++ ) {
+		float ext = bmax[a] - bmin[a];
+		float pscale = (ext > 0) ? qmax / ext : 0;
+		float vscale = (hdr.vel_step > 0) ? 1.0f / hdr.vel_step : 0;
+		int prevp = 0, prevv = 0;
+		for (int n=0; n < f.num; n++ ) {
+			float t = ( (&f.pos[n].x)[a] - bmin[a] ) * pscale + 0.5f;
+			if ( !(t > 0) ) t = 0;
+			if ( t > qmax ) t = qmax;
+			float s = (&f.vel[n].x)[a] * vscale;
+			if ( !(s > -vq) ) s = (s == s) ? -vq : 0;
+			if ( s > vq ) s = vq;
+			int qp = int(t);
+			int qv = int(floorf(s + 0.5f));
+			pp = putVarint ( pp, zigzag ( qp - prevp ) );
+			pv = putVarint ( pv, zigzag ( qv - prevv ) );
+			prevp = qp; prevv = qv;
+		}
+	}
+	raw[PCACHE_POS].resize ( pp - raw[PCACHE_POS].data() );
+	raw[PCACHE_VEL].resize ( pv - raw[PCACHE_VEL].data() );
+
+	// Colors as delta-coded byte planes
+	raw[PCACHE_CLR].resize ( size_t(f.num) * 4 );
+	uchar* pc = raw[PCACHE_CLR].data();
+	for (int b=0; b < 4; b++ ) {
+		uchar prev = 0;
+		for (int n=0; n < f.num; n++ ) {
+			uchar c = uchar( f.clr[n] >> (b*8) );
+			*pc++ = uchar( c - prev );
+			prev = c;
+		}
+	}
+
+	// Compress streams behind the chunk header
+	std::vector<uchar> packed;
+	out.resize ( sizeof(PCacheChunk) );
+	for (int s=0; s < PCACHE_STREAMS; s++ ) {
+		LZCompress ( raw[s].data(), (int) raw[s].size(), packed );
+		hdr.raw[s] = (uint) raw[s].size();
+		hdr.packed[s] = (uint) packed.size();
+		out.insert ( out.end(), packed.begin(), packed.end() );
+	}
+	memcpy ( out.data(), &hdr, sizeof(hdr) );
+}
+
+bool ParticleCache::DecodeFrame ( std::vector<uchar>& in, int num, Vector3DF* pos, Vector3DF* vel, uint* clr )
+{
+	PCacheChunk hdr;
+	if ( in.size() < sizeof(hdr) ) return false;
+	memcpy ( &hdr, in.data(), sizeof(hdr) );
+	if ( hdr.magic != PCACHE_CHUNK || hdr.num != num ) return false;
+
+	std::vector<uchar> raw[PCACHE_STREAMS];
+	size_t ofs = sizeof(hdr);
+	for (int s=0; s < PCACHE_STREAMS; s++ ) {
+		if ( ofs + hdr.packed[s] > in.size() ) return false;
+		raw[s].resize ( hdr.raw[s] );
+		if ( !LZDecompress ( in.data() + ofs, hdr.packed[s], raw[s].data(), hdr.raw[s] ) ) return false;
+		ofs += hdr.packed[s];
+	}
+
+	const float qmax = float( (1 << PCACHE_POS_BITS) - 1 );
+	const uchar* pp = raw[PCACHE_POS].data();
+	const uchar* pv = raw[PCACHE_VEL].data();
+	const uchar* pend = pp + raw[PCACHE_POS].size();
+	const uchar* vend = pv + raw[PCACHE_VEL].size();
+	for (int a=0; a < 3; a++ ) {
+		float pstep = (hdr.bmax[a] - hdr.bmin[a]) / qmax;
+		int qp = 0, qv = 0;
+		uint d;
+		for (int n=0; n < num; n++ ) {
+			if ( (pp = getVarint ( pp, pend, d )) == 0x0 ) return false;
+			qp += unzigzag ( d );
+			if ( (pv = getVarint ( pv, vend, d )) == 0x0 ) return false;
+			qv += unzigzag ( d );
+			(&pos[n].x)[a] = hdr.bmin[a] + qp * pstep;
+			(&vel[n].x)[a] = qv * hdr.vel_step;
+		}
+	}
+
+	if ( raw[PCACHE_CLR].size() != size_t(num) * 4 ) return false;
+	const uchar* pc = raw[PCACHE_CLR].data();
+	memset ( clr, 0, num * sizeof(uint) );
+	for (int b=0; b < 4; b++ ) {
+		uchar c = 0;
+		for (int n=0; n < num; n++ ) {
+			c += *pc++;
+			clr[n] |= uint(c) << (b*8);
+		}
+	}
+	return true;
+}
+
+//---------------------------------------------------------------- Writing
+bool ParticleCache::OpenWrite ( std::string fname, int max_queue )
+{
+	Close ();
+	m_File = fopen ( fname.c_str(), "wb" );
+	if ( m_File == 0x0 ) {
+		nvprintf ( "ERROR: Unable to write particle cache %s\n", fname.c_str() );
+		return false;
+	}
+	PCacheHeader hdr;
+	hdr.magic = PCACHE_MAGIC;
+	hdr.version = PCACHE_VERSION;
+	hdr.pos_bits = PCACHE_POS_BITS;
+	hdr.vel_bits = PCACHE_VEL_BITS;
+	fwrite ( &hdr, sizeof(hdr), 1, m_File );
+
+	m_Name = fname;
+	m_Mode = 1;
+	m_Index.clear ();
+	m_Offset = sizeof(hdr);
+	m_RawBytes = 0;
+	m_FileBytes = sizeof(hdr);
+	m_MaxQueue = (max_queue < 1) ? 1 : max_queue;
+	m_Quit = false;
+	m_Thread = std::thread ( &ParticleCache::WriterLoop, this );
+	return true;
+}
+
+void ParticleCache::PushFrame ( int frame, int num, Vector3DF* pos, Vector3DF* vel, uint* clr )
+{
+	if ( m_Mode != 1 ) return;
+
+	Frame* f;
+	{
+		std::unique_lock<std::mutex> lock ( m_Mutex );
+		if ( (int) m_Queue.size() >= m_MaxQueue ) {
+			nvprintf ( "WARNING: Particle cache writer is behind, waiting.\n" );
+			m_Cond.wait ( lock, [this] { return (int) m_Queue.size() < m_MaxQueue; } );
+		}
+		if ( m_Free.empty() ) {
+			f = new Frame;
+		} else {
+			f = m_Free.back ();
+			m_Free.pop_back ();
+		}
+	}
+	f->frame = frame;
+	f->num = num;
+	f->pos.assign ( pos, pos + num );
+	f->vel.assign ( vel, vel + num );
+	f->clr.assign ( clr, clr + num );
+	{
+		std::lock_guard<std::mutex> lock ( m_Mutex );
+		m_Queue.push_back ( f );
+	}
+	m_Cond.notify_all ();
+}
+
+void ParticleCache::WriterLoop ()
+{
+	std::vector<uchar> chunk;
+	for (;;) {
+		Frame* f;
+		{
+			std::unique_lock<std::mutex> lock ( m_Mutex );
+			m_Cond.wait ( lock, [this] { return m_Quit || !m_Queue.empty(); } );
+			if ( m_Queue.empty() ) break;
+			f = m_Queue.front ();
+		}
+		EncodeFrame ( *f, chunk );
+		fwrite ( chunk.data(), chunk.size(), 1, m_File );
+
+		PCacheEntry e;
+		memset ( &e, 0, sizeof(e) );
+		e.frame = f->frame;
+		e.num = f->num;
+		e.offset = m_Offset;
+		e.size = (uint) chunk.size();
+		{
+			std::lock_guard<std::mutex> lock ( m_Mutex );
+			m_Index.push_back ( e );
+			m_Offset += chunk.size();
+			m_RawBytes += slong(f->num) * (2*sizeof(Vector3DF) + sizeof(uint));
+			m_FileBytes += chunk.size();
+			m_Queue.pop_front ();
+			m_Free.push_back ( f );
+		}
+		m_Cond.notify_all ();
+	}
+}
+
+void ParticleCache::Close ()
+{
+	if ( m_Mode == 0 ) return;
+
+	{
+		std::lock_guard<std::mutex> lock ( m_Mutex );
+		m_Quit = true;
+	}
+	m_Cond.notify_all ();
+	if ( m_Thread.joinable() ) m_Thread.join ();
+
+	if ( m_Mode == 1 ) {
+		PCacheFooter foot;
+		foot.index = m_Offset;
+		foot.count = (int) m_Index.size();
+		foot.magic = PCACHE_INDEX;
+		if ( !m_Index.empty() ) fwrite ( m_Index.data(), sizeof(PCacheEntry), m_Index.size(), m_File );
+		fwrite ( &foot, sizeof(foot), 1, m_File );
+		m_FileBytes += m_Index.size() * sizeof(PCacheEntry) + sizeof(foot);
+		nvprintf ( "Particle cache %s: %d frames, %.1f MB -> %.1f MB\n", m_Name.c_str(), foot.count,
+			m_RawBytes / (1024.0*1024.0), m_FileBytes / (1024.0*1024.0) );
+	}
+	fclose ( m_File );
+	m_File = 0x0;
+
+	for (size_t n=0; n < m_Queue.size(); n++ ) delete m_Queue[n];
+	for (size_t n=0; n < m_Free.size(); n++ ) delete m_Free[n];
+	m_Queue.clear ();
+	m_Free.clear ();
+	m_Ready.clear ();
+	m_Chunk.clear ();
+	m_Request = -1;
+	m_ReadySlot = -1;
+	m_Quit = false;
+	m_Mode = 0;
+}
+
+//---------------------------------------------------------------- Reading
+bool ParticleCache::OpenRead ( std::string fname )
+{
+	Close ();
+	m_File = fopen ( fname.c_str(), "rb" );
+	if ( m_File == 0x0 ) {
+		nvprintf ( "WARNING: File not found %s\n", fname.c_str() );
+		return false;
+	}
+	PCacheHeader hdr;
+	if ( fread ( &hdr, sizeof(hdr), 1, m_File ) != 1 || hdr.magic != PCACHE_MAGIC || hdr.version != PCACHE_VERSION ) {
+		nvprintf ( "ERROR: Not a particle cache %s\n", fname.c_str() );
+		fclose ( m_File );
+		m_File = 0x0;
+		return false;
+	}
+	m_Name = fname;
+	m_Mode = 2;
+	if ( !ReadIndex () ) {
+		nvprintf ( "WARNING: Particle cache %s has no index, scanning.\n", fname.c_str() );
+		ScanIndex ();
+	}
+	m_Quit = false;
+	m_Request = -1;
+	m_ReadySlot = -1;
+	m_Thread = std::thread ( &ParticleCache::ReaderLoop, this );
+	return true;
+}
+
+bool ParticleCache::ReadIndex ()
+{
+	PCacheFooter foot;
+	m_Index.clear ();
+	if ( pc_fseek ( m_File, -(slong) sizeof(foot), SEEK_END ) != 0 ) return false;
+	slong end = pc_ftell ( m_File );
+	if ( fread ( &foot, sizeof(foot), 1, m_File ) != 1 || foot.magic != PCACHE_INDEX ) return false;
+	if ( foot.count < 0 || foot.index + slong(foot.count) * (slong) sizeof(PCacheEntry) != end ) return false;
+
+	m_Index.resize ( foot.count );
+	pc_fseek ( m_File, foot.index, SEEK_SET );
+	if ( foot.count > 0 && fread ( m_Index.data(), sizeof(PCacheEntry), foot.count, m_File ) != (size_t) foot.count ) {
+		m_Index.clear ();
+		return false;
+	}
+	return true;
+}
+
+bool ParticleCache::ScanIndex ()
+{
+	PCacheChunk hdr;
+	slong ofs = sizeof(PCacheHeader);
+	m_Index.clear ();
+	for (;;) {
+		if ( pc_fseek ( m_File, ofs, SEEK_SET ) != 0 ) break;
+		if ( fread ( &hdr, sizeof(hdr), 1, m_File ) != 1 || hdr.magic != PCACHE_CHUNK ) break;
+		PCacheEntry e;
+		memset ( &e, 0, sizeof(e) );
+		e.frame = hdr.frame;
+		e.num = hdr.num;
+		e.offset = ofs;
+		e.size = sizeof(hdr);
+		for (int s=0; s < PCACHE_STREAMS; s++ ) e.size += hdr.packed[s];
+		// a truncated final chunk is dropped
+		if ( pc_fseek ( m_File, ofs + e.size - 1, SEEK_SET ) != 0 || fgetc ( m_File ) == EOF ) break;
+		m_Index.push_back ( e );
+		ofs += e.size;
+	}
+	return !m_Index.empty();
+}
+
+int ParticleCache::FindFrame ( int frame )
+{
+	if ( m_Index.empty() ) return -1;
+	int guess = frame - m_Index[0].frame;			// frames are usually recorded in order
+	if ( guess >= 0 && guess < (int) m_Index.size() && m_Index[guess].frame == frame ) return guess;
+	for (int n=0; n < (int) m_Index.size(); n++ )
+		if ( m_Index[n].frame == frame ) return n;
+	return -1;
+}
+
+bool ParticleCache::ReadChunk ( int slot, std::vector<uchar>& out )
+{
+	const PCacheEntry& e = m_Index[slot];
+	out.resize ( e.size );
+	if ( pc_fseek ( m_File, e.offset, SEEK_SET ) != 0 ) return false;
+	return fread ( out.data(), 1, e.size, m_File ) == e.size;
+}
+
+void ParticleCache::ReaderLoop ()
+{
+	std::vector<uchar> buf;
+	for (;;) {
+		int slot;
+		{
+			std::unique_lock<std::mutex> lock ( m_Mutex );
+			m_Cond.wait ( lock, [this] { return m_Quit || m_Request >= 0; } );
+			if ( m_Quit ) break;
+			slot = m_Request;
+		}
+		bool ok = ReadChunk ( slot, buf );
+		{
+			std::lock_guard<std::mutex> lock ( m_Mutex );
+			m_Ready.swap ( buf );
+			m_ReadySlot = ok ? slot : -1;
+			m_Request = -1;
+		}
+		m_Cond.notify_all ();
+	}
+}
+
+bool ParticleCache::ReadFrame ( int slot, Vector3DF* pos, Vector3DF* vel, uint* clr )
+{
+	if ( m_Mode != 2 || slot < 0 || slot >= (int) m_Index.size() ) return false;
+
+	bool ready = false;
+	{
+		std::unique_lock<std::mutex> lock ( m_Mutex );
+		m_Cond.wait ( lock, [this] { return m_Request < 0; } );		// file is ours once no prefetch is pending
+		if ( m_ReadySlot == slot ) {
+			m_Chunk.swap ( m_Ready );
+			ready = true;
+		}
+		m_ReadySlot = -1;
+	}
+	if ( !ready && !ReadChunk ( slot, m_Chunk ) ) return false;
+
+	if ( slot + 1 < (int) m_Index.size() ) {
+		{
+			std::lock_guard<std::mutex> lock ( m_Mutex );
+			m_Request = slot + 1;
+		}
+		m_Cond.notify_all ();
+	}
+	return DecodeFrame ( m_Chunk, m_Index[slot].num, pos, vel, clr );
+}
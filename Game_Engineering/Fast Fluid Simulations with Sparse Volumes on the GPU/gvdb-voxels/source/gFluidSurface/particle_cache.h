@@ -0,0 +1,134 @@
+//-----------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+//-----------------------------------------------------------------------------
+
+// Particle cache (.pcache) - a single file holding a whole recorded sequence.
+//
+// Layout:  [PCacheHeader] [chunk]...[chunk] [PCacheEntry x count] [PCacheFooter]
+//
+// Each chunk is one frame: a PCacheChunk header followed by three compressed
+// streams (positions, velocities, colors). Positions are quantized to 16 bits
+// per axis inside the frame bounding box, velocities to a per-frame step, and
+// both are stored as zigzag varint deltas between consecutive particles (the
+// counting sort keeps neighbors adjacent, so deltas are small). Colors are
+// split into byte planes. Every stream is then LZ compressed (gvdb_compress.h).
+// The index at the end gives random access by frame; if it is missing (the
+// recording was interrupted) the reader rebuilds it by scanning chunk headers.
+
+#ifndef DEF_PARTICLE_CACHE
+	#define DEF_PARTICLE_CACHE
+
+	#include <stdio.h>
+	#include <string>
+	#include <vector>
+	#include <deque>
+	#include <thread>
+	#include <mutex>
+	#include <condition_variable>
+
+	#include "gvdb_types.h"
+	#include "gvdb_vec.h"
+	using namespace nvdb;
+
+	#define PCACHE_MAGIC		0x48435050		// 'PPCH'
+	#define PCACHE_CHUNK		0x4B4E4843		// 'CHNK'
+	#define PCACHE_INDEX		0x58444E49		// 'INDX'
+	#define PCACHE_VERSION		1
+
+	#define PCACHE_POS			0				// streams in a frame chunk
+	#define PCACHE_VEL			1
+	#define PCACHE_CLR			2
+	#define PCACHE_STREAMS		3
+
+	struct PCacheHeader {
+		uint		magic;
+		uint		version;
+		uint		pos_bits;					// quantization of positions
+		uint		vel_bits;					// quantization of velocities
+	};
+	struct PCacheChunk {
+		uint		magic;
+		int			frame;
+		int			num;
+		float		vel_step;					// velocity quantum
+		float		bmin[3], bmax[3];			// frame bounding box
+		uint		raw[PCACHE_STREAMS];		// stream sizes before compression
+		uint		packed[PCACHE_STREAMS];		// stream sizes in file
+	};
+	struct PCacheEntry {
+		int			frame;
+		int			num;
+		slong		offset;						// file offset of the chunk header
+		uint		size;						// chunk size incl. header
+		uint		pad;
+	};
+	struct PCacheFooter {
+		slong		index;						// file offset of the index
+		int			count;
+		uint		magic;
+	};
+
+	class ParticleCache {
+	public:
+		ParticleCache ();
+		~ParticleCache ();
+
+		// Writing. PushFrame copies the particles and returns; a background
+		// thread quantizes, compresses and writes them.
+		bool OpenWrite ( std::string fname, int max_queue = 4 );
+		void PushFrame ( int frame, int num, Vector3DF* pos, Vector3DF* vel, uint* clr );
+
+		// Reading. ReadFrame decodes one frame and prefetches the next chunk.
+		bool OpenRead ( std::string fname );
+		int FindFrame ( int frame );			// index slot of a frame, -1 if missing
+		int getNumFrames ()				{ return (int) m_Index.size(); }
+		int getFrame ( int slot )		{ return m_Index[slot].frame; }
+		int getFramePoints ( int slot )	{ return m_Index[slot].num; }
+		bool ReadFrame ( int slot, Vector3DF* pos, Vector3DF* vel, uint* clr );
+
+		void Close ();							// drains the writer and writes the index
+		bool isWriting ()				{ return m_Mode == 1; }
+		bool isReading ()				{ return m_Mode == 2; }
+		std::string getName ()			{ return m_Name; }
+		slong getRawBytes ()			{ return m_RawBytes; }
+		slong getFileBytes ()			{ return m_FileBytes; }
+
+	private:
+		struct Frame {
+			int						frame, num;
+			std::vector<Vector3DF>	pos, vel;
+			std::vector<uint>		clr;
+		};
+		void WriterLoop ();
+		void ReaderLoop ();
+		void EncodeFrame ( Frame& f, std::vector<uchar>& out );
+		bool DecodeFrame ( std::vector<uchar>& in, int num, Vector3DF* pos, Vector3DF* vel, uint* clr );
+		bool ReadChunk ( int slot, std::vector<uchar>& out );
+		bool ReadIndex ();
+		bool ScanIndex ();
+
+		FILE*						m_File;
+		std::string					m_Name;
+		int							m_Mode;				// 0=closed, 1=write, 2=read
+		std::vector<PCacheEntry>	m_Index;
+		slong						m_Offset;			// write position
+		slong						m_RawBytes, m_FileBytes;
+
+		std::thread					m_Thread;
+		std::mutex					m_Mutex;
+		std::condition_variable		m_Cond;
+		bool						m_Quit;
+
+		std::deque<Frame*>			m_Queue;			// writer: frames waiting to be encoded
+		std::vector<Frame*>			m_Free;				// writer: recycled frames
+		int							m_MaxQueue;
+
+		int							m_Request;			// reader: slot to prefetch, -1 none
+		int							m_ReadySlot;		// reader: slot held in m_Ready
+		std::vector<uchar>			m_Ready;			// reader: prefetched chunk
+		std::vector<uchar>			m_Chunk;			// reader: chunk being decoded
+	};
+
+#endif
@@ -121,11 +121,11 @@ __device__ void ProcessLeaf(VDBInfo* gvdb, void* nanoVDBLeafNodes, cudaSurfaceOb
 	// Note that mAverage and mStdDevi currently aren't set.
 
 	// Since all voxels are active, the bounding box of active values of this node is the
-	// bounding box of the node itself:
+	// bounding box of the node itself (inclusive, so the difference is brickres - 1):
 	nodeData.mBBoxMin = { gvdbNode->mPos.x, gvdbNode->mPos.y, gvdbNode->mPos.z };
-	nodeData.mBBoxDif[0] = brickres;
-	nodeData.mBBoxDif[1] = brickres;
-	nodeData.mBBoxDif[2] = brickres;
+	nodeData.mBBoxDif[0] = brickres - 1;
+	nodeData.mBBoxDif[1] = brickres - 1;
+	nodeData.mBBoxDif[2] = brickres - 1;
 }
 
 // Autogenerated list of ProcessLeaf instantiation function pointers. You can generate this list
@@ -7,6 +7,8 @@
 //----------------------------------------------------------------------------------
 
 #include <algorithm> // For min/max
+#include <thread>
+#include <vector>
 
 #include "gvdb_export_nanovdb.h"
 
@@ -158,7 +160,7 @@ print('};')
 		return { FLT_MAX, FLT_MAX, FLT_MAX };
 	}
 	template<class T> T ExportToNanoVDB_MinimumValue() {
-		return std::numeric_limits<T>::min();
+		return std::numeric_limits<T>::lowest();
 	}
 	template<> Vec3f ExportToNanoVDB_MinimumValue<Vec3f>() {
 		return { -FLT_MAX, -FLT_MAX, -FLT_MAX };
@@ -223,6 +225,192 @@ print('};')
 {GetNode2Range<int, 2>, GetNode2Range<int, 3>, GetNode2Range<int, 4>, GetNode2Range<int, 5>, GetNode2Range<int, 6>, GetNode2Range<int, 7>}
 	};
 
+	// Gets information about the range of the given leaf node, for level-1 nodes exported on the
+	// host.
+	template<class ValueT, int LOG2DIM> NodeRangeData GetLeafRange(uint8_t* leafStart, int nodeIdx) {
+		using LeafT = LeafNode<ValueT, Coord, Mask, LOG2DIM>;
+
+		LeafT* node = reinterpret_cast<LeafT*>(leafStart) + nodeIdx;
+
+		NodeRangeData result;
+
+		*getValueUnion<ValueT>(result.valueMin) = node->valueMin();
+		*getValueUnion<ValueT>(result.valueMax) = node->valueMax();
+		result.aabb = node->bbox();
+
+		return result;
+	}
+
+	// Autogenerated list of instantiations of GetLeafRange, using the script for rangeFunctions
+	// with GetNode2Range replaced by GetLeafRange.
+	static const Node2RangeFunc leafRangeFunctions[3][6] = {
+{GetLeafRange<float, 2>, GetLeafRange<float, 3>, GetLeafRange<float, 4>, GetLeafRange<float, 5>, GetLeafRange<float, 6>, GetLeafRange<float, 7>},
+{GetLeafRange<Vec3f, 2>, GetLeafRange<Vec3f, 3>, GetLeafRange<Vec3f, 4>, GetLeafRange<Vec3f, 5>, GetLeafRange<Vec3f, 6>, GetLeafRange<Vec3f, 7>},
+{GetLeafRange<int, 2>, GetLeafRange<int, 3>, GetLeafRange<int, 4>, GetLeafRange<int, 5>, GetLeafRange<int, 6>, GetLeafRange<int, 7>}
+	};
+
+	//---------------------------------------------------------------------------------------------
+	// Host export. These are the CPU counterparts of the kernels in cuda_export_nanovdb.cu, and
+	// each processes the nodes [start, end) of one level. Since NanoVDB node i of a level is GVDB
+	// node i of that level, nodes of a level can be written in any order and by any thread.
+
+	// A HostLeafFunc takes the volume, the start of the NanoVDB leaves, the host atlas and its
+	// resolution, and the range of leaves to write.
+	using HostLeafFunc = void(*)(VolumeGVDB&, uint8_t*, const uchar*, Vector3DI, int, int);
+
+	template<class ValueT, int LOG2DIM>
+	void ProcessLeavesHost(VolumeGVDB& gvdb, uint8_t* nanoVDBLeafNodes, const uchar* atlas, Vector3DI atlasRes, int start, int end)
+	{
+		using LeafT = LeafNode<ValueT, Coord, Mask, LOG2DIM>;
+		using DataT = typename LeafT::DataType;
+		const int brickres = 1 << LOG2DIM;
+		LeafT* leafNodes = reinterpret_cast<LeafT*>(nanoVDBLeafNodes);
+
+		for (int leafIdx = start; leafIdx < end; leafIdx++) {
+			nvdb::Node* gvdbNode = gvdb.getNodeAtLevel(leafIdx, 0);
+
+			// As on the GPU, skip leftover nodes that aren't part of the tree, and leaves without a
+			// brick. Their NanoVDB leaves stay zeroed.
+			if (gvdbNode->mChildList != ID_UNDEFL || gvdbNode->mValue.x == -1) continue;
+
+			DataT& nodeData = *reinterpret_cast<DataT*>(&leafNodes[leafIdx]);
+
+			// All values in a brick are active in GVDB
+			nodeData.mValueMask.set(true);
+
+			ValueT minValue = ExportToNanoVDB_MaximumValue<ValueT>();
+			ValueT maxValue = ExportToNanoVDB_MinimumValue<ValueT>();
+
+			// The atlas is stored x-fastest, while NanoVDB stores values in the order
+			// ((x * T) + y) * T + z. Read atlas rows in order and scatter into the leaf.
+			const Vector3DI brickValue = gvdbNode->mValue;
+			for (int z = 0; z < brickres; z++) {
+				for (int y = 0; y < brickres; y++) {
+					const uchar* row = atlas + ((uint64(brickValue.z + z) * atlasRes.y + (brickValue.y + y))
+						* atlasRes.x + brickValue.x) * sizeof(ValueT);
+					for (int x = 0; x < brickres; x++) {
+						ValueT value;
+						memcpy(&value, row + x * sizeof(ValueT), sizeof(ValueT));
+						nodeData.mValues[(x * brickres + y) * brickres + z] = value;
+						minValue = ExportToNanoVDB_Min(minValue, value);
+						maxValue = ExportToNanoVDB_Max(maxValue, value);
+					}
+				}
+			}
+
+			nodeData.mMinimum = minValue;
+			nodeData.mMaximum = maxValue;
+
+			// All voxels are active, so the active bounding box is the node's (inclusive) box
+			nodeData.mBBoxMin = { gvdbNode->mPos.x, gvdbNode->mPos.y, gvdbNode->mPos.z };
+			nodeData.mBBoxDif[0] = brickres - 1;
+			nodeData.mBBoxDif[1] = brickres - 1;
+			nodeData.mBBoxDif[2] = brickres - 1;
+		}
+	}
+
+	// Autogenerated list of ProcessLeavesHost instantiations, [value type][leaf log2dim - 2].
+	static const HostLeafFunc processLeavesHostFuncs[3][6] = {
+{ProcessLeavesHost<float, 2>, ProcessLeavesHost<float, 3>, ProcessLeavesHost<float, 4>, ProcessLeavesHost<float, 5>, ProcessLeavesHost<float, 6>, ProcessLeavesHost<float, 7>},
+{ProcessLeavesHost<Vec3f, 2>, ProcessLeavesHost<Vec3f, 3>, ProcessLeavesHost<Vec3f, 4>, ProcessLeavesHost<Vec3f, 5>, ProcessLeavesHost<Vec3f, 6>, ProcessLeavesHost<Vec3f, 7>},
+{ProcessLeavesHost<int, 2>, ProcessLeavesHost<int, 3>, ProcessLeavesHost<int, 4>, ProcessLeavesHost<int, 5>, ProcessLeavesHost<int, 6>, ProcessLeavesHost<int, 7>}
+	};
+
+	// A HostInternalFunc takes the volume, the level, the start of this level's and the child
+	// level's NanoVDB nodes, a range function for the children, the number of nodes at this level,
+	// the background, and the range of nodes to write.
+	using HostInternalFunc = void(*)(VolumeGVDB&, int, uint8_t*, uint8_t*, Node2RangeFunc, int, ValueUnion, int, int);
+
+	// Here, LOG2DIM is the log2dim of the internal node (not the child node).
+	template<class ValueT, int LOG2DIM>
+	void ProcessInternalNodesHost(VolumeGVDB& gvdb, int level, uint8_t* nanoVDBNodes, uint8_t* nanoVDBChildNodes,
+		Node2RangeFunc childRange, int numNodes, ValueUnion backgroundUnion, int start, int end)
+	{
+		// As in the PTX code, the leaf type of the child doesn't change the layout of the node.
+		using NodeT = InternalNode<LeafNode<ValueT>, LOG2DIM>;
+		using DataT = typename NodeT::DataType;
+		const uint32_t res = 1 << LOG2DIM;
+		const uint32_t numChildren = res * res * res;
+		const uint32_t resMask = res - 1;
+		const uint32_t resSquared = res * res;
+		const uint32_t middleMask = res * resMask;
+		const ValueT background = *getValueUnion<ValueT>(backgroundUnion);
+
+		for (int nodeIdx = start; nodeIdx < end; nodeIdx++) {
+			nvdb::Node* gvdbNode = gvdb.getNodeAtLevel(nodeIdx, level);
+
+			// Nodes without children are left zeroed, as on the GPU.
+			if (gvdbNode->mChildList == ID_UNDEFL) continue;
+
+			DataT* nodeData = reinterpret_cast<DataT*>(nanoVDBNodes) + nodeIdx;
+			nodeData->mValueMask.setOff();
+			nodeData->mChildMask.setOff();
+			nodeData->mOffset = numNodes - nodeIdx;
+
+			ValueT valueMin = ExportToNanoVDB_MaximumValue<ValueT>();
+			ValueT valueMax = ExportToNanoVDB_MinimumValue<ValueT>();
+			Coord aabbMin = { INT_MAX, INT_MAX, INT_MAX };
+			Coord aabbMax = { -INT_MAX, -INT_MAX, -INT_MAX };
+
+			for (uint32_t gvdbChildIdx = 0; gvdbChildIdx < numChildren; gvdbChildIdx++) {
+				// GVDB children are in (z*T+y)*T+x order, NanoVDB children in (x*T+y)*T+z order.
+				const uint32_t nanoVDBChildIdx =
+					(gvdbChildIdx / resSquared)
+					+ (gvdbChildIdx & middleMask)
+					+ (gvdbChildIdx & resMask) * resSquared;
+
+				// With bitmasks the child list is compacted, so check the mask first.
+#ifdef USE_BITMASKS
+				const uint64 childRef = gvdb.isOn(gvdbNode, gvdbChildIdx) ? gvdb.getChildRefAtBit(gvdbNode, gvdbChildIdx) : ID_UNDEF64;
+#else
+				const uint64 childRef = gvdb.getChildRefAtBit(gvdbNode, gvdbChildIdx);
+#endif
+				if (childRef == ID_UNDEF64) {
+					nodeData->mTable[nanoVDBChildIdx].value = background;
+					continue;
+				}
+
+				const int childID = static_cast<int>(ElemNdx(childRef));
+				nodeData->mChildMask.setOn(nanoVDBChildIdx);
+				nodeData->mTable[nanoVDBChildIdx].childID = static_cast<uint32_t>(childID);
+
+				NodeRangeData rangeData = childRange(nanoVDBChildNodes, childID);
+				valueMin = ExportToNanoVDB_Min(valueMin, *getValueUnion<ValueT>(rangeData.valueMin));
+				valueMax = ExportToNanoVDB_Max(valueMax, *getValueUnion<ValueT>(rangeData.valueMax));
+				for (int c = 0; c < 3; c++) {
+					aabbMin[c] = std::min(aabbMin[c], rangeData.aabb.min()[c]);
+					aabbMax[c] = std::max(aabbMax[c], rangeData.aabb.max()[c]);
+				}
+			}
+
+			nodeData->mMinimum = valueMin;
+			nodeData->mMaximum = valueMax;
+			nodeData->mBBox.min() = aabbMin;
+			nodeData->mBBox.max() = aabbMax;
+		}
+	}
+
+	// Autogenerated list of ProcessInternalNodesHost instantiations, [value type][node log2dim - 2].
+	static const HostInternalFunc processInternalNodesHostFuncs[3][6] = {
+{ProcessInternalNodesHost<float, 2>, ProcessInternalNodesHost<float, 3>, ProcessInternalNodesHost<float, 4>, ProcessInternalNodesHost<float, 5>, ProcessInternalNodesHost<float, 6>, ProcessInternalNodesHost<float, 7>},
+{ProcessInternalNodesHost<Vec3f, 2>, ProcessInternalNodesHost<Vec3f, 3>, ProcessInternalNodesHost<Vec3f, 4>, ProcessInternalNodesHost<Vec3f, 5>, ProcessInternalNodesHost<Vec3f, 6>, ProcessInternalNodesHost<Vec3f, 7>},
+{ProcessInternalNodesHost<int, 2>, ProcessInternalNodesHost<int, 3>, ProcessInternalNodesHost<int, 4>, ProcessInternalNodesHost<int, 5>, ProcessInternalNodesHost<int, 6>, ProcessInternalNodesHost<int, 7>}
+	};
+
+	// Runs func(start, end) over [0, num) split into contiguous ranges, one per hardware thread.
+	template<class Func>
+	void ExportToNanoVDB_ParallelFor(int num, Func func) {
+		const int threads = std::max(1, std::min(static_cast<int>(std::thread::hardware_concurrency()), (num + 63) / 64));
+		std::vector<std::thread> pool;
+		for (int t = 1; t < threads; t++) {
+			pool.push_back(std::thread(func, int(int64_t(num) * t / threads), int(int64_t(num) * (t + 1) / threads)));
+		}
+		func(0, int(int64_t(num) / threads));
+		for (std::thread& thread : pool) {
+			thread.join();
+		}
+	}
+
 	// Computes the bounding box and min/max values for the grid and root nodes from the level-2
 	// node data.
 	template<class ValueT>
@@ -371,6 +559,193 @@ print('};')
 #endif
 	}
 
+	// Denotes the different regions of a NanoVDB file/memory representation.
+	enum Region {
+		R_GRID,
+		R_TREE,
+		R_ROOT,
+		R_NODE2,
+		R_NODE1,
+		R_LEAF,
+		R_COUNT
+	};
+
+	// Checks that a channel of a GVDB volume can be exported, counts its nodes, and computes the
+	// byte offsets of each region of the NanoVDB buffer. Prints an error and returns false if the
+	// volume can't be exported.
+	static bool ExportToNanoVDB_Layout(VolumeGVDB& gvdb, uchar channel, int numNodes[3],
+		size_t dataSizes[R_COUNT], size_t dataOffsetsBytes[R_COUNT + 1])
+	{
+		// Get template parameters from GVDB
+		int brickLog2Dim = gvdb.getLD(0);
+		int node1Log2Dim = gvdb.getLD(1);
+		int node2Log2Dim = gvdb.getLD(2);
+		uchar gvdbType = gvdb.GetChannelType(channel);
+		// Make sure the node log dimensions are in the range [2,7], to keep the number of types small
+		if (brickLog2Dim < 2 || brickLog2Dim > 7) {
+			gprintf("Error in ExportToNanoVDB: The brick log2dim (%d) was outside of the range [2,7]. "
+				"Consider using a different tree structure or adding this case to the supported types.\n",
+				brickLog2Dim);
+			return false;
+		}
+		if (node1Log2Dim < 2 || node1Log2Dim > 7) {
+			gprintf("Error in ExportToNanoVDB: The level-1 node log2dim (%d) was outside of the range [2,7]. "
+				"Consider using a different tree structure or adding this case to the supported types.\n",
+				node1Log2Dim);
+			return false;
+		}
+		if (node2Log2Dim < 2 || node2Log2Dim > 7) {
+			gprintf("Error in ExportToNanoVDB: The level-2 node log2dim (%d) was outside of the range [2,7]. "
+				"Consider using a different tree structure or adding this case to the supported types.\n",
+				node2Log2Dim);
+			return false;
+		}
+		// Make sure that the gvdbType is a type that can be converted to a NanoVDB volume.
+		switch (gvdbType) {
+		case T_FLOAT:
+		case T_FLOAT3:
+		case T_INT:
+			break;
+		default:
+			gprintf("Error in ExportToNanoVDB:  The type of GVDB channel %u was %u, which is not "
+				"supported for NanoVDB export.",
+				static_cast<unsigned int>(channel), static_cast<unsigned int>(gvdbType));
+			return false;
+		}
+
+		// Count the number of nodes at each level. At the moment, limit the number of nodes of each
+		// type to INT_MAX (2^31-1).
+		for (int level = 0; level < 3; level++) {
+			if (!ExportToNanoVDB_GetNumNodes(gvdb, level, numNodes[level])) {
+				return false;
+			}
+		}
+
+		// Compute the size of each region.
+		NanoVDBTypeSizes typeSizes = ComputeTypeSizes(gvdbType, brickLog2Dim, node1Log2Dim, node2Log2Dim);
+		dataSizes[R_GRID] = typeSizes.grid;
+		dataSizes[R_TREE] = typeSizes.tree;
+		dataSizes[R_ROOT] = typeSizes.root + typeSizes.rootTile * numNodes[2];
+		dataSizes[R_NODE2] = numNodes[2] * typeSizes.node2;
+		dataSizes[R_NODE1] = numNodes[1] * typeSizes.node1;
+		dataSizes[R_LEAF] = numNodes[0] * typeSizes.leaf;
+
+		// Compute offsets into memory using an exclusive prefix sum; the last element in this array
+		// will hold the size of all of the memory we need to allocate.
+		// (e.g. this turns {3, 5, 2, 5} into {0, 3, 8, 10, 15}.)
+		dataOffsetsBytes[0] = 0;
+		for (int i = 1; i <= R_COUNT; i++) {
+			dataOffsetsBytes[i] = dataOffsetsBytes[i - 1] + dataSizes[i - 1];
+		}
+		return true;
+	}
+
+	// Fills in the grid data, except for the world bounding box, which ProcessGridExtents computes.
+	static void ExportToNanoVDB_FillGrid(VolumeGVDB& gvdb, nanovdb::GridData* gridData, uchar gvdbType,
+		const char gridName[nanovdb::GridData::MaxNameSize], nanovdb::GridClass gridClass)
+	{
+		gridData->mMagic = NANOVDB_MAGIC_NUMBER;
+
+		memcpy(gridData->mGridName, gridName, nanovdb::GridData::MaxNameSize);
+
+		// Get the GVDB index-to-world transform and copy it to a format Map can read
+		Matrix4F xform = gvdb.getTransform(); // Make a copy (note that once this is integrated
+		// into the main library, we can access the inverse directly):
+		{
+			float indexToWorld[4][4];
+			for (int row = 0; row < 4; row++) {
+				for (int col = 0; col < 4; col++) {
+					indexToWorld[row][col] = xform(row, col);
+				}
+			}
+			float worldToIndex[4][4];
+			xform.InvertTRS();
+			for (int row = 0; row < 4; row++) {
+				for (int col = 0; col < 4; col++) {
+					worldToIndex[row][col] = xform(row, col);
+				}
+			}
+			gridData->mMap.set(indexToWorld, worldToIndex, 1.0); // mTaper seems to be unused
+		}
+
+		// Skip over the world bounding box for now - we'll fill it in later.
+
+		// GridData would like a uniform scale, but that's not really possible to provide, since
+		// GVDB supports arbitrary voxel transforms (e.g. think of skewed voxels).
+		// For now, we use the approach GridBuilder uses, which is scale_i = ||map(e_i) - map((0,0,0))||.
+		// However, for a different approximation, we could use something like sqrt(tr(A*A)/3),
+		// where A is the upper-left 3x3 block of xform; if A is normal, this gives the root mean
+		// square of the singular values of A.
+		const nanovdb::Vec3d mapAt0 = gridData->applyMap(nanovdb::Vec3d(0, 0, 0));
+		gridData->mVoxelSize = Vec3R(
+			(gridData->applyMap(nanovdb::Vec3d(1, 0, 0)) - mapAt0).length(),
+			(gridData->applyMap(nanovdb::Vec3d(0, 1, 0)) - mapAt0).length(),
+			(gridData->applyMap(nanovdb::Vec3d(0, 0, 1)) - mapAt0).length()
+		);
+
+		gridData->mGridClass = gridClass;
+
+		switch (gvdbType) {
+		case T_FLOAT:
+			gridData->mGridType = nanovdb::GridType::Float;
+			break;
+		case T_FLOAT3:
+			gridData->mGridType = nanovdb::GridType::Vec3f;
+			break;
+		case T_INT:
+			gridData->mGridType = nanovdb::GridType::Int32;
+		}
+
+		gridData->mBlindMetadataCount = 0;
+		gridData->mBlindMetadataOffset = 0;
+	}
+
+	// Fills in the tree data. This is much simpler; we simply give the offsets from the tree to
+	// each of the regions, and the number of nodes in each region. Note that the indices of mBytes
+	// and mCount refer to the level of the nodes.
+	static void ExportToNanoVDB_FillTree(TreeData<TREE_DEPTH>* treeData, const int numNodes[3],
+		const size_t dataOffsetsBytes[R_COUNT + 1])
+	{
+		treeData->mBytes[0] = dataOffsetsBytes[R_LEAF] - dataOffsetsBytes[R_TREE];
+		treeData->mBytes[1] = dataOffsetsBytes[R_NODE1] - dataOffsetsBytes[R_TREE];
+		treeData->mBytes[2] = dataOffsetsBytes[R_NODE2] - dataOffsetsBytes[R_TREE];
+		treeData->mBytes[3] = dataOffsetsBytes[R_ROOT] - dataOffsetsBytes[R_TREE];
+
+		treeData->mCount[0] = numNodes[0];
+		treeData->mCount[1] = numNodes[1];
+		treeData->mCount[2] = numNodes[2];
+		treeData->mCount[3] = 1; // There's only one root
+	}
+
+	// Computes the root and grid extents from the level-2 nodes, for either export path.
+	static void ExportToNanoVDB_FillRoot(VolumeGVDB& gvdb, nanovdb::GridData* gridData, uchar gvdbType,
+		uint8_t* rootDataPtr, uint8_t* node2Start, void* backgroundPtr, const int numNodes[3])
+	{
+		const int brickLog2Dim = gvdb.getLD(0);
+		const int node1Log2Dim = gvdb.getLD(1);
+		const int node2Log2Dim = gvdb.getLD(2);
+
+		// All voxels in the leaves of the GVDB volume are active, so this is the total volume of
+		// of the leaves:
+		uint64_t activeVoxelCount = numNodes[0] * gvdb.getVoxCnt(0);
+		const int totalLog2Dim = node2Log2Dim + node1Log2Dim + brickLog2Dim;
+
+		switch (gvdbType) {
+		case T_FLOAT:
+			ProcessGridExtents<float>(gridData, rootDataPtr, node2Start,
+				activeVoxelCount, backgroundPtr, numNodes[2], node2Log2Dim, totalLog2Dim);
+			break;
+		case T_FLOAT3:
+			ProcessGridExtents<Vec3f>(gridData, rootDataPtr, node2Start,
+				activeVoxelCount, backgroundPtr, numNodes[2], node2Log2Dim, totalLog2Dim);
+			break;
+		case T_INT:
+			ProcessGridExtents<int>(gridData, rootDataPtr, node2Start,
+				activeVoxelCount, backgroundPtr, numNodes[2], node2Log2Dim, totalLog2Dim);
+			break;
+		}
+	}
+
 	CUdeviceptr ExportToNanoVDB(VolumeGVDB& gvdb, uchar channel, void* backgroundPtr,
 		const char gridName[nanovdb::GridData::MaxNameSize], nanovdb::GridClass gridClass, size_t* outTotalSize)
 	{
@@ -383,6 +758,13 @@ print('};')
 			gprintf("Error in ExportToNanoVDB: outTotalSize was nullptr!\n");
 			return GVDB_EXPORT_NANOVDB_NULL;
 		}
+#ifdef USE_BITMASKS
+		// The export kernels are compiled without USE_BITMASKS, so they would read compacted child
+		// lists as full ones.
+		gprintf("Error in ExportToNanoVDB: The GPU exporter doesn't support bitmask builds. "
+			"Use ExportToNanoVDB_Host instead.\n");
+		return GVDB_EXPORT_NANOVDB_NULL;
+#endif
 
 		// This function works by splitting its work between the GPU and CPU. While the GPU exports
 		// leaves and internal nodes, the CPU fills in the grid data. The CPU then receives the
@@ -421,85 +803,15 @@ print('};')
 
 		ValueUnion backgroundUnion = *reinterpret_cast<ValueUnion*>(backgroundPtr);
 
-		// Get template parameters from GVDB
-		int brickLog2Dim = gvdb.getLD(0);
-		int node1Log2Dim = gvdb.getLD(1);
-		int node2Log2Dim = gvdb.getLD(2);
-		uchar gvdbType = gvdb.GetChannelType(channel);
-		// Make sure the node log dimensions are in the range [1,8], to keep the number of types small
-		if (brickLog2Dim < 1 || brickLog2Dim > 8) {
-			gprintf("Error in ExportToNanoVDB: The brick log2dim (%d) was outside of the range [1,8]. "
-				"Consider using a different tree structure or adding this case to the supported types.\n",
-				brickLog2Dim);
-			return GVDB_EXPORT_NANOVDB_NULL;
-		}
-		if (node1Log2Dim < 1 || node1Log2Dim > 8) {
-			gprintf("Error in ExportToNanoVDB: The level-1 node log2dim (%d) was outside of the range [1,8]. "
-				"Consider using a different tree structure or adding this case to the supported types.\n",
-				node1Log2Dim);
-			return GVDB_EXPORT_NANOVDB_NULL;
-		}
-		if (node2Log2Dim < 1 || node2Log2Dim > 8) {
-			gprintf("Error in ExportToNanoVDB: The level-2 node log2dim (%d) was outside of the range [1,8]. "
-				"Consider using a different tree structure or adding this case to the supported types.\n",
-				node2Log2Dim);
-			return GVDB_EXPORT_NANOVDB_NULL;
-		}
-		// Make sure that the gvdbType is a type that can be converted to a NanoVDB volume.
-		switch (gvdbType) {
-		case T_FLOAT:
-		case T_FLOAT3:
-		case T_INT:
-			break;
-		default:
-			gprintf("Error in ExportToNanoVDB:  The type of GVDB channel %u was %u, which is not "
-				"supported for NanoVDB export.",
-				static_cast<unsigned int>(channel), static_cast<unsigned int>(gvdbType));
-			return GVDB_EXPORT_NANOVDB_NULL;
-		}
-
-		// Denotes the different regions of a NanoVDB file/memory representation.
-		enum Region {
-			R_GRID,
-			R_TREE,
-			R_ROOT,
-			R_NODE2,
-			R_NODE1,
-			R_LEAF,
-			R_COUNT
-		};
-
-		// Count the number of nodes at each level. At the moment, limit the number of nodes of each
-		// type to INT_MAX (2^31-1).
-		int numNode2s, numNode1s, numLeaves;
-		if (!ExportToNanoVDB_GetNumNodes(gvdb, 2, numNode2s)) {
-			return GVDB_EXPORT_NANOVDB_NULL;
-		}
-		if (!ExportToNanoVDB_GetNumNodes(gvdb, 1, numNode1s)) {
-			return GVDB_EXPORT_NANOVDB_NULL;
-		}
-		if (!ExportToNanoVDB_GetNumNodes(gvdb, 0, numLeaves)) {
-			return GVDB_EXPORT_NANOVDB_NULL;
-		}
-
-		// Compute the size of each region.
-		NanoVDBTypeSizes typeSizes = ComputeTypeSizes(gvdbType, brickLog2Dim, node1Log2Dim, node2Log2Dim);
+		// Validate the volume and compute the size and offset of each region
+		int numNodes[3];
 		size_t dataSizes[R_COUNT];
-		dataSizes[R_GRID] = typeSizes.grid;
-		dataSizes[R_TREE] = typeSizes.tree;
-		dataSizes[R_ROOT] = typeSizes.root + typeSizes.rootTile * numNode2s;
-		dataSizes[R_NODE2] = numNode2s * typeSizes.node2;
-		dataSizes[R_NODE1] = numNode1s * typeSizes.node1;
-		dataSizes[R_LEAF] = numLeaves * typeSizes.leaf;
-
-		// Compute offsets into memory using an exclusive prefix sum; the last element in this array
-		// will hold the size of all of the memory we need to allocate.
-		// (e.g. this turns {3, 5, 2, 5} into {0, 3, 8, 10, 15}.)
 		size_t dataOffsetsBytes[R_COUNT + 1];
-		dataOffsetsBytes[0] = 0;
-		for (int i = 1; i <= R_COUNT; i++) {
-			dataOffsetsBytes[i] = dataOffsetsBytes[i - 1] + dataSizes[i - 1];
+		if (!ExportToNanoVDB_Layout(gvdb, channel, numNodes, dataSizes, dataOffsetsBytes)) {
+			return GVDB_EXPORT_NANOVDB_NULL;
 		}
+		int numNode2s = numNodes[2], numNode1s = numNodes[1], numLeaves = numNodes[0];
+		uchar gvdbType = gvdb.GetChannelType(channel);
 
 		// Switch to GVDB's context
 		const CUcontext gvdbContext = gvdb.getContext();
@@ -596,82 +908,14 @@ print('};')
 		//---------------------------------------------------------------------------------------------
 		// Grid (CPU)
 		nanovdb::GridData* gridData = reinterpret_cast<nanovdb::GridData*>(bufferCPU);
-		{
-			gridData->mMagic = NANOVDB_MAGIC_NUMBER;
-
-			memcpy(gridData->mGridName, gridName, nanovdb::GridData::MaxNameSize);
-
-			// Get the GVDB index-to-world transform and copy it to a format Map can read
-			Matrix4F xform = gvdb.getTransform(); // Make a copy (note that once this is integrated
-			// into the main library, we can access the inverse directly):
-			{
-				float indexToWorld[4][4];
-				for (int row = 0; row < 4; row++) {
-					for (int col = 0; col < 4; col++) {
-						indexToWorld[row][col] = xform(row, col);
-					}
-				}
-				float worldToIndex[4][4];
-				xform.InvertTRS();
-				for (int row = 0; row < 4; row++) {
-					for (int col = 0; col < 4; col++) {
-						worldToIndex[row][col] = xform(row, col);
-					}
-				}
-				gridData->mMap.set(indexToWorld, worldToIndex, 1.0); // mTaper seems to be unused
-			}
-
-			// Skip over the world bounding box for now - we'll fill it in later.
-
-			// GridData would like a uniform scale, but that's not really possible to provide, since
-			// GVDB supports arbitrary voxel transforms (e.g. think of skewed voxels).
-			// For now, we use the approach GridBuilder uses, which is scale_i = ||map(e_i) - map((0,0,0))||.
-			// However, for a different approximation, we could use something like sqrt(tr(A*A)/3),
-			// where A is the upper-left 3x3 block of xform; if A is normal, this gives the root mean
-			// square of the singular values of A.
-			const nanovdb::Vec3d mapAt0 = gridData->applyMap(nanovdb::Vec3d(0, 0, 0));
-			gridData->mVoxelSize = Vec3R(
-				(gridData->applyMap(nanovdb::Vec3d(1, 0, 0)) - mapAt0).length(),
-				(gridData->applyMap(nanovdb::Vec3d(0, 1, 0)) - mapAt0).length(),
-				(gridData->applyMap(nanovdb::Vec3d(0, 0, 1)) - mapAt0).length()
-			);
-
-			gridData->mGridClass = gridClass;
-
-			switch (gvdbType) {
-			case T_FLOAT:
-				gridData->mGridType = nanovdb::GridType::Float;
-				break;
-			case T_FLOAT3:
-				gridData->mGridType = nanovdb::GridType::Vec3f;
-				break;
-			case T_INT:
-				gridData->mGridType = nanovdb::GridType::Int32;
-			}
-
-			gridData->mBlindMetadataCount = 0;
-			gridData->mBlindMetadataOffset = 0;
-		}
+		ExportToNanoVDB_FillGrid(gvdb, gridData, gvdbType, gridName, gridClass);
 		assert(sizeof(nanovdb::GridData) == dataSizes[R_GRID]); // Consistency check
 
 		//---------------------------------------------------------------------------------------------
 		// Tree (CPU)
 		using TreeDataT = TreeData<TREE_DEPTH>; // The root is always at level 3 in NanoVDB
-		TreeDataT* treeData = reinterpret_cast<TreeDataT*>(bufferCPU + dataOffsetsBytes[R_TREE]);
-		{
-			// Filling in the tree is much simpler; we simply give the offsets from treePtr to each of
-			// the regions, and the number of nodes in each region. Note that the indices of mBytes
-			// and mCount refer to the level of the nodes.
-			treeData->mBytes[0] = dataOffsetsBytes[R_LEAF] - dataOffsetsBytes[R_TREE];
-			treeData->mBytes[1] = dataOffsetsBytes[R_NODE1] - dataOffsetsBytes[R_TREE];
-			treeData->mBytes[2] = dataOffsetsBytes[R_NODE2] - dataOffsetsBytes[R_TREE];
-			treeData->mBytes[3] = dataOffsetsBytes[R_ROOT] - dataOffsetsBytes[R_TREE];
-
-			treeData->mCount[0] = numLeaves;
-			treeData->mCount[1] = numNode1s;
-			treeData->mCount[2] = numNode2s;
-			treeData->mCount[3] = 1; // There's only one root
-		}
+		ExportToNanoVDB_FillTree(reinterpret_cast<TreeDataT*>(bufferCPU + dataOffsetsBytes[R_TREE]),
+			numNodes, dataOffsetsBytes);
 
 		// Now, wait for the GPU to finish by issuing a synchronizing operation to copy its level-2
 		// nodes to the CPU:
@@ -684,34 +928,13 @@ print('};')
 		// Root and grid extents
 		// This computes the bounding box and min and max values of the grid from the level-2 nodes.
 		// It also computes the grid's world-space AABB.
-		uint8_t* rootDataPtr = bufferCPU + dataOffsetsBytes[R_ROOT];
-		{
-			uint8_t* node2Start = bufferCPU + dataOffsetsBytes[R_NODE2];
-
-			// All voxels in the leaves of the GVDB volume are active, so this is the total volume of
-			// of the leaves:
-			uint64_t activeVoxelCount = numLeaves * gvdb.getVoxCnt(0);
-			const int totalLog2Dim = node2Log2Dim + node1Log2Dim + brickLog2Dim;
-
-			switch (gvdbType) {
-			case T_FLOAT:
-				ProcessGridExtents<float>(gridData, rootDataPtr, node2Start,
-					activeVoxelCount, backgroundPtr, numNode2s, node2Log2Dim, totalLog2Dim);
-				break;
-			case T_FLOAT3:
-				ProcessGridExtents<Vec3f>(gridData, rootDataPtr, node2Start,
-					activeVoxelCount, backgroundPtr, numNode2s, node2Log2Dim, totalLog2Dim);
-				break;
-			case T_INT:
-				ProcessGridExtents<int>(gridData, rootDataPtr, node2Start,
-					activeVoxelCount, backgroundPtr, numNode2s, node2Log2Dim, totalLog2Dim);
-				break;
-			}
-		}
+		ExportToNanoVDB_FillRoot(gvdb, gridData, gvdbType, bufferCPU + dataOffsetsBytes[R_ROOT],
+			bufferCPU + dataOffsetsBytes[R_NODE2], backgroundPtr, numNodes);
 
 		// Finally, copy the updated data - i.e. grid, tree, and root, no level-2 nodes! - back to
 		// the GPU.
 		cuMemcpyHtoD(bufferGPU, bufferCPU, dataOffsetsBytes[R_NODE2]); // i.e. up to but not including level-2 nodes
+		delete[] bufferCPU;
 
 		// Pop the context and return.
 		CUcontext pctx;
@@ -721,6 +944,112 @@ print('};')
 		return bufferGPU;
 	}
 
+	uint8_t* ExportToNanoVDB_Host(VolumeGVDB& gvdb, uchar channel, void* backgroundPtr,
+		const char gridName[nanovdb::GridData::MaxNameSize], nanovdb::GridClass gridClass, size_t* outTotalSize)
+	{
+		// Validate input
+		if (backgroundPtr == nullptr) {
+			gprintf("Error in ExportToNanoVDB_Host: backgroundPtr was nullptr!\n");
+			return nullptr;
+		}
+		if (outTotalSize == nullptr) {
+			gprintf("Error in ExportToNanoVDB_Host: outTotalSize was nullptr!\n");
+			return nullptr;
+		}
+
+		// This follows the same layout as ExportToNanoVDB, but builds the whole buffer on the CPU.
+		// Each level is written in parallel, from the leaves up, since internal nodes need the
+		// value ranges and bounding boxes of their children.
+		ValueUnion backgroundUnion = *reinterpret_cast<ValueUnion*>(backgroundPtr);
+
+		int numNodes[3];
+		size_t dataSizes[R_COUNT];
+		size_t dataOffsetsBytes[R_COUNT + 1];
+		if (!ExportToNanoVDB_Layout(gvdb, channel, numNodes, dataSizes, dataOffsetsBytes)) {
+			return nullptr;
+		}
+		const uchar gvdbType = gvdb.GetChannelType(channel);
+		const int typeTableIndex = TypeTableIndex(gvdbType);
+
+		// In CPU compute mode the CPU pools and atlas are current; otherwise fetch them.
+		if (!gvdb.isCPUCompute()) {
+			gvdb.FetchPoolCPU();
+		}
+		std::vector<uchar> atlasCopy;
+		Vector3DI atlasRes;
+		int atlasStride = 0;
+		const uchar* atlas = gvdb.AtlasRetrieveCPU(channel, atlasCopy, atlasRes, atlasStride);
+		if (atlas == nullptr) {
+			gprintf("Error in ExportToNanoVDB_Host: Channel %u has no atlas on the CPU.\n",
+				static_cast<unsigned int>(channel));
+			return nullptr;
+		}
+		const size_t valueSizes[3] = { sizeof(float), sizeof(Vec3f), sizeof(int) };
+		if (static_cast<size_t>(atlasStride) != valueSizes[typeTableIndex]) {
+			gprintf("Error in ExportToNanoVDB_Host: Atlas stride (%d) did not match the NanoVDB value size.\n",
+				atlasStride);
+			return nullptr;
+		}
+
+		uint8_t* buffer = new uint8_t[dataOffsetsBytes[R_COUNT]];
+		memset(buffer, 0, dataOffsetsBytes[R_COUNT]); // Zero for reproducibility
+
+		// Leaves (GVDB bricks)
+		{
+			HostLeafFunc func = processLeavesHostFuncs[typeTableIndex][gvdb.getLD(0) - 2];
+			uint8_t* leafStart = buffer + dataOffsetsBytes[R_LEAF];
+			ExportToNanoVDB_ParallelFor(numNodes[0], [&](int start, int end) {
+				func(gvdb, leafStart, atlas, atlasRes, start, end);
+			});
+		}
+
+		// Level-1 and level-2 nodes
+		const Region nodeRegion[3] = { R_LEAF, R_NODE1, R_NODE2 };
+		for (int level = 1; level <= 2; level++) {
+			HostInternalFunc func = processInternalNodesHostFuncs[typeTableIndex][gvdb.getLD(level) - 2];
+			Node2RangeFunc childRange = (level == 1)
+				? leafRangeFunctions[typeTableIndex][gvdb.getLD(0) - 2]
+				: rangeFunctions[typeTableIndex][gvdb.getLD(1) - 2];
+			uint8_t* nodeStart = buffer + dataOffsetsBytes[nodeRegion[level]];
+			uint8_t* childStart = buffer + dataOffsetsBytes[nodeRegion[level - 1]];
+			const int numLevelNodes = numNodes[level];
+			ExportToNanoVDB_ParallelFor(numLevelNodes, [&](int start, int end) {
+				func(gvdb, level, nodeStart, childStart, childRange, numLevelNodes, backgroundUnion, start, end);
+			});
+		}
+
+		// Grid, tree, root and extents
+		nanovdb::GridData* gridData = reinterpret_cast<nanovdb::GridData*>(buffer);
+		ExportToNanoVDB_FillGrid(gvdb, gridData, gvdbType, gridName, gridClass);
+		ExportToNanoVDB_FillTree(reinterpret_cast<TreeData<TREE_DEPTH>*>(buffer + dataOffsetsBytes[R_TREE]),
+			numNodes, dataOffsetsBytes);
+		ExportToNanoVDB_FillRoot(gvdb, gridData, gvdbType, buffer + dataOffsetsBytes[R_ROOT],
+			buffer + dataOffsetsBytes[R_NODE2], backgroundPtr, numNodes);
+
+		*outTotalSize = dataOffsetsBytes[R_COUNT];
+		return buffer;
+	}
+
+	bool SaveNanoVDB(const char* fileName, const uint8_t* grid, size_t gridSize)
+	{
+		if (grid == nullptr || gridSize == 0) {
+			gprintf("Error in SaveNanoVDB: No grid to save.\n");
+			return false;
+		}
+		// Wrap a copy of the grid in a handle, so that NanoVDB writes the file header and metadata.
+		nanovdb::HostBuffer hostBuffer = nanovdb::HostBuffer::create(gridSize);
+		memcpy(hostBuffer.data(), grid, gridSize);
+		nanovdb::GridHandle<nanovdb::HostBuffer> handle(std::move(hostBuffer));
+		try {
+			nanovdb::io::writeGrid(fileName, handle);
+		}
+		catch (const std::exception& e) {
+			gprintf("Error in SaveNanoVDB: Unable to write %s (%s).\n", fileName, e.what());
+			return false;
+		}
+		return true;
+	}
+
 	void RenderNanoVDB(CUcontext context, CUdeviceptr nanoVDB, Camera3D* camera,
 		uint width, uint height, uchar* outImage)
 	{
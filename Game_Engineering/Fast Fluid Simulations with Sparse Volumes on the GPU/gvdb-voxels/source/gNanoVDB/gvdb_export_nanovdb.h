@@ -13,15 +13,12 @@
 #include <nanovdb/NanoVDB.h>
 #include <nanovdb/util/HDDA.h>
 #include <nanovdb/util/Ray.h>
+#include <nanovdb/util/IO.h> // For SaveNanoVDB
 
 // GVDB
 #define NOMINMAX
 #include "gvdb.h"
 
-#ifdef USE_BITMASKS
-#error As of this writing, GVDB-to-NanoVDB conversion requires not using bitmasks.
-#endif // #ifdef USE_BITMASKS
-
 #ifdef NDEBUG
 static const bool DEBUG_EXPORT_NANOVDB = false;
 #else
@@ -77,6 +74,21 @@ namespace nvdb {
 	CUdeviceptr ExportToNanoVDB(VolumeGVDB& gvdb, uchar channel, void* backgroundPtr,
 		const char gridName[nanovdb::GridData::MaxNameSize], nanovdb::GridClass gridClass, size_t* outTotalSize);
 
+	// Creates the same NanoVDB volume as ExportToNanoVDB, but on the host, without launching any
+	// kernels. Returns a buffer allocated with new[] (free it with delete[]), or nullptr if
+	// exporting failed. Nodes of each level are serialized in parallel on all CPU threads.
+	//
+	// The atlas is read directly from the CPU when GVDB is in CPU compute mode (see
+	// VolumeGVDB::UseCPUCompute), so this works on machines without a CUDA device. Otherwise the
+	// node pools and the channel's atlas are first fetched from the GPU. Unlike the GPU exporter,
+	// this supports builds with USE_BITMASKS.
+	uint8_t* ExportToNanoVDB_Host(VolumeGVDB& gvdb, uchar channel, void* backgroundPtr,
+		const char gridName[nanovdb::GridData::MaxNameSize], nanovdb::GridClass gridClass, size_t* outTotalSize);
+
+	// Writes a NanoVDB volume in host memory (e.g. from ExportToNanoVDB_Host) to a .nvdb file.
+	// Note that other NanoVDB readers expect NanoGrid, i.e. log2dims of 5, 4 and 3.
+	bool SaveNanoVDB(const char* fileName, const uint8_t* grid, size_t gridSize);
+
 	// Renders a level set of a NanoGridCustom<float, 5, 4, 3> on the GPU. Switches to the given
 	// CUDA context before rendering.
 	void RenderNanoVDB(CUcontext context, CUdeviceptr nanoVDB, Camera3D* camera,
@@ -59,6 +59,17 @@ int main(int argc, char* argv) {
 	CUdeviceptr deviceGrid = ExportToNanoVDB(gvdb, 0, &background, gridName, nanovdb::GridClass::LevelSet, &gridSize);
 	gprintf("Finished converting to a NanoVDB volume in %f ms.\n", gvdb.TimerStop());
 
+	// The same conversion can also run entirely on the host, which doesn't need a CUDA device when
+	// GVDB is in CPU compute mode. Save the result as a .nvdb file for other NanoVDB tools.
+	gvdb.TimerStart();
+	size_t hostGridSize = 0;
+	uint8_t* hostGrid = ExportToNanoVDB_Host(gvdb, 0, &background, gridName, nanovdb::GridClass::LevelSet, &hostGridSize);
+	gprintf("Finished converting on the CPU in %f ms. Saving to explosion.nvdb.\n", gvdb.TimerStop());
+	if (hostGrid != nullptr) {
+		SaveNanoVDB("explosion.nvdb", hostGrid, hostGridSize);
+		delete[] hostGrid;
+	}
+
 	// Render the volume using the render kernel in cuda_export_nanovdb.cu.
 	gprintf("Rendering...\n");
 	gvdb.TimerStart();
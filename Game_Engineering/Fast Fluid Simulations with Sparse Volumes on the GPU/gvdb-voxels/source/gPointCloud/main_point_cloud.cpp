@@ -15,6 +15,7 @@ using namespace nvdb;
 #include <fstream> 
 
 #include "string_helper.h"
+#include "point_tiles.h"
 
 VolumeGVDB	gvdb;
 
@@ -49,6 +50,7 @@ public:
 	void		add_material ( bool bDeep );
 	void		add_model ();
 	void		load_points ( std::string pntpath, std::string pntfile, int frame );
+	void		load_tiles ( std::string fpath );
 	void		load_polys ( std::string polypath, std::string polyfile, int frame, float pscale, Vector3DF poffs, int pmat );	
 	void		clear_gvdb();
 	void		render_update();
@@ -88,6 +90,9 @@ public:
 	std::string	m_pntpath;
 	std::string m_pntfile;
 	int			m_pntmat;
+	bool		m_region;		// load only tiles overlapping [m_regmin, m_regmax]
+	Vector3DF	m_regmin, m_regmax;
+	int			m_tileres;		// convert input to .ptile at this resolution
 
 	bool		m_polyon;		// polygon time series
 	std::string m_polypath;
@@ -257,6 +262,7 @@ Sample::Sample()
 	m_frame = -1;
 	m_key = false;
 	m_renderscale = 0.0;
+	m_tileres = 0;
 	m_infile = "teapot.scn";
 }
 
@@ -272,6 +278,8 @@ void Sample::parse_value ( int mode, std::string tag, std::string val )
 		if (strEq(tag,"mat")) m_pntmat= static_cast<int>(strToNum(val));
 		if (strEq(tag,"frame")) m_frame = static_cast<int>(strToNum(val));
 		if (strEq(tag, "fstep")) m_fstep = static_cast<int>(strToNum(val));
+		if (strEq(tag, "rmin")) { strToVec3(val, "<", ",", ">", &m_regmin.x); m_region = true; }
+		if (strEq(tag, "rmax")) { strToVec3(val, "<", ",", ">", &m_regmax.x); m_region = true; }
 		break;
 	case M_POLYS:
 		if (strEq(tag,"path")) m_polypath = val;
@@ -408,6 +416,11 @@ void Sample::on_arg(std::string arg, std::string val)
 		m_renderscale = strToNum(val);
 		nvprintf("render scale: %f\n", m_renderscale);
 	}
+
+	if (arg.compare("-tiles") == 0) {
+		m_tileres = static_cast<int>(strToNum(val));
+		nvprintf("convert to tiles: %d\n", m_tileres);
+	}
 }
 
 bool Sample::init() 
@@ -435,6 +448,9 @@ bool Sample::init()
 	m_pnton = false;				// point time series
 	m_pntmat = 0;
 	m_fstep = 0;
+	m_region = false;
+	m_regmin.Set(-1.0e30f, -1.0e30f, -1.0e30f);
+	m_regmax.Set( 1.0e30f,  1.0e30f,  1.0e30f);
 	
 	m_polyon = false;					// polygonal time series
 	m_pframe = 0;
@@ -551,6 +567,20 @@ void Sample::load_points ( std::string pntpath, std::string pntfile, int frame )
 		sprintf ( filepath, "%s", srcfile );
 	}
 
+	// Tiled point files, optionally converted from the legacy format first
+	std::string fpath = filepath;
+	if ( m_tileres > 0 && fpath.find(".ptile") == std::string::npos ) {
+		nvprintf ( "Convert %s to tiles...", filepath );
+		PERF_PUSH ( "  Convert to tiles" );
+		if ( PointTiles::ConvertRaw ( fpath, fpath + ".ptile", m_tileres ) < 0 ) exit(-1);
+		PERF_POP ();
+		fpath += ".ptile";
+	}
+	if ( fpath.size() > 6 && fpath.compare ( fpath.size()-6, 6, ".ptile" ) == 0 ) {
+		load_tiles ( fpath );
+		return;
+	}
+
 	nvprintf ( "Load points from %s...", filepath );
 
 	// Read # of points
@@ -622,6 +652,45 @@ void Sample::load_points ( std::string pntpath, std::string pntfile, int frame )
 	nvprintf ( "  Done.\n" );
 }
 
+// Read the tiles of a .ptile file overlapping the region (all tiles if none is set)
+void Sample::load_tiles ( std::string fpath )
+{
+	nvprintf ( "Load point tiles from %s...", fpath.c_str() );
+
+	PointTiles tiles;
+	PERF_PUSH ( "  Open file" );
+	if ( !tiles.Open ( fpath ) ) {
+		printf("Cannot open file: %s\n", fpath.c_str());
+		exit(-1);
+	}
+	std::vector<int> sel;
+	if ( m_region )
+		tiles.SelectBox ( m_regmin, m_regmax, sel );
+	else
+		tiles.SelectAll ( sel );
+	slong cnt = tiles.CountPoints ( sel );
+	PERF_POP ();
+	if ( cnt > 0x7FFFFFFF ) {
+		printf("Region holds %lld points, too many to load at once.\n", (long long) cnt);
+		exit(-1);
+	}
+	m_numpnts = static_cast<int>(cnt);
+
+	// Decode selected tiles directly to render space
+	PERF_PUSH("Read");
+	gvdb.AllocData(m_pnts, m_numpnts, sizeof(Vector3DF), true);
+	tiles.ReadTiles ( sel, (Vector3DF*) m_pnts.cpu, 0x0, Vector3DF(m_renderscale,m_renderscale,m_renderscale), Vector3DF(0,0,0) );
+	PERF_POP();
+	PERF_PUSH("Commit");
+	gvdb.CommitData(m_pnts);
+	PERF_POP();
+
+	DataPtr temp;
+	gvdb.SetPoints( m_pnts, temp, temp);
+	printf("m_numpnts = %d (%d of %d tiles)\n", m_numpnts, (int) sel.size(), tiles.getNumTiles());
+	nvprintf ( "  Done.\n" );
+}
+
 void Sample::load_polys ( std::string polypath, std::string polyfile, int frame, float pscale, Vector3DF poffs, int pmat )
 {
 	bool bFirst = false;
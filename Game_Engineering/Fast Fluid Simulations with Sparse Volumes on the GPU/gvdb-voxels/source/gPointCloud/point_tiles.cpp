@@ -0,0 +1,440 @@
+//-----------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "point_tiles.h"
+
+#define PTILE_BATCH			(64 << 20)		// writer: payload bytes encoded per batch
+
+PointTiles::PointTiles ()
+{
+	memset ( &m_Header, 0, sizeof(m_Header) );
+	m_Data = 0x0;
+	m_Size = 0;
+	m_Mapping = 0x0;
+}
+
+PointTiles::~PointTiles ()
+{
+	Close ();
+}
+
+//---------------------------------------------------------------- Helpers
+static int NumThreads ()
+{
+	return std::max ( 1, (int) std::thread::hardware_concurrency() );
+}
+
+// Run func(t, start, end) over [0,num) split into contiguous chunks
+template <typename F>
+static void ParallelRange ( slong num, int threads, F func )
+{
+	threads = (int) std::max ( slong(1), std::min ( slong(threads), num ) );
+	slong step = (num + threads - 1) / threads;
+	std::vector<std::thread> pool;
+	for (int t = 1; t < threads; t++ )
+		pool.push_back ( std::thread ( func, t, std::min ( num, t*step ), std::min ( num, (t+1)*step ) ) );
+	func ( 0, slong(0), std::min ( num, step ) );
+	for (size_t t = 0; t < pool.size(); t++ )
+		pool[t].join ();
+}
+
+static inline uint SpreadBits3 ( uint v )
+{
+	v &= 0x3FF;
+	v = ( v | (v << 16) ) & 0x030000FF;
+	v = ( v | (v << 8) ) & 0x0300F00F;
+	v = ( v | (v << 4) ) & 0x030C30C3;
+	v = ( v | (v << 2) ) & 0x09249249;
+	return v;
+}
+static inline uint Morton3 ( int x, int y, int z )
+{
+	return SpreadBits3 ( x ) | ( SpreadBits3 ( y ) << 1 ) | ( SpreadBits3 ( z ) << 2 );
+}
+
+static inline bool isFinite3 ( const Vector3DF& p )
+{
+	return fabs(p.x) < 1.0e30f && fabs(p.y) < 1.0e30f && fabs(p.z) < 1.0e30f;
+}
+
+static inline slong PosBytes ( slong num )		{ return ( num * 6 + 3 ) & ~slong(3); }
+
+//---------------------------------------------------------------- Writing
+slong PointTiles::Write ( std::string fname, slong num, const Vector3DF* pos, const uint* clr, int res )
+{
+	if ( res < 1 || res > PTILE_MAX_RES ) {
+		gprintf ( "ERROR: PointTiles resolution %d out of range (1-%d).\n", res, PTILE_MAX_RES );
+		return -1;
+	}
+	const int threads = NumThreads ();
+
+	// Bounding box (non-finite points are dropped)
+	std::vector<Vector3DF> tmin ( threads, Vector3DF( 1.0e30f, 1.0e30f, 1.0e30f) );
+	std::vector<Vector3DF> tmax ( threads, Vector3DF(-1.0e30f,-1.0e30f,-1.0e30f) );
+	ParallelRange ( num, threads, [&] ( int t, slong start, slong end ) {
+		Vector3DF lo = tmin[t], hi = tmax[t];
+		for (slong n = start; n < end; n++ ) {
+			if ( !isFinite3 ( pos[n] ) ) continue;
+			lo.x = std::min ( lo.x, pos[n].x ); hi.x = std::max ( hi.x, pos[n].x );
+			lo.y = std::min ( lo.y, pos[n].y ); hi.y = std::max ( hi.y, pos[n].y );
+			lo.z = std::min ( lo.z, pos[n].z ); hi.z = std::max ( hi.z, pos[n].z );
+		}
+		tmin[t] = lo; tmax[t] = hi;
+	} );
+	Vector3DF bmin = tmin[0], bmax = tmax[0];
+	for (int t = 1; t < threads; t++ ) {
+		bmin.x = std::min ( bmin.x, tmin[t].x ); bmax.x = std::max ( bmax.x, tmax[t].x );
+		bmin.y = std::min ( bmin.y, tmin[t].y ); bmax.y = std::max ( bmax.y, tmax[t].y );
+		bmin.z = std::min ( bmin.z, tmin[t].z ); bmax.z = std::max ( bmax.z, tmax[t].z );
+	}
+	if ( bmin.x > bmax.x ) bmin = bmax = Vector3DF(0,0,0);
+
+	// Tile grid: cubic tiles, res along the longest axis
+	PTileHeader hdr;
+	memset ( &hdr, 0, sizeof(hdr) );
+	hdr.magic = PTILE_MAGIC;
+	hdr.version = PTILE_VERSION;
+	hdr.flags = ( clr != 0x0 ) ? PTILE_COLOR : 0;
+	hdr.res = res;
+	Vector3DF ext = bmax - bmin;
+	hdr.tile = std::max ( std::max ( ext.x, ext.y ), std::max ( ext.z, 1.0e-20f ) ) / res;
+	hdr.grid[0] = std::min ( res, std::max ( 1, int( ceil ( ext.x / hdr.tile ) ) ) );
+	hdr.grid[1] = std::min ( res, std::max ( 1, int( ceil ( ext.y / hdr.tile ) ) ) );
+	hdr.grid[2] = std::min ( res, std::max ( 1, int( ceil ( ext.z / hdr.tile ) ) ) );
+	hdr.bmin[0] = bmin.x; hdr.bmin[1] = bmin.y; hdr.bmin[2] = bmin.z;
+	hdr.bmax[0] = bmax.x; hdr.bmax[1] = bmax.y; hdr.bmax[2] = bmax.z;
+	const int gx = hdr.grid[0], gy = hdr.grid[1], gz = hdr.grid[2];
+	const slong cells = slong(gx) * gy * gz;
+	const float inv = 1.0f / hdr.tile;
+	if ( cells >= slong(ID_UNDEFL) ) {				// cell ids are uint, ID_UNDEFL marks dropped points
+		gprintf ( "ERROR: PointTiles grid %d x %d x %d has too many cells.\n", gx, gy, gz );
+		return -1;
+	}
+
+	// Counting sort of points by grid cell. Per-thread histograms keep the
+	// scatter deterministic; fewer threads are used for very fine grids.
+	const int sort_threads = (int) std::max ( slong(1), std::min ( slong(threads), ( slong(64) << 20 ) / ( cells * slong(sizeof(uint)) ) ) );
+	std::vector<uint> cell ( num );
+	std::vector< std::vector<uint> > hist ( sort_threads );
+	ParallelRange ( num, sort_threads, [&] ( int t, slong start, slong end ) {
+		std::vector<uint>& h = hist[t];
+		h.assign ( cells, 0 );
+		for (slong n = start; n < end; n++ ) {
+			if ( !isFinite3 ( pos[n] ) ) { cell[n] = ID_UNDEFL; continue; }
+			int x = std::min ( gx-1, int( (pos[n].x - bmin.x) * inv ) );
+			int y = std::min ( gy-1, int( (pos[n].y - bmin.y) * inv ) );
+			int z = std::min ( gz-1, int( (pos[n].z - bmin.z) * inv ) );
+			cell[n] = uint( ( slong(z) * gy + y ) * gx + x );
+			h[ cell[n] ]++;
+		}
+	} );
+
+	// Occupied cells in Morton order, and their output ranges
+	std::vector<uint> order;
+	std::vector<slong> base ( cells, 0 );
+	for (slong c = 0; c < cells; c++ ) {
+		for (int t = 0; t < sort_threads; t++ ) base[c] += hist[t].empty() ? 0 : hist[t][c];
+		if ( base[c] > 0 ) order.push_back ( uint(c) );
+	}
+	auto morton = [&] ( uint c ) { return Morton3 ( c % gx, (c / gx) % gy, c / ( uint(gx) * gy ) ); };
+	std::sort ( order.begin(), order.end(), [&] ( uint a, uint b ) { return morton(a) < morton(b); } );
+
+	std::vector<PTileEntry> index ( order.size() );
+	std::vector<slong> first ( order.size() + 1, 0 );
+	slong written = 0;
+	slong offset = sizeof(PTileHeader);
+	for (size_t i = 0; i < order.size(); i++ ) {
+		slong cnt = base[ order[i] ];
+		if ( cnt > 0x7FFFFFFF ) {
+			gprintf ( "ERROR: PointTiles tile has %lld points, use a finer resolution than %d.\n", (long long) cnt, res );
+			return -1;
+		}
+		PTileEntry& e = index[i];
+		memset ( &e, 0, sizeof(e) );
+		e.cell = morton ( order[i] );
+		e.num = int(cnt);
+		e.offset = offset;
+		offset += PosBytes ( cnt ) + ( clr ? cnt * sizeof(uint) : 0 );
+		first[i] = written;
+		base[ order[i] ] = written;
+		written += cnt;
+	}
+	first[ order.size() ] = written;
+
+	// Scatter point ids, each thread into its own sub-range of every cell
+	std::vector<slong> sorted ( written );
+	ParallelRange ( num, sort_threads, [&] ( int t, slong start, slong end ) {
+		std::vector<slong> next ( cells );
+		for (slong c = 0; c < cells; c++ ) {
+			next[c] = base[c];
+			for (int u = 0; u < t; u++ ) next[c] += hist[u][c];
+		}
+		for (slong n = start; n < end; n++ )
+			if ( cell[n] != ID_UNDEFL ) sorted[ next[ cell[n] ]++ ] = n;
+	} );
+	cell.clear (); cell.shrink_to_fit ();
+	hist.clear ();
+
+	FILE* fp = fopen ( fname.c_str(), "wb" );
+	if ( fp == 0x0 ) {
+		gprintf ( "ERROR: Unable to write %s\n", fname.c_str() );
+		return -1;
+	}
+	hdr.num = written;
+	bool ok = fwrite ( &hdr, sizeof(hdr), 1, fp ) == 1;
+
+	// Encode and write tiles in batches of about PTILE_BATCH bytes
+	std::vector<uchar> buf;
+	for (size_t i0 = 0; ok && i0 < index.size(); ) {
+		size_t i1 = i0 + 1;
+		while ( i1 < index.size() && index[i1].offset - index[i0].offset < PTILE_BATCH ) i1++;
+		slong batch_end = ( i1 < index.size() ) ? index[i1].offset : offset;
+		buf.assign ( batch_end - index[i0].offset, 0 );
+
+		std::atomic<size_t> next_tile ( i0 );
+		ParallelRange ( NumThreads(), NumThreads(), [&] ( int, slong, slong ) {
+			for (size_t i; ( i = next_tile++ ) < i1; ) {
+				PTileEntry& e = index[i];
+				const slong* ids = &sorted[ first[i] ];
+				Vector3DF lo = pos[ ids[0] ], hi = lo;
+				for (int n = 1; n < e.num; n++ ) {
+					const Vector3DF& p = pos[ ids[n] ];
+					lo.x = std::min ( lo.x, p.x ); hi.x = std::max ( hi.x, p.x );
+					lo.y = std::min ( lo.y, p.y ); hi.y = std::max ( hi.y, p.y );
+					lo.z = std::min ( lo.z, p.z ); hi.z = std::max ( hi.z, p.z );
+				}
+				e.bmin[0] = lo.x; e.bmin[1] = lo.y; e.bmin[2] = lo.z;
+				e.bmax[0] = hi.x; e.bmax[1] = hi.y; e.bmax[2] = hi.z;
+				Vector3DF q ( hi.x > lo.x ? 65535.0f / (hi.x - lo.x) : 0.0f,
+							  hi.y > lo.y ? 65535.0f / (hi.y - lo.y) : 0.0f,
+							  hi.z > lo.z ? 65535.0f / (hi.z - lo.z) : 0.0f );
+
+				uchar* dst = &buf[ e.offset - index[i0].offset ];
+				ushort* qp = (ushort*) dst;
+				for (int n = 0; n < e.num; n++ ) {
+					const Vector3DF& p = pos[ ids[n] ];
+					*qp++ = ushort( std::min ( 65535.0f, (p.x - lo.x) * q.x + 0.5f ) );
+					*qp++ = ushort( std::min ( 65535.0f, (p.y - lo.y) * q.y + 0.5f ) );
+					*qp++ = ushort( std::min ( 65535.0f, (p.z - lo.z) * q.z + 0.5f ) );
+				}
+				if ( clr ) {
+					uint* qc = (uint*) ( dst + PosBytes ( e.num ) );
+					for (int n = 0; n < e.num; n++ ) qc[n] = clr[ ids[n] ];
+				}
+			}
+		} );
+		ok = fwrite ( buf.data(), 1, buf.size(), fp ) == buf.size();
+		i0 = i1;
+	}
+
+	// Index and footer
+	PTileFooter foot;
+	foot.index = offset;
+	foot.count = (int) index.size();
+	foot.magic = PTILE_INDEX;
+	if ( ok && !index.empty() ) ok = fwrite ( index.data(), sizeof(PTileEntry), index.size(), fp ) == index.size();
+	if ( ok ) ok = fwrite ( &foot, sizeof(foot), 1, fp ) == 1;
+	if ( fclose ( fp ) != 0 ) ok = false;
+	if ( !ok ) {
+		gprintf ( "ERROR: Failed writing %s\n", fname.c_str() );
+		return -1;
+	}
+	return written;
+}
+
+slong PointTiles::ConvertRaw ( std::string src, std::string dst, int res )
+{
+	FILE* fp = fopen ( src.c_str(), "rb" );
+	if ( fp == 0x0 ) {
+		gprintf ( "ERROR: Unable to open %s\n", src.c_str() );
+		return -1;
+	}
+	int num = 0;
+	Vector3DF wMin, wMax;
+	bool ok = fread ( &num, sizeof(int), 1, fp ) == 1;			// 7*4 = 28 byte header
+	ok = ok && fread ( &wMin.x, sizeof(float), 3, fp ) == 3;
+	ok = ok && fread ( &wMax.x, sizeof(float), 3, fp ) == 3;
+	std::vector<ushort> raw;
+	if ( ok && num > 0 ) {
+		raw.resize ( slong(num) * 3 );
+		ok = fread ( raw.data(), 3 * sizeof(ushort), num, fp ) == (size_t) num;
+	}
+	fclose ( fp );
+	if ( !ok || num < 0 ) {
+		gprintf ( "ERROR: %s is truncated or not a point file.\n", src.c_str() );
+		return -1;
+	}
+
+	Vector3DF wdelta ( (wMax.x - wMin.x)/65535.0f, (wMax.y - wMin.y)/65535.0f, (wMax.z - wMin.z)/65535.0f );
+	std::vector<Vector3DF> pos ( num );
+	ParallelRange ( num, NumThreads(), [&] ( int, slong start, slong end ) {
+		for (slong n = start; n < end; n++ )
+			pos[n].Set ( wMin.x + raw[n*3] * wdelta.x, wMin.y + raw[n*3+1] * wdelta.y, wMin.z + raw[n*3+2] * wdelta.z );
+	} );
+	raw.clear (); raw.shrink_to_fit ();
+
+	return Write ( dst, num, pos.data(), 0x0, res );
+}
+
+//---------------------------------------------------------------- Reading
+void PointTiles::Close ()
+{
+	gunmapFile ( m_Data, m_Size, m_Mapping );
+	m_Data = 0x0;
+	m_Size = 0;
+	m_Mapping = 0x0;
+	m_Index.clear ();
+	memset ( &m_Header, 0, sizeof(m_Header) );
+}
+
+bool PointTiles::Open ( std::string fname )
+{
+	Close ();
+	m_Name = fname;
+	m_Data = gmapFile ( fname.c_str(), m_Size, m_Mapping );
+	if ( m_Data == 0x0 ) {
+		gprintf ( "ERROR: Unable to open %s\n", fname.c_str() );
+		return false;
+	}
+	if ( m_Size < slong( sizeof(PTileHeader) + sizeof(PTileFooter) ) ) {
+		gprintf ( "ERROR: %s is not a point tile file.\n", fname.c_str() );
+		Close ();
+		return false;
+	}
+	memcpy ( &m_Header, m_Data, sizeof(PTileHeader) );
+	if ( m_Header.magic != PTILE_MAGIC || m_Header.version != PTILE_VERSION ) {
+		gprintf ( "ERROR: %s is not a point tile file (or version %d).\n", fname.c_str(), m_Header.version );
+		Close ();
+		return false;
+	}
+
+	PTileFooter foot;
+	memcpy ( &foot, m_Data + m_Size - sizeof(PTileFooter), sizeof(PTileFooter) );
+	if ( foot.magic != PTILE_INDEX || foot.count < 0 || foot.index < slong(sizeof(PTileHeader))
+		|| foot.index + slong(foot.count) * slong(sizeof(PTileEntry)) + slong(sizeof(PTileFooter)) != m_Size ) {
+		gprintf ( "ERROR: %s has no tile index (truncated?).\n", fname.c_str() );
+		Close ();
+		return false;
+	}
+	m_Index.resize ( foot.count );
+	if ( foot.count > 0 )
+		memcpy ( m_Index.data(), m_Data + foot.index, foot.count * sizeof(PTileEntry) );
+
+	// Every tile must lie between the header and the index
+	slong total = 0;
+	const slong cbytes = hasColor() ? sizeof(uint) : 0;
+	for (int i = 0; i < foot.count; i++ ) {
+		const PTileEntry& e = m_Index[i];
+		if ( e.num < 0 || e.offset < slong(sizeof(PTileHeader)) || e.offset + PosBytes ( e.num ) + e.num * cbytes > foot.index ) {
+			gprintf ( "ERROR: %s tile %d is corrupt.\n", fname.c_str(), i );
+			Close ();
+			return false;
+		}
+		total += e.num;
+	}
+	if ( total != m_Header.num ) {
+		gprintf ( "ERROR: %s index holds %lld points, header says %lld.\n", fname.c_str(), (long long) total, (long long) m_Header.num );
+		Close ();
+		return false;
+	}
+	return true;
+}
+
+int PointTiles::SelectAll ( std::vector<int>& tiles )
+{
+	tiles.resize ( m_Index.size() );
+	for (size_t i = 0; i < m_Index.size(); i++ ) tiles[i] = (int) i;
+	return (int) tiles.size();
+}
+
+int PointTiles::SelectBox ( Vector3DF bmin, Vector3DF bmax, std::vector<int>& tiles )
+{
+	tiles.clear ();
+	for (size_t i = 0; i < m_Index.size(); i++ ) {
+		const PTileEntry& e = m_Index[i];
+		if ( e.bmin[0] > bmax.x || e.bmin[1] > bmax.y || e.bmin[2] > bmax.z ) continue;
+		if ( e.bmax[0] < bmin.x || e.bmax[1] < bmin.y || e.bmax[2] < bmin.z ) continue;
+		tiles.push_back ( (int) i );
+	}
+	return (int) tiles.size();
+}
+
+int PointTiles::SelectFrustum ( Camera3D* cam, Vector3DF scal, Vector3DF trans, std::vector<int>& tiles )
+{
+	tiles.clear ();
+	for (size_t i = 0; i < m_Index.size(); i++ ) {
+		const PTileEntry& e = m_Index[i];
+		Vector3DF a ( e.bmin[0]*scal.x + trans.x, e.bmin[1]*scal.y + trans.y, e.bmin[2]*scal.z + trans.z );
+		Vector3DF b ( e.bmax[0]*scal.x + trans.x, e.bmax[1]*scal.y + trans.y, e.bmax[2]*scal.z + trans.z );
+		Vector3DF lo ( std::min(a.x,b.x), std::min(a.y,b.y), std::min(a.z,b.z) );
+		Vector3DF hi ( std::max(a.x,b.x), std::max(a.y,b.y), std::max(a.z,b.z) );
+		if ( cam->boxInFrustum ( lo, hi ) ) tiles.push_back ( (int) i );
+	}
+	return (int) tiles.size();
+}
+
+slong PointTiles::CountPoints ( const std::vector<int>& tiles )
+{
+	slong cnt = 0;
+	for (size_t i = 0; i < tiles.size(); i++ ) cnt += m_Index[ tiles[i] ].num;
+	return cnt;
+}
+
+void PointTiles::DecodeTile ( int i, Vector3DF* pos, uint* clr, Vector3DF scal, Vector3DF trans )
+{
+	const PTileEntry& e = m_Index[i];
+	const uchar* src = m_Data + e.offset;
+	Vector3DF d ( (e.bmax[0] - e.bmin[0]) / 65535.0f, (e.bmax[1] - e.bmin[1]) / 65535.0f, (e.bmax[2] - e.bmin[2]) / 65535.0f );
+	const ushort* qp = (const ushort*) src;
+	for (int n = 0; n < e.num; n++, qp += 3 )
+		pos[n].Set ( (e.bmin[0] + qp[0] * d.x) * scal.x + trans.x,
+					 (e.bmin[1] + qp[1] * d.y) * scal.y + trans.y,
+					 (e.bmin[2] + qp[2] * d.z) * scal.z + trans.z );
+	if ( clr != 0x0 ) {
+		if ( hasColor() )
+			memcpy ( clr, src + PosBytes ( e.num ), e.num * sizeof(uint) );
+		else
+			memset ( clr, 0xFF, e.num * sizeof(uint) );
+	}
+}
+
+slong PointTiles::ReadTiles ( const std::vector<int>& tiles, Vector3DF* pos, uint* clr, Vector3DF scal, Vector3DF trans )
+{
+	std::vector<slong> first ( tiles.size() );
+	slong cnt = 0;
+	for (size_t i = 0; i < tiles.size(); i++ ) {
+		first[i] = cnt;
+		cnt += m_Index[ tiles[i] ].num;
+	}
+	std::atomic<size_t> next ( 0 );
+	ParallelRange ( NumThreads(), NumThreads(), [&] ( int, slong, slong ) {
+		for (size_t i; ( i = next++ ) < tiles.size(); )
+			DecodeTile ( tiles[i], pos + first[i], clr ? clr + first[i] : 0x0, scal, trans );
+	} );
+	return cnt;
+}
+
+void PointTiles::StreamTiles ( const std::vector<int>& tiles, std::function<void ( int tile, int num, const Vector3DF* pos, const uint* clr )> func )
+{
+	std::atomic<size_t> next ( 0 );
+	ParallelRange ( NumThreads(), NumThreads(), [&] ( int, slong, slong ) {
+		std::vector<Vector3DF> pos;
+		std::vector<uint> clr;
+		for (size_t i; ( i = next++ ) < tiles.size(); ) {
+			int num = m_Index[ tiles[i] ].num;
+			pos.resize ( num );
+			if ( hasColor() ) clr.resize ( num );
+			DecodeTile ( tiles[i], pos.data(), hasColor() ? clr.data() : 0x0, Vector3DF(1,1,1), Vector3DF(0,0,0) );
+			func ( tiles[i], num, pos.data(), hasColor() ? clr.data() : 0x0 );
+		}
+	} );
+}
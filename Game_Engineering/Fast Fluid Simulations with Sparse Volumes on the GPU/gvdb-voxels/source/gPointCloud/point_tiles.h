@@ -0,0 +1,112 @@
+//-----------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+//-----------------------------------------------------------------------------
+
+// Tiled point cloud (.ptile) - points sorted into spatial tiles so a region of
+// a large scan can be read without touching the rest of the file.
+//
+// Layout:  [PTileHeader] [tile]...[tile] [PTileEntry x count] [PTileFooter]
+//
+// The cloud bounding box is cut into a grid of cubic tiles, res tiles along
+// its longest axis. Occupied tiles are written in Morton order of their grid
+// cell, so tiles close in space are close in the file. A tile holds its points
+// as 16-bit positions quantized to the tile's own tight bounds (padded to 4
+// bytes), followed by one uint color per point if the cloud has colors. The
+// index at the end gives each tile's cell, point count, offset and bounds.
+// Readers memory-map the file, select tiles by box or camera frustum and
+// decode them on several threads.
+
+#ifndef DEF_POINT_TILES
+	#define DEF_POINT_TILES
+
+	#include <string>
+	#include <vector>
+	#include <functional>
+
+	#include "gvdb_types.h"
+	#include "gvdb_vec.h"
+	#include "gvdb_camera.h"
+	using namespace nvdb;
+
+	#define PTILE_MAGIC			0x4C495450		// 'PTIL'
+	#define PTILE_INDEX			0x58444E49		// 'INDX'
+	#define PTILE_VERSION		1
+	#define PTILE_COLOR			1				// header flags
+	#define PTILE_MAX_RES		256				// bounds the writer's cell histogram
+
+	struct PTileHeader {
+		uint		magic;
+		uint		version;
+		uint		flags;
+		int			res;						// tiles along the longest axis
+		int			grid[3];					// tiles per axis
+		float		tile;						// tile width
+		slong		num;						// total points
+		float		bmin[3], bmax[3];			// cloud bounding box
+	};
+	struct PTileEntry {
+		uint		cell;						// Morton code of the grid cell
+		int			num;
+		slong		offset;						// file offset of the tile payload
+		float		bmin[3], bmax[3];			// tight bounds, also the quantization box
+	};
+	struct PTileFooter {
+		slong		index;						// file offset of the index
+		int			count;
+		uint		magic;
+	};
+
+	class PointTiles {
+	public:
+		PointTiles ();
+		~PointTiles ();
+
+		// Writing. Sorts the points into tiles (in parallel) and writes the file.
+		// clr may be 0x0. Non-finite points are dropped. Returns the number of
+		// points written, -1 on error.
+		static slong Write ( std::string fname, slong num, const Vector3DF* pos, const uint* clr, int res = 64 );
+
+		// Converts the legacy point format (28-byte header, ushort[3] per point)
+		static slong ConvertRaw ( std::string src, std::string dst, int res = 64 );
+
+		// Reading
+		bool Open ( std::string fname );
+		void Close ();
+		bool isOpen ()						{ return m_Data != 0x0; }
+		bool hasColor ()					{ return (m_Header.flags & PTILE_COLOR) != 0; }
+		slong getNumPoints ()				{ return m_Header.num; }
+		Vector3DF getMin ()					{ return Vector3DF ( m_Header.bmin[0], m_Header.bmin[1], m_Header.bmin[2] ); }
+		Vector3DF getMax ()					{ return Vector3DF ( m_Header.bmax[0], m_Header.bmax[1], m_Header.bmax[2] ); }
+		int getNumTiles ()					{ return (int) m_Index.size(); }
+		const PTileEntry& getTile ( int i )	{ return m_Index[i]; }
+
+		// Tile selection, in file order. Tiles are returned whole, so points
+		// near the edges of a selection may lie outside it.
+		int SelectAll ( std::vector<int>& tiles );
+		int SelectBox ( Vector3DF bmin, Vector3DF bmax, std::vector<int>& tiles );
+		int SelectFrustum ( Camera3D* cam, Vector3DF scal, Vector3DF trans, std::vector<int>& tiles );	// tiles placed by p*scal+trans
+		slong CountPoints ( const std::vector<int>& tiles );
+
+		// Decode tiles into pos (and clr, if not 0x0) in the order given, on
+		// several threads. Positions are written as p*scal+trans. Returns the count.
+		slong ReadTiles ( const std::vector<int>& tiles, Vector3DF* pos, uint* clr, Vector3DF scal = Vector3DF(1,1,1), Vector3DF trans = Vector3DF(0,0,0) );
+
+		// Decode tiles one at a time and hand them to func from worker threads;
+		// func must be thread safe. Buffers are reused after func returns.
+		void StreamTiles ( const std::vector<int>& tiles, std::function<void ( int tile, int num, const Vector3DF* pos, const uint* clr )> func );
+
+	private:
+		void DecodeTile ( int i, Vector3DF* pos, uint* clr, Vector3DF scal, Vector3DF trans );
+
+		std::string					m_Name;
+		PTileHeader					m_Header;
+		std::vector<PTileEntry>		m_Index;
+
+		uchar*						m_Data;				// file mapping
+		slong						m_Size;
+		void*						m_Mapping;
+	};
+
+#endif
@@ -27,6 +27,7 @@ public:
 
 	bool		LoadRAW(char* fname, Vector3DI res, int bpp);
 	bool		ConvertToFloat(Vector3DI res, uchar* dat);
+	bool		LoadSource();
 	void		Rebuild() { Rebuild(m_VolMax, m_sparse, m_halo); }
 	void		Rebuild( Vector3DF vmax, bool bSparse, bool bHalo);
 	
@@ -34,8 +35,9 @@ public:
 	void		draw_topology();
 
 	Vector3DI	m_DataRes;
-	int			m_DataBpp;			// 1=byte, 2=ushort, 4=float
+	int			m_DataBpp;			// of m_DataFile: 1=byte, 2=ushort, 4=float
 	char*		m_DataBuf;
+	std::string	m_DataFile;
 	Vector3DF	m_VolMax;
 
 	int			m_gvdb_tex;	
@@ -43,6 +45,7 @@ public:
 	bool		m_show_topo;
 	bool		m_sparse;
 	bool		m_halo;
+	bool		m_stream;
 };
 Sample sample_obj;
 
@@ -63,6 +66,7 @@ void Sample::start_guis(int w, int h)
 	addGui(20, h - 30, 130, 20, "Topology", GUI_CHECK, GUI_BOOL, &m_show_topo, 0, 1);
 	addGui(160, h - 30, 130, 20, "Halo", GUI_CHECK, GUI_BOOL, &m_halo, 0, 1);
 	addGui(300, h - 30, 130, 20, "Sparse", GUI_CHECK, GUI_BOOL, &m_sparse, 0, 1);	
+	addGui(440, h - 30, 130, 20, "Stream", GUI_CHECK, GUI_BOOL, &m_stream, 0, 1);
 }
 
 bool Sample::ConvertToFloat(Vector3DI res, uchar* dat)
@@ -77,7 +81,6 @@ bool Sample::ConvertToFloat(Vector3DI res, uchar* dat)
 	if (m_DataBuf != 0) free(m_DataBuf);
 	m_DataBuf = (char*) vnew;
 	m_DataRes = res;
-	m_DataBpp = 4;
 	
 	return true;
 }
@@ -103,6 +106,27 @@ bool Sample::LoadRAW (char* fname, Vector3DI res, int bpp)
 	return true;
 }
 
+// Load the RAW file into memory and transfer it to the AUX_DATA3D buffer used by
+// Resample. Only needed when not streaming.
+bool Sample::LoadSource ()
+{
+	printf ( "Loading RAW. %s\n", m_DataFile.c_str() );
+	if ( !LoadRAW ( (char*) m_DataFile.c_str(), m_DataRes, m_DataBpp ) )		// This sets m_DataBuf
+		return false;
+
+	// Convert data to float
+	printf("Convert to float.\n");
+	ConvertToFloat( m_DataRes, (uchar*) m_DataBuf );
+
+	// Transfer source data to GPU
+	printf("Transfer data to GPU.\n");
+	gvdb.PrepareAux( AUX_DATA3D, m_DataRes.x*m_DataRes.y*m_DataRes.z, sizeof(float), false, false );
+	DataPtr& aux3D = gvdb.getAux(AUX_DATA3D);
+	gvdb.SetDataCPU( aux3D, m_DataRes.x*m_DataRes.y*m_DataRes.z, m_DataBuf, 0, sizeof(float) );
+	gvdb.CommitData(aux3D);
+	return true;
+}
+
 void Sample::Rebuild(Vector3DF vmax, bool bSparse, bool bHalo )
 {
 	gvdb.Clear();
@@ -114,6 +138,19 @@ void Sample::Rebuild(Vector3DF vmax, bool bSparse, bool bHalo )
 	gvdb.SetChannelDefault(16, 16, 16);
 	gvdb.AddChannel(0, T_FLOAT, 1);
 
+	if (m_stream) {
+		// Stream - Read the RAW file in z-slabs straight into the atlas, without resampling
+		// and without holding the volume in memory. This is how volumes larger than host
+		// memory are loaded. The source orientation and voxel aspect (see below) are
+		// applied by the render transform instead: scale X by 2, swap Y and Z, invert Z.
+		printf("Stream RAW into GVDB.\n");
+		gvdb.SetTransform(Vector3DF(0, 0, 0), Vector3DF(2, 1, 1), Vector3DF(-90, 0, 0), Vector3DF(0, 0, 252));
+		gvdb.LoadRAW(m_DataFile, m_DataRes, m_DataBpp, 0, bSparse ? 0.05f : -1.0f, Vector3DF(0, 256, 0), Vector3DF(0, 1, 0));
+		return;
+	}
+	if ( m_DataBuf == 0x0 && !LoadSource () ) return;		// first in-memory build
+	gvdb.SetTransform(Vector3DF(0, 0, 0), Vector3DF(1, 1, 1), Vector3DF(0, 0, 0), Vector3DF(0, 0, 0));
+
 	// Set volume transform
 	Matrix4F xform;
 	// NOTE: 
@@ -167,7 +204,7 @@ bool Sample::init()
 	m_show_topo = false;
 	m_halo = true;
 	m_sparse = false;	
-	m_DataBuf = 0;
+	m_DataBuf = 0;							// m_stream is set by -stream
 
 	init2D("arial");
 
@@ -181,26 +218,17 @@ bool Sample::init()
 
 	gvdb.StartRasterGL();
 
-	// Load RAW in CPU memory
+	// Locate the RAW file. It is loaded into memory by the first in-memory
+	// Rebuild; when streaming it is never held in memory.
 	char scnpath[1024];
 	printf("Loading volume data.\n");	
 	if ( !gvdb.getScene()->FindFile ( "head.raw", scnpath ) ) {
 		nvprintf ( "Cannot find pvm file.\n" );
 		nverror();
 	}
-	printf ( "Loading RAW. %s\n", scnpath );			
-	LoadRAW ( scnpath, Vector3DI(128,256,256), 1 );		// This sets m_DataRes and m_DataBuf
-
-	// Convert data to float
-	printf("Convert to float.\n");
-	ConvertToFloat( m_DataRes, (uchar*) m_DataBuf );
-
-	// Transfer source data to GPU
-	printf("Transfer data to GPU.\n");
-	gvdb.PrepareAux( AUX_DATA3D, m_DataRes.x*m_DataRes.y*m_DataRes.z, sizeof(float), false, false );
-	DataPtr& aux3D = gvdb.getAux(AUX_DATA3D);
-	gvdb.SetDataCPU( aux3D, m_DataRes.x*m_DataRes.y*m_DataRes.z, m_DataBuf, 0, sizeof(float) );
-	gvdb.CommitData(aux3D);
+	m_DataFile = scnpath;
+	m_DataRes = Vector3DI(128,256,256);
+	m_DataBpp = 1;										// head.raw is 8-bit
 
 	// Rebuild the data in GVDB	
 	m_VolMax = Vector3DF(256, 256, 256);
@@ -315,6 +343,7 @@ void Sample::keyboardchar(unsigned char key, int mods, int x, int y)
 	case '1':	m_show_topo = !m_show_topo;	break;
 	case '2':	m_sparse = !m_sparse; Rebuild(); break;
 	case '3':	m_halo = !m_halo; Rebuild(); break;
+	case '4':	m_stream = !m_stream; Rebuild(); break;
 	};
 }
 
@@ -364,6 +393,8 @@ void Sample::mouse(NVPWindow::MouseButton button, NVPWindow::ButtonAction state,
 
 int sample_main ( int argc, const char** argv ) 
 {
+	for (int i = 1; i < argc; i++ )
+		if ( strcmp ( argv[i], "-stream" ) == 0 ) sample_obj.m_stream = true;		// start streaming, skip the in-memory load
 	return sample_obj.run ( "NVIDIA(R) GVDB Voxels - gResample", "resample", argc, argv, 1024, 768, 4, 5 );
 }
 
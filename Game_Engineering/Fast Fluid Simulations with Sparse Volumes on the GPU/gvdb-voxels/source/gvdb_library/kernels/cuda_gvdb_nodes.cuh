@@ -76,37 +76,28 @@ __device__ float								cxform[16];
 #endif
 
 #ifdef USE_BITMASKS
-inline __device__ uint64 numBitsOn ( uint64 v)
+// Child index of bit b. The mask is followed by a table of bits on before each
+// mask word (see VolumeGVDB::getMaskPrefix), so this is one load plus one popcount.
+inline __device__ int countOn ( VDBInfo* gvdb, VDBNode* node, int b )
 {
-	v = v - ((v >> 1) & uint64(0x5555555555555555LLU));
-	v = (v & uint64(0x3333333333333333LLU)) + ((v >> 2) & uint64(0x3333333333333333LLU));
-	return ((v + (v >> 4) & uint64(0xF0F0F0F0F0F0F0FLLU)) * uint64(0x101010101010101LLU)) >> 56;
+	int res = gvdb->res[node->mLev];
+	uint64* mask = &node->mMask;
+	uint* prefix = (uint*) (mask + max((res*res*res) >> 6, 1));
+	return prefix[b >> 6] + __popcll ( mask[b >> 6] & ((uint64(1) << (b & 63))-1) );
 }
-inline __device__ int countOn ( VDBNode* node, int n )
-{
-	uint64 sum = 0;
-	uint64* w1 = (uint64*) (&node->mMask);
-	uint64* we = w1 + (n >> 6);
-	for (; w1 != we; ) sum += numBitsOn (*w1++ );
-	uint64 w2 = *w1;
-	w2 = *w1 & (( uint64(1) << (n & 63))-1);
-	sum += numBitsOn ( w2 );
-	return sum;
-}
-inline __device__ bool isBitOn ( VDBNode* node, int b )
+inline __device__ bool isBitOn ( VDBInfo* gvdb, VDBNode* node, int b )
 {
 	return ( (&node->mMask)[ b >> 6 ] & (uint64(1) << (b & 63))) != 0;
 }
 
-inline __device__ int getChild ( VDBNode* node, int b )
+inline __device__ int getChild ( VDBInfo* gvdb, VDBNode* node, int b )
 {	
-	int n = countOn ( node, b );
 	uint64 listid = node->mChildList;
-	if (listid == ID_UNDEFL) return ID_UNDEF64;
+	if (listid == ID_UNDEFL || !isBitOn ( gvdb, node, b ) ) return ID_UNDEF64;
 	uchar clev = uchar( (listid >> 8) & 0xFF );
 	int cndx = listid >> 16;
-	uint64* clist = (uint64*) (gvdb.childlist[clev] + cndx*gvdb.childwid[clev]);
-	int c = (*(clist + n)) >> 16;
+	uint64* clist = (uint64*) (gvdb->childlist[clev] + cndx*gvdb->childwid[clev]);
+	int c = (*(clist + countOn ( gvdb, node, b ))) >> 16;
 	return c;
 }
 
@@ -321,17 +312,6 @@ inline __device__ uint64 getPosParent( VDBInfo* gvdb, int3 pos, int stopLev)
 		posInNode.z /= range.z;
 		bitMaskPos = (posInNode.z*res + posInNode.y)*res + posInNode.x;
 		//bitMaskPos = ((pos.z - nd->mPos.z)*gvdb->res[l]/gvdb->noderange[l].z*gvdb->res[l] + (pos.y - nd->mPos.y)*gvdb->res[l]/gvdb->noderange[l].y)*gvdb->res[l] + (pos.x - nd->mPos.x)*gvdb->res[l]/gvdb->noderange[l].x;
-#ifdef USE_BITMASKS
-		uint64 p = nd->countOn ( bitMaskPos );
-
-		l--;
-
-		uint64* clist = mPool->PoolData64(nd->mChildList);
-		if (l == lev) return clist[p];
-
-		nd = getNode(clist[p]);
-#else
-		
 		childId = getChild( gvdb, nd, bitMaskPos);
 
 		l--;
@@ -341,7 +321,6 @@ inline __device__ uint64 getPosParent( VDBInfo* gvdb, int3 pos, int stopLev)
 		if(l == stopLev) return childId;
 
 		nd = (VDBNode*) (gvdb->nodelist[l] + childId*gvdb->nodewid[l]);//getNode(l, childId);
-#endif
 	}
 
 	return ID_UNDEFL;
@@ -371,16 +350,6 @@ inline __device__ uint64 getParent( VDBInfo* gvdb, int stopLev, int3 pos)
 		posInNode.z /= range.z;
 		bitMaskPos = (posInNode.z*res + posInNode.y)*res + posInNode.x;
 
-#ifdef USE_BITMASKS
-		uint64 p = nd->countOn ( bitMaskPos );
-
-		l--;
-
-		uint64* clist = mPool->PoolData64(nd->mChildList);
-		if (l == lev) return clist[p];
-
-		nd = getNode( gvdb, clist[p] );
-#else
 		l--;
 
 		childId = getChild( gvdb, nd, bitMaskPos);
@@ -390,7 +359,6 @@ inline __device__ uint64 getParent( VDBInfo* gvdb, int stopLev, int3 pos)
 		if(l == stopLev) return childId;
 
 		nd = getNode( gvdb, l, childId);
-#endif
 	}
 
 	return ID_UNDEFL;
@@ -24,6 +24,9 @@ features for CPU and GPU profiling:
 10. CPU Level specifies maximum printf level for markers. Useful when
     your markers are inside an inner loop. You can keep in code, but hide their output.
 11. GPU markers use NVIDIA's Perfmarkers for viewing in NVIDIA NSIGHT
+12. Markers are per-thread and lock-free. PERF_TRACE records them into
+    per-thread rings, PERF_TRACE_SAVE exports Chrome trace JSON and
+    PERF_REPORT prints call-tree statistics.
 */
 
 #include "app_perf.h"
@@ -39,6 +42,13 @@ features for CPU and GPU profiling:
 #include <cstring>
 #include <fcntl.h>	
 #include <cstdlib>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cmath>
 
 extern void				gprintf(const char * fmt, ...);
 #define PERF_PRINTF		gprintf
@@ -53,9 +63,6 @@ bool				g_perfInit = false;			// Is perf started? Checks for DLL
 	char*				g_nvtxPop = 0x0;
 #endif
 
-int					g_perfLevel = 0;			// Current level of push/pop
-sjtime				g_perfStack[1024];			// Stack of recorded CPU timings
-char				g_perfMsg[1024][256];			// Stack of recorded messages
 FILE*				g_perfCons = 0x0;			// On-screen console to output CPU timing
 int					g_perfPrintLev = 2;			// Maximum level to print. Set with PERF_SET
 bool				g_perfCPU = false;			// Do CPU timing? Set with PERF_SET
@@ -64,17 +71,100 @@ bool				g_perfConsOut = true;
 std::string			g_perfFName = "";			// File name for CPU output. Set with PERF_SET
 FILE*				g_perfFile = 0x0;			// File handle for output
 
+// Per-thread marker state. Each thread owns its stack of open markers and,
+// while tracing, a ring of closed events. A ring has one writer (its thread),
+// which publishes events by a release store of head, so markers never lock.
+// The registry lock is only taken when a thread attaches a new ring.
+#define PERF_DEPTH		64						// deepest nesting timed
+#define PERF_NAME		128						// marker name kept for printing
+
+struct PerfEvent {								// 64 bytes
+	sjtime				start, dur;				// nanoseconds
+	int					depth;
+	char				name[44];
+};
+struct PerfRing {
+	std::vector<PerfEvent>	ev;
+	std::atomic<uint64>		head;				// events written so far
+	int						tid;
+};
+struct PerfThread {
+	int					level;					// open PERF_PUSH markers
+	sjtime				stack[PERF_DEPTH];
+	char				msg[PERF_DEPTH][PERF_NAME];
+	int					timers;					// open PERF_START timers
+	sjtime				timer[PERF_DEPTH];
+	PerfRing*			ring;
+	int					gen;					// trace generation of ring
+	int					tid;
+};
+static thread_local PerfThread	t_perf = {};
+static std::atomic<bool>		g_perfTrace ( false );		// Record trace events? Set with PERF_TRACE
+static std::atomic<int>			g_perfGen ( 1 );			// Bumped when the trace is reset
+static std::atomic<int>			g_perfThreads ( 0 );
+static int						g_perfEvents = 0;			// Ring size per thread
+static std::mutex				g_perfRingMtx;
+static std::vector<PerfRing*>	g_perfRings;				// Rings of the current trace
+static std::vector<PerfRing*>	g_perfRetired;				// Old rings threads may still hold
+
+// Monotonic nanoseconds; cheap enough to call around inner loops
+static inline sjtime PerfClock ()
+{
+	return (sjtime) std::chrono::duration_cast<std::chrono::nanoseconds> ( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// Bounded copy; unlike strncpy, does not zero-fill the rest of dst
+static inline void PerfCopy ( char* dst, const char* src, int size )
+{
+	int i = 0;
+	for ( ; i < size - 1 && src[i] != '\0'; i++ ) dst[i] = src[i];
+	dst[i] = '\0';
+}
+
+static PerfRing* PerfAttach ( PerfThread& t )
+{
+	std::lock_guard<std::mutex> lock ( g_perfRingMtx );
+	t.gen = g_perfGen.load ();
+	t.ring = 0x0;
+	if ( !g_perfTrace.load() || g_perfEvents <= 0 ) return 0x0;
+	if ( t.tid == 0 ) t.tid = ++g_perfThreads;
+	PerfRing* r = new PerfRing;
+	r->ev.resize ( g_perfEvents );
+	r->head.store ( 0 );
+	r->tid = t.tid;
+	g_perfRings.push_back ( r );
+	t.ring = r;
+	return r;
+}
+
+static void PerfRecord ( PerfThread& t, sjtime start, sjtime dur )
+{
+	PerfRing* r = t.ring;
+	if ( t.gen != g_perfGen.load ( std::memory_order_relaxed ) ) r = PerfAttach ( t );
+	if ( r == 0x0 ) return;
+	uint64 h = r->head.load ( std::memory_order_relaxed );
+	PerfEvent& e = r->ev[ h % r->ev.size() ];
+	e.start = start;
+	e.dur = dur;
+	e.depth = t.level;
+	PerfCopy ( e.name, t.msg[t.level], sizeof(e.name) );
+	r->head.store ( h + 1, std::memory_order_release );
+}
+
 void PERF_START ()
 {
-	g_perfStack [ g_perfLevel ] = TimeX::GetSystemNSec ();
-	g_perfLevel++;
+	PerfThread& t = t_perf;
+	if ( t.timers < PERF_DEPTH ) t.timer[ t.timers ] = PerfClock ();
+	t.timers++;
 }
 
 float PERF_STOP ()
 {
-	g_perfLevel--;
-	sjtime curr = TimeX::GetSystemNSec ();
-	curr -= g_perfStack [ g_perfLevel ];
+	PerfThread& t = t_perf;
+	if ( t.timers <= 0 ) return 0;
+	sjtime curr = PerfClock ();
+	if ( --t.timers >= PERF_DEPTH ) return 0;
+	curr -= t.timer[ t.timers ];
 	return ((float) curr) / MSEC_SCALAR;
 }
 
@@ -84,13 +174,16 @@ void PERF_PUSH ( const char* msg )
 	#ifdef USE_NVTX
 		if ( g_perfGPU ) (*g_nvtxPush) (msg);	
 	#endif
-	if ( g_perfCPU ) {
-		if ( ++g_perfLevel < g_perfPrintLev ) {
-			strncpy ( (char*) g_perfMsg[ g_perfLevel ], msg, 256 );
-			g_perfStack [ g_perfLevel ] = TimeX::GetSystemNSec ();				
-			if ( g_perfConsOut ) PERF_PRINTF ( "%*s%s\n", g_perfLevel <<1, "", msg );
-			if ( g_perfFile != 0x0 ) fprintf ( g_perfFile, "%*s%s\n", g_perfLevel <<1, "", msg );
-		}		
+	if ( g_perfCPU || g_perfTrace.load ( std::memory_order_relaxed ) ) {
+		PerfThread& t = t_perf;
+		if ( ++t.level < PERF_DEPTH ) {
+			PerfCopy ( t.msg[ t.level ], msg, PERF_NAME );
+			if ( g_perfCPU && t.level < g_perfPrintLev ) {
+				if ( g_perfConsOut ) PERF_PRINTF ( "%*s%s\n", t.level <<1, "", msg );
+				if ( g_perfFile != 0x0 ) fprintf ( g_perfFile, "%*s%s\n", t.level <<1, "", msg );
+			}
+			t.stack[ t.level ] = PerfClock ();
+		}
 	}
 }
 float PERF_POP ()
@@ -98,18 +191,221 @@ float PERF_POP ()
 	#ifdef USE_NVTX
 		if ( g_perfGPU ) (*g_nvtxPop) ();
 	#endif
-	if ( g_perfCPU ) {
-		if ( g_perfLevel < g_perfPrintLev) {
-			sjtime curr = TimeX::GetSystemNSec ();
-			curr -= g_perfStack [ g_perfLevel ];		
-			if ( g_perfConsOut ) PERF_PRINTF ( "%*s%s: %f ms\n", g_perfLevel <<1, "", g_perfMsg[g_perfLevel], ((float) curr)/MSEC_SCALAR );		
-			if ( g_perfFile != 0x0 ) fprintf ( g_perfFile, "%*s%s: %f ms\n", g_perfLevel <<1, "", g_perfMsg[g_perfLevel], ((float) curr)/MSEC_SCALAR );
-			g_perfLevel--;
-			return ((float) curr) / MSEC_SCALAR;
-		}	
-		g_perfLevel--;
+	PerfThread& t = t_perf;
+	if ( t.level <= 0 ) return 0;
+	if ( t.level >= PERF_DEPTH ) { t.level--; return 0; }
+
+	sjtime curr = PerfClock () - t.stack[ t.level ];
+	float ms = ((float) curr) / MSEC_SCALAR;
+	if ( g_perfTrace.load ( std::memory_order_relaxed ) ) PerfRecord ( t, t.stack[ t.level ], curr );
+	if ( g_perfCPU && t.level < g_perfPrintLev ) {
+		if ( g_perfConsOut ) PERF_PRINTF ( "%*s%s: %f ms\n", t.level <<1, "", t.msg[t.level], ms );
+		if ( g_perfFile != 0x0 ) fprintf ( g_perfFile, "%*s%s: %f ms\n", t.level <<1, "", t.msg[t.level], ms );
+	}
+	t.level--;
+	return ms;
+}
+
+// Start or stop recording events. Starting clears any previous trace and gives
+// every thread a ring of the given size; when a ring is full the oldest events
+// are overwritten.
+void PERF_TRACE ( bool on, int events )
+{
+	std::lock_guard<std::mutex> lock ( g_perfRingMtx );
+	if ( on ) {
+		g_perfRetired.insert ( g_perfRetired.end(), g_perfRings.begin(), g_perfRings.end() );
+		g_perfRings.clear ();
+		g_perfEvents = ( events > 0 ) ? events : 65536;
+		g_perfGen++;
+	}
+	g_perfTrace.store ( on );
+}
+
+// Stop tracing and free every ring, including those retired by PERF_TRACE.
+// Call once no other thread is closing markers.
+void PERF_SHUTDOWN ()
+{
+	std::lock_guard<std::mutex> lock ( g_perfRingMtx );
+	g_perfTrace.store ( false );
+	g_perfGen++;								// threads drop their ring pointers
+	for (size_t i = 0; i < g_perfRings.size(); i++ )	delete g_perfRings[i];
+	for (size_t i = 0; i < g_perfRetired.size(); i++ )	delete g_perfRetired[i];
+	g_perfRings.clear ();
+	g_perfRetired.clear ();
+	t_perf.ring = 0x0;
+	if ( g_perfFile != 0x0 ) {
+		fclose ( g_perfFile );
+		g_perfFile = 0x0;
+	}
+}
+
+// Snapshot of the recorded events of all threads. Exact when no markers are
+// being closed meanwhile; otherwise the oldest events of a busy ring may be torn.
+static void PerfCollect ( std::vector< std::vector<PerfEvent> >& out, std::vector<int>& tids )
+{
+	std::lock_guard<std::mutex> lock ( g_perfRingMtx );
+	for (size_t i = 0; i < g_perfRings.size(); i++ ) {
+		PerfRing* r = g_perfRings[i];
+		uint64 head = r->head.load ( std::memory_order_acquire );
+		uint64 size = r->ev.size ();
+		uint64 first = ( head > size ) ? head - size : 0;
+		out.push_back ( std::vector<PerfEvent> () );
+		for (uint64 n = first; n < head; n++ )
+			out.back().push_back ( r->ev[ n % size ] );
+		tids.push_back ( r->tid );
+	}
+}
+
+// Parents before children: by start time, then outermost first
+static bool PerfEventOrder ( const PerfEvent& a, const PerfEvent& b )
+{
+	if ( a.start != b.start ) return a.start < b.start;
+	return a.depth < b.depth;
+}
+
+static void PerfEscape ( FILE* fp, const char* s )
+{
+	for ( ; *s != '\0'; s++ ) {
+		if ( *s == '"' || *s == '\\' )	fprintf ( fp, "\\%c", *s );
+		else if ( (uchar) *s < 0x20 )	fprintf ( fp, "\\u%04x", (int) (uchar) *s );
+		else							fputc ( *s, fp );
+	}
+}
+
+// Write the trace in Chrome trace-event format (chrome://tracing, Perfetto)
+bool PERF_TRACE_SAVE ( const char* fname )
+{
+	std::vector< std::vector<PerfEvent> > rings;
+	std::vector<int> tids;
+	PerfCollect ( rings, tids );
+
+	FILE* fp = fopen ( fname, "wt" );
+	if ( fp == 0x0 ) {
+		PERF_PRINTF ( "ERROR: PERF_TRACE_SAVE unable to open %s\n", fname );
+		return false;
+	}
+	sjtime base = 0;
+	bool any = false;
+	for (size_t i = 0; i < rings.size(); i++ )
+		for (size_t n = 0; n < rings[i].size(); n++ )
+			if ( !any || rings[i][n].start < base ) { base = rings[i][n].start; any = true; }
+
+	fprintf ( fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" );
+	const char* sep = "\n";
+	for (size_t i = 0; i < rings.size(); i++ ) {
+		std::sort ( rings[i].begin(), rings[i].end(), PerfEventOrder );
+		for (size_t n = 0; n < rings[i].size(); n++ ) {
+			PerfEvent& e = rings[i][n];
+			fprintf ( fp, "%s{\"name\":\"", sep );
+			PerfEscape ( fp, e.name );
+			fprintf ( fp, "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%d}", (e.start - base) / 1000.0, e.dur / 1000.0, tids[i] );
+			sep = ",\n";
+		}
+	}
+	fprintf ( fp, "\n]}\n" );
+	bool ok = ( ferror ( fp ) == 0 );
+	fclose ( fp );
+	return ok;
+}
+
+// Call tree of the trace, merged across threads by marker path
+struct PerfNode {
+	std::string					name;
+	int							depth;
+	std::map<std::string, int>	child;
+	std::vector<sjtime>			dur;
+};
+
+static float PerfPercentile ( std::vector<sjtime>& v, float p )
+{
+	size_t k = (size_t) ceil ( p * v.size() );				// nearest rank
+	k = ( k > 0 ) ? std::min ( k - 1, v.size() - 1 ) : 0;
+	std::nth_element ( v.begin(), v.begin() + k, v.end() );
+	return float( v[k] ) / MSEC_SCALAR;
+}
+
+static void PerfReportNode ( FILE* fp, std::vector<PerfNode>& nodes, int n )
+{
+	PerfNode& nd = nodes[n];
+	if ( n > 0 ) {
+		std::vector<sjtime>& d = nd.dur;
+		sjtime total = 0, vmin = d[0], vmax = d[0];
+		for (size_t i = 0; i < d.size(); i++ ) {
+			total += d[i];
+			vmin = std::min ( vmin, d[i] );
+			vmax = std::max ( vmax, d[i] );
+		}
+		char line[512];
+		snprintf ( line, sizeof(line), "%8d %11.3f %10.4f %10.4f %10.4f %10.4f %10.4f %10.4f  %*s%s\n", (int) d.size(),
+			float(total) / MSEC_SCALAR, float(total) / MSEC_SCALAR / d.size(), float(vmin) / MSEC_SCALAR, float(vmax) / MSEC_SCALAR,
+			PerfPercentile ( d, 0.50f ), PerfPercentile ( d, 0.95f ), PerfPercentile ( d, 0.99f ), (nd.depth-1) <<1, "", nd.name.c_str() );
+		if ( fp != 0x0 ) fputs ( line, fp ); else PERF_PRINTF ( "%s", line );
+	}
+	// children by total time
+	std::vector< std::pair<sjtime, int> > order;
+	for ( std::map<std::string, int>::iterator it = nd.child.begin(); it != nd.child.end(); it++ ) {
+		sjtime total = 0;
+		for (size_t i = 0; i < nodes[it->second].dur.size(); i++ ) total += nodes[it->second].dur[i];
+		order.push_back ( std::make_pair ( -total, it->second ) );
+	}
+	std::sort ( order.begin(), order.end() );
+	for (size_t i = 0; i < order.size(); i++ )
+		PerfReportNode ( fp, nodes, order[i].second );
+}
+
+// Print count, total, mean, min, max and percentiles (ms) of every marker
+// path in the trace. Writes to fname, or through PERF_PRINTF if null.
+void PERF_REPORT ( const char* fname )
+{
+	std::vector< std::vector<PerfEvent> > rings;
+	std::vector<int> tids;
+	PerfCollect ( rings, tids );
+
+	std::vector<PerfNode> nodes ( 1 );
+	nodes[0].depth = 0;
+	size_t events = 0;
+	for (size_t i = 0; i < rings.size(); i++ ) {
+		std::vector<PerfEvent>& ev = rings[i];
+		std::sort ( ev.begin(), ev.end(), PerfEventOrder );
+		// Enclosing markers, innermost last. A marker lost to ring wrap or
+		// still open leaves its children attached higher up.
+		std::vector< std::pair<sjtime, int> > open;
+		for (size_t n = 0; n < ev.size(); n++ ) {
+			PerfEvent& e = ev[n];
+			while ( !open.empty() && open.back().first < e.start + e.dur ) open.pop_back ();
+			int parent = open.empty() ? 0 : open.back().second;
+			std::string name ( e.name );
+			std::map<std::string, int>::iterator it = nodes[parent].child.find ( name );
+			int id;
+			if ( it == nodes[parent].child.end() ) {
+				id = (int) nodes.size();
+				nodes[parent].child[name] = id;
+				nodes.push_back ( PerfNode() );
+				nodes[id].name = name;
+				nodes[id].depth = nodes[parent].depth + 1;
+			} else {
+				id = it->second;
+			}
+			nodes[id].dur.push_back ( e.dur );
+			open.push_back ( std::make_pair ( e.start + e.dur, id ) );
+			events++;
+		}
+	}
+
+	FILE* fp = 0x0;
+	if ( fname != 0x0 ) {
+		fp = fopen ( fname, "wt" );
+		if ( fp == 0x0 ) {
+			PERF_PRINTF ( "ERROR: PERF_REPORT unable to open %s\n", fname );
+			return;
+		}
 	}
-	return 0;
+	char line[512];
+	snprintf ( line, sizeof(line), "PERF_REPORT: %d threads, %d events (ms)\n%8s %11s %10s %10s %10s %10s %10s %10s  %s\n", (int) rings.size(), (int) events,
+		"count", "total", "mean", "min", "max", "p50", "p95", "p99", "marker" );
+	if ( fp != 0x0 ) fputs ( line, fp ); else PERF_PRINTF ( "%s", line );
+	PerfReportNode ( fp, nodes, 0 );
+	if ( fp != 0x0 ) fclose ( fp );
 }
 
 
@@ -128,7 +424,7 @@ void PERF_INIT ( int buildbits, bool cpu, bool gpu, bool cons, int lev, const ch
 	if ( lev == 0 ) lev = 32767;
 	g_perfPrintLev = lev;
 	g_perfInit = true;
-	g_perfLevel = 0;	
+	t_perf.level = 0;
 	g_perfFile = 0x0;
 	g_perfFName = fname;	
 	if ( g_perfFName.length() > 0 ) {
@@ -224,6 +520,7 @@ const int TimeX::m_DaysInMonth[13] = {0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31,
 bool TimeX::m_Started = false;
 sjtime			m_BaseTime;
 sjtime			m_BaseTicks;
+sjtime			m_BaseNSec;
 
 void start_timing ( sjtime base )
 {	
@@ -237,6 +534,9 @@ void start_timing ( sjtime base )
 		struct timeval tv;
 		gettimeofday(&tv, NULL);
 		m_BaseTicks = ((sjtime) tv.tv_sec * 1000000LL) + (sjtime) tv.tv_usec;		
+		struct timespec ts;
+		clock_gettime ( CLOCK_MONOTONIC, &ts );
+		m_BaseNSec = ((sjtime) ts.tv_sec * SEC_SCALAR) + (sjtime) ts.tv_nsec;
 	#endif
 }
 
@@ -259,7 +559,9 @@ sjtime TimeX::GetSystemNSec ()
 		QueryPerformanceCounter ( &currCount );
 		return m_BaseTime + sjtime( (double(currCount.QuadPart-m_BaseCount.QuadPart) / m_BaseFreq.QuadPart) * SEC_SCALAR);
 	#else
-		printf ( "ERROR: GetSystemNSec not implemented. QueryPerformanceCounter not available.\n" );
+		struct timespec ts;
+		clock_gettime ( CLOCK_MONOTONIC, &ts );
+		return m_BaseTime + ((sjtime) ts.tv_sec * SEC_SCALAR) + (sjtime) ts.tv_nsec - m_BaseNSec;
 	#endif	
 }
 
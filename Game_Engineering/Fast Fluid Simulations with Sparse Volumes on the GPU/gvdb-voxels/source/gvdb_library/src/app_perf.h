@@ -25,6 +25,15 @@ features for CPU and GPU profiling:
 11. CPU Level specifies maximum printf level for markers. Useful when
     your markers are inside an inner loop. You can keep them in code, but hide their output.
 12. GPU markers use NVIDIA's Perfmarkers for viewing in NVIDIA NSIGHT
+13. Markers are per-thread and safe to use from worker threads.
+    Call PERF_TRACE( true, events ) to record every marker (any level, even with
+    CPU printing off) into a lock-free ring of that many events per thread.
+14. PERF_TRACE_SAVE( filename ) writes the trace as Chrome trace-event JSON,
+    viewable in chrome://tracing or Perfetto, one row per thread.
+15. PERF_REPORT( filename ) merges the trace into a call tree and prints count,
+    total, mean, min, max and 50/95/99th percentile times of each marker path.
+    Pass 0x0 to print to the console.
+16. PERF_SHUTDOWN() stops tracing, frees the trace rings and closes the log file.
 */
 
 #ifndef APP_PERF
@@ -51,6 +60,10 @@ features for CPU and GPU profiling:
 	extern "C" GVDB_API void PERF_INIT ( int buildbits, bool cpu, bool gpu, bool cons, int lev, const char* fname );
 	extern "C" GVDB_API void PERF_SET ( bool cons, int lev );
 	extern "C" GVDB_API void PERF_PRINTF ( char* format, ... );
+	extern "C" GVDB_API void PERF_TRACE ( bool on, int events );
+	extern "C" GVDB_API bool PERF_TRACE_SAVE ( const char* fname );
+	extern "C" GVDB_API void PERF_REPORT ( const char* fname );
+	extern "C" GVDB_API void PERF_SHUTDOWN ();
 
 
 	// Time Class
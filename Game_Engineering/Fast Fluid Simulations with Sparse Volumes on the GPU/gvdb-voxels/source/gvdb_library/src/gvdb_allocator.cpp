@@ -14,24 +14,98 @@
 
 #if defined(_WIN32)
 #	include <windows.h>
+#else
+#	include <sys/mman.h>
 #endif
 
 #include <cstdlib>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
 #include <cuda_runtime.h>
 #include <cuda.h>
 
 using namespace nvdb;
 
+#define POOL_RESERVE		(uint64(1) << 36)	// default address space per concurrent pool
+#define POOL_PAGE			uint64(65536)		// commit granularity
+#define POOL_SLAB			64					// elements a thread claims at once
+#define POOL_SLAB_THREADS	256					// threads with a slab, others bump the pool directly
+#define POOL_TAG_SHIFT		40					// free list head: (tag << 40) | (ndx+1), ndx+1 = 0 when empty
+#define POOL_NDX_MASK		((uint64(1) << POOL_TAG_SHIFT) - 1)
+
+// Pool memory reserved up front and committed in place, so it never moves
+struct Allocator::PoolShared {
+	char*					base;
+	std::atomic<uint64>*	link;				// free list links, one per element
+	uint64					reserve;			// elements that fit in the reservation
+	uint64					stride;
+	uint64					gpu_max;			// elements held by the gpu buffer
+	std::atomic<uint64>		next;				// bump pointer while concurrent
+	std::atomic<uint64>		committed;			// elements backed by memory
+	std::atomic<uint64>		head;				// lock-free free list
+	std::atomic<uint64>		freed;
+	std::mutex				grow;
+	struct Slab { uint64 next, end; char pad[48]; } slab[POOL_SLAB_THREADS];	// [next,end) owned by one thread, one cache line each
+};
+struct Allocator::PoolSession {
+	uint64					id;
+	std::atomic<int>		slots;
+};
+
+static std::atomic<uint64>	g_poolSession ( 0 );
+static thread_local uint64	t_poolSession = 0;	// session the thread's slot belongs to
+static thread_local int		t_poolSlot = -1;
+
+static char* ReservePages ( uint64 bytes )
+{
+#if defined(_WIN32)
+	return (char*) VirtualAlloc ( NULL, (SIZE_T) bytes, MEM_RESERVE, PAGE_NOACCESS );
+#else
+	void* p = mmap ( 0x0, (size_t) bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+	return ( p == MAP_FAILED ) ? 0x0 : (char*) p;
+#endif
+}
+static bool CommitPages ( char* base, uint64 from, uint64 to )		// zero-filled
+{
+	from = from / POOL_PAGE * POOL_PAGE;
+	to = (to + POOL_PAGE - 1) / POOL_PAGE * POOL_PAGE;
+	if ( to <= from ) return true;
+#if defined(_WIN32)
+	return VirtualAlloc ( base + from, (SIZE_T) (to - from), MEM_COMMIT, PAGE_READWRITE ) != NULL;
+#else
+	return mprotect ( base + from, (size_t) (to - from), PROT_READ | PROT_WRITE ) == 0;
+#endif
+}
+static void ReleasePages ( void* base, uint64 bytes )
+{
+#if defined(_WIN32)
+	VirtualFree ( base, 0, MEM_RELEASE );
+#else
+	munmap ( base, (size_t) bytes );
+#endif
+}
+static inline uint64 PageRound ( uint64 bytes )
+{
+	return (bytes + POOL_PAGE - 1) / POOL_PAGE * POOL_PAGE;
+}
+
 
 DataPtr::DataPtr() {
 	type=T_UCHAR; usedNum=0; lastEle=0; max=0; size=0; stride=0; cpu=0; glid=0; grsc=0; gpu=0; 
+	garray=0; tex_obj=0; surf_obj=0;
 	filter = 0; border = 0;
 }		
 
-Allocator::Allocator ()
+Allocator::Allocator ( bool cpu_only )
 {
 	mbDebug = false;
+	mbCPUOnly = cpu_only;
 	mVFBO[0] = -1;
+	mSession = 0x0;
+	mConcurrent = false;
+
+	if ( mbCPUOnly ) return;				// no context, no kernels
 
 	cudaCheck ( cuModuleLoad ( &cuAllocatorModule, CUDA_GVDB_COPYDATA_PTX ), "Allocator", "Allocator", "cuModuleLoad", CUDA_GVDB_COPYDATA_PTX, mbDebug);
 		
@@ -48,7 +122,8 @@ Allocator::~Allocator() {
 	AtlasReleaseAll();
 	PoolReleaseAll();
 
-	cudaCheck(cuModuleUnload(cuAllocatorModule), "Allocator", "~Allocator", "cuModuleUnload", "cuAllocatorModule", false);
+	if ( !mbCPUOnly )
+		cudaCheck(cuModuleUnload(cuAllocatorModule), "Allocator", "~Allocator", "cuModuleUnload", "cuAllocatorModule", false);
 }
 
 
@@ -82,7 +157,7 @@ void Allocator::PoolCreate ( uchar grp, uchar lev, uint64 width, uint64 initmax,
 	}	
 
 	// gpu allocate
-	if ( bGPU ) {
+	if ( bGPU && !mbCPUOnly ) {
 		size_t sz = p.size;
 		cudaCheck ( cuMemAlloc ( &p.gpu, sz ), "Allocator", "PoolCreate", "cuMemAlloc", "", mbDebug );
 		cudaCheck ( cuMemsetD8 ( p.gpu, 0, sz ), "Allocator", "PoolCreate", "cuMemsetD8", "", mbDebug );
@@ -111,6 +186,7 @@ void Allocator::PoolClearCPU()
 void Allocator::PoolCommit ( int grp, int lev )
 {
 	DataPtr* p = &mPool[grp][lev];
+	if ( p->gpu == 0x0 ) return;
 	//std::cout << grp << " " << lev << " " << p->gpu << " " << p->lastEle * p->stride << std::endl;
 	cudaCheck ( cuMemcpyHtoD ( p->gpu, p->cpu, p->lastEle * p->stride ), "Allocator", "PoolCommit", "cuMemcpyHtoD", "", mbDebug );	
 }
@@ -127,6 +203,7 @@ void Allocator::PoolFetchAll()
 void Allocator::PoolFetch(int grp, int lev )
 {
 	DataPtr* p = &mPool[grp][lev];
+	if ( p->gpu == 0x0 ) return;
 	cudaCheck ( cuMemcpyDtoH ( p->cpu,  p->gpu, p->lastEle * p->stride ), "Allocator", "PoolFetch", "cuMemcpyDtoH", "", mbDebug);	
 }
 
@@ -134,7 +211,7 @@ void Allocator::PoolCommitAtlasMap ()
 {
 	DataPtr* p;
 	for (int n=0; n < mAtlasMap.size(); n++ ) {
-		if ( mAtlasMap[n].cpu != 0x0 ) {
+		if ( mAtlasMap[n].cpu != 0x0 && mAtlasMap[n].gpu != 0x0 ) {
 			p = &mAtlasMap[n];
 			cudaCheck ( cuMemcpyHtoD ( p->gpu, p->cpu, p->lastEle * p->stride ), "Allocator", "PoolCommitAtlasMap", "cuMemcpyHtoD", "", mbDebug);
 		}
@@ -143,10 +220,17 @@ void Allocator::PoolCommitAtlasMap ()
 
 void Allocator::PoolReleaseAll ()
 {
+	if ( mConcurrent ) PoolEndConcurrent ();
+
 	// release all memory
 	for (int grp=0; grp < MAX_POOL; grp++) 
 		for (int lev=0; lev < mPool[grp].size(); lev++ )  {
-			if ( mPool[grp][lev].cpu != 0x0 ) 
+			PoolShared* s = ( lev < mShared[grp].size() ) ? mShared[grp][lev] : 0x0;
+			if ( s != 0x0 ) {
+				ReleasePages ( s->base, PageRound(s->reserve * s->stride) );
+				ReleasePages ( s->link, PageRound(s->reserve * sizeof(uint64)) );
+				delete s;
+			} else if ( mPool[grp][lev].cpu != 0x0 ) 
 				free ( mPool[grp][lev].cpu );
 
 			if ( mPool[grp][lev].gpu != 0x0 )
@@ -155,40 +239,67 @@ void Allocator::PoolReleaseAll ()
 
 
 	// release pool structure	
-	for (int grp=0; grp < MAX_POOL; grp++) 
+	for (int grp=0; grp < MAX_POOL; grp++) {
 		mPool[grp].clear ();
+		mShared[grp].clear ();
+	}
 }
 
 
 uint64 Allocator::PoolAlloc ( uchar grp, uchar lev, bool bGPU )
+{
+	return PoolAllocMulti ( grp, lev, 1, bGPU );
+}
+
+uint64 Allocator::PoolAllocMulti ( uchar grp, uchar lev, uint64 cnt, bool bGPU )
 {
 	if ( lev >= mPool[grp].size() ) return ID_UNDEFL;
 	DataPtr* p = &mPool[grp][lev];
-	
-	if ( p->lastEle >= p->max ) {
-		// Expand pool
-		p->max *= 2;
+	PoolShared* s = ( lev < mShared[grp].size() ) ? mShared[grp][lev] : 0x0;
+
+	if ( mConcurrent ) {
+		if ( s == 0x0 ) return ID_UNDEFL;
+		uint64 ndx = AllocShared ( s, cnt );
+		return ( ndx == ID_UNDEF64 ) ? ID_UNDEFL : Elem(grp, lev, ndx);
+	}
+
+	// Reuse a freed element
+	if ( cnt == 1 && s != 0x0 && (s->head.load() & POOL_NDX_MASK) != 0 ) {
+		uint64 h = s->head.load();
+		uint64 ndx = (h & POOL_NDX_MASK) - 1;
+		s->head.store ( s->link[ndx].load() );
+		s->freed--;
+		p->usedNum++;
+		return Elem(grp, lev, ndx);
+	}
+
+	if ( p->lastEle + cnt > p->max ) {
+		// Expand pool (once, to fit the whole request)
+		if ( p->max == 0 ) p->max = 1;
+		while ( p->lastEle + cnt > p->max ) p->max *= 2;
+		if ( s != 0x0 ) {
+			// reserved pool, commit in place
+			p->max = std::min ( p->max, s->reserve );
+			if ( p->lastEle + cnt > p->max || !GrowShared ( s, p->max ) ) {
+				gprintf ( "ERROR: Pool %d,%d exceeded its reservation of %lld elements.\n", grp, lev, s->reserve );
+				return ID_UNDEFL;
+			}
+			p->max = s->committed.load ();
+		}
 		p->size = p->stride * p->max;
-		if ( p->cpu != 0x0 ) {
+		if ( p->cpu != 0x0 && s == 0x0 ) {
 			char* new_cpu = (char*) calloc ( p->size, 1 );
 			memcpy ( new_cpu, p->cpu, p->stride*p->lastEle );
 			free ( p->cpu );
 			p->cpu = new_cpu;
 		}
-		if ( p->gpu != 0x0 ) {
-			size_t sz = p->size;	
-			CUdeviceptr new_gpu;
-			cudaCheck ( cuMemAlloc ( &new_gpu, sz ), "Allocator", "PoolAlloc", "cuMemAlloc", "", mbDebug);
-			cudaCheck ( cuMemsetD8 ( new_gpu, 0, sz ), "Allocator", "PoolAlloc", "cuMemsetD8", "", mbDebug);
-			cudaCheck ( cuMemcpy ( new_gpu, p->gpu, p->stride*p->lastEle), "Allocator", "PoolAlloc", "cuMemcpy", "", mbDebug);
-			cudaCheck ( cuMemFree ( p->gpu ), "Allocator", "PoolAlloc", "cuMemFree", "", mbDebug );
-			p->gpu = new_gpu;
-		}
+		ResizePoolGPU ( p, p->lastEle );
+		if ( s != 0x0 ) s->gpu_max = p->max;
 	}
-	// Return new element
-	p->lastEle++;	
-	p->usedNum++;
-	return Elem(grp,lev, (p->lastEle-1) );
+	// Return first new element
+	p->lastEle += cnt;	
+	p->usedNum += cnt;
+	return Elem(grp,lev, (p->lastEle-cnt) );
 }
 
 void Allocator::PoolEmptyAll ()
@@ -199,6 +310,10 @@ void Allocator::PoolEmptyAll ()
 		{
 			mPool[grp][lev].usedNum = 0;	
 			mPool[grp][lev].lastEle = 0;	
+			if ( lev < mShared[grp].size() && mShared[grp][lev] != 0x0 ) {
+				mShared[grp][lev]->head = 0;
+				mShared[grp][lev]->freed = 0;
+			}
 		}
 }
 
@@ -229,8 +344,194 @@ uint64* Allocator::PoolData64 ( uint64 elem )
 	return (uint64*) PoolData ( elem );
 }
 
-void PoolFree ( int elem )
+void Allocator::ResizePoolGPU ( DataPtr* p, uint64 keep )
+{
+	if ( p->gpu == 0x0 ) return;
+	size_t sz = p->size;	
+	CUdeviceptr new_gpu;
+	cudaCheck ( cuMemAlloc ( &new_gpu, sz ), "Allocator", "PoolAlloc", "cuMemAlloc", "", mbDebug);
+	cudaCheck ( cuMemsetD8 ( new_gpu, 0, sz ), "Allocator", "PoolAlloc", "cuMemsetD8", "", mbDebug);
+	cudaCheck ( cuMemcpy ( new_gpu, p->gpu, p->stride*keep), "Allocator", "PoolAlloc", "cuMemcpy", "", mbDebug);
+	cudaCheck ( cuMemFree ( p->gpu ), "Allocator", "PoolAlloc", "cuMemFree", "", mbDebug );
+	p->gpu = new_gpu;
+}
+
+void Allocator::PoolFree ( uint64 id )
+{
+	uchar grp = ElemGrp(id), lev = ElemLev(id);
+	uint64 ndx = ElemNdx(id);
+	if ( lev >= mPool[grp].size() ) return;
+	DataPtr* p = &mPool[grp][lev];
+	PoolShared* s = getShared ( grp, lev, 0 );		// first free moves a serial pool to reserved memory
+	if ( s == 0x0 || ndx >= s->committed.load ( std::memory_order_acquire ) ) return;
+
+	// Freed elements read as zero, i.e. discarded nodes (mFlags=0)
+	memset ( p->cpu + ndx * p->stride, 0, p->stride );
+
+	if ( !mConcurrent ) {
+		s->link[ndx].store ( s->head.load() );
+		s->head.store ( ndx+1 );
+		s->freed++;
+		p->usedNum--;
+		return;
+	}
+	// Treiber stack push, the tag in the upper bits guards against ABA
+	uint64 h = s->head.load ( std::memory_order_relaxed );
+	uint64 n;
+	do {
+		s->link[ndx].store ( h, std::memory_order_relaxed );
+		n = ( ((h >> POOL_TAG_SHIFT) + 1) << POOL_TAG_SHIFT ) | (ndx+1);
+	} while ( !s->head.compare_exchange_weak ( h, n, std::memory_order_release, std::memory_order_relaxed ) );
+	s->freed.fetch_add ( 1, std::memory_order_relaxed );
+}
+
+Allocator::PoolShared* Allocator::getShared ( uchar grp, uchar lev, uint64 reserve_bytes )
+{
+	if ( mShared[grp].size() < mPool[grp].size() )
+		mShared[grp].resize ( mPool[grp].size(), 0x0 );
+	if ( mShared[grp][lev] != 0x0 ) return mShared[grp][lev];
+
+	DataPtr* p = &mPool[grp][lev];
+	if ( p->stride == 0 ) return 0x0;
+	if ( reserve_bytes == 0 ) reserve_bytes = POOL_RESERVE;
+	reserve_bytes = std::max ( reserve_bytes, 2 * p->size );
+
+	PoolShared* s = new PoolShared;
+	s->stride = p->stride;
+	s->reserve = PageRound ( reserve_bytes ) / p->stride;
+	s->base = ReservePages ( PageRound(s->reserve * s->stride) );
+	s->link = (std::atomic<uint64>*) ReservePages ( PageRound(s->reserve * sizeof(uint64)) );
+	s->committed = 0;
+	if ( s->base == 0x0 || s->link == 0x0 || !GrowShared ( s, std::max ( p->max, uint64(POOL_SLAB) ) ) ) {
+		gprintf ( "ERROR: Unable to reserve %lld bytes for pool %d,%d\n", reserve_bytes, grp, lev );
+		if ( s->base != 0x0 ) ReleasePages ( s->base, PageRound(s->reserve * s->stride) );
+		if ( s->link != 0x0 ) ReleasePages ( s->link, PageRound(s->reserve * sizeof(uint64)) );
+		delete s;
+		return 0x0;
+	}
+	s->gpu_max = p->max;
+	s->next = p->lastEle;
+	s->head = 0;
+	s->freed = 0;
+	if ( p->cpu != 0x0 ) {
+		memcpy ( s->base, p->cpu, p->lastEle * p->stride );
+		free ( p->cpu );
+	}
+	p->cpu = s->base;
+	p->max = s->committed.load ();
+	p->size = p->max * p->stride;
+	mShared[grp][lev] = s;
+	return s;
+}
+
+bool Allocator::GrowShared ( PoolShared* s, uint64 need )
+{
+	if ( s->committed.load ( std::memory_order_acquire ) >= need ) return true;
+	std::lock_guard<std::mutex> lock ( s->grow );
+	uint64 have = s->committed.load ( std::memory_order_relaxed );
+	if ( have >= need ) return true;
+	if ( need > s->reserve ) return false;
+
+	// commit in chunks of half the pool, never moving what is there
+	uint64 want = std::min ( s->reserve, std::max ( need, have + have/2 ) );
+	if ( !CommitPages ( s->base, have * s->stride, want * s->stride ) ) return false;
+	if ( !CommitPages ( (char*) s->link, have * sizeof(uint64), want * sizeof(uint64) ) ) return false;
+	s->committed.store ( want, std::memory_order_release );
+	return true;
+}
+
+uint64 Allocator::AllocShared ( PoolShared* s, uint64 cnt )
+{
+	if ( cnt == 1 ) {
+		// pop a freed element
+		uint64 h = s->head.load ( std::memory_order_acquire );
+		while ( (h & POOL_NDX_MASK) != 0 ) {
+			uint64 ndx = (h & POOL_NDX_MASK) - 1;
+			uint64 n = ( s->link[ndx].load ( std::memory_order_relaxed ) & POOL_NDX_MASK ) | ( ((h >> POOL_TAG_SHIFT) + 1) << POOL_TAG_SHIFT );
+			if ( s->head.compare_exchange_weak ( h, n, std::memory_order_acquire, std::memory_order_acquire ) ) {
+				s->freed.fetch_sub ( 1, std::memory_order_relaxed );
+				return ndx;
+			}
+		}
+		// take from the thread's slab
+		if ( t_poolSession != mSession->id ) {
+			t_poolSession = mSession->id;
+			t_poolSlot = mSession->slots.fetch_add ( 1 );
+		}
+		if ( t_poolSlot < POOL_SLAB_THREADS ) {
+			PoolShared::Slab& sl = s->slab[ t_poolSlot ];
+			if ( sl.next == sl.end ) {
+				uint64 first = AllocShared ( s, POOL_SLAB );
+				if ( first == ID_UNDEF64 ) return ID_UNDEF64;
+				sl.next = first;
+				sl.end = first + POOL_SLAB;
+			}
+			return sl.next++;
+		}
+	}
+	// bump the pool
+	uint64 first = s->next.fetch_add ( cnt, std::memory_order_relaxed );
+	if ( first + cnt > s->reserve || !GrowShared ( s, first + cnt ) ) {
+		uint64 undo = first + cnt;
+		s->next.compare_exchange_strong ( undo, first );		// give back the range unless others bumped past it
+		gprintf ( "ERROR: Pool exceeded its reservation of %lld elements.\n", s->reserve );
+		return ID_UNDEF64;
+	}
+	return first;
+}
+
+void Allocator::PoolBeginConcurrent ( uint64 reserve_bytes )
+{
+	if ( mConcurrent ) return;
+	for (int grp=0; grp < MAX_POOL; grp++) 
+		for (int lev=0; lev < mPool[grp].size(); lev++ ) {
+			PoolShared* s = getShared ( grp, lev, reserve_bytes );
+			if ( s == 0x0 ) continue;
+			s->next = mPool[grp][lev].lastEle;
+			for (int n=0; n < POOL_SLAB_THREADS; n++ ) 
+				s->slab[n].next = s->slab[n].end = 0;
+		}
+	mSession = new PoolSession;
+	mSession->id = ++g_poolSession;
+	mSession->slots = 0;
+	mConcurrent = true;
+}
+
+void Allocator::PoolEndConcurrent ()
 {
+	if ( !mConcurrent ) return;
+	int slots = std::min ( mSession->slots.load(), POOL_SLAB_THREADS );
+
+	for (int grp=0; grp < MAX_POOL; grp++) 
+		for (int lev=0; lev < mShared[grp].size(); lev++ ) {
+			PoolShared* s = mShared[grp][lev];
+			if ( s == 0x0 ) continue;
+			DataPtr* p = &mPool[grp][lev];
+			uint64 last = std::min ( s->next.load(), s->committed.load() );		// failed bumps may overshoot
+
+			// return unused slab tails, trimming the pool when a tail is at the end
+			for (int n=0; n < slots; n++ ) {
+				PoolShared::Slab& sl = s->slab[n];
+				if ( sl.end == last ) { last = sl.next; sl.next = sl.end; }
+				for (uint64 i = sl.next; i < sl.end; i++ ) {
+					s->link[i].store ( s->head.load() & POOL_NDX_MASK );
+					s->head.store ( i+1 );
+					s->freed++;
+				}
+				sl.next = sl.end = 0;
+			}
+			p->lastEle = last;
+			p->usedNum = last - s->freed.load();
+			p->max = s->committed.load ();
+			p->size = p->max * p->stride;
+			if ( p->max > s->gpu_max ) {
+				ResizePoolGPU ( p, s->gpu_max );
+				s->gpu_max = p->max;
+			}
+		}
+	delete mSession;
+	mSession = 0x0;
+	mConcurrent = false;
 }
 
 
@@ -272,10 +573,10 @@ void Allocator::CreateMemLinear ( DataPtr& p, char* dat, int stride, uint64 cnt,
 	p.subdim = Vector3DI(0,0,0);
 
 	if ( dat==0x0 ) {
-		if ( bCPU ) {
+		if ( bCPU || mbCPUOnly ) {
 			if ( p.cpu != 0x0 ) free (p.cpu);		// release previous
 			
-			if (bAllocHost)
+			if (bAllocHost && !mbCPUOnly)
 				cudaCheck ( cuMemAllocHost ( (void**)&p.cpu, sizeof(float) * 3 ), "Allocator", "CreateMemLinear", "cuMemAllocHost", "", mbDebug);
 			else 
 				p.cpu = (char*) malloc ( p.size );		// create on cpu 
@@ -283,6 +584,8 @@ void Allocator::CreateMemLinear ( DataPtr& p, char* dat, int stride, uint64 cnt,
 	} else {
 		p.cpu = dat;							// get from user
 	}
+	if ( mbCPUOnly ) return;					// host copy is the only copy
+
 	if ( p.gpu != 0x0 ) cudaCheck ( cuMemFree (p.gpu), "Allocator", "CreateMemLinear", "cuMemFree", "", mbDebug);
 	cudaCheck ( cuMemAlloc ( &p.gpu, p.size ), "Allocator", "CreateMemLinear", "cuMemAlloc", "", mbDebug);
 
@@ -299,17 +602,21 @@ void Allocator::FreeMemLinear ( DataPtr& p )
 
 void Allocator::RetrieveMem ( DataPtr& p)
 {
+	if ( p.gpu == 0x0 ) return;
 	cudaCheck ( cuMemcpyDtoH ( p.cpu, p.gpu, p.size), "Allocator", "RetrieveMem", "cuMemcpyDtoH", "", mbDebug);
 }
 
 void Allocator::CommitMem ( DataPtr& p)
 {
+	if ( p.gpu == 0x0 ) return;
 	cudaCheck ( cuMemcpyHtoD ( p.gpu, p.cpu, p.size), "Allocator", "CommitMem", "cuMemcpyHtoD", "", mbDebug);
 }
 
 
 void Allocator::AllocateTextureGPU ( DataPtr& p, uchar dtype, Vector3DI res, bool bGL, uint64 preserve )
 {	
+	if ( mbCPUOnly ) return;
+
 	// GPU allocate	
 	if ( bGL ) {
 		// OpenGL 3D texture
@@ -465,6 +772,9 @@ void Allocator::AllocateTextureCPU ( DataPtr& p, uint64 sz, bool bCPU, uint64 pr
 			memcpy ( p.cpu, old_cpu, preserve );
 		}
 		if ( old_cpu != 0x0 ) free ( old_cpu );	
+		if ( mbCPUOnly && p.size > preserve ) 
+			memset ( p.cpu + preserve, 0, p.size - preserve );		// the fill done on the GPU texture otherwise
+
 	}
 }
 
@@ -487,6 +797,7 @@ void Allocator::AllocateAtlasMap ( int stride, Vector3DI axiscnt )
 	q.size = stride * q.max;					// list of mapping structs			
 	if ( q.cpu != 0x0 ) free ( q.cpu );
 	q.cpu = (char*) malloc ( q.size );			// cpu allocate		
+	if ( mbCPUOnly ) { mAtlasMap[0] = q; return; }
 			
 	size_t sz = q.size;							// gpu allocate
 	if ( q.gpu != 0x0 ) cudaCheck ( cuMemFree ( q.gpu ), "Allocator", "AllocateAtlasMap", "cuMemFree", "", mbDebug);
@@ -515,10 +826,10 @@ bool Allocator::TextureCreate ( uchar chan, uchar dtype, Vector3DI res, bool bCP
 
 	// Atlas
 	AllocateTextureGPU ( p, dtype, res, bGL, 0 );		// GPU allocate	
-	AllocateTextureCPU ( p, p.size, bCPU, 0 );			// CPU allocate	
+	AllocateTextureCPU ( p, p.size, bCPU || mbCPUOnly, 0 );			// CPU allocate	
 	mAtlas.push_back ( p );
 
-	cudaCheck ( cuCtxSynchronize(), "Allocator", "TextureCreate", "cuCtxSynchronize", "", mbDebug);
+	if ( !mbCPUOnly ) cudaCheck ( cuCtxSynchronize(), "Allocator", "TextureCreate", "cuCtxSynchronize", "", mbDebug);
 
 	return true;
 }
@@ -551,10 +862,10 @@ bool Allocator::AtlasCreate ( uchar chan, uchar dtype, Vector3DI leafdim, Vector
 
 	// Atlas
 	AllocateTextureGPU ( p, dtype, axisres, bGL, 0 );		// GPU allocate	
-	AllocateTextureCPU ( p, p.size, bCPU, 0 );				// CPU allocate
+	AllocateTextureCPU ( p, p.size, bCPU || mbCPUOnly, 0 );				// CPU allocate
 	mAtlas.push_back ( p );
 
-	cudaCheck ( cuCtxSynchronize(), "Allocator", "AtlasCreate", "cuCtxSynchronize", "", mbDebug);
+	if ( !mbCPUOnly ) cudaCheck ( cuCtxSynchronize(), "Allocator", "AtlasCreate", "cuCtxSynchronize", "", mbDebug);
 
 	return true;
 }
@@ -607,6 +918,10 @@ void Allocator::CopyChannel(int chanDst, int chanSrc)
 
 	axisres = axiscnt * int(leafdim + pSrc.apron * 2);		
 
+	if ( mbCPUOnly ) {
+		memcpy ( pDst.cpu, pSrc.cpu, std::min ( pDst.size, preserve ) );
+		return;
+	}
 	CUDA_MEMCPY3D cp = {0};
 	cp.dstMemoryType = CU_MEMORYTYPE_ARRAY;
 	cp.dstArray = pDst.garray;
@@ -661,6 +976,7 @@ void Allocator::AllocateNeighbors( uint64 cnt )
 
 	if (mNeighbors.cpu != 0x0) free(mNeighbors.cpu);
 	mNeighbors.cpu = (char*) malloc(mNeighbors.size);
+	if ( mbCPUOnly ) return;
 
 	if ( mNeighbors.gpu != 0x0) cudaCheck(cuMemFree(mNeighbors.gpu), "Allocator", "AllocateNeighbors", "cuMemFree", "", mbDebug);
 	cudaCheck(cuMemAlloc(&mNeighbors.gpu, mNeighbors.size), "Allocator", "AllocateNeighbors", "cuMemAlloc", "", mbDebug);
@@ -668,6 +984,7 @@ void Allocator::AllocateNeighbors( uint64 cnt )
 
 void Allocator::CommitNeighbors()
 {
+	if ( mNeighbors.gpu == 0x0 ) return;
 	cudaCheck(cuMemcpyHtoD( mNeighbors.gpu, mNeighbors.cpu, mNeighbors.size), "Allocator", "CommitNeighbors", "cuMemcpyHtoD", "", mbDebug);
 }
 
@@ -796,6 +1113,7 @@ void Allocator::AtlasCommit ( uchar chan )
 }
 void Allocator::AtlasCommitFromCPU ( uchar chan, uchar* src )
 {
+	if ( mAtlas[chan].garray == 0x0 ) return;				// host-only atlas
 	Vector3DI res = mAtlas[chan].subdim * int(mAtlas[chan].stride + (int(mAtlas[chan].apron) << 1) );		// atlas res
 
 	CUDA_MEMCPY3D cp = {0};
@@ -803,15 +1121,38 @@ void Allocator::AtlasCommitFromCPU ( uchar chan, uchar* src )
 	cp.dstArray = mAtlas[chan].garray;
 	cp.srcMemoryType = CU_MEMORYTYPE_HOST;
 	cp.srcHost = src;
-	cp.WidthInBytes = res.x*sizeof(float);
+	cp.WidthInBytes = res.x*getSize(mAtlas[chan].type);
 	cp.Height = res.y;
 	cp.Depth = res.z;
 	
 	cudaCheck ( cuMemcpy3D ( &cp ), "Allocator", "AtlasCommitFromCPU", "cuMemcpy3D", "", mbDebug);
 }
+void Allocator::AtlasFetch ( uchar chan )
+{
+	DataPtr& p = mAtlas[chan];
+	if ( p.cpu == 0x0 ) {
+		AllocateTextureCPU ( p, p.size, true, 0 );
+		memset ( p.cpu, 0, p.size );
+	}
+	if ( p.garray == 0x0 ) return;				// no device atlas to fetch from
+
+	Vector3DI res = getAtlasRes ( chan );
+
+	CUDA_MEMCPY3D cp = {0};
+	cp.srcMemoryType = CU_MEMORYTYPE_ARRAY;
+	cp.srcArray = p.garray;
+	cp.dstMemoryType = CU_MEMORYTYPE_HOST;
+	cp.dstHost = p.cpu;
+	cp.WidthInBytes = res.x*getSize(p.type);
+	cp.Height = res.y;
+	cp.Depth = res.z;
+
+	cudaCheck ( cuMemcpy3D ( &cp ), "Allocator", "AtlasFetch", "cuMemcpy3D", "", mbDebug);
+}
 
 void Allocator::AtlasFill ( uchar chan )
 {
+	if ( mbCPUOnly ) { memset ( mAtlas[chan].cpu, 0, mAtlas[chan].size ); return; }
 	Vector3DI atlasres = getAtlasRes(chan);	
 	Vector3DI block ( 8, 8, 8 );
 	Vector3DI grid ( int(atlasres.x/block.x)+1, int(atlasres.y/block.y)+1, int(atlasres.z/block.z)+1 );	
@@ -985,11 +1326,22 @@ void Allocator::PoolWrite ( FILE* fp, uchar grp, uchar lev )
 void Allocator::PoolRead ( FILE* fp, uchar grp, uchar lev, int cnt, int wid )
 {
 	char* dat = getPoolCPU (grp,lev );
-	fread ( dat, wid, cnt, fp );
+	uint64 stride = mPool[grp][lev].stride;
+	if ( wid == stride ) {
+		fread ( dat, wid, cnt, fp );
+	} else {
+		// file rows differ from pool rows (e.g. nodes saved with or without mask prefix tables).
+		// Keep the shared front of each row: a narrower row is zero padded, a wider one is cut.
+		uint64 keep = std::min ( uint64(wid), stride );
+		for (int n=0; n < cnt; n++ ) {
+			fread ( dat + n*stride, keep, 1, fp );
+			if ( keep < stride )	memset ( dat + n*stride + keep, 0, stride - keep );
+			if ( keep < wid )		fseek ( fp, long(wid - keep), SEEK_CUR );
+		}
+	}
 
 	mPool[grp][lev].usedNum = cnt;
 	mPool[grp][lev].lastEle = cnt;
-	mPool[grp][lev].stride = wid;
 }
 
 void Allocator::AtlasWrite ( FILE* fp, uchar chan )
@@ -63,9 +63,9 @@
 
 	// Allocator
 	// Primary memory handler for GVDB
-	class Allocator {
+	class GVDB_API Allocator {
 	public:
-		Allocator();
+		Allocator ( bool cpu_only = false );		// cpu_only: host memory only, for use without a CUDA context
 		~Allocator();
 		
 		// Pool functions
@@ -80,7 +80,17 @@
 		void	PoolFetch(int grp, int lev );
 
 		uint64	PoolAlloc ( uchar grp, uchar lev, bool bGPU );		// allocate on pool
-		void	PoolFree ( uint64 id );								// free from pool		
+		uint64	PoolAllocMulti ( uchar grp, uchar lev, uint64 cnt, bool bGPU );	// allocate 'cnt' consecutive elements, returns first
+		void	PoolFree ( uint64 id );								// zero-fill (a discarded node) and recycle an element
+
+		// Concurrent pools. Between PoolBeginConcurrent and PoolEndConcurrent, PoolAlloc,
+		// PoolAllocMulti, PoolFree and PoolData may be called from many threads; nothing else may.
+		// Pools move once into reserved address space that is committed in place as they grow,
+		// so element pointers stay valid. Threads take single elements from private slabs and
+		// recycle freed ones through a lock-free list. GPU pools are resized at the end.
+		void	PoolBeginConcurrent ( uint64 reserve_bytes = 0 );	// address space per pool, 0 = default
+		void	PoolEndConcurrent ();
+		bool	isPoolConcurrent ()		{ return mConcurrent; }
 		char*	PoolData ( uint64 id );								// get data ptr
 		char*	PoolData ( uchar grp, uchar lev, uint64 ndx );
 		uint64* PoolData64 ( uint64 id );		
@@ -113,6 +123,7 @@
 		bool	AtlasAlloc ( uchar chan, Vector3DI& val );
 		void	AtlasFill ( uchar chan );		
 		void	AtlasCommit ( uchar chan );										// commit CPU atlas data to GPU
+		void	AtlasFetch ( uchar chan );										// fetch GPU atlas data to CPU (allocates CPU atlas)
 		void	AtlasCommitFromCPU ( uchar chan, uchar* src );					// host-to-device copy from 3D to 3D (entire vol)				
 		void	AtlasAppendLinearCPU ( uchar chan, int n, float* src );			// CPU only, append 3D data linearly to end of atlas (no GPU update)
 		void	AtlasCopyTex ( uchar chan, Vector3DI val, const DataPtr& src );		// device-to-device copy 3D sub-vol into 3D 
@@ -167,14 +178,25 @@
 		void SetStream(CUstream strm) { mStream = strm;  }
 		CUstream getStream() { return mStream; }
 		void SetDebug(bool b) { mbDebug = b; }
+		bool isCPUOnly ()	{ return mbCPUOnly; }
 
 	private:
+		struct PoolShared;										// reserved memory and free list of a pool
+		struct PoolSession;										// thread slabs of a concurrent section
+		PoolShared*	getShared ( uchar grp, uchar lev, uint64 reserve_bytes );
+		uint64	AllocShared ( PoolShared* s, uint64 cnt );
+		bool	GrowShared ( PoolShared* s, uint64 need );
+		void	ResizePoolGPU ( DataPtr* p, uint64 keep );
 
 		std::vector< DataPtr >		mPool[ MAX_POOL ];
+		std::vector< PoolShared* >	mShared[ MAX_POOL ];
+		PoolSession*				mSession;
+		bool						mConcurrent;
 		std::vector< DataPtr >		mAtlas;
 		std::vector< DataPtr >		mAtlasMap;
 		DataPtr						mNeighbors;
 		bool						mbDebug;
+		bool						mbCPUOnly;
 
 		int							mVFBO[2];
 
@@ -0,0 +1,145 @@
+//-----------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+//-----------------------------------------------------------------------------
+
+#include "gvdb_compress.h"
+#include <string.h>
+
+#define LZ_HASH_BITS	14
+
+namespace nvdb {
+
+// LZ77 with a single-probe hash table and a 64KB window. Each sequence is a
+// token (4 bits literal count, 4 bits match length-4), 255-extended counts,
+// the literals, then a 2-byte match offset. The final sequence is literals only.
+
+static inline uint read32 ( const uchar* p )	{ uint v; memcpy ( &v, p, 4 ); return v; }
+
+static inline void putCount ( std::vector<uchar>& dst, int cnt )
+{
+	for ( ; cnt >= 255; cnt -= 255 ) dst.push_back ( 255 );
+	dst.push_back ( (uchar) cnt );
+}
+
+static void putSequence ( std::vector<uchar>& dst, const uchar* lit, int litn, int off, int mlen )
+{
+	int ml = (mlen > 0) ? mlen - 4 : 0;
+	dst.push_back ( (uchar) ( ((litn < 15 ? litn : 15) << 4) | (ml < 15 ? ml : 15) ) );
+	if ( litn >= 15 ) putCount ( dst, litn - 15 );
+	dst.insert ( dst.end(), lit, lit + litn );
+	if ( mlen == 0 ) return;
+	dst.push_back ( (uchar) (off & 0xFF) );
+	dst.push_back ( (uchar) (off >> 8) );
+	if ( ml >= 15 ) putCount ( dst, ml - 15 );
+}
+
+void LZCompress ( const uchar* src, int n, std::vector<uchar>& dst )
+{
+	std::vector<int> table ( 1 << LZ_HASH_BITS, -1 );
+	dst.clear ();
+	dst.reserve ( n + n/255 + 16 );
+
+	int anchor = 0, i = 0;
+	int limit = n - 8;						// keep the tail as literals
+	while ( i < limit ) {
+		uint seq = read32 ( src + i );
+		uint h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+		int ref = table[h];
+		table[h] = i;
+		if ( ref < 0 || i - ref > 0xFFFF || read32 ( src + ref ) != seq ) {
+			i += 1 + ((i - anchor) >> 6);	// skip faster through incompressible data
+			continue;
+		}
+		int len = 4;
+		while ( i + len < n && src[ref+len] == src[i+len] ) len++;
+		putSequence ( dst, src + anchor, i - anchor, i - ref, len );
+		i += len;
+		anchor = i;
+	}
+	putSequence ( dst, src + anchor, n - anchor, 0, 0 );
+}
+
+bool LZDecompress ( const uchar* src, int n, uchar* dst, int rawn )
+{
+	int ip = 0, op = 0;
+	while ( ip < n ) {
+		int token = src[ip++];
+		int lit = token >> 4;
+		if ( lit == 15 ) {
+			int b;
+			do { if ( ip >= n ) return false; b = src[ip++]; lit += b; } while ( b == 255 );
+		}
+		if ( ip + lit > n || op + lit > rawn ) return false;
+		memcpy ( dst + op, src + ip, lit );
+		ip += lit; op += lit;
+		if ( ip == n ) break;				// final sequence
+
+		if ( ip + 2 > n ) return false;
+		int off = src[ip] | (src[ip+1] << 8);
+		ip += 2;
+		int mlen = token & 15;
+		if ( mlen == 15 ) {
+			int b;
+			do { if ( ip >= n ) return false; b = src[ip++]; mlen += b; } while ( b == 255 );
+		}
+		mlen += 4;
+		if ( off == 0 || off > op || op + mlen > rawn ) return false;
+		const uchar* m = dst + op - off;
+		for (int k=0; k < mlen; k++ ) dst[op+k] = m[k];	// may overlap
+		op += mlen;
+	}
+	return op == rawn;
+}
+
+void ByteShuffle ( const uchar* src, int num, int stride, uchar* dst )
+{
+	for (int k=0; k < stride; k++ )
+		for (int n=0; n < num; n++ )
+			*dst++ = src[ n*stride + k ];
+}
+
+void ByteUnshuffle ( const uchar* src, int num, int stride, uchar* dst )
+{
+	for (int k=0; k < stride; k++ )
+		for (int n=0; n < num; n++ )
+			dst[ n*stride + k ] = *src++;
+}
+
+// Brick codec for compressed VBX atlases
+int EncodeBrick ( const uchar* src, int num, int stride, std::vector<uchar>& dst, uchar* tmp )
+{
+	int v = 1;
+	while ( v < num && memcmp ( src + v*stride, src, stride ) == 0 ) v++;
+	if ( v == num ) {
+		dst.assign ( src, src + stride );
+		return BRICK_CONST;
+	}
+	ByteShuffle ( src, num, stride, tmp );
+	LZCompress ( tmp, num * stride, dst );
+	if ( dst.size() < size_t(num) * stride ) return BRICK_LZ;
+	dst.assign ( src, src + size_t(num) * stride );
+	return BRICK_RAW;
+}
+
+bool DecodeBrick ( int codec, const uchar* src, int n, int num, int stride, uchar* dst, uchar* tmp )
+{
+	switch ( codec ) {
+	case BRICK_CONST:
+		if ( n != stride ) return false;
+		for (int v=0; v < num; v++ ) memcpy ( dst + v*stride, src, stride );
+		return true;
+	case BRICK_LZ:
+		if ( !LZDecompress ( src, n, tmp, num * stride ) ) return false;
+		ByteUnshuffle ( tmp, num, stride, dst );
+		return true;
+	case BRICK_RAW:
+		if ( n != num * stride ) return false;
+		memcpy ( dst, src, n );
+		return true;
+	}
+	return false;
+}
+
+}
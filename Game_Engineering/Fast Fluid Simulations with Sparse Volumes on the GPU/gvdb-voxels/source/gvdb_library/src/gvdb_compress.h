@@ -0,0 +1,37 @@
+//-----------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+//-----------------------------------------------------------------------------
+
+// Fast lossless compression, used for VBX bricks and particle caches.
+// LZ77 with a single-probe hash table and a 64KB window, in the spirit of LZ4.
+// Fixed-size records (e.g. floats) compress much better after a byte shuffle,
+// which groups byte k of every element together.
+
+#ifndef DEF_GVDB_COMPRESS
+	#define DEF_GVDB_COMPRESS
+
+	#include "gvdb_types.h"
+	#include <vector>
+
+	namespace nvdb {
+
+	GVDB_API void LZCompress ( const uchar* src, int n, std::vector<uchar>& dst );
+	GVDB_API bool LZDecompress ( const uchar* src, int n, uchar* dst, int rawn );		// false if corrupt or not rawn bytes
+
+	GVDB_API void ByteShuffle ( const uchar* src, int num, int stride, uchar* dst );
+	GVDB_API void ByteUnshuffle ( const uchar* src, int num, int stride, uchar* dst );
+
+	// Brick codec (VBX grid_compress 2). Encode picks the codec and returns it;
+	// tmp is scratch of num*stride bytes.
+	#define BRICK_RAW		0			// stored as is
+	#define BRICK_CONST		1			// all voxels equal, one voxel stored
+	#define BRICK_LZ		2			// byte shuffled, then LZ compressed
+
+	GVDB_API int EncodeBrick ( const uchar* src, int num, int stride, std::vector<uchar>& dst, uchar* tmp );
+	GVDB_API bool DecodeBrick ( int codec, const uchar* src, int n, int num, int stride, uchar* dst, uchar* tmp );
+
+	}
+
+#endif
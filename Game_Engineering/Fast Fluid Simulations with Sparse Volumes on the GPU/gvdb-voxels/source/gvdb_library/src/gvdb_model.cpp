@@ -23,15 +23,13 @@ Model::~Model ()
 
 void Model::Transform ( Vector3DF move, Vector3DF scale )
 {
-	float* pos = (float*) ( (char*) vertBuffer + vertOffset);	
+	Vector3DF* pos = (Vector3DF*) ( (char*) vertBuffer + vertOffset);	
 
 	// Scale object
-	for (int n=0; n < vertCount; n++ ) {
-		*(pos)	 = *(pos) * scale.x + move.x;
-		*(pos+1) = *(pos+1) * scale.y + move.y;
-		*(pos+2) = *(pos+2) * scale.z + move.z;
-		pos += vertStride/sizeof(float);
-	}		
+	Matrix4F xform;
+	xform.Scale ( scale.x, scale.y, scale.z );
+	xform.TranslateInPlace ( move );
+	TransformPoints ( xform, pos, pos, vertCount, vertStride, vertStride );
 	Matrix4F ident;
 	ComputeBounds ( ident, 0 );	
 }
@@ -46,21 +44,8 @@ void Model::ComputeBounds ( Matrix4F& xform, float margin )
 	}
 
 	// Compute polygon bounds
-	Vector3DF pnt;
-	float* pos = (float*) ( (char*) vertBuffer + vertOffset);	
-	pnt = *(Vector3DF*) pos; pnt *= xform;
-	objMin = pnt;
-	objMax = pnt;
-	for (int n=0; n < vertCount; n++ ) {
-		pnt = *(Vector3DF*) pos; pnt *= xform;
-		if ( pnt.x < objMin.x ) objMin.x = pnt.x;
-		if ( pnt.y < objMin.y ) objMin.y = pnt.y;
-		if ( pnt.z < objMin.z ) objMin.z = pnt.z;
-		if ( pnt.x > objMax.x ) objMax.x = pnt.x;
-		if ( pnt.y > objMax.y ) objMax.y = pnt.y;
-		if ( pnt.z > objMax.z ) objMax.z = pnt.z;
-		pos += vertStride/sizeof(float);
-	}
+	Vector3DF* pos = (Vector3DF*) ( (char*) vertBuffer + vertOffset);	
+	BoundPoints ( pos, vertCount, objMin, objMax, vertStride, &xform );
 	// Add margin
 	Vector3DF m = objMax; m -= objMin; m *= margin;
 	objMin -= m;
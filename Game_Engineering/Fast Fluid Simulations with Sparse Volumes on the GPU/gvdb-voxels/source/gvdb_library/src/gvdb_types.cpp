@@ -14,9 +14,18 @@
 #include <stdio.h>
 #include <stdarg.h>
 
+#if defined(_WIN32)
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
 //------------------------------------------------------- gprintf
-static size_t fmt2_sz    = 0;
-static char *fmt2 = NULL;
+static thread_local size_t fmt2_sz    = 0;		// per thread: concurrent pools report errors from workers
+static thread_local char *fmt2 = NULL;
 static FILE *fd = NULL;
 static bool bLogReady = false;
 static bool bPrintLogging = true;
@@ -89,3 +98,67 @@ void gerror ()
 	gprintf ( "Error. Application will exit.\n" );	
 	exit(-1);
 }
+
+//------------------------------------------------------- file mapping
+unsigned char* gmapFile ( const char* fname, slong& size, void*& handle )
+{
+	unsigned char* data = 0x0;
+	size = 0;
+	handle = 0x0;
+#if defined(_WIN32)
+	HANDLE file = CreateFileA ( fname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( file == INVALID_HANDLE_VALUE ) return 0x0;
+	LARGE_INTEGER sz;
+	if ( GetFileSizeEx ( file, &sz ) && sz.QuadPart > 0 ) {
+		HANDLE mapping = CreateFileMappingA ( file, NULL, PAGE_READONLY, 0, 0, NULL );
+		if ( mapping != NULL ) {
+			data = (unsigned char*) MapViewOfFile ( mapping, FILE_MAP_READ, 0, 0, 0 );
+			if ( data == 0x0 ) CloseHandle ( mapping );
+			else { handle = mapping; size = sz.QuadPart; }
+		}
+	}
+	CloseHandle ( file );								// the mapping keeps the file open
+#else
+	int fd = open ( fname, O_RDONLY );
+	if ( fd < 0 ) return 0x0;
+	struct stat st;
+	if ( fstat ( fd, &st ) == 0 && st.st_size > 0 ) {
+		void* p = mmap ( 0x0, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+		if ( p != MAP_FAILED ) {
+			data = (unsigned char*) p;
+			size = (slong) st.st_size;
+		}
+	}
+	close ( fd );										// the mapping stays valid
+#endif
+	return data;
+}
+
+void gunmapFile ( unsigned char* data, slong size, void* handle )
+{
+	if ( data == 0x0 ) return;
+#if defined(_WIN32)
+	UnmapViewOfFile ( data );
+	CloseHandle ( (HANDLE) handle );
+#else
+	munmap ( data, (size_t) size );
+#endif
+}
+
+slong gftell ( FILE* fp )
+{
+#if defined(_WIN32)
+	return _ftelli64 ( fp );
+#else
+	return (slong) ftello ( fp );
+#endif
+}
+
+int gfseek ( FILE* fp, slong pos )
+{
+#if defined(_WIN32)
+	return _fseeki64 ( fp, pos, SEEK_SET );
+#else
+	return fseeko ( fp, (off_t) pos, SEEK_SET );
+#endif
+}
@@ -12,6 +12,7 @@
 
 	#include <stdint.h>
         #include <cstdarg>
+	#include <cstdio>
 
 		#if !defined ( GVDB_STATIC )
 		#if defined ( GVDB_EXPORTS )				// inside DLL
@@ -127,6 +128,14 @@
 	extern void GVDB_API gprintSetLogging(bool b);
 	extern void GVDB_API gerror();			
 
+	// read-only file mapping; returns 0x0 on failure or for empty files
+	extern GVDB_API uchar* gmapFile ( const char* fname, slong& size, void*& handle );
+	extern GVDB_API void gunmapFile ( uchar* data, slong size, void* handle );
+
+	// 64-bit file positions (long is 32-bit on Windows; VBX atlases easily exceed 2GB)
+	extern GVDB_API slong gftell ( FILE* fp );
+	extern GVDB_API int gfseek ( FILE* fp, slong pos );
+
 	#define  LOGLEVEL_INFO 0
 	#define  LOGLEVEL_WARNING 1
 	#define  LOGLEVEL_ERROR 2
@@ -0,0 +1,278 @@
+//-----------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+//-----------------------------------------------------------------------------
+
+#include "gvdb_vbx_pager.h"
+#include "gvdb_allocator.h"
+#include "gvdb_compress.h"
+#include "app_perf.h"
+
+#include <algorithm>
+#include <thread>
+
+using namespace nvdb;
+
+VBXPager::VBXPager ()
+{
+	mGVDB = 0x0;
+	mAccess = 0x0;
+	mData = 0x0;
+	mSize = 0;
+	mMapping = 0x0;
+	mBrickres = 0; mApron = 0; mBrickVox = 0;
+	mSlotBytes = 0; mSlots = 0;
+	mHits = 0; mMisses = 0;
+}
+
+VBXPager::~VBXPager ()
+{
+	Close ();
+}
+
+void VBXPager::Close ()
+{
+	gunmapFile ( mData, mSize, mMapping );
+	mData = 0x0; mSize = 0;
+	mMapping = 0x0;
+
+	delete mAccess;
+	mAccess = 0x0;
+	mChan.clear ();
+	mCache.clear ();
+	mSlotKey.clear ();
+	mSlotPos.clear ();
+	mLRU.clear ();
+	mLookup.clear ();
+	mSlots = 0;
+	mHits = 0; mMisses = 0;
+}
+
+// Load topology eagerly, then map the file for the atlas bricks
+bool VBXPager::Open ( const std::string fname, VolumeGVDB* gvdb, int cache_bricks )
+{
+	Close ();
+	mGVDB = gvdb;
+	if ( !gvdb->LoadVBX ( fname, 0, 0, this ) ) {
+		Close ();
+		return false;
+	}
+
+	mData = gmapFile ( fname.c_str(), mSize, mMapping );
+	if ( mData == 0x0 ) {
+		gprintf ( "ERROR: VBXPager unable to map %s\n", fname.c_str() );
+		Close ();
+		return false;
+	}
+
+	// Check that every channel lies inside the file
+	int max_stride = 1;
+	for (size_t c = 0; c < mChan.size(); c++ ) {
+		Channel& ch = mChan[c];
+		slong end = ch.offset + slong(mAxisres.x) * mAxisres.y * mAxisres.z * ch.stride;
+		if ( ch.compress == 2 )
+			end = ch.brick_offs.empty() ? ch.offset : ch.brick_offs.back() + ch.sizes.back();
+		if ( end > mSize ) {
+			gprintf ( "ERROR: VBXPager %s is truncated (channel %d).\n", fname.c_str(), (int) c );
+			Close ();
+			return false;
+		}
+		max_stride = std::max ( max_stride, ch.stride );
+	}
+
+	// Brick cache
+	mSlots = std::max ( 1, cache_bricks );
+	mSlotBytes = slong(mBrickVox) * max_stride;
+	mCache.resize ( mSlots * mSlotBytes );
+	mTmp.resize ( mSlotBytes );
+	mSlotKey.assign ( mSlots, ID_UNDEF64 );
+	mSlotPos.resize ( mSlots );
+	for (int s = 0; s < mSlots; s++ )
+		mSlotPos[s] = mLRU.insert ( mLRU.end(), s );
+
+	mAccess = new VoxelAccessor ( gvdb );
+	return true;
+}
+
+void VBXPager::SetLayout ( Vector3DI axiscnt, Vector3DI axisres, int brickwid, int apron )
+{
+	mAxiscnt = axiscnt;
+	mAxisres = axisres;
+	mApron = apron;
+	mBrickres = brickwid + 2*apron;
+	mBrickVox = mBrickres * mBrickres * mBrickres;
+	mChan.clear ();
+}
+
+// Record where a channel's atlas lies and skip over it. See GVDB_FILESPEC.txt.
+bool VBXPager::AddChannel ( FILE* fp, int type, int stride, int compress )
+{
+	Channel ch;
+	ch.type = type;
+	ch.stride = stride;
+	ch.compress = compress;
+
+	if ( compress == 0 ) {
+		ch.offset = gftell ( fp );
+		gfseek ( fp, ch.offset + slong(mAxisres.x) * mAxisres.y * mAxisres.z * stride );
+	} else if ( compress == 2 ) {
+		int num = 0;
+		fread ( &num, sizeof(int), 1, fp );
+		if ( num != mAxiscnt.x * mAxiscnt.y * mAxiscnt.z ) {
+			gprintf ( "ERROR: VBX compressed atlas has %d bricks, expected %d.\n", num, mAxiscnt.x * mAxiscnt.y * mAxiscnt.z );
+			return false;
+		}
+		ch.sizes.resize ( num );
+		ch.codec.resize ( num );
+		fread ( ch.sizes.data(), sizeof(uint), num, fp );
+		fread ( ch.codec.data(), sizeof(uchar), num, fp );
+		ch.offset = gftell ( fp );
+		ch.brick_offs.resize ( num );
+		slong pos = ch.offset;
+		for (int b = 0; b < num; b++ ) {
+			ch.brick_offs[b] = pos;
+			pos += ch.sizes[b];
+		}
+		gfseek ( fp, pos );
+	} else {
+		gprintf ( "ERROR: VBX grid compression %d not supported.\n", compress );
+		return false;
+	}
+	mChan.push_back ( ch );
+	return true;
+}
+
+// Atlas slot of a leaf, from the atlas position stored in the node
+int VBXPager::getBrickID ( slong leaf )
+{
+	if ( leaf == ID_UNDEFL ) return -1;
+	Node* node = mGVDB->getNode ( leaf );
+	if ( node->mLev != 0 || node->mValue.x == -1 ) return -1;
+	Vector3DI b = ( node->mValue - mApron ) / mBrickres;
+	return ( b.z * mAxiscnt.y + b.y ) * mAxiscnt.x + b.x;
+}
+
+bool VBXPager::DecodeSlot ( uchar chan, int id, uchar* dst, uchar* tmp )
+{
+	Channel& ch = mChan[chan];
+	if ( ch.compress == 2 )
+		return DecodeBrick ( ch.codec[id], mData + ch.brick_offs[id], ch.sizes[id], mBrickVox, ch.stride, dst, tmp );
+
+	// Raw atlas: gather the slot's rows, touching only the pages they sit in
+	const int br = mBrickres;
+	Vector3DI b ( id % mAxiscnt.x, (id / mAxiscnt.x) % mAxiscnt.y, id / (mAxiscnt.x * mAxiscnt.y) );
+	const uchar* corner = mData + ch.offset + ( ( slong(b.z) * br * mAxisres.y + slong(b.y) * br ) * mAxisres.x + slong(b.x) * br ) * ch.stride;
+	for (int z = 0; z < br; z++ )
+		for (int y = 0; y < br; y++ )
+			memcpy ( dst + ( (z*br + y) * br ) * ch.stride, corner + ( slong(z) * mAxisres.y + y ) * mAxisres.x * ch.stride, br * ch.stride );
+	return true;
+}
+
+// Take the least recently used slot for key
+int VBXPager::AssignSlot ( uint64 key )
+{
+	int s = mLRU.back ();
+	if ( mSlotKey[s] != ID_UNDEF64 ) mLookup.erase ( mSlotKey[s] );
+	mSlotKey[s] = key;
+	mLookup[key] = s;
+	mLRU.splice ( mLRU.begin(), mLRU, mSlotPos[s] );
+	return s;
+}
+
+const uchar* VBXPager::getBrick ( uchar chan, slong leaf )
+{
+	int id = getBrickID ( leaf );
+	if ( id < 0 || chan >= mChan.size() ) return 0x0;
+	uint64 key = ( uint64(chan) << 32 ) | uint64(id);
+
+	std::unordered_map<uint64, int>::iterator it = mLookup.find ( key );
+	if ( it != mLookup.end() ) {
+		mHits++;
+		mLRU.splice ( mLRU.begin(), mLRU, mSlotPos[it->second] );
+		return &mCache[ it->second * mSlotBytes ];
+	}
+	mMisses++;
+	int s = AssignSlot ( key );
+	if ( !DecodeSlot ( chan, id, &mCache[ s * mSlotBytes ], mTmp.data() ) ) {
+		gprintf ( "ERROR: VBXPager brick %d of channel %d is corrupt.\n", id, (int) chan );
+		mLookup.erase ( key );
+		mSlotKey[s] = ID_UNDEF64;
+		mLRU.splice ( mLRU.end(), mLRU, mSlotPos[s] );
+		return 0x0;
+	}
+	return &mCache[ s * mSlotBytes ];
+}
+
+// Decode all bricks overlapping a voxel region in parallel. At most the cache
+// size is touched (hits and misses), so no slot is assigned twice in one call;
+// later bricks in pool order are left for on-demand loads.
+int VBXPager::Prefetch ( uchar chan, Vector3DI vmin, Vector3DI vmax )
+{
+	if ( chan >= mChan.size() ) return 0;
+	PERF_PUSH ( "VBX Prefetch" );
+
+	const int res = mGVDB->getRes ( 0 );
+	const uint64 leaves = mGVDB->mPool->getPoolTotalCnt ( 0, 0 );
+	std::vector<int> ids;
+	std::vector<int> slots;
+	int touched = 0;
+	for (uint64 n = 0; n < leaves && touched < mSlots; n++ ) {
+		Node* node = mGVDB->getNode ( 0, 0, n );
+		if ( node->mValue.x == -1 ) continue;
+		Vector3DI p = node->mPos;
+		if ( p.x > vmax.x || p.y > vmax.y || p.z > vmax.z ) continue;
+		if ( p.x + res <= vmin.x || p.y + res <= vmin.y || p.z + res <= vmin.z ) continue;
+		int id = getBrickID ( (slong) Elem ( 0, 0, n ) );
+		if ( id < 0 ) continue;
+		touched++;
+		uint64 key = ( uint64(chan) << 32 ) | uint64(id);
+		std::unordered_map<uint64, int>::iterator it = mLookup.find ( key );
+		if ( it != mLookup.end() ) {
+			mLRU.splice ( mLRU.begin(), mLRU, mSlotPos[it->second] );
+			continue;
+		}
+		ids.push_back ( id );
+		slots.push_back ( AssignSlot ( key ) );
+	}
+
+	// Decode into the assigned slots
+	const int num = (int) ids.size();
+	std::vector<uchar> ok ( num, 0 );
+	int threads = std::min ( std::max ( 1, (int) std::thread::hardware_concurrency() ), (num + 15) / 16 );
+	auto work = [&] ( int t ) {
+		std::vector<uchar> tmp ( mSlotBytes );
+		for (int i = t; i < num; i += threads )
+			ok[i] = DecodeSlot ( chan, ids[i], &mCache[ slots[i] * mSlotBytes ], tmp.data() );
+	};
+	std::vector<std::thread> pool;
+	for (int t = 1; t < threads; t++ )
+		pool.push_back ( std::thread ( work, t ) );
+	if ( num > 0 ) work ( 0 );
+	for (size_t t = 0; t < pool.size(); t++ )
+		pool[t].join ();
+
+	int cnt = 0;
+	for (int i = 0; i < num; i++ ) {
+		if ( ok[i] ) { cnt++; continue; }
+		gprintf ( "ERROR: VBXPager brick %d of channel %d is corrupt.\n", ids[i], (int) chan );
+		mLookup.erase ( mSlotKey[ slots[i] ] );
+		mSlotKey[ slots[i] ] = ID_UNDEF64;
+		mLRU.splice ( mLRU.end(), mLRU, mSlotPos[ slots[i] ] );
+	}
+	mMisses += num;
+
+	PERF_POP ();
+	return cnt;
+}
+
+bool VBXPager::probeValue ( uchar chan, Vector3DI pos, float& val )
+{
+	if ( chan >= mChan.size() || mChan[chan].type != T_FLOAT ) return false;
+	slong leaf = mAccess->getLeaf ( pos );
+	const float* brick = (const float*) getBrick ( chan, leaf );
+	if ( brick == 0x0 ) return false;
+	Vector3DI v = pos - mGVDB->getNode ( leaf )->mPos + mApron;
+	val = brick[ ( v.z * mBrickres + v.y ) * mBrickres + v.x ];
+	return true;
+}
@@ -0,0 +1,87 @@
+//-----------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+//-----------------------------------------------------------------------------
+
+// Lazy VBX reader
+// Memory-maps a VBX file and loads only its topology into a VolumeGVDB. Atlas
+// bricks stay in the file and are decoded on demand into an LRU cache of fixed
+// size, so CPU tools can inspect parts of volumes too large to load whole.
+// Works with raw and compressed (grid_compress 2) atlases. The VolumeGVDB gets
+// no atlas channels and cannot be rendered. Brick pointers stay valid until the
+// next call that may evict. Not thread safe.
+
+#ifndef DEF_GVDB_VBX_PAGER
+	#define DEF_GVDB_VBX_PAGER
+
+	#include "gvdb_volume_gvdb.h"
+	#include <list>
+	#include <unordered_map>
+
+	namespace nvdb {
+
+	class GVDB_API VBXPager {
+	public:
+		VBXPager ();
+		~VBXPager ();
+
+		bool	Open ( const std::string fname, VolumeGVDB* gvdb, int cache_bricks = 4096 );
+		void	Close ();
+		bool	isOpen ()					{ return mData != 0x0; }
+
+		int		getNumChannels ()			{ return (int) mChan.size(); }
+		int		getChannelType ( uchar chan )	{ return mChan[chan].type; }
+		int		getBrickRes ()				{ return mBrickres; }			// incl. apron
+		int		getApron ()					{ return mApron; }
+
+		const uchar* getBrick ( uchar chan, slong leaf );					// apron-inclusive brick of a leaf node, 0x0 if none
+		int		Prefetch ( uchar chan, Vector3DI vmin, Vector3DI vmax );	// decode bricks overlapping [vmin,vmax] (voxels), returns count
+		bool	probeValue ( uchar chan, Vector3DI pos, float& val );		// T_FLOAT channels, false if pos is in no brick
+
+		slong	getHits ()					{ return mHits; }
+		slong	getMisses ()				{ return mMisses; }
+
+		// Called by LoadVBX
+		void	SetLayout ( Vector3DI axiscnt, Vector3DI axisres, int brickwid, int apron );
+		bool	AddChannel ( FILE* fp, int type, int stride, int compress );
+
+	private:
+		struct Channel {
+			int					type, stride;
+			int					compress;					// 0=raw atlas, 2=brick LZ
+			slong				offset;						// raw atlas start in file
+			std::vector<slong>	brick_offs;					// compressed: brick starts in file
+			std::vector<uint>	sizes;
+			std::vector<uchar>	codec;
+		};
+		int		getBrickID ( slong leaf );
+		bool	DecodeSlot ( uchar chan, int id, uchar* dst, uchar* tmp );
+		int		AssignSlot ( uint64 key );
+
+		VolumeGVDB*				mGVDB;
+		VoxelAccessor*			mAccess;
+		std::vector<Channel>	mChan;
+		Vector3DI				mAxiscnt, mAxisres;
+		int						mBrickres, mApron, mBrickVox;
+
+		// file mapping
+		uchar*					mData;
+		slong					mSize;
+		void*					mMapping;
+
+		// brick cache
+		std::vector<uchar>		mCache;						// slots of mSlotBytes
+		slong					mSlotBytes;
+		int						mSlots;
+		std::vector<uint64>		mSlotKey;
+		std::list<int>			mLRU;						// slots, most recent first
+		std::vector< std::list<int>::iterator > mSlotPos;
+		std::unordered_map<uint64, int> mLookup;			// (chan, brick) -> slot
+		std::vector<uchar>		mTmp;
+		slong					mHits, mMisses;
+	};
+
+	}
+
+#endif
@@ -8,6 +8,12 @@
 //-----------------------------------------------------------------------------
 
 #include "gvdb_vec.h"
+#include <algorithm>
+#if defined(__AVX2__)
+	#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+	#include <emmintrin.h>
+#endif
 using namespace nvdb;
 
 Vector4DF &Vector4DF::operator*= (const Matrix4F &op)
@@ -613,4 +619,320 @@ Matrix4F& Matrix4F::InvScaleInPlace(const Vector3DF& scale) {
 
 
 #undef VTYPE
-#undef VNAME
\ No newline at end of file
+#undef VNAME
+
+//---------------------------------------------------------------- Batch kernels
+// Each kernel is written once over a lane type V: the SIMD register in the main
+// loop, float for the tail (and for everything when no SIMD ISA is targeted).
+
+#define VEC_BLOCK		256				// points gathered to SoA per step of the AoS kernels
+
+template <class V> static inline V vsplat ( float a );
+template <> inline float vsplat<float> ( float a )				{ return a; }
+static inline void vload ( const float* p, float& v )			{ v = *p; }
+static inline void vstore ( float* p, float v )					{ *p = v; }
+static inline float vadd ( float a, float b )					{ return a + b; }
+static inline float vsub ( float a, float b )					{ return a - b; }
+static inline float vmul ( float a, float b )					{ return a * b; }
+static inline float vdiv ( float a, float b )					{ return a / b; }
+static inline float vmin ( float a, float b )					{ return (b < a) ? b : a; }
+static inline float vmax ( float a, float b )					{ return (b > a) ? b : a; }
+static inline float vsqrt ( float a )							{ return sqrtf ( a ); }
+static inline bool vgt ( float a, float b )						{ return a > b; }
+static inline float vsel ( bool m, float a, float b )			{ return m ? a : b; }
+
+#if defined(__AVX2__)
+	#define VEC_WIDTH		8
+	#define VEC_NAME		"AVX2"
+	typedef __m256			vfloat;
+	template <> inline vfloat vsplat<vfloat> ( float a )			{ return _mm256_set1_ps ( a ); }
+	static inline void vload ( const float* p, vfloat& v )			{ v = _mm256_loadu_ps ( p ); }
+	static inline void vstore ( float* p, vfloat v )				{ _mm256_storeu_ps ( p, v ); }
+	static inline vfloat vadd ( vfloat a, vfloat b )				{ return _mm256_add_ps ( a, b ); }
+	static inline vfloat vsub ( vfloat a, vfloat b )				{ return _mm256_sub_ps ( a, b ); }
+	static inline vfloat vmul ( vfloat a, vfloat b )				{ return _mm256_mul_ps ( a, b ); }
+	static inline vfloat vdiv ( vfloat a, vfloat b )				{ return _mm256_div_ps ( a, b ); }
+	static inline vfloat vmin ( vfloat a, vfloat b )				{ return _mm256_min_ps ( a, b ); }
+	static inline vfloat vmax ( vfloat a, vfloat b )				{ return _mm256_max_ps ( a, b ); }
+	static inline vfloat vsqrt ( vfloat a )							{ return _mm256_sqrt_ps ( a ); }
+	static inline vfloat vgt ( vfloat a, vfloat b )					{ return _mm256_cmp_ps ( a, b, _CMP_GT_OQ ); }
+	static inline vfloat vsel ( vfloat m, vfloat a, vfloat b )		{ return _mm256_blendv_ps ( b, a, m ); }
+#elif defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+	#define VEC_WIDTH		4
+	#define VEC_NAME		"SSE2"
+	typedef __m128			vfloat;
+	template <> inline vfloat vsplat<vfloat> ( float a )			{ return _mm_set1_ps ( a ); }
+	static inline void vload ( const float* p, vfloat& v )			{ v = _mm_loadu_ps ( p ); }
+	static inline void vstore ( float* p, vfloat v )				{ _mm_storeu_ps ( p, v ); }
+	static inline vfloat vadd ( vfloat a, vfloat b )				{ return _mm_add_ps ( a, b ); }
+	static inline vfloat vsub ( vfloat a, vfloat b )				{ return _mm_sub_ps ( a, b ); }
+	static inline vfloat vmul ( vfloat a, vfloat b )				{ return _mm_mul_ps ( a, b ); }
+	static inline vfloat vdiv ( vfloat a, vfloat b )				{ return _mm_div_ps ( a, b ); }
+	static inline vfloat vmin ( vfloat a, vfloat b )				{ return _mm_min_ps ( a, b ); }
+	static inline vfloat vmax ( vfloat a, vfloat b )				{ return _mm_max_ps ( a, b ); }
+	static inline vfloat vsqrt ( vfloat a )							{ return _mm_sqrt_ps ( a ); }
+	static inline vfloat vgt ( vfloat a, vfloat b )					{ return _mm_cmpgt_ps ( a, b ); }
+	static inline vfloat vsel ( vfloat m, vfloat a, vfloat b )		{ return _mm_or_ps ( _mm_and_ps ( m, a ), _mm_andnot_ps ( m, b ) ); }
+#else
+	#define VEC_WIDTH		1
+	#define VEC_NAME		"Scalar"
+#endif
+
+const char* nvdb::getVecSIMDName ()
+{
+	return VEC_NAME;
+}
+
+// Rows of the affine part of m: p' = r[0..3].(p,1), r[4..7].(p,1), r[8..11].(p,1)
+static void getAffineRows ( const Matrix4F& m, float* r )
+{
+	for (int i = 0; i < 3; i++ )
+		for (int j = 0; j < 4; j++ )
+			r[i*4 + j] = m.data[j*4 + i];
+}
+
+// Rows of the normal matrix: cofactors of the upper 3x3, i.e. its inverse transpose
+// scaled by |det|. Normals are renormalized after, so the scale does not matter.
+static void getNormalRows ( const Matrix4F& m, float* r )
+{
+	double a[3][3], c[3][3];
+	for (int i = 0; i < 3; i++ )
+		for (int j = 0; j < 3; j++ )
+			a[i][j] = m.data[j*4 + i];
+	for (int i = 0; i < 3; i++ )
+		for (int j = 0; j < 3; j++ )
+			c[i][j] = a[(i+1)%3][(j+1)%3] * a[(i+2)%3][(j+2)%3] - a[(i+1)%3][(j+2)%3] * a[(i+2)%3][(j+1)%3];
+	double det = a[0][0]*c[0][0] + a[0][1]*c[0][1] + a[0][2]*c[0][2];
+	double s = (det < 0) ? -1.0 : 1.0;
+	for (int i = 0; i < 3; i++ ) {
+		for (int j = 0; j < 3; j++ )
+			r[i*4 + j] = float( c[i][j] * s );
+		r[i*4 + 3] = 0;
+	}
+}
+
+template <class V>
+static inline void AffineOp ( const float* r, const float* x, const float* y, const float* z, float* ox, float* oy, float* oz )
+{
+	V px, py, pz;
+	vload ( x, px ); vload ( y, py ); vload ( z, pz );
+	V qx = vadd ( vadd ( vadd ( vmul ( px, vsplat<V>(r[0]) ), vmul ( py, vsplat<V>(r[1]) ) ), vmul ( pz, vsplat<V>(r[2]) ) ), vsplat<V>(r[3]) );
+	V qy = vadd ( vadd ( vadd ( vmul ( px, vsplat<V>(r[4]) ), vmul ( py, vsplat<V>(r[5]) ) ), vmul ( pz, vsplat<V>(r[6]) ) ), vsplat<V>(r[7]) );
+	V qz = vadd ( vadd ( vadd ( vmul ( px, vsplat<V>(r[8]) ), vmul ( py, vsplat<V>(r[9]) ) ), vmul ( pz, vsplat<V>(r[10]) ) ), vsplat<V>(r[11]) );
+	vstore ( ox, qx ); vstore ( oy, qy ); vstore ( oz, qz );
+}
+
+template <class V>
+static inline void NormalizeOp ( float* x, float* y, float* z )
+{
+	V px, py, pz;
+	vload ( x, px ); vload ( y, py ); vload ( z, pz );
+	V d = vadd ( vadd ( vmul ( px, px ), vmul ( py, py ) ), vmul ( pz, pz ) );
+	V inv = vsel ( vgt ( d, vsplat<V>(0) ), vdiv ( vsplat<V>(1), vsqrt ( d ) ), vsplat<V>(1) );
+	vstore ( x, vmul ( px, inv ) ); vstore ( y, vmul ( py, inv ) ); vstore ( z, vmul ( pz, inv ) );
+}
+
+template <class V>
+static inline void DotOp ( const float* ax, const float* ay, const float* az, const float* bx, const float* by, const float* bz, float* out )
+{
+	V a, b, d;
+	vload ( ax, a ); vload ( bx, b ); d = vmul ( a, b );
+	vload ( ay, a ); vload ( by, b ); d = vadd ( d, vmul ( a, b ) );
+	vload ( az, a ); vload ( bz, b ); d = vadd ( d, vmul ( a, b ) );
+	vstore ( out, d );
+}
+
+template <class V>
+static inline void CrossOp ( const float* ax, const float* ay, const float* az, const float* bx, const float* by, const float* bz, float* ox, float* oy, float* oz )
+{
+	V px, py, pz, qx, qy, qz;
+	vload ( ax, px ); vload ( ay, py ); vload ( az, pz );
+	vload ( bx, qx ); vload ( by, qy ); vload ( bz, qz );
+	vstore ( ox, vsub ( vmul ( py, qz ), vmul ( pz, qy ) ) );
+	vstore ( oy, vsub ( vmul ( pz, qx ), vmul ( px, qz ) ) );
+	vstore ( oz, vsub ( vmul ( px, qy ), vmul ( py, qx ) ) );
+}
+
+template <class V>
+static inline void BoundOp ( const float* x, const float* y, const float* z, V* lo, V* hi )
+{
+	V p;
+	vload ( x, p ); lo[0] = vmin ( lo[0], p ); hi[0] = vmax ( hi[0], p );
+	vload ( y, p ); lo[1] = vmin ( lo[1], p ); hi[1] = vmax ( hi[1], p );
+	vload ( z, p ); lo[2] = vmin ( lo[2], p ); hi[2] = vmax ( hi[2], p );
+}
+
+static void AffineSoA ( const float* r, const float* x, const float* y, const float* z, float* ox, float* oy, float* oz, size_t num )
+{
+	size_t i = 0;
+#if VEC_WIDTH > 1
+	for ( ; i + VEC_WIDTH <= num; i += VEC_WIDTH )
+		AffineOp<vfloat> ( r, x+i, y+i, z+i, ox+i, oy+i, oz+i );
+#endif
+	for ( ; i < num; i++ )
+		AffineOp<float> ( r, x+i, y+i, z+i, ox+i, oy+i, oz+i );
+}
+
+// Grows lo/hi (float[3]) to include the points
+static void BoundSoA ( const float* x, const float* y, const float* z, size_t num, float* lo, float* hi )
+{
+	size_t i = 0;
+#if VEC_WIDTH > 1
+	if ( num >= VEC_WIDTH ) {
+		vfloat vlo[3], vhi[3];
+		for (int a = 0; a < 3; a++ ) { vlo[a] = vsplat<vfloat> ( lo[a] ); vhi[a] = vsplat<vfloat> ( hi[a] ); }
+		for ( ; i + VEC_WIDTH <= num; i += VEC_WIDTH )
+			BoundOp<vfloat> ( x+i, y+i, z+i, vlo, vhi );
+		float l[VEC_WIDTH], h[VEC_WIDTH];
+		for (int a = 0; a < 3; a++ ) {
+			vstore ( l, vlo[a] ); vstore ( h, vhi[a] );
+			for (int k = 0; k < VEC_WIDTH; k++ ) { lo[a] = vmin ( lo[a], l[k] ); hi[a] = vmax ( hi[a], h[k] ); }
+		}
+	}
+#endif
+	for ( ; i < num; i++ )
+		BoundOp<float> ( x+i, y+i, z+i, lo, hi );
+}
+
+#if VEC_WIDTH >= 4
+// Packed AoS: four Vector3DF are three registers; transpose to x/y/z lanes and back in place
+static inline void AffinePacked4 ( const float* r, const float* src, float* dst )
+{
+	__m128 a = _mm_loadu_ps ( src ), b = _mm_loadu_ps ( src+4 ), c = _mm_loadu_ps ( src+8 );	// x0y0z0x1 y1z1x2y2 z2x3y3z3
+	__m128 t0 = _mm_shuffle_ps ( b, c, _MM_SHUFFLE(2,1,3,2) );			// x2 y2 x3 y3
+	__m128 t1 = _mm_shuffle_ps ( a, b, _MM_SHUFFLE(1,0,2,1) );			// y0 z0 y1 z1
+	__m128 px = _mm_shuffle_ps ( a, t0, _MM_SHUFFLE(2,0,3,0) );
+	__m128 py = _mm_shuffle_ps ( t1, t0, _MM_SHUFFLE(3,1,2,0) );
+	__m128 pz = _mm_shuffle_ps ( t1, c, _MM_SHUFFLE(3,0,3,1) );
+	__m128 qx = _mm_add_ps ( _mm_add_ps ( _mm_add_ps ( _mm_mul_ps ( px, _mm_set1_ps(r[0]) ), _mm_mul_ps ( py, _mm_set1_ps(r[1]) ) ), _mm_mul_ps ( pz, _mm_set1_ps(r[2]) ) ), _mm_set1_ps(r[3]) );
+	__m128 qy = _mm_add_ps ( _mm_add_ps ( _mm_add_ps ( _mm_mul_ps ( px, _mm_set1_ps(r[4]) ), _mm_mul_ps ( py, _mm_set1_ps(r[5]) ) ), _mm_mul_ps ( pz, _mm_set1_ps(r[6]) ) ), _mm_set1_ps(r[7]) );
+	__m128 qz = _mm_add_ps ( _mm_add_ps ( _mm_add_ps ( _mm_mul_ps ( px, _mm_set1_ps(r[8]) ), _mm_mul_ps ( py, _mm_set1_ps(r[9]) ) ), _mm_mul_ps ( pz, _mm_set1_ps(r[10]) ) ), _mm_set1_ps(r[11]) );
+	__m128 xy01 = _mm_unpacklo_ps ( qx, qy ), xy23 = _mm_unpackhi_ps ( qx, qy );
+	__m128 yz01 = _mm_unpacklo_ps ( qy, qz ), yz23 = _mm_unpackhi_ps ( qy, qz );
+	__m128 zx01 = _mm_unpacklo_ps ( qz, qx ), zx23 = _mm_unpackhi_ps ( qz, qx );
+	_mm_storeu_ps ( dst,   _mm_shuffle_ps ( xy01, zx01, _MM_SHUFFLE(3,0,1,0) ) );
+	_mm_storeu_ps ( dst+4, _mm_shuffle_ps ( yz01, xy23, _MM_SHUFFLE(1,0,3,2) ) );
+	_mm_storeu_ps ( dst+8, _mm_shuffle_ps ( zx23, yz23, _MM_SHUFFLE(3,2,3,0) ) );
+}
+#endif
+
+static inline void GatherBlock ( const Vector3DF* src, size_t stride, size_t start, size_t num, float* x, float* y, float* z )
+{
+	const char* p = (const char*) src + start * stride;
+	for (size_t i = 0; i < num; i++, p += stride ) {
+		const float* v = (const float*) p;
+		x[i] = v[0]; y[i] = v[1]; z[i] = v[2];
+	}
+}
+
+static inline void ScatterBlock ( Vector3DF* dst, size_t stride, size_t start, size_t num, const float* x, const float* y, const float* z )
+{
+	char* p = (char*) dst + start * stride;
+	for (size_t i = 0; i < num; i++, p += stride ) {
+		float* v = (float*) p;
+		v[0] = x[i]; v[1] = y[i]; v[2] = z[i];
+	}
+}
+
+void nvdb::TransformPoints ( const Matrix4F& m, const Vector3DF* src, Vector3DF* dst, size_t num, size_t src_stride, size_t dst_stride )
+{
+	if ( src_stride == 0 ) src_stride = sizeof(Vector3DF);
+	if ( dst_stride == 0 ) dst_stride = sizeof(Vector3DF);
+	float r[12];
+	getAffineRows ( m, r );
+#if VEC_WIDTH >= 4
+	if ( src_stride == sizeof(Vector3DF) && dst_stride == sizeof(Vector3DF) ) {
+		size_t i = 0;
+		for ( ; i + 4 <= num; i += 4 )
+			AffinePacked4 ( r, &src[i].x, &dst[i].x );
+		for ( ; i < num; i++ )
+			AffineOp<float> ( r, &src[i].x, &src[i].y, &src[i].z, &dst[i].x, &dst[i].y, &dst[i].z );
+		return;
+	}
+#endif
+	float x[VEC_BLOCK], y[VEC_BLOCK], z[VEC_BLOCK];
+	for (size_t b = 0; b < num; b += VEC_BLOCK ) {
+		size_t n = std::min ( size_t(VEC_BLOCK), num - b );
+		GatherBlock ( src, src_stride, b, n, x, y, z );
+		AffineSoA ( r, x, y, z, x, y, z, n );
+		ScatterBlock ( dst, dst_stride, b, n, x, y, z );
+	}
+}
+
+void nvdb::TransformNormals ( const Matrix4F& m, const Vector3DF* src, Vector3DF* dst, size_t num, size_t src_stride, size_t dst_stride )
+{
+	if ( src_stride == 0 ) src_stride = sizeof(Vector3DF);
+	if ( dst_stride == 0 ) dst_stride = sizeof(Vector3DF);
+	float r[12];
+	getNormalRows ( m, r );
+	float x[VEC_BLOCK], y[VEC_BLOCK], z[VEC_BLOCK];
+	for (size_t b = 0; b < num; b += VEC_BLOCK ) {
+		size_t n = std::min ( size_t(VEC_BLOCK), num - b );
+		GatherBlock ( src, src_stride, b, n, x, y, z );
+		AffineSoA ( r, x, y, z, x, y, z, n );
+		NormalizeSoA ( x, y, z, n );
+		ScatterBlock ( dst, dst_stride, b, n, x, y, z );
+	}
+}
+
+void nvdb::BoundPoints ( const Vector3DF* src, size_t num, Vector3DF& bmin, Vector3DF& bmax, size_t src_stride, const Matrix4F* m )
+{
+	if ( num == 0 ) {
+		bmin.Set ( 0, 0, 0 );
+		bmax.Set ( 0, 0, 0 );
+		return;
+	}
+	if ( src_stride == 0 ) src_stride = sizeof(Vector3DF);
+	float r[12];
+	if ( m != 0x0 ) getAffineRows ( *m, r );
+	float lo[3] = { 1.0e38f, 1.0e38f, 1.0e38f }, hi[3] = { -1.0e38f, -1.0e38f, -1.0e38f };
+	float x[VEC_BLOCK], y[VEC_BLOCK], z[VEC_BLOCK];
+	for (size_t b = 0; b < num; b += VEC_BLOCK ) {
+		size_t n = std::min ( size_t(VEC_BLOCK), num - b );
+		GatherBlock ( src, src_stride, b, n, x, y, z );
+		if ( m != 0x0 ) AffineSoA ( r, x, y, z, x, y, z, n );
+		BoundSoA ( x, y, z, n, lo, hi );
+	}
+	bmin.Set ( lo[0], lo[1], lo[2] );
+	bmax.Set ( hi[0], hi[1], hi[2] );
+}
+
+void nvdb::TransformSoA ( const Matrix4F& m, const float* x, const float* y, const float* z, float* ox, float* oy, float* oz, size_t num )
+{
+	float r[12];
+	getAffineRows ( m, r );
+	AffineSoA ( r, x, y, z, ox, oy, oz, num );
+}
+
+void nvdb::DotSoA ( const float* ax, const float* ay, const float* az, const float* bx, const float* by, const float* bz, float* out, size_t num )
+{
+	size_t i = 0;
+#if VEC_WIDTH > 1
+	for ( ; i + VEC_WIDTH <= num; i += VEC_WIDTH )
+		DotOp<vfloat> ( ax+i, ay+i, az+i, bx+i, by+i, bz+i, out+i );
+#endif
+	for ( ; i < num; i++ )
+		DotOp<float> ( ax+i, ay+i, az+i, bx+i, by+i, bz+i, out+i );
+}
+
+void nvdb::CrossSoA ( const float* ax, const float* ay, const float* az, const float* bx, const float* by, const float* bz, float* ox, float* oy, float* oz, size_t num )
+{
+	size_t i = 0;
+#if VEC_WIDTH > 1
+	for ( ; i + VEC_WIDTH <= num; i += VEC_WIDTH )
+		CrossOp<vfloat> ( ax+i, ay+i, az+i, bx+i, by+i, bz+i, ox+i, oy+i, oz+i );
+#endif
+	for ( ; i < num; i++ )
+		CrossOp<float> ( ax+i, ay+i, az+i, bx+i, by+i, bz+i, ox+i, oy+i, oz+i );
+}
+
+void nvdb::NormalizeSoA ( float* x, float* y, float* z, size_t num )
+{
+	size_t i = 0;
+#if VEC_WIDTH > 1
+	for ( ; i + VEC_WIDTH <= num; i += VEC_WIDTH )
+		NormalizeOp<vfloat> ( x+i, y+i, z+i );
+#endif
+	for ( ; i < num; i++ )
+		NormalizeOp<float> ( x+i, y+i, z+i );
+}
@@ -574,7 +574,25 @@ namespace nvdb {
 	Vector3D<VTYPE>& Vector3D<VTYPE>::operator/= (const Vector4DF& op) {
 			return Set(x / static_cast<VTYPE>(op.x), y / static_cast<VTYPE>(op.y), z / static_cast<VTYPE>(op.z));
 	}
-	
+
+	// Batch kernels. These vectorize with AVX2 or SSE2, whichever the compiler targets.
+	// Array versions take byte strides between elements (0 = packed Vector3DF), so
+	// interleaved vertex buffers can be used in place; src and dst may be the same array.
+	// Points are transformed as by Vector3DF::operator*=(const Matrix4F&).
+	GVDB_API void TransformPoints(const Matrix4F& m, const Vector3DF* src, Vector3DF* dst, size_t num, size_t src_stride = 0, size_t dst_stride = 0);
+	// Transforms normals by the inverse transpose of m's upper 3x3 and renormalizes them.
+	GVDB_API void TransformNormals(const Matrix4F& m, const Vector3DF* src, Vector3DF* dst, size_t num, size_t src_stride = 0, size_t dst_stride = 0);
+	// Bounding box of the points, transformed by m first if not null. Zero for num = 0.
+	GVDB_API void BoundPoints(const Vector3DF* src, size_t num, Vector3DF& bmin, Vector3DF& bmax, size_t src_stride = 0, const Matrix4F* m = 0x0);
+
+	// Structure-of-arrays kernels. Outputs may be the same arrays as inputs.
+	GVDB_API void TransformSoA(const Matrix4F& m, const float* x, const float* y, const float* z, float* ox, float* oy, float* oz, size_t num);
+	GVDB_API void DotSoA(const float* ax, const float* ay, const float* az, const float* bx, const float* by, const float* bz, float* out, size_t num);
+	GVDB_API void CrossSoA(const float* ax, const float* ay, const float* az, const float* bx, const float* by, const float* bz, float* ox, float* oy, float* oz, size_t num);
+	// Zero-length vectors are left unchanged, as in Vector3DF::Normalize.
+	GVDB_API void NormalizeSoA(float* x, float* y, float* z, size_t num);
+
+	GVDB_API const char* getVecSIMDName();
 }
 
 #endif // #ifndef DEF_GVDB_VEC
\ No newline at end of file
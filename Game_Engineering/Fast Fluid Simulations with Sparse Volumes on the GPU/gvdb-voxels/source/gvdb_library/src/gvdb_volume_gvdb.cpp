@@ -12,6 +12,8 @@
 #include "gvdb_volume_gvdb.h"
 #include "gvdb_render.h"
 #include "gvdb_node.h"
+#include "gvdb_compress.h"
+#include "gvdb_vbx_pager.h"
 #include "app_perf.h"
 #include "string_helper.h"
 
@@ -21,6 +23,8 @@
 #include <iostream>
 #include <float.h>
 #include <fstream>
+#include <thread>
+#include <unordered_map>
 
 #if !defined(_WIN32)
 #	include <GL/glx.h>
@@ -38,8 +42,8 @@ using namespace nvdb;
 // GVDB 1.1.1  - Bug Fixes
 
 
-#define PUSH_CTX		cuCtxPushCurrent(mContext);
-#define POP_CTX			CUcontext pctx; cuCtxPopCurrent(&pctx);
+#define PUSH_CTX		if ( mContext != NULL ) cuCtxPushCurrent(mContext);
+#define POP_CTX			CUcontext pctx; if ( mContext != NULL ) cuCtxPopCurrent(&pctx);
 #define	MRES	2048
 
 #ifndef GVDB_CPU_VERSION
@@ -78,6 +82,7 @@ VolumeGVDB::VolumeGVDB ()
 
 	mRoot = ID_UNDEFL;
 	mbUseGLAtlas = false;
+	mbUseCPUCompute = false;
 
 	mVDBInfo.update = true;	
 	mVDBInfo.clr_chan = CHAN_UNDEF;
@@ -242,6 +247,11 @@ void VolumeGVDB::SetCudaDevice ( int devid, CUcontext ctx )
 	size_t len = 0;
 
 	mDevSelect = devid;	
+	if ( mbUseCPUCompute ) {
+		// CPU compute selected before the device: run host-only, without a context or kernels
+		verbosef ( "Using CPU compute. No CUDA device.\n" );
+		return;
+	}
 	StartCuda(devid, ctx, mDevice, mContext, &mStream, mbVerbose );
 
 	PUSH_CTX
@@ -504,7 +514,7 @@ void VolumeGVDB::ConvertBitmaskToNonBitmask( int levs )
 
 
 // Load a VBX file
-bool VolumeGVDB::LoadVBX(const std::string fname, int force_maj, int force_min)
+bool VolumeGVDB::LoadVBX(const std::string fname, int force_maj, int force_min, VBXPager* lazy)
 {
 	// See GVDB_FILESPEC.txt for the specification of the VBX file format.
 	PUSH_CTX
@@ -546,6 +556,7 @@ bool VolumeGVDB::LoadVBX(const std::string fname, int force_maj, int force_min)
 	int width0[MAXLEV]{}, width1[MAXLEV];
 
 	std::vector<uint64> grid_offs;
+	bool ok = true;
 
 	//--- VBX file header
 	fread (&major, sizeof(uchar), 1, fp);					// major version
@@ -591,7 +602,7 @@ bool VolumeGVDB::LoadVBX(const std::string fname, int force_maj, int force_min)
 		fread ( &grid_offs[n], sizeof(uint64), 1, fp );		// grid offsets
 	}
 
-	for (int n = 0; n < num_grids; n++) {
+	for (int n = 0; n < num_grids && ok; n++) {
 
 		//---- grid header
 		fread(&grid_name, 256, 1, fp);					// grid name
@@ -652,17 +663,37 @@ bool VolumeGVDB::LoadVBX(const std::string fname, int force_maj, int force_min)
 
 		// Atlas section
 		DestroyChannels ();
+		if ( lazy != 0x0 ) lazy->SetLayout ( axiscnt, axisres, leafdim.x, apron );
 		
 		// Read atlas into GPU slice-by-slice to conserve CPU and GPU mem
-		for (int chan = 0 ; chan < num_chan; chan++ ) {
+		for (int chan = 0 ; chan < num_chan && ok; chan++ ) {
 			int chan_type, chan_stride;
 			fread ( &chan_type, sizeof(int), 1, fp );
 			fread ( &chan_stride, sizeof(int), 1, fp );
 
+			if ( lazy != 0x0 ) {
+				ok = lazy->AddChannel ( fp, chan_type, chan_stride, grid_compress );	// bricks stay in the file
+				continue;
+			}
+
 			AddChannel ( chan, chan_type, apron, F_LINEAR, F_BORDER, axiscnt );		// provide axiscnt
 
 			mPool->AtlasSetNum ( chan, cnt0[0] );		// assumes atlas contains all bricks (all are resident)
 
+			if ( grid_compress == 2 ) {
+				ok = ReadAtlasBricks ( fp, chan );		// per-brick LZ
+				continue;
+			}
+			if ( grid_compress != 0 ) {
+				gprintf ( "ERROR: VBX grid compression %d not supported.\n", (int) grid_compress );
+				ok = false;
+				continue;
+			}
+			if ( mbUseCPUCompute ) {
+				DataPtr atlas = mPool->getAtlas ( chan );		// CPU atlas is authoritative
+				fread ( atlas.cpu, uint64(axisres.x)*axisres.y*axisres.z*chan_stride, 1, fp );
+				continue;
+			}
 			DataPtr slice;
 			mPool->CreateMemLinear ( slice, 0x0, chan_stride, axisres.x*axisres.y, true );
 			for (int z = 0; z < axisres.z; z++ ) {
@@ -672,14 +703,15 @@ bool VolumeGVDB::LoadVBX(const std::string fname, int force_maj, int force_min)
 			}
 			mPool->FreeMemLinear ( slice );
 		}
-		UpdateAtlas ();
+		if ( lazy == 0x0 ) UpdateAtlas ();
 	}
+	fclose ( fp );
 
 	PERF_POP ();
 
 	POP_CTX
 
-	return true;
+	return ok;
 }
 
 // Set the current color channel for rendering
@@ -693,6 +725,26 @@ void VolumeGVDB::AtlasRetrieveBrickXYZ(uchar channel, Vector3DI minimumCorner, D
 	mPool->AtlasRetrieveTexXYZ(channel, minimumCorner, dest);
 }
 
+const uchar* VolumeGVDB::AtlasRetrieveCPU ( uchar chan, std::vector<uchar>& buf, Vector3DI& res, int& stride )
+{
+	if ( mPool == 0x0 || chan >= mPool->getNumAtlas() ) return 0x0;
+	DataPtr atlas = mPool->getAtlas ( chan );
+	res = mPool->getAtlasRes ( chan );
+	stride = mPool->getSize ( atlas.type );
+	if ( mbUseCPUCompute ) return (const uchar*) atlas.cpu;
+
+	PUSH_CTX
+	const uint64 slice_sz = uint64(res.x) * res.y * stride;
+	buf.resize ( slice_sz * res.z );
+	DataPtr slice;
+	mPool->CreateMemLinear ( slice, 0x0, stride, res.x*res.y, true );
+	for (int z = 0; z < res.z; z++ )
+		mPool->AtlasRetrieveSlice ( chan, z, static_cast<int>(slice.size), slice.gpu, &buf[z * slice_sz] );
+	mPool->FreeMemLinear ( slice );
+	POP_CTX
+	return buf.data();
+}
+
 // Clear device access to atlases
 void VolumeGVDB::ClearAtlasAccess ()
 {
@@ -721,6 +773,7 @@ void VolumeGVDB::SetupAtlasAccess ()
 {	
 	if ( mPool == 0x0 ) return;
 	if ( mPool->getNumAtlas() == 0 ) return;
+	if ( mPool->isCPUOnly() ) return;			// no device textures
 	
 	PUSH_CTX
 
@@ -1217,13 +1270,229 @@ void VolumeGVDB::RebuildTopology(int pNumPnts, float pRadius, Vector3DF pOrig )
 	}
 }
 
+//---------------------------------------------------------------- CPU topology builder
+// Brick keys pack x,y,z brick coordinates into 21 bits each, biased so that
+// negative coordinates sort in order. Sorted keys are x-major.
+#define TOPO_KEY_BITS		21
+#define TOPO_KEY_BIAS		(1 << (TOPO_KEY_BITS-1))
+#define TOPO_KEY_MASK		((uint64(1) << TOPO_KEY_BITS) - 1)
+
+static inline bool TopoKeyFits ( const Vector3DI& b )
+{
+	return b.x >= -TOPO_KEY_BIAS && b.y >= -TOPO_KEY_BIAS && b.z >= -TOPO_KEY_BIAS &&
+		   b.x < TOPO_KEY_BIAS && b.y < TOPO_KEY_BIAS && b.z < TOPO_KEY_BIAS;
+}
+static inline uint64 TopoKey ( const Vector3DI& b )
+{
+	return (uint64(b.x + TOPO_KEY_BIAS) << (2*TOPO_KEY_BITS)) | (uint64(b.y + TOPO_KEY_BIAS) << TOPO_KEY_BITS) | uint64(b.z + TOPO_KEY_BIAS);
+}
+static inline Vector3DI TopoKeyPos ( uint64 key )
+{
+	return Vector3DI ( int((key >> (2*TOPO_KEY_BITS)) & TOPO_KEY_MASK) - TOPO_KEY_BIAS,
+					   int((key >> TOPO_KEY_BITS) & TOPO_KEY_MASK) - TOPO_KEY_BIAS,
+					   int(key & TOPO_KEY_MASK) - TOPO_KEY_BIAS );
+}
+static inline int FloorDiv ( int a, int b )
+{
+	int q = a / b;
+	return ( a % b != 0 && a < 0 ) ? q-1 : q;
+}
+
+// Run func(thread, start, end) over contiguous chunks of [0,num)
+template <class Func>
+static void ParallelChunks ( int num, int threads, Func func )
+{
+	if ( threads > num ) threads = num;
+	if ( threads <= 1 ) {
+		if ( num > 0 ) func ( 0, 0, num );
+		return;
+	}
+	std::vector<std::thread> pool;
+	for (int t=1; t < threads; t++ )
+		pool.push_back ( std::thread ( func, t, int( uint64(num)*t/threads ), int( uint64(num)*(t+1)/threads ) ) );
+	func ( 0, 0, int( num / threads ) );
+	for (size_t t=0; t < pool.size(); t++ )
+		pool[t].join ();
+}
+
+static inline int NumThreadsCPU ()
+{
+	return std::max ( 1, (int) std::thread::hardware_concurrency() );
+}
+
+// Parallel LSD radix sort of brick keys followed by dedup, the CPU counterpart of
+// RadixSortByByte + FindUniqueBrick. Bytes that are equal across all keys are skipped.
+static void SortUniqueKeys ( std::vector<uint64>& keys, int threads )
+{
+	int num = (int) keys.size();
+	if ( num > 1 ) {
+		if ( num < 65536 ) threads = 1;
+		std::vector<uint64> tmp ( num );
+		std::vector<int> hist ( threads * 256 );
+		uint64* src = keys.data();
+		uint64* dst = tmp.data();
+		for (int shift=0; shift < 3*TOPO_KEY_BITS; shift += 8 ) {
+			std::fill ( hist.begin(), hist.end(), 0 );
+			ParallelChunks ( num, threads, [&] ( int t, int start, int end ) {
+				int* h = &hist[t*256];
+				for (int n=start; n < end; n++ ) h[ (src[n] >> shift) & 0xFF ]++;
+			} );
+			int total = 0, used = 0;
+			for (int d=0; d < 256; d++ ) {
+				int dsum = 0;
+				for (int t=0; t < threads; t++ ) dsum += hist[t*256+d];
+				if ( dsum > 0 ) used++;
+			}
+			if ( used <= 1 ) continue;				// every key shares this byte
+			for (int d=0; d < 256; d++ ) {
+				for (int t=0; t < threads; t++ ) {
+					int c = hist[t*256+d];
+					hist[t*256+d] = total;
+					total += c;
+				}
+			}
+			ParallelChunks ( num, threads, [&] ( int t, int start, int end ) {
+				int* h = &hist[t*256];
+				for (int n=start; n < end; n++ ) dst[ h[ (src[n] >> shift) & 0xFF ]++ ] = src[n];
+			} );
+			std::swap ( src, dst );
+		}
+		if ( src != keys.data() ) memcpy ( keys.data(), src, num * sizeof(uint64) );
+	}
+	keys.erase ( std::unique ( keys.begin(), keys.end() ), keys.end() );
+}
+
+// Activate the leaf bricks covering a set of points.
+// Points are quantized to leaf bricks in parallel and the brick keys are sorted and
+// deduplicated, so the tree sees each brick once rather than each point. An empty tree
+// is then built level by level: parent keys are derived and deduplicated per level,
+// nodes are allocated and set up by threads sharing the pools concurrently, and children
+// are linked directly to their parents. On a non-empty tree the unique bricks go through
+// ActivateSpace.
 void VolumeGVDB::RebuildTopologyCPU(int pNumPnts, Vector3DF pOrig, Vector3DF* pPos)
 {
-	Vector3DF p;
-	for (int n=0; n < pNumPnts; n++) {		
-		p = (*pPos++) + pOrig;					
-		ActivateSpace ( p );					
-	}	
+	PERF_PUSH ( "Topology (CPU)" );
+
+	int threads = ( pNumPnts < 65536 ) ? 1 : NumThreadsCPU();
+	Vector3DI range0 = getRange(0);
+
+	// Quantize points to leaf bricks, dropping repeats of the previous brick
+	std::vector< std::vector<uint64> > part ( threads );
+	std::vector< std::vector<int> > outside ( threads );		// bricks beyond the key range
+	ParallelChunks ( pNumPnts, threads, [&] ( int t, int start, int end ) {
+		std::vector<uint64>& out = part[t];
+		uint64 prev = ID_UNDEF64;
+		for (int n=start; n < end; n++ ) {
+			Vector3DI p = pPos[n] + pOrig;				// truncates, as ActivateSpace(Vector3DF) does
+			Vector3DI b ( FloorDiv(p.x, range0.x), FloorDiv(p.y, range0.y), FloorDiv(p.z, range0.z) );
+			if ( !TopoKeyFits ( b ) ) { outside[t].push_back ( n ); continue; }
+			uint64 key = TopoKey ( b );
+			if ( key != prev ) out.push_back ( key );
+			prev = key;
+		}
+	} );
+	std::vector<uint64> keys;
+	for (int t=0; t < threads; t++ ) {
+		keys.insert ( keys.end(), part[t].begin(), part[t].end() );
+		std::vector<uint64>().swap ( part[t] );
+	}
+	SortUniqueKeys ( keys, threads );
+
+	if ( mRoot != ID_UNDEFL || keys.empty() || !BuildTopologyCPU ( keys, threads ) ) {
+		bool bnew;
+		for (size_t n=0; n < keys.size(); n++ ) {
+			bnew = false;
+			ActivateSpace ( mRoot, TopoKeyPos(keys[n]) * range0, bnew );
+		}
+	}
+	for (int t=0; t < threads; t++ )
+		for (size_t n=0; n < outside[t].size(); n++ )
+			ActivateSpace ( pPos[ outside[t][n] ] + pOrig );
+
+	PERF_POP ();
+}
+
+// Build an empty tree from sorted, unique leaf brick keys.
+// Returns false, leaving the tree untouched, if no single root can cover the bricks.
+bool VolumeGVDB::BuildTopologyCPU ( std::vector<uint64>& leafkeys, int threads )
+{
+	// Root level: lowest level whose covering node holds every brick
+	Vector3DI range0 = getRange(0);
+	Vector3DI bmin = TopoKeyPos ( leafkeys.front() ), bmax = bmin, b;
+	for (size_t n=1; n < leafkeys.size(); n++ ) {
+		b = TopoKeyPos ( leafkeys[n] );
+		bmin.x = std::min(bmin.x, b.x);	bmin.y = std::min(bmin.y, b.y);	bmin.z = std::min(bmin.z, b.z);
+		bmax.x = std::max(bmax.x, b.x);	bmax.y = std::max(bmax.y, b.y);	bmax.z = std::max(bmax.z, b.z);
+	}
+	bmin *= range0;
+	bmax *= range0;
+	int rootlev = 0;
+	Vector3DI r, c0, c1;
+	for (; rootlev < GetLevels(); rootlev++ ) {
+		c0 = GetCoveringNode ( rootlev, bmin, r );
+		c1 = GetCoveringNode ( rootlev, bmax, r );
+		if ( c0.x == c1.x && c0.y == c1.y && c0.z == c1.z ) break;
+	}
+	if ( rootlev >= GetLevels() ) return false;
+
+	// Unique node keys for every level, in units of that level's range
+	std::vector< std::vector<uint64> > levkeys ( rootlev+1 );
+	levkeys[0].swap ( leafkeys );
+	for (int lev=1; lev <= rootlev; lev++ ) {
+		int res = getRes(lev);
+		std::vector<uint64>& child = levkeys[lev-1];
+		std::vector<uint64>& keys = levkeys[lev];
+		uint64 prev = ID_UNDEF64;
+		for (size_t n=0; n < child.size(); n++ ) {
+			b = TopoKeyPos ( child[n] );
+			uint64 key = TopoKey ( Vector3DI( FloorDiv(b.x, res), FloorDiv(b.y, res), FloorDiv(b.z, res) ) );
+			if ( key != prev ) keys.push_back ( key );
+			prev = key;
+		}
+		SortUniqueKeys ( keys, threads );
+	}
+
+	// Allocate and set up each level. Threads take their own runs of nodes from the
+	// pools concurrently, so nodes are found through ids rather than by offset.
+	std::vector< std::vector<slong> > ids ( rootlev+1 );
+	if ( threads > 1 ) mPool->PoolBeginConcurrent ();
+	for (int lev=0; lev <= rootlev; lev++ ) {
+		std::vector<uint64>& keys = levkeys[lev];
+		ids[lev].resize ( keys.size() );
+		Vector3DI range = getRange(lev);
+		ParallelChunks ( (int) keys.size(), threads, [&] ( int t, int start, int end ) {
+			uint64 cnt = end - start;
+			uint64 first = ElemNdx ( mPool->PoolAllocMulti ( 0, lev, cnt, true ) );
+			uint64 clist = (lev > 0) ? ElemNdx ( mPool->PoolAllocMulti ( 1, lev, cnt, true ) ) : 0;
+			for (uint64 n=0; n < cnt; n++ ) {
+				slong id = Elem ( 0, lev, first + n );
+				ids[lev][start + n] = id;
+				SetupNode ( id, lev, TopoKeyPos(keys[start + n]) * range );
+				if ( lev > 0 ) {
+					Node* node = getNode ( id );
+					node->mChildList = Elem ( 1, lev, clist + n );
+					memset ( mPool->PoolData64 ( node->mChildList ), 0xFF, mPool->getPoolWidth(1, lev) );
+				}
+			}
+		} );
+	}
+	if ( threads > 1 ) mPool->PoolEndConcurrent ();
+
+	// Link children to parents; keys are sorted, so parents are found by binary search
+	for (int lev=0; lev < rootlev; lev++ ) {
+		std::vector<uint64>& keys = levkeys[lev];
+		std::vector<uint64>& pkeys = levkeys[lev+1];
+		int res = getRes(lev+1);
+		for (size_t n=0; n < keys.size(); n++ ) {
+			b = TopoKeyPos ( keys[n] );
+			Vector3DI pb ( FloorDiv(b.x, res), FloorDiv(b.y, res), FloorDiv(b.z, res) );
+			uint64 pndx = std::lower_bound ( pkeys.begin(), pkeys.end(), TopoKey(pb) ) - pkeys.begin();
+			b -= pb * res;
+			InsertChild ( ids[lev+1][pndx], ids[lev][n], getBitPos(lev+1, b) );
+		}
+	}
+	mRoot = ids[rootlev][0];
+	return true;
 }
 
 void VolumeGVDB::ActivateBricksGPU(int pNumPnts, float pRadius, Vector3DF pOrig, int pRootLev, Vector3DI pRootPos)
@@ -1363,9 +1632,9 @@ void VolumeGVDB::ActivateBricksGPU(int pNumPnts, float pRadius, Vector3DF pOrig,
 			nd->mParent = parentNodeID;	// set parent of child
 #ifdef USE_BITMASKS
 			// determine child bit position	
-			uint64 p = parentNd->countOn ( bitMaskPos );
-			uint64 cnum = parentNd->getNumChild();		// existing children count
-			parentNd->setOn ( bitMaskPos );
+			uint64 p = countOn ( parentNd, bitMaskPos );
+			uint64 cnum = getNumChild ( parentNd );		// existing children count
+			setChildOn ( parentNd, bitMaskPos );
 
 			// insert into child list in parent node
 			uint64* clist = mPool->PoolData64 ( parentNd->mChildList );
@@ -1546,9 +1815,9 @@ void VolumeGVDB::FindActivBricks(int pLev,  int pRootlev,  int pNumPnts, Vector3
 
 		// determine child bit position	
 #ifdef USE_BITMASKS
-		uint64 p = parentNd->countOn ( bitMaskPos );
-		uint64 cnum = parentNd->getNumChild();		// existing children count
-		parentNd->setOn ( bitMaskPos );
+		uint64 p = countOn ( parentNd, bitMaskPos );
+		uint64 cnum = getNumChild ( parentNd );		// existing children count
+		setChildOn ( parentNd, bitMaskPos );
 
 		// insert into child list in parent node
 		uint64* clist = mPool->PoolData64 ( parentNd->mChildList );
@@ -1583,6 +1852,15 @@ void VolumeGVDB::FinishTopology (bool pCommitPool, bool pComputeBounds)
 	// compute bounds
 	if (pComputeBounds) ComputeBounds ();
 
+	#ifdef USE_BITMASKS
+		// rebuild mask prefix tables
+		for (int lev = 1; lev < GetLevels(); lev++ ) {
+			uint64 cnt = mPool->getPoolTotalCnt ( 0, lev );
+			for (uint64 n = 0; n < cnt; n++ )
+				UpdateMaskPrefix ( getNode ( 0, lev, n ) );
+		}
+	#endif
+
 	// commit topology
 	if (pCommitPool)	mPool->PoolCommitAll();
 
@@ -1598,7 +1876,12 @@ void VolumeGVDB::ClearChannel (uchar chan)
 	// This launches a kernel to clear the CUarray.
 	//   (there is no MemsetD8 for cuda arrays)
 	PUSH_CTX
-	mPool->AtlasFill(chan);	
+	if ( mbUseCPUCompute ) {
+		DataPtr atlas = mPool->getAtlas(chan);
+		if ( atlas.cpu != 0x0 ) memset ( atlas.cpu, 0, atlas.size );
+	} else {
+		mPool->AtlasFill(chan);	
+	}
 	POP_CTX
 }
 
@@ -1622,8 +1905,149 @@ void VolumeGVDB::ClearAllChannels ()
 	POP_CTX
 }
 
+// Compressed atlas section (grid_compress = 2). Bricks are stored whole, apron included,
+// so a load restores the atlas exactly. Work proceeds one layer of bricks (brickres atlas
+// slices) at a time, which bounds memory and lets the GPU path stream slices.
+// Brick codecs are in gvdb_compress.h.
+
+void VolumeGVDB::WriteAtlasBricks ( FILE* fp, uchar chan )
+{
+	DataPtr atlas = mPool->getAtlas ( chan );
+	const int stride = mPool->getSize ( atlas.type );
+	const int br = mPool->getAtlasBrickres ( chan );
+	const Vector3DI ac = atlas.subdim;
+	const Vector3DI res = mPool->getAtlasRes ( chan );
+	const int layer_cnt = ac.x * ac.y;
+	const int num = layer_cnt * ac.z;
+	const int brick_vox = br*br*br;
+	const uint64 slice_sz = uint64(res.x) * res.y * stride;
+
+	// brick table, filled in after the payload is written
+	std::vector<uint> sizes ( num, 0 );
+	std::vector<uchar> codec ( num, BRICK_RAW );
+	fwrite ( &num, sizeof(int), 1, fp );
+	const slong table = gftell ( fp );
+	fwrite ( sizes.data(), sizeof(uint), num, fp );
+	fwrite ( codec.data(), sizeof(uchar), num, fp );
+
+	DataPtr slice;
+	std::vector<uchar> layer;
+	if ( !mbUseCPUCompute ) {
+		mPool->CreateMemLinear ( slice, 0x0, stride, res.x*res.y, true );
+		layer.resize ( slice_sz * br );
+	}
+	std::vector< std::vector<uchar> > packed ( layer_cnt );
+
+	for (int lz = 0; lz < ac.z; lz++ ) {
+		const uchar* src;
+		if ( mbUseCPUCompute ) {
+			src = (uchar*) atlas.cpu + lz * br * slice_sz;
+		} else {
+			for (int z = 0; z < br; z++ )
+				mPool->AtlasRetrieveSlice ( chan, lz*br + z, static_cast<int>(slice.size), slice.gpu, &layer[z * slice_sz] );
+			src = layer.data();
+		}
+		ParallelChunks ( layer_cnt, NumThreadsCPU(), [&] ( int t, int start, int end ) {
+			std::vector<uchar> brick ( brick_vox * stride ), shuf ( brick_vox * stride );
+			for (int b = start; b < end; b++ ) {
+				const int id = lz * layer_cnt + b;
+				const uchar* corner = src + ( uint64(b / ac.x) * br * res.x + uint64(b % ac.x) * br ) * stride;
+				for (int z = 0; z < br; z++ )
+					for (int y = 0; y < br; y++ )
+						memcpy ( &brick[ ((z*br + y)*br) * stride ], corner + ( uint64(z)*res.y*res.x + uint64(y)*res.x ) * stride, br * stride );
+				codec[id] = EncodeBrick ( brick.data(), brick_vox, stride, packed[b], shuf.data() );
+			}
+		} );
+		for (int b = 0; b < layer_cnt; b++ ) {
+			sizes[ lz * layer_cnt + b ] = (uint) packed[b].size();
+			fwrite ( packed[b].data(), 1, packed[b].size(), fp );
+		}
+	}
+	if ( !mbUseCPUCompute ) mPool->FreeMemLinear ( slice );
+
+	const slong end = gftell ( fp );
+	gfseek ( fp, table );
+	fwrite ( sizes.data(), sizeof(uint), num, fp );
+	fwrite ( codec.data(), sizeof(uchar), num, fp );
+	gfseek ( fp, end );
+}
+
+bool VolumeGVDB::ReadAtlasBricks ( FILE* fp, uchar chan )
+{
+	DataPtr atlas = mPool->getAtlas ( chan );
+	const int stride = mPool->getSize ( atlas.type );
+	const int br = mPool->getAtlasBrickres ( chan );
+	const Vector3DI ac = atlas.subdim;
+	const Vector3DI res = mPool->getAtlasRes ( chan );
+	const int layer_cnt = ac.x * ac.y;
+	const int brick_vox = br*br*br;
+	const uint64 slice_sz = uint64(res.x) * res.y * stride;
+
+	int num = 0;
+	fread ( &num, sizeof(int), 1, fp );
+	if ( num != layer_cnt * ac.z ) {
+		gprintf ( "ERROR: VBX compressed atlas has %d bricks, expected %d.\n", num, layer_cnt * ac.z );
+		return false;
+	}
+	std::vector<uint> sizes ( num );
+	std::vector<uchar> codec ( num );
+	fread ( sizes.data(), sizeof(uint), num, fp );
+	fread ( codec.data(), sizeof(uchar), num, fp );
+
+	DataPtr slice;
+	std::vector<uchar> layer;
+	if ( !mbUseCPUCompute ) {
+		mPool->CreateMemLinear ( slice, 0x0, stride, res.x*res.y, true );
+		layer.resize ( slice_sz * br );
+	}
+	std::vector<uchar> in;
+	std::vector<uint64> offs ( layer_cnt + 1 );
+	std::vector<int> bad ( NumThreadsCPU(), 0 );			// corrupt bricks seen per thread
+	bool ok = true;
+
+	for (int lz = 0; lz < ac.z && ok; lz++ ) {
+		offs[0] = 0;
+		for (int b = 0; b < layer_cnt; b++ )
+			offs[b+1] = offs[b] + sizes[ lz * layer_cnt + b ];
+		in.resize ( offs[layer_cnt] );
+		if ( offs[layer_cnt] > 0 && fread ( in.data(), 1, in.size(), fp ) != in.size() ) {
+			gprintf ( "ERROR: VBX compressed atlas is truncated.\n" );
+			ok = false;
+			break;
+		}
+		uchar* dst = mbUseCPUCompute ? (uchar*) atlas.cpu + lz * br * slice_sz : layer.data();
+
+		ParallelChunks ( layer_cnt, NumThreadsCPU(), [&] ( int t, int start, int end ) {
+			std::vector<uchar> brick ( brick_vox * stride ), shuf ( brick_vox * stride );
+			for (int b = start; b < end; b++ ) {
+				const int id = lz * layer_cnt + b;
+				if ( !DecodeBrick ( codec[id], in.data() + offs[b], sizes[id], brick_vox, stride, brick.data(), shuf.data() ) ) {
+					bad[t]++;
+					continue;
+				}
+				uchar* corner = dst + ( uint64(b / ac.x) * br * res.x + uint64(b % ac.x) * br ) * stride;
+				for (int z = 0; z < br; z++ )
+					for (int y = 0; y < br; y++ )
+						memcpy ( corner + ( uint64(z)*res.y*res.x + uint64(y)*res.x ) * stride, &brick[ ((z*br + y)*br) * stride ], br * stride );
+			}
+		} );
+		for (size_t t = 0; t < bad.size(); t++ )
+			if ( bad[t] ) ok = false;
+		if ( !ok ) {
+			gprintf ( "ERROR: VBX compressed atlas is corrupt (brick layer %d).\n", lz );
+			break;
+		}
+		if ( !mbUseCPUCompute ) {
+			for (int z = 0; z < br; z++ )
+				mPool->AtlasWriteSlice ( chan, lz*br + z, static_cast<int>(slice.size), slice.gpu, &layer[z * slice_sz] );
+		}
+	}
+	if ( !mbUseCPUCompute ) mPool->FreeMemLinear ( slice );		// CPU atlas is committed on UseCPUCompute(false)
+	return ok;
+}
+
 // Save a VBX file
-void VolumeGVDB::SaveVBX ( const std::string fname )
+void VolumeGVDB::SaveVBX ( const std::string fname, bool compress )
 {
 	// See GVDB_FILESPEC.txt for the specification of the VBX file format.
 	PUSH_CTX
@@ -1644,7 +2068,7 @@ void VolumeGVDB::SaveVBX ( const std::string fname )
 	char		grid_name[grid_name_len];
 	const char	grid_components = 1;						// one component
 	const char	grid_dtype = 'f';							// float
-	const char	grid_compress = 0;							// no compression
+	const char	grid_compress = compress ? 2 : 0;			// none, or per-brick LZ
 	const char	grid_topotype = 2;							// gvdb topology
 	const int	grid_reuse = 0;
 	const char	grid_layout = 0;							// atlas layout
@@ -1685,11 +2109,11 @@ void VolumeGVDB::SaveVBX ( const std::string fname )
 	}
 
 	//--- grid offset table
-	const long grid_table = ftell ( fp );					// position of grid table in file
+	const slong grid_table = gftell ( fp );					// position of grid table in file
 	fwrite(grid_offs.data(), sizeof(uint64), grid_offs.size(), fp); // grid offsets (populated later)
 
 	for (int n=0; n < num_grids; n++ ) {
-		grid_offs[n] = ftell ( fp );						// record grid offset
+		grid_offs[n] = gftell ( fp );						// record grid offset
 
 		//---- grid header
 		fwrite ( &grid_name, 256, 1, fp );					// grid name
@@ -1745,6 +2169,14 @@ void VolumeGVDB::SaveVBX ( const std::string fname )
 
 			fwrite ( &chan_type, sizeof(int), 1, fp );
 			fwrite ( &chan_stride, sizeof(int), 1, fp );
+			if ( grid_compress == 2 ) {
+				WriteAtlasBricks ( fp, chan );
+				continue;
+			}
+			if ( mbUseCPUCompute ) {
+				fwrite ( mPool->getAtlas(chan).cpu, uint64(axisres.x)*axisres.y*axisres.z*chan_stride, 1, fp );
+				continue;
+			}
 			mPool->CreateMemLinear ( slice, 0x0, chan_stride, axisres.x*axisres.y, true );
 
 			for (int z = 0; z < axisres.z; z++ ) {
@@ -1756,7 +2188,7 @@ void VolumeGVDB::SaveVBX ( const std::string fname )
 		}
 	}
 	// update grid offsets table
-	fseek(fp, grid_table, SEEK_SET);
+	gfseek ( fp, grid_table );
 	fwrite(grid_offs.data(), sizeof(uint64), grid_offs.size(), fp); // grid offsets
 
 	fclose ( fp );
@@ -1883,7 +2315,7 @@ bool VolumeGVDB::LoadBRK ( std::string fname )
 	
 	int side = int(ceil(pow(brkcnt, 1 / 3.0f)));		// number of leaves along one axis	
 	Vector3DI axiscnt (side, side, side);
-	mPool->AtlasCreate ( 0, T_FLOAT, bres, axiscnt, mApron, sizeof(AtlasNode), false, mbUseGLAtlas );
+	mPool->AtlasCreate ( 0, T_FLOAT, bres, axiscnt, mApron, sizeof(AtlasNode), mbUseCPUCompute, mbUseGLAtlas );
 	PERF_POP ();
 	
 	float vmin = FLT_MAX, vmax = -FLT_MAX;
@@ -1957,6 +2389,181 @@ bool VolumeGVDB::LoadBRK ( std::string fname )
 }
 
 
+// Convert a row of raw samples to v*scale + bias, returns the row maximum
+template <class T>
+static inline float RawRowToFloat ( const uchar* src, int n, float scale, float bias, float* dst )
+{
+	const T* s = (const T*) src;
+	float vmax = -FLT_MAX;
+	for (int i=0; i < n; i++ ) {
+		dst[i] = float(s[i]) * scale + bias;
+		vmax = std::max ( vmax, dst[i] );
+	}
+	return vmax;
+}
+
+// Stream a headerless RAW volume into a T_FLOAT channel, one brick-high z-slab at a time.
+// A reader thread fills one slab buffer while the other is processed, so no more than
+// two slabs are ever in memory. Bricks of a slab are scanned in parallel, those with a
+// value above thresh are activated, and their data goes straight to the atlas slot that
+// UpdateAtlas will give them (the leaf pool index), growing the atlas as needed.
+bool VolumeGVDB::LoadRAW ( const std::string fname, Vector3DI res, int bpp, uchar chan, float thresh, Vector3DF inr, Vector3DF outr )
+{
+	if ( bpp != 1 && bpp != 2 && bpp != 4 ) {
+		gprintf ( "ERROR: LoadRAW. %d bytes per voxel not supported.\n", bpp );
+		return false;
+	}
+	if ( chan >= mPool->getNumAtlas() || mPool->getAtlas(chan).type != T_FLOAT ) {
+		gprintf ( "ERROR: LoadRAW. Channel %d must be T_FLOAT. Call AddChannel first.\n", (int) chan );
+		return false;
+	}
+	if ( res.x <= 0 || res.y <= 0 || res.z <= 0 || inr.y == inr.x ) {
+		gprintf ( "ERROR: LoadRAW. Invalid resolution or input range.\n" );
+		return false;
+	}
+	FILE* fp = fopen ( fname.c_str(), "rb" );
+	if ( fp == 0x0 ) {
+		gprintf ( "ERROR: LoadRAW. Cannot open %s.\n", fname.c_str() );
+		return false;
+	}
+
+	PUSH_CTX
+	PERF_PUSH ( "LoadRAW" );
+
+	Clear ();
+
+	const int W = mPool->getAtlasBrickwid ( chan );
+	const int bx = (res.x + W-1) / W, by = (res.y + W-1) / W, bz = (res.z + W-1) / W;
+	const uint64 row = uint64(res.x) * bpp;
+	const uint64 brick_vox = uint64(W) * W * W;
+	const float scale = (outr.y - outr.x) / (inr.y - inr.x);
+	const float bias = outr.x - inr.x * scale;
+	const int threads = NumThreadsCPU ();
+
+	// Convert brick (x,y) of a slab into dst, zero outside the volume. Returns the maximum.
+	auto brickRows = [&] ( const uchar* slab, int layers, int x, int y, float* dst, uint64 ystride, uint64 zstride ) {
+		int x0 = x*W, n = std::min ( W, res.x - x0 );
+		float vmax = -FLT_MAX;
+		for (int lz=0; lz < W; lz++ )
+			for (int ly=0; ly < W; ly++ ) {
+				float* d = dst + lz*zstride + ly*ystride;
+				int gy = y*W + ly;
+				if ( lz >= layers || gy >= res.y ) { std::fill ( d, d + W, 0.0f ); continue; }
+				const uchar* s = slab + ( uint64(lz) * res.y + gy ) * row + uint64(x0) * bpp;
+				switch ( bpp ) {
+				case 1:	vmax = std::max ( vmax, RawRowToFloat<uchar> ( s, n, scale, bias, d ) );	break;
+				case 2:	vmax = std::max ( vmax, RawRowToFloat<ushort> ( s, n, scale, bias, d ) );	break;
+				case 4:	vmax = std::max ( vmax, RawRowToFloat<float> ( s, n, scale, bias, d ) );	break;
+				}
+				std::fill ( d + n, d + W, 0.0f );
+			}
+		return vmax;
+	};
+
+	// Double-buffered slab reads
+	std::vector<uchar> buf[2];
+	size_t got[2] = { 0, 0 };
+	buf[0].resize ( row * res.y * W );
+	buf[1].resize ( row * res.y * W );
+	auto readSlab = [&] ( int k ) {
+		got[k & 1] = fread ( buf[k & 1].data(), 1, row * res.y * std::min(W, res.z - k*W), fp );
+	};
+
+	DataPtr stage;											// device staging for new bricks
+	uint64 stage_max = 0;
+	std::vector<uchar> hit ( bx * by );
+	std::vector<int> act;
+	std::vector<uint64> slot;
+	uint64 active = 0;
+	bool ok = true;
+
+	std::thread reader ( readSlab, 0 );
+	for (int k=0; k < bz; k++ ) {
+		reader.join ();
+		int layers = std::min ( W, res.z - k*W );
+		if ( got[k & 1] != row * res.y * layers ) {
+			gprintf ( "ERROR: LoadRAW. %s is truncated at slab %d.\n", fname.c_str(), k );
+			ok = false;
+			break;
+		}
+		if ( k+1 < bz ) reader = std::thread ( readSlab, k+1 );
+		const uchar* slab = buf[k & 1].data();
+
+		// Bricks with a value above threshold
+		ParallelChunks ( bx * by, threads, [&] ( int t, int start, int end ) {
+			std::vector<float> tmp ( brick_vox );
+			for (int b=start; b < end; b++ )
+				hit[b] = brickRows ( slab, layers, b % bx, b / bx, tmp.data(), W, uint64(W)*W ) > thresh;
+		} );
+
+		// Activate them, new leaves are appended to the pool
+		act.clear ();
+		slot.clear ();
+		uint64 need = 0;
+		for (int b=0; b < bx * by; b++ ) {
+			if ( !hit[b] ) continue;
+			bool bnew = false;
+			slong leaf = ActivateSpace ( mRoot, Vector3DI( (b % bx) * W, (b / bx) * W, k*W ), bnew );
+			if ( leaf == ID_UNDEFL ) continue;
+			act.push_back ( b );
+			slot.push_back ( ElemNdx(leaf) );
+			need = std::max ( need, ElemNdx(leaf) + 1 );
+		}
+		if ( act.empty() ) continue;
+		active += act.size ();
+
+		// Grow all atlases by half; existing slots keep their place
+		uint64 amax = mPool->getAtlas(chan).max;
+		if ( need > amax ) {
+			need = std::max ( need, amax + amax/2 );
+			for (int n=0; n < mPool->getNumAtlas(); n++ )
+				mPool->AtlasResize ( n, need );
+			SetupAtlasAccess ();
+		}
+
+		// Write brick data
+		int num = (int) act.size ();
+		if ( mbUseCPUCompute ) {
+			DataPtr atlas = mPool->getAtlas ( chan );
+			Vector3DI ares = mPool->getAtlasRes ( chan );
+			ParallelChunks ( num, threads, [&] ( int t, int start, int end ) {
+				for (int i=start; i < end; i++ ) {
+					Vector3DI a = mPool->getAtlasPos ( chan, slot[i] );
+					float* dst = (float*) atlas.cpu + ( uint64(a.z) * ares.y + a.y ) * ares.x + a.x;
+					brickRows ( slab, layers, act[i] % bx, act[i] / bx, dst, ares.x, uint64(ares.x) * ares.y );
+				}
+			} );
+		} else {
+			if ( uint64(num) > stage_max ) {
+				stage_max = std::max ( uint64(num), stage_max * 2 );
+				mPool->CreateMemLinear ( stage, 0x0, int(brick_vox * sizeof(float)), stage_max, true );
+			}
+			ParallelChunks ( num, threads, [&] ( int t, int start, int end ) {
+				for (int i=start; i < end; i++ )
+					brickRows ( slab, layers, act[i] % bx, act[i] / bx, (float*) stage.cpu + i * brick_vox, W, uint64(W)*W );
+			} );
+			cudaCheck ( cuMemcpyHtoD ( stage.gpu, stage.cpu, num * brick_vox * sizeof(float) ), "VolumeGVDB", "LoadRAW", "cuMemcpyHtoD", "stage", mbDebug );
+			for (int i=0; i < num; i++ )
+				mPool->AtlasCopyLinear ( chan, mPool->getAtlasPos ( chan, slot[i] ), stage.gpu + i * brick_vox * sizeof(float) );
+		}
+	}
+	if ( reader.joinable() ) reader.join ();
+	fclose ( fp );
+	if ( stage_max > 0 ) mPool->FreeMemLinear ( stage );
+
+	// Atlas map and aprons; UpdateAtlas assigns the same slots in pool order
+	FinishTopology ( true, true );
+	UpdateAtlas ();
+	UpdateApron ( chan, 0.0f );
+
+	verbosef ( "LoadRAW.. %s, %d slabs, %llu of %llu bricks active\n", fname.c_str(), bz, (unsigned long long) active, (unsigned long long) bx * by * bz );
+
+	PERF_POP ();
+	POP_CTX
+
+	return ok;
+}
+
 #ifdef BUILD_OPENVDB
 template<class GridType>
 bool VolumeGVDB::LoadVDBInternal(openvdb::GridBase::Ptr& baseGrid) {
@@ -2324,7 +2931,7 @@ void VolumeGVDB::Initialize ()
 	// Create Pool Allocator
 	verbosef("Starting GVDB Voxels. ver %d.%d\n", MAJOR_VERSION, MINOR_VERSION );
 	verbosef(" Creating Allocator..\n");
-	mPool = new Allocator;	
+	mPool = new Allocator ( mbUseCPUCompute && mContext == NULL );	
 	mPool->SetStream(mStream);
 	mPool->SetDebug(mbDebug);
 
@@ -2333,7 +2940,8 @@ void VolumeGVDB::Initialize ()
 	mScene = new Scene;		
 
 	// Create VDB object
-	cudaCheck(cuMemAlloc(&cuVDBInfo, sizeof(VDBInfo)), "VolumeGVDB", "Initialize", "cuMemAlloc", "cuVDBInfo", mbDebug);
+	if ( !mPool->isCPUOnly() )
+		cudaCheck(cuMemAlloc(&cuVDBInfo, sizeof(VDBInfo)), "VolumeGVDB", "Initialize", "cuMemAlloc", "cuVDBInfo", mbDebug);
 
 	// Default Camera & Light
 	mScene->SetCamera ( new Camera3D );		// Default camera
@@ -2417,6 +3025,9 @@ void VolumeGVDB::Configure ( int levs, int* r, int* numcnt, bool use_masks )
 	for (int n = 0; n < levs; n++) {
 		nodesz = hdr;
 		if ( use_masks ) nodesz += getMaskSize(n);
+		#ifdef USE_BITMASKS
+			nodesz += getPrefixSize(n);
+		#endif
 		mPool->PoolCreate(0, n, nodesz, maxcnt[n], true);
 	}
 
@@ -2444,7 +3055,7 @@ void VolumeGVDB::AddChannel ( uchar chan, int dt, int apron, int filter, int bor
 	}
 	mApron = apron;
 
-	mPool->AtlasCreate ( chan, dt, getRes3DI(0), axiscnt, apron, sizeof(AtlasNode), false, mbUseGLAtlas );
+	mPool->AtlasCreate ( chan, dt, getRes3DI(0), axiscnt, apron, sizeof(AtlasNode), mbUseCPUCompute, mbUseGLAtlas );
 	mPool->AtlasSetFilter ( chan, filter, border );
 
 	SetupAtlasAccess ();	
@@ -2519,7 +3130,7 @@ void VolumeGVDB::SetupNode ( slong nodeid, int lev, Vector3DF pos, bool marker)
 	node->mValue = Vector3DI(-1,-1,-1);
 	node->mFlags = marker;
 #ifdef USE_BITMASKS
-	if ( lev > 0 ) node->clearMask ();
+	if ( lev > 0 ) clearMask ( node );
 #endif
 }
 
@@ -2787,8 +3398,8 @@ slong VolumeGVDB::ActivateSpaceAtLevel ( int lev, Vector3DI pos )
 bool VolumeGVDB::isOn (slong nodeid, uint32 b )
 {
 	#ifdef USE_BITMASKS
-		Node* node = getNode(noideid);
-		return node->isOn( b );
+		Node* node = getNode(nodeid);
+		return isOn( node, b );
 	#else
 		uint64 cid = getChildNode ( nodeid, b );
 		return (cid != ID_UNDEF64 );
@@ -2900,8 +3511,8 @@ void VolumeGVDB::DebugNode ( slong nodeid )
 	}
 #ifdef USE_BITMASKS
 	if ( curr->mLev > 0 ) {		
-		gprintf ( "%*s L%d #%d, Bit: %d, Pos: %d %d %d, Mask: %s\n", (5-curr->mLev)*2, "", (int) curr->mLev, ndx, b, curr->mPos.x, curr->mPos.y, curr->mPos.z, binaryStr( *curr->getMask() ) );
-		for (int n=0; n < curr->getNumChild(); n++ ) {
+		gprintf ( "%*s L%d #%d, Bit: %d, Pos: %d %d %d, Mask: %s\n", (5-curr->mLev)*2, "", (int) curr->mLev, ndx, b, curr->mPos.x, curr->mPos.y, curr->mPos.z, binaryStr( *getMask(curr) ) );
+		for (int n=0; n < getNumChild(curr); n++ ) {
 			slong childid = getChildNode ( nodeid, n );
 			DebugNode ( childid );
 		}
@@ -2954,7 +3565,7 @@ slong VolumeGVDB::FindParent(int lev,  Vector3DI pos)
 		int posInNodeZ = static_cast<int>(floor(posInNode.z)); // IMPORTANT!!! truncate decimal 
 		bitMaskPos = (posInNodeZ*res.x + posInNodeY)*res.x+ posInNodeX;
 #ifdef USE_BITMASKS
-		uint64 p = nd->countOn ( bitMaskPos );
+		uint64 p = countOn ( nd, bitMaskPos );
 
 		l--;
 
@@ -2985,10 +3596,10 @@ slong VolumeGVDB::InsertChild ( slong nodeid, slong childid, uint32 i )
 
 #ifdef USE_BITMASKS
 	// determine child bit position	
-	assert ( ! curr->isOn ( i ) );			// check if child already exists
-	uint64 p = curr->countOn ( i );
-	uint64 cnum = curr->getNumChild();		// existing children count
-	curr->setOn ( i );
+	assert ( ! isOn ( curr, i ) );			// check if child already exists
+	uint64 p = countOn ( curr, i );
+	uint64 cnum = getNumChild ( curr );		// existing children count
+	setChildOn ( curr, i );
 
 	// add child list if doesn't exist
 	if ( curr->mChildList == ID_UNDEFL ) {
@@ -3010,7 +3621,6 @@ slong VolumeGVDB::InsertChild ( slong nodeid, slong childid, uint32 i )
 	} else {
 		*(clist + cnum) = childid;		
 	}
-	int cnt = curr->countOn();			// count children again
 #else
 	if ( curr->mChildList == ID_UNDEFL ) {
 		curr->mChildList = mPool->PoolAlloc ( 1, curr->mLev, true );	
@@ -3054,7 +3664,7 @@ Node* VolumeGVDB::getChildAtBit (Node* curr, uint b)
 	if (curr->mChildList == ID_UNDEFL) return 0x0;
 	uint64* clist = mPool->PoolData64(curr->mChildList);
 #ifdef USE_BITMASKS
-	uint32 ndx = curr->countOn(b);
+	uint32 ndx = countOn(curr, b);
 	uint64 ch = *(clist + ndx);	
 #else		
 	uint64 ch = *(clist + b);
@@ -3068,7 +3678,7 @@ uint64 VolumeGVDB::getChildRefAtBit(Node* curr, uint b)
 	if (curr->mChildList == ID_UNDEFL) return ID_UNDEF64;
 	uint64* clist = mPool->PoolData64(curr->mChildList);
 #ifdef USE_BITMASKS
-	uint32 ndx = curr->countOn(b);
+	uint32 ndx = countOn(curr, b);
 	return *(clist + ndx);
 #else
 	return *(clist + b);
@@ -3083,7 +3693,7 @@ uint64 VolumeGVDB::getChildNode ( slong nodeid, uint b )
 	uint64* clist = mPool->PoolData64 ( curr->mChildList );
 
 #ifdef USE_BITMASKS
-	uint32 ndx = curr->countOn ( b );	
+	uint32 ndx = countOn ( curr, b );	
 	return *(clist + ndx);
 #else		
 	return *(clist + b);
@@ -3151,10 +3761,203 @@ void VolumeGVDB::setupVerts ( int gv[], Vector3DI g, int r1, int r2 )
 	gv[7] = g0 + r2+r1;
 }
 
+// Isosurface export
+// Surface nets, a dual contouring scheme: every cell whose corners straddle the threshold
+// gets one vertex at the mean of its edge crossings, and every crossing edge emits a quad
+// joining the four cells around it. Bricks are meshed in parallel, each one owning the
+// edges that start inside it. The apron supplies the samples one voxel past the brick, so
+// a cell on a brick face comes out the same from both sides and is welded through a hash
+// on its global cell key. Quads face from lower toward higher values (outward for level sets).
+struct MeshBrick {
+	std::vector<Vector3DF>	verts;			// index-space positions
+	std::vector<uint64>		keys;			// cell key of verts shared with other bricks, else ID_UNDEF64
+	std::vector<int>		quads;			// 4 local vertex ids per quad
+	std::vector<int>		ids;			// global vertex id of each local vertex
+	int						first;			// first vertex emitted by this brick
+	std::string				text;			// formatted output
+};
+
+static void MeshBrickCPU ( const float* atlas, Vector3DI ares, Node* node, int R, float thresh, MeshBrick& m )
+{
+	int W = R+2, C = R+1;					// samples and cells per axis, both starting at -1
+	std::vector<float> s ( W*W*W );
+	std::vector<int> vid ( C*C*C, -1 );
+	Vector3DI a = node->mValue;
+	for (int k=0; k < W; k++ )
+		for (int j=0; j < W; j++ ) {
+			const float* src = atlas + ( uint64(a.z+k-1)*ares.y + (a.y+j-1) )*ares.x + (a.x-1);
+			memcpy ( &s[(k*W+j)*W], src, W*sizeof(float) );
+		}
+	m.verts.clear (); m.keys.clear (); m.quads.clear ();
+
+	static const int corner[8][3] = { {0,0,0},{1,0,0},{0,1,0},{1,1,0},{0,0,1},{1,0,1},{0,1,1},{1,1,1} };
+	static const int edge[12][2] = { {0,1},{2,3},{4,5},{6,7},{0,2},{1,3},{4,6},{5,7},{0,4},{1,5},{2,6},{3,7} };
+
+	// vertex of the cell with sample-space corner (i,j,k), created on first use
+	auto cellVert = [&] ( int i, int j, int k ) -> int {
+		int& id = vid[(k*C+j)*C+i];
+		if ( id >= 0 ) return id;
+		float v[8];
+		for (int c=0; c < 8; c++ )
+			v[c] = s[ ((k+corner[c][2])*W + j+corner[c][1])*W + i+corner[c][0] ];
+		Vector3DF p ( 0, 0, 0 );
+		int n = 0;
+		for (int e=0; e < 12; e++ ) {
+			float v0 = v[edge[e][0]], v1 = v[edge[e][1]];
+			if ( (v0 > thresh) == (v1 > thresh) ) continue;
+			float t = (thresh - v0) / (v1 - v0);
+			const int* c0 = corner[edge[e][0]];
+			const int* c1 = corner[edge[e][1]];
+			p += Vector3DF ( c0[0] + t*(c1[0]-c0[0]), c0[1] + t*(c1[1]-c0[1]), c0[2] + t*(c1[2]-c0[2]) );
+			n++;
+		}
+		p /= float(n);
+		Vector3DI g ( node->mPos.x + i-1, node->mPos.y + j-1, node->mPos.z + k-1 );
+		p += Vector3DF ( g );
+		bool shared = ( i==0 || j==0 || k==0 || i==R || j==R || k==R );
+		id = (int) m.verts.size ();
+		m.verts.push_back ( p );
+		m.keys.push_back ( ( shared && TopoKeyFits(g) ) ? TopoKey(g) : ID_UNDEF64 );
+		return id;
+	};
+
+	// edges starting at interior sample p along each axis
+	int step[3] = { 1, W, W*W };
+	for (int k=1; k <= R; k++ )
+		for (int j=1; j <= R; j++ )
+			for (int i=1; i <= R; i++ ) {
+				int n = (k*W+j)*W+i;
+				bool in0 = s[n] > thresh;
+				for (int ax=0; ax < 3; ax++ ) {
+					if ( (s[n+step[ax]] > thresh) == in0 ) continue;
+					int p[3] = { i, j, k }, b = (ax+1) % 3, c = (ax+2) % 3;
+					int q[4];										// cells around the edge, counter-clockwise about +axis
+					int d[4][2] = { {0,0}, {1,0}, {1,1}, {0,1} };
+					for (int v=0; v < 4; v++ ) {
+						int cp[3] = { p[0], p[1], p[2] };
+						cp[b] -= d[v][0]; cp[c] -= d[v][1];
+						q[v] = cellVert ( cp[0], cp[1], cp[2] );
+					}
+					if ( in0 ) { m.quads.push_back(q[0]); m.quads.push_back(q[3]); m.quads.push_back(q[2]); m.quads.push_back(q[1]); }
+					else       { m.quads.push_back(q[0]); m.quads.push_back(q[1]); m.quads.push_back(q[2]); m.quads.push_back(q[3]); }
+				}
+			}
+}
+
 void VolumeGVDB::WriteObj ( char* fname )
 {
-	//NOT IMPLEMENTED
-	//TODO - IMPLEMENT OR RAISE EXCEPTION
+	WriteMesh ( fname, 0, ( mScene != 0x0 ) ? mScene->mVThreshold.x : 0.0f );
+}
+
+bool VolumeGVDB::WriteMesh ( std::string fname, uchar chan, float thresh )
+{
+	DataPtr atlas = mPool->getAtlas ( chan );
+	if ( atlas.type != T_FLOAT || atlas.apron < 1 ) {
+		gprintf ( "ERROR: WriteMesh needs a T_FLOAT channel with an apron of at least 1.\n" );
+		return false;
+	}
+	bool ply = ( fname.size() > 4 && fname.compare ( fname.size()-4, 4, ".ply" ) == 0 );
+	FILE* fp = fopen ( fname.c_str(), "wb" );
+	if ( fp == 0x0 ) {
+		gprintf ( "ERROR: Unable to open %s for writing.\n", fname.c_str() );
+		return false;
+	}
+	PUSH_CTX
+	PERF_PUSH ( "WriteMesh" );
+
+	if ( !mbUseCPUCompute ) mPool->AtlasFetch ( chan );		// read back device atlas
+	atlas = mPool->getAtlas ( chan );
+	const float* data = (const float*) atlas.cpu;
+	Vector3DI ares = mPool->getAtlasRes ( chan );
+	int R = getRes ( 0 );
+
+	std::vector<Node*> leaves;
+	uint64 cnt = mPool->getPoolTotalCnt ( 0, 0 );
+	for (uint64 n=0; n < cnt; n++ ) {
+		Node* node = getNode ( 0, 0, n );
+		if ( node->mFlags && node->mValue.x >= 0 ) leaves.push_back ( node );
+	}
+
+	// ply counts are patched in once known
+	char hdr[256];
+	int hdrlen = 0;
+	if ( ply ) {
+		hdrlen = sprintf ( hdr, "ply\nformat binary_little_endian 1.0\nelement vertex %012d\nproperty float x\nproperty float y\nproperty float z\n"
+								"element face %012d\nproperty list uchar int vertex_indices\nend_header\n", 0, 0 );
+		fwrite ( hdr, hdrlen, 1, fp );
+	}
+	std::vector<char> plyfaces;
+
+	std::unordered_map<uint64, int> weld;
+	int numverts = 0, numfaces = 0;
+	int threads = NumThreadsCPU ();
+	const int batch = 4096;
+	std::vector<MeshBrick> mesh ( std::min ( (int) leaves.size(), batch ) );
+
+	for (int b0=0; b0 < (int) leaves.size(); b0 += batch ) {
+		int bn = std::min ( batch, (int) leaves.size() - b0 );
+
+		ParallelChunks ( bn, threads, [&] ( int t, int start, int end ) {
+			for (int b=start; b < end; b++ )
+				MeshBrickCPU ( data, ares, leaves[b0+b], R, thresh, mesh[b] );
+		} );
+
+		// number vertices in brick order, welding shared cells
+		for (int b=0; b < bn; b++ ) {
+			MeshBrick& m = mesh[b];
+			m.first = numverts;
+			m.ids.resize ( m.verts.size() );
+			for (size_t v=0; v < m.verts.size(); v++ ) {
+				if ( m.keys[v] == ID_UNDEF64 ) { m.ids[v] = numverts++; continue; }
+				auto it = weld.insert ( std::make_pair ( m.keys[v], numverts ) );
+				m.ids[v] = it.first->second;
+				if ( it.second ) numverts++;
+			}
+			numfaces += (int) m.quads.size() / 4;
+		}
+
+		// format in parallel, write in order
+		ParallelChunks ( bn, threads, [&] ( int t, int start, int end ) {
+			char buf[128];
+			for (int b=start; b < end; b++ ) {
+				MeshBrick& m = mesh[b];
+				m.text.clear ();
+				for (size_t v=0; v < m.verts.size(); v++ ) {
+					if ( m.ids[v] < m.first ) continue;			// welded to a vertex written earlier
+					Vector3DF p = m.verts[v];
+					p *= mXform;
+					if ( ply ) m.text.append ( (const char*) &p.x, 3*sizeof(float) );
+					else	   m.text.append ( buf, sprintf ( buf, "v %.7g %.7g %.7g\n", p.x, p.y, p.z ) );
+				}
+				if ( ply ) continue;
+				for (size_t q=0; q < m.quads.size(); q += 4 )
+					m.text.append ( buf, sprintf ( buf, "f %d %d %d %d\n", m.ids[m.quads[q]]+1, m.ids[m.quads[q+1]]+1, m.ids[m.quads[q+2]]+1, m.ids[m.quads[q+3]]+1 ) );
+			}
+		} );
+		for (int b=0; b < bn; b++ ) {
+			MeshBrick& m = mesh[b];
+			fwrite ( m.text.data(), m.text.size(), 1, fp );
+			if ( !ply ) continue;
+			for (size_t q=0; q < m.quads.size(); q += 4 ) {
+				int f[4] = { m.ids[m.quads[q]], m.ids[m.quads[q+1]], m.ids[m.quads[q+2]], m.ids[m.quads[q+3]] };
+				plyfaces.push_back ( 4 );
+				plyfaces.insert ( plyfaces.end(), (const char*) f, (const char*) f + sizeof(f) );
+			}
+		}
+	}
+	if ( ply ) {
+		fwrite ( plyfaces.data(), plyfaces.size(), 1, fp );
+		fseek ( fp, 0, SEEK_SET );
+		sprintf ( hdr, "ply\nformat binary_little_endian 1.0\nelement vertex %012d\nproperty float x\nproperty float y\nproperty float z\n"
+					   "element face %012d\nproperty list uchar int vertex_indices\nend_header\n", numverts, numfaces );
+		fwrite ( hdr, hdrlen, 1, fp );
+	}
+	fclose ( fp );
+
+	verbosef ( "  WriteMesh: %s, %d bricks, %d verts, %d quads\n", fname.c_str(), (int) leaves.size(), numverts, numfaces );
+	PERF_POP ();
+	POP_CTX
+	return true;
 }
 
 // Validate OpenGL
@@ -3477,6 +4280,8 @@ int VolumeGVDB::VoxelizeNode ( Node* node, uchar chan, Matrix4F* xform, float bd
 // SolidVoxelize - Voxelize a polygonal mesh to a sparse volume
 void VolumeGVDB::SolidVoxelize ( uchar chan, Model* model, Matrix4F* xform, float val_surf, float val_inside, float vthresh )
 {
+	if ( mbUseCPUCompute ) { SolidVoxelizeCPU ( chan, model, xform, val_surf, val_inside ); return; }
+
 	PUSH_CTX
 
 	//TimerStart();
@@ -3587,6 +4392,331 @@ Vector3DI VolumeGVDB::InsertTriangles ( Model* model, Matrix4F* xform, float& yd
 	return Vector3DI( ybins, tri_cnt, ecnt);	// return: number of bins, total inserted tris, original tri count
 }
 
+// Brick keys for the CPU voxelizer: TopoKey with the axes reversed, so sorted keys
+// run along x rows of bricks and a row is key >> TOPO_KEY_BITS
+static inline uint64 RowKey ( const Vector3DI& b )		{ return TopoKey ( Vector3DI(b.z, b.y, b.x) ); }
+static inline Vector3DI RowKeyPos ( uint64 key )		{ Vector3DI p = TopoKeyPos ( key ); return Vector3DI(p.z, p.y, p.x); }
+
+// Sort in parallel: chunks are sorted by each thread, then merged pairwise
+template <class T>
+static void ParallelSort ( std::vector<T>& v, int threads )
+{
+	int num = (int) v.size();
+	if ( num < 65536 ) threads = 1;
+	std::vector<int> bound ( threads+1 );
+	for (int t=0; t <= threads; t++ ) bound[t] = int( uint64(num)*t/threads );
+	ParallelChunks ( threads, threads, [&] ( int t, int start, int end ) {
+		for (int c=start; c < end; c++ ) std::sort ( v.begin()+bound[c], v.begin()+bound[c+1] );
+	} );
+	for (int w=1; w < threads; w *= 2 ) {
+		int pairs = (threads + 2*w - 1) / (2*w);
+		ParallelChunks ( pairs, pairs, [&] ( int t, int start, int end ) {
+			for (int p=start; p < end; p++ ) {
+				int lo = p*2*w, mid = std::min(lo+w, threads), hi = std::min(lo+2*w, threads);
+				if ( mid < hi ) std::inplace_merge ( v.begin()+bound[lo], v.begin()+bound[mid], v.begin()+bound[hi] );
+			}
+		} );
+	}
+}
+
+// Triangle / cube overlap by separating axes, as in gvdbVoxelize.
+// c is the cube center, h its half width.
+static bool TriBoxOverlapCPU ( Vector3DF v0, Vector3DF v1, Vector3DF v2, const Vector3DF& c, float h )
+{
+	v0 -= c; v1 -= c; v2 -= c;
+	auto separated = [&] ( float ax, float ay, float az ) {
+		float p0 = ax*v0.x + ay*v0.y + az*v0.z;
+		float p1 = ax*v1.x + ay*v1.y + az*v1.z;
+		float p2 = ax*v2.x + ay*v2.y + az*v2.z;
+		float r = h * ( fabsf(ax) + fabsf(ay) + fabsf(az) );
+		return std::min(p0, std::min(p1, p2)) > r || std::max(p0, std::max(p1, p2)) < -r;
+	};
+	if ( separated(1,0,0) || separated(0,1,0) || separated(0,0,1) ) return false;		// box faces
+
+	Vector3DF e[3] = { v1 - v0, v2 - v1, v0 - v2 };
+	Vector3DF n = e[0]; n.Cross ( e[1] );
+	if ( separated ( n.x, n.y, n.z ) ) return false;									// triangle plane
+	for (int i=0; i < 3; i++ ) {														// edge x box axes
+		if ( separated ( 0, -e[i].z, e[i].y ) ) return false;
+		if ( separated ( e[i].z, 0, -e[i].x ) ) return false;
+		if ( separated ( -e[i].y, e[i].x, 0 ) ) return false;
+	}
+	return true;
+}
+
+// Crossing of a +x ray at (py,pz) with a triangle, returns hit x in hx.
+// Edge functions are evaluated in the yz plane in double precision; a ray exactly
+// on an edge or vertex belongs to one triangle only (top-left rule), so the
+// crossings of a closed mesh are always even.
+static bool RayCrossCPU ( const Vector3DF* v, float py, float pz, float& hx )
+{
+	double area = (double(v[1].y) - v[0].y) * (double(v[2].z) - v[0].z) - (double(v[1].z) - v[0].z) * (double(v[2].y) - v[0].y);
+	if ( area == 0 ) return false;							// parallel to the ray
+	double s = (area > 0) ? 1.0 : -1.0, w[3], du, dv;
+	for (int i=0; i < 3; i++ ) {							// edge opposite vertex i, counter-clockwise
+		const Vector3DF& a = v[(i+1)%3];
+		const Vector3DF& b = v[(i+2)%3];
+		du = s * (double(b.y) - a.y);
+		dv = s * (double(b.z) - a.z);
+		w[i] = du * (double(pz) - a.z) - dv * (double(py) - a.y);
+		if ( w[i] < 0 || ( w[i] == 0 && !( dv < 0 || (dv == 0 && du < 0) ) ) ) return false;
+	}
+	hx = float( (w[0]*v[0].x + w[1]*v[1].x + w[2]*v[2].x) / (w[0] + w[1] + w[2]) );
+	return true;
+}
+
+// Crossings of the triangles binned to brick b with the +x rays through the voxel
+// rows of the brick, as (row, hit x) sorted, row = z*W + y. Only hits in the brick's
+// x span are kept, so each crossing is seen by one of the bricks a triangle is in.
+static void BrickCrossingsCPU ( const Vector3DI& b, int W, const std::pair<uint64,int>* bt, int cnt, const Vector3DF* tris,
+								std::vector< std::pair<int,float> >& out )
+{
+	out.clear ();
+	float x0 = float(b.x*W), x1 = float(b.x*W + W), hx;
+	for (int n=0; n < cnt; n++ ) {
+		const Vector3DF* v = tris + uint64(bt[n].second) * 3;
+		int y0 = std::max ( 0, int(ceilf( std::min(v[0].y, std::min(v[1].y, v[2].y)) - 0.5f )) - b.y*W );
+		int y1 = std::min ( W-1, int(floorf( std::max(v[0].y, std::max(v[1].y, v[2].y)) - 0.5f )) - b.y*W );
+		int z0 = std::max ( 0, int(ceilf( std::min(v[0].z, std::min(v[1].z, v[2].z)) - 0.5f )) - b.z*W );
+		int z1 = std::min ( W-1, int(floorf( std::max(v[0].z, std::max(v[1].z, v[2].z)) - 0.5f )) - b.z*W );
+		for (int z=z0; z <= z1; z++ )
+			for (int y=y0; y <= y1; y++ )
+				if ( RayCrossCPU ( v, float(b.y*W + y) + 0.5f, float(b.z*W + z) + 0.5f, hx ) && hx >= x0 && hx < x1 )
+					out.push_back ( std::pair<int,float> ( z*W + y, hx ) );
+	}
+	std::sort ( out.begin(), out.end() );
+}
+
+// Voxelize a polygonal mesh on the CPU into the CPU atlas of chan.
+// Triangles are binned to the leaf bricks they overlap (exact triangle/box test) and
+// the (brick, triangle) pairs sorted in parallel. The bricks of each x row are then
+// classified by +x ray parity: empty bricks between surface bricks are inside when
+// an odd number of crossings lie to their right. Surface bricks are filled per voxel,
+// val_surf where a triangle overlaps the voxel, else val_inside by scanline parity.
+// The mesh should be closed. Builds the topology and atlas from scratch.
+void VolumeGVDB::SolidVoxelizeCPU ( uchar chan, Model* model, Matrix4F* xform, float val_surf, float val_inside )
+{
+	if ( !mbUseCPUCompute || chan >= mPool->getNumAtlas() || mPool->getAtlas(chan).cpu == 0x0 ) {
+		gprintf ( "ERROR: SolidVoxelizeCPU. Channel %d has no CPU atlas.\n", (int) chan );
+		return;
+	}
+	uchar dt = mPool->getAtlas(chan).type;
+	if ( dt != T_FLOAT && dt != T_UCHAR && dt != T_INT ) {
+		gprintf ( "ERROR: SolidVoxelizeCPU. Channel %d must be T_FLOAT, T_UCHAR or T_INT.\n", (int) chan );
+		return;
+	}
+	if ( !model->isPolygonal() || model->vertBuffer == 0x0 || model->elemBuffer == 0x0 ) {
+		gprintf ( "ERROR: SolidVoxelizeCPU. Model has no polygon data.\n" );
+		return;
+	}
+
+	PERF_PUSH ( "SolidVoxelize (CPU)" );
+
+	int threads = NumThreadsCPU ();
+	int W = getRes(0);
+	int nv = model->vertCount;
+	int nt = model->elemCount;
+
+	// Identify model bounding box
+	model->ComputeBounds ( *xform, 0.1f );
+	mObjMin = model->objMin; mObjMax = model->objMax;
+	mVoxMin = mObjMin;
+	mVoxMax = mObjMax;
+	mVoxRes = mVoxMax; mVoxRes -= mVoxMin;
+	Clear ();
+
+	// Transformed triangles, 3 vertices each
+	PERF_PUSH ( "Transform" );
+	std::vector<Vector3DF> vert ( nv );
+	ParallelChunks ( nv, threads, [&] ( int t, int start, int end ) {
+		const Vector3DF* src = (const Vector3DF*) ( (char*) model->vertBuffer + model->vertOffset + uint64(start) * model->vertStride );
+		TransformPoints ( *xform, src, &vert[start], end - start, model->vertStride );
+	} );
+	std::vector<Vector3DF> tris ( uint64(nt) * 3 );
+	std::vector<uchar> valid ( nt, 0 );
+	ParallelChunks ( nt, threads, [&] ( int t, int start, int end ) {
+		for (int n=start; n < end; n++ ) {
+			const uint* f = model->elemBuffer + uint64(n) * 3;
+			if ( f[0] >= uint(nv) || f[1] >= uint(nv) || f[2] >= uint(nv) ) continue;
+			for (int k=0; k < 3; k++ ) tris[uint64(n)*3 + k] = vert[ f[k] ];
+			valid[n] = 1;
+		}
+	} );
+	std::vector<Vector3DF>().swap ( vert );
+	PERF_POP ();
+
+	// Bin triangles to the bricks they overlap. The brick test is padded slightly
+	// so rounding never drops a brick in which a crossing is counted.
+	PERF_PUSH ( "Bin triangles" );
+	typedef std::pair<uint64,int> BrickTri;
+	std::vector< std::vector<BrickTri> > part ( threads );
+	std::vector<int> outside ( threads, 0 );
+	ParallelChunks ( nt, threads, [&] ( int t, int start, int end ) {
+		std::vector<BrickTri>& out = part[t];
+		Vector3DI b0, b1, b;
+		for (int n=start; n < end; n++ ) {
+			if ( !valid[n] ) continue;
+			const Vector3DF* v = &tris[uint64(n) * 3];
+			b0.Set ( int(floorf( std::min(v[0].x, std::min(v[1].x, v[2].x)) / W )), int(floorf( std::min(v[0].y, std::min(v[1].y, v[2].y)) / W )), int(floorf( std::min(v[0].z, std::min(v[1].z, v[2].z)) / W )) );
+			b1.Set ( int(floorf( std::max(v[0].x, std::max(v[1].x, v[2].x)) / W )), int(floorf( std::max(v[0].y, std::max(v[1].y, v[2].y)) / W )), int(floorf( std::max(v[0].z, std::max(v[1].z, v[2].z)) / W )) );
+			bool single = ( b0.x == b1.x && b0.y == b1.y && b0.z == b1.z );
+			for (b.z=b0.z; b.z <= b1.z; b.z++ )
+				for (b.y=b0.y; b.y <= b1.y; b.y++ )
+					for (b.x=b0.x; b.x <= b1.x; b.x++ ) {
+						if ( !TopoKeyFits ( b ) ) { outside[t]++; continue; }
+						Vector3DF c ( (b.x + 0.5f) * W, (b.y + 0.5f) * W, (b.z + 0.5f) * W );
+						if ( single || TriBoxOverlapCPU ( v[0], v[1], v[2], c, 0.5f * W + 0.01f ) )
+							out.push_back ( BrickTri ( RowKey(b), n ) );
+					}
+		}
+	} );
+	std::vector<BrickTri> bins;
+	for (int t=0; t < threads; t++ ) {
+		bins.insert ( bins.end(), part[t].begin(), part[t].end() );
+		std::vector<BrickTri>().swap ( part[t] );
+		if ( outside[t] > 0 ) gprintf ( "WARNING: SolidVoxelizeCPU. %d bricks beyond the key range skipped.\n", outside[t] );
+	}
+	ParallelSort ( bins, threads );
+
+	// Surface bricks, in row order, and their triangle ranges
+	std::vector<uint64> sbrick;
+	std::vector<int> soff;
+	for (size_t n=0; n < bins.size(); n++ ) {
+		if ( n == 0 || bins[n].first != bins[n-1].first ) {
+			sbrick.push_back ( bins[n].first );
+			soff.push_back ( (int) n );
+		}
+	}
+	int ns = (int) sbrick.size();
+	soff.push_back ( (int) bins.size() );
+	PERF_POP ();
+
+	// Crossing parity of each surface brick per voxel row, then the parity to the
+	// right of each brick by a suffix sum along its brick row
+	PERF_PUSH ( "Scanline parity" );
+	int rows = W*W;
+	std::vector<uchar> par ( uint64(ns) * rows, 0 );
+	std::vector<uchar> right ( uint64(ns) * rows, 0 );
+	ParallelChunks ( ns, threads, [&] ( int t, int start, int end ) {
+		std::vector< std::pair<int,float> > hits;
+		for (int s=start; s < end; s++ ) {
+			BrickCrossingsCPU ( RowKeyPos(sbrick[s]), W, &bins[soff[s]], soff[s+1] - soff[s], tris.data(), hits );
+			uchar* p = &par[ uint64(s) * rows ];
+			for (size_t h=0; h < hits.size(); h++ ) p[ hits[h].first ] ^= 1;
+		}
+	} );
+	for (int s=ns-2; s >= 0; s-- ) {
+		if ( (sbrick[s] >> TOPO_KEY_BITS) != (sbrick[s+1] >> TOPO_KEY_BITS) ) continue;		// last in its row
+		uchar* r = &right[ uint64(s) * rows ];
+		const uchar* rn = &right[ uint64(s+1) * rows ];
+		const uchar* pn = &par[ uint64(s+1) * rows ];
+		for (int i=0; i < rows; i++ ) r[i] = rn[i] ^ pn[i];
+	}
+
+	// Empty bricks between two surface bricks of a row are inside or outside as a
+	// whole; decide by the center row
+	std::vector<uint64> keys;
+	keys.reserve ( ns );
+	int center = (W/2)*W + W/2;
+	int inside_cnt = 0;
+	for (int s=0; s < ns; s++ ) {
+		Vector3DI b = RowKeyPos ( sbrick[s] );
+		keys.push_back ( TopoKey ( b ) );
+		if ( s+1 == ns || (sbrick[s] >> TOPO_KEY_BITS) != (sbrick[s+1] >> TOPO_KEY_BITS) ) continue;
+		if ( !right[ uint64(s) * rows + center ] ) continue;
+		int bx = RowKeyPos ( sbrick[s+1] ).x;
+		for (b.x++; b.x < bx; b.x++, inside_cnt++ )
+			keys.push_back ( TopoKey ( b ) );
+	}
+	std::vector<uchar>().swap ( par );
+	PERF_POP ();
+
+	// Topology and atlas
+	PERF_PUSH ( "Topology" );
+	SortUniqueKeys ( keys, threads );
+	if ( keys.empty() || !BuildTopologyCPU ( keys, threads ) ) {
+		bool bnew;
+		for (size_t n=0; n < keys.size(); n++ ) {
+			bnew = false;
+			ActivateSpace ( mRoot, TopoKeyPos(keys[n]) * W, bnew );
+		}
+	}
+	FinishTopology ( true, true );
+	UpdateAtlas ();
+	PERF_POP ();
+
+	// Fill bricks
+	PERF_PUSH ( "Fill bricks" );
+	DataPtr atlas = mPool->getAtlas ( chan );
+	Vector3DI res = mPool->getAtlasRes ( chan );
+	int bricks = static_cast<int>(mPool->getPoolTotalCnt(0,0));
+	auto put = [&] ( uint64 i, float val ) {
+		switch ( dt ) {
+		case T_UCHAR:	((uchar*) atlas.cpu)[i] = (uchar) val;	break;
+		case T_FLOAT:	((float*) atlas.cpu)[i] = val;			break;
+		case T_INT:		((int*) atlas.cpu)[i] = (int) val;		break;
+		};
+	};
+	ParallelChunks ( bricks, threads, [&] ( int t, int start, int end ) {
+		std::vector< std::pair<int,float> > hits;
+		std::vector<uchar> surf ( uint64(W)*W*W );
+		Vector3DI b, l;
+		for (int n=start; n < end; n++ ) {
+			Node* node = getNode ( 0, 0, n );
+			if ( !node->mFlags ) continue;
+			b.Set ( FloorDiv(node->mPos.x, W), FloorDiv(node->mPos.y, W), FloorDiv(node->mPos.z, W) );
+			std::vector<uint64>::iterator it = std::lower_bound ( sbrick.begin(), sbrick.end(), RowKey(b) );
+			int s = ( it != sbrick.end() && *it == RowKey(b) ) ? int(it - sbrick.begin()) : -1;
+			Vector3DI a = node->mValue;
+
+			if ( s == -1 ) {									// inside brick
+				for (l.z=0; l.z < W; l.z++ )
+					for (l.y=0; l.y < W; l.y++ )
+						for (l.x=0; l.x < W; l.x++ )
+							put ( (uint64(a.z + l.z)*res.y + a.y + l.y)*res.x + a.x + l.x, val_inside );
+				continue;
+			}
+
+			// Surface voxels: cubes overlapped by a triangle binned here
+			std::fill ( surf.begin(), surf.end(), 0 );
+			for (int k=soff[s]; k < soff[s+1]; k++ ) {
+				const Vector3DF* v = &tris[ uint64(bins[k].second) * 3 ];
+				Vector3DI v0, v1;
+				v0.Set ( std::max(0, int(floorf( std::min(v[0].x, std::min(v[1].x, v[2].x)) )) - b.x*W), std::max(0, int(floorf( std::min(v[0].y, std::min(v[1].y, v[2].y)) )) - b.y*W), std::max(0, int(floorf( std::min(v[0].z, std::min(v[1].z, v[2].z)) )) - b.z*W) );
+				v1.Set ( std::min(W-1, int(floorf( std::max(v[0].x, std::max(v[1].x, v[2].x)) )) - b.x*W), std::min(W-1, int(floorf( std::max(v[0].y, std::max(v[1].y, v[2].y)) )) - b.y*W), std::min(W-1, int(floorf( std::max(v[0].z, std::max(v[1].z, v[2].z)) )) - b.z*W) );
+				for (l.z=v0.z; l.z <= v1.z; l.z++ )
+					for (l.y=v0.y; l.y <= v1.y; l.y++ )
+						for (l.x=v0.x; l.x <= v1.x; l.x++ ) {
+							uchar& m = surf[ (l.z*W + l.y)*W + l.x ];
+							if ( !m ) m = TriBoxOverlapCPU ( v[0], v[1], v[2], Vector3DF(float(b.x*W + l.x) + 0.5f, float(b.y*W + l.y) + 0.5f, float(b.z*W + l.z) + 0.5f), 0.5f );
+						}
+			}
+
+			// Remaining voxels by parity, scanning each row from the right
+			BrickCrossingsCPU ( b, W, &bins[soff[s]], soff[s+1] - soff[s], tris.data(), hits );
+			int h = (int) hits.size() - 1;
+			for (l.z=W-1; l.z >= 0; l.z-- )
+				for (l.y=W-1; l.y >= 0; l.y-- ) {
+					int row = l.z*W + l.y;
+					uchar in = right[ uint64(s) * rows + row ];
+					for (l.x=W-1; l.x >= 0; l.x-- ) {
+						float px = float(b.x*W + l.x) + 0.5f;
+						for (; h >= 0 && hits[h].first == row && hits[h].second > px; h-- ) in ^= 1;
+						float val = surf[ (row)*W + l.x ] ? val_surf : ( in ? val_inside : 0.0f );
+						put ( (uint64(a.z + l.z)*res.y + a.y + l.y)*res.x + a.x + l.x, val );
+					}
+					for (; h >= 0 && hits[h].first == row; h-- );		// hits left of the last voxel center
+				}
+		}
+	} );
+	PERF_POP ();
+
+	UpdateApron ( chan, 0.0f );
+
+	verbosef ( "SolidVoxelize (CPU).. triangles: %d, surface bricks: %d, inside bricks: %d\n", nt, ns, inside_cnt );
+	PERF_POP ();
+}
+
 // Voxelize a mesh as surface voxels using OpenGL hardware rasterizer
 void VolumeGVDB::SurfaceVoxelizeGL ( uchar chan, Model* model, Matrix4F* xform )
 {
@@ -4418,6 +5548,7 @@ void VolumeGVDB::UpdateApron ()
 void VolumeGVDB::UpdateApron ( uchar chan, float boundval, bool changeCtx)
 { 	
 	if ( mApron == 0 ) return;	
+	if ( mbUseCPUCompute ) { UpdateApronCPU ( chan, boundval ); return; }
 	
 	// Send VDB Info	
 	PrepareVDB ();			
@@ -4461,6 +5592,7 @@ void VolumeGVDB::UpdateApron ( uchar chan, float boundval, bool changeCtx)
 void VolumeGVDB::UpdateApronFaces (uchar chan)
 {
 	if (mApron == 0) return;
+	if (mbUseCPUCompute) { UpdateApronCPU(chan, 0.0f); return; }		// full apron is a superset of the faces
 
 	if (mbProfile) PERF_PUSH("UpdateApron");
 
@@ -4498,6 +5630,11 @@ void VolumeGVDB::UpdateApronFaces (uchar chan)
 
 void VolumeGVDB::ComputeKernel (CUmodule user_module, CUfunction user_kernel, uchar channel, bool bUpdateApron, bool skipOverAprons)
 {
+	if ( mbUseCPUCompute ) {
+		gprintf ( "ERROR: ComputeKernel. User kernels cannot run with CPU compute enabled.\n" );
+		return;
+	}
+
 	PERF_PUSH ("ComputeKernel");
 
 	SetModule ( user_module );
@@ -4531,6 +5668,11 @@ void VolumeGVDB::ComputeKernel (CUmodule user_module, CUfunction user_kernel, uc
 
 void VolumeGVDB::Compute (int effect, uchar channel, int num_iterations, Vector3DF parameters, bool bUpdateApron, bool skipOverAprons, float boundval)
 { 
+	if ( mbUseCPUCompute ) {
+		ComputeCPU ( effect, channel, num_iterations, parameters, bUpdateApron, boundval );
+		return;
+	}
+
 	PERF_PUSH ("Compute");
 
 	// Send VDB Info	
@@ -4563,6 +5705,49 @@ void VolumeGVDB::DownsampleCPU(Matrix4F xform, Vector3DI in_res, char in_aux, Ve
 
 	PrepareAux(out_aux, out_res.x*out_res.y*out_res.z, sizeof(float), true, true);
 
+	if (mbUseCPUCompute) {
+		// Same box filter as gvdbDownsample, straight into the CPU buffer
+		const float* src = (const float*) mAux[in_aux].cpu;
+		float* dest = (float*) mAux[out_aux].cpu;
+		const float* m = xform.GetDataF();
+		if (src == 0x0) {
+			gprintf("ERROR: DownsampleCPU. Aux %d has no CPU data.\n", in_aux);
+			POP_CTX
+			return;
+		}
+		ParallelChunks(out_res.z, NumThreadsCPU(), [&](int t, int start, int end) {
+			Vector3DF dmin, dmax;
+			Vector3DI smin, smax;
+			for (int z = start; z < end; z++)
+				for (int y = 0; y < out_res.y; y++)
+					for (int x = 0; x < out_res.x; x++) {
+						dmin.Set(x * out_max.x / (out_res.x + 1), y * out_max.y / (out_res.y + 1), z * out_max.z / (out_res.z + 1));
+						dmax.Set((x + 1) * out_max.x / (out_res.x + 1) - 1, (y + 1) * out_max.y / (out_res.y + 1) - 1, (z + 1) * out_max.z / (out_res.z + 1) - 1);
+						smin.x = (int)(dmin.x * m[0] + dmin.y * m[4] + dmin.z * m[8] + m[12]);
+						smin.y = (int)(dmin.x * m[1] + dmin.y * m[5] + dmin.z * m[9] + m[13]);
+						smin.z = (int)(dmin.x * m[2] + dmin.y * m[6] + dmin.z * m[10] + m[14]);
+						smax.x = (int)(dmax.x * m[0] + dmax.y * m[4] + dmax.z * m[8] + m[12]);
+						smax.y = (int)(dmax.x * m[1] + dmax.y * m[5] + dmax.z * m[9] + m[13]);
+						smax.z = (int)(dmax.x * m[2] + dmax.y * m[6] + dmax.z * m[10] + m[14]);
+						smin.x = std::min(std::max(smin.x, 0), in_res.x - 1);
+						smin.y = std::min(std::max(smin.y, 0), in_res.y - 1);
+						smin.z = std::min(std::max(smin.z, 0), in_res.z - 1);
+						smax.x = std::min(std::max(smax.x, smin.x), in_res.x - 1);
+						smax.y = std::min(std::max(smax.y, smin.y), in_res.y - 1);
+						smax.z = std::min(std::max(smax.z, smin.z), in_res.z - 1);
+						float v = 0;
+						for (int k = smin.z; k <= smax.z; k++)
+							for (int j = smin.y; j <= smax.y; j++)
+								for (int i = smin.x; i <= smax.x; i++)
+									v += outr.x + (src[(uint64(k) * in_res.y + j) * in_res.x + i] - inr.x) * (outr.y - outr.x) / (inr.y - inr.x);
+						v /= (smax.x - smin.x + 1) * (smax.y - smin.y + 1) * (smax.z - smin.z + 1);
+						dest[(uint64(z) * out_res.y + y) * out_res.x + x] = v;
+					}
+		});
+		POP_CTX
+		return;
+	}
+
 	// Determine grid and block dims
 	Vector3DI block(8, 8, 8);
 	Vector3DI grid(int(out_res.x / block.x) + 1, int(out_res.y / block.y) + 1, int(out_res.z / block.z) + 1);
@@ -4584,6 +5769,8 @@ void VolumeGVDB::DownsampleCPU(Matrix4F xform, Vector3DI in_res, char in_aux, Ve
 
 Vector3DF VolumeGVDB::Reduction(uchar chan)
 {
+	if (mbUseCPUCompute) return ReductionCPU(chan);
+
 	if (mbProfile) PERF_PUSH("Reduction");
 
 	PrepareVDB();
@@ -4624,6 +5811,11 @@ Vector3DF VolumeGVDB::Reduction(uchar chan)
 
 void VolumeGVDB::Resample ( uchar chan, Matrix4F xform, Vector3DI in_res, char in_aux, Vector3DF inr, Vector3DF outr )
 {
+	if ( mbUseCPUCompute ) {
+		ResampleCPU ( chan, xform, in_res, in_aux, inr, outr );
+		return;
+	}
+
 	PrepareVDB ();
 
 	PUSH_CTX
@@ -4647,6 +5839,342 @@ void VolumeGVDB::Resample ( uchar chan, Matrix4F xform, Vector3DI in_res, char i
 }
 
 
+//---------------------------------------------------------------- CPU compute
+// Reference implementations of the atlas operators in cuda_gvdb_operators.cuh.
+// They work on the CPU atlases (x fastest, getSize(type) bytes per voxel) with
+// bricks split across threads. Stencil operators read from a copy of the channel,
+// so unlike the in-place kernels the result does not depend on scheduling.
+
+static inline uint HashCPU ( uint x )
+{
+	x += ( x << 10u );	x ^= ( x >>  6u );
+	x += ( x <<  3u );	x ^= ( x >> 11u );
+	x += ( x << 15u );
+	return x;
+}
+// Same sequence as random(float3) in cuda_gvdb.cuh
+static inline float RandomCPU ( float x, float y, float z )
+{
+	uint ix, iy, iz, m;
+	memcpy ( &ix, &x, sizeof(uint) ); memcpy ( &iy, &y, sizeof(uint) ); memcpy ( &iz, &z, sizeof(uint) );
+	m = HashCPU ( ix ^ HashCPU(iy) ^ HashCPU(iz) );
+	m = (m & 0x007FFFFFu) | 0x3F800000u;
+	float f;
+	memcpy ( &f, &m, sizeof(float) );
+	return f - 1.0f;
+}
+// Atlas index of the six face neighbors of voxel v (clamped to the atlas)
+static inline void StencilCPU ( const Vector3DI& v, const Vector3DI& res, uint64 n, uint64* o )
+{
+	uint64 sy = res.x, sz = uint64(res.x) * res.y;
+	o[0] = (v.x > 0) ? n-1 : n;			o[1] = (v.x < res.x-1) ? n+1 : n;
+	o[2] = (v.y > 0) ? n-sy : n;		o[3] = (v.y < res.y-1) ? n+sy : n;
+	o[4] = (v.z > 0) ? n-sz : n;		o[5] = (v.z < res.z-1) ? n+sz : n;
+}
+// Run func(thread, atlas voxel, voxel index) over the interior (non-apron)
+// voxels of every brick in a channel
+template <class Func>
+static void ForAtlasInterior ( Allocator* pool, uchar chan, Func func )
+{
+	DataPtr atlas = pool->getAtlas ( chan );
+	Vector3DI res = pool->getAtlasRes ( chan );
+	int brickwid = pool->getAtlasBrickwid ( chan );
+	int bricks = atlas.subdim.x * atlas.subdim.y * atlas.subdim.z;
+
+	ParallelChunks ( bricks, NumThreadsCPU(), [&] ( int t, int start, int end ) {
+		Vector3DI c, v;
+		uint64 n;
+		for (int b=start; b < end; b++ ) {
+			c = pool->getAtlasPos ( chan, b );				// first interior voxel
+			for (v.z=c.z; v.z < c.z+brickwid; v.z++ )
+				for (v.y=c.y; v.y < c.y+brickwid; v.y++ ) {
+					n = (uint64(v.z)*res.y + v.y)*res.x + c.x;
+					for (v.x=c.x; v.x < c.x+brickwid; v.x++, n++ )
+						func ( t, v, n );
+				}
+		}
+	} );
+}
+
+void VolumeGVDB::UseCPUCompute ( bool tf )
+{
+	if ( mbUseCPUCompute == tf ) return;
+	if ( !tf && mPool != 0x0 && mPool->isCPUOnly() ) {
+		gprintf ( "ERROR: UseCPUCompute. GVDB was initialized without a CUDA device.\n" );
+		return;
+	}
+	mbUseCPUCompute = tf;
+	if ( mPool == 0x0 ) return;
+
+	PUSH_CTX
+	for (int n=0; n < mPool->getNumAtlas(); n++ ) {
+		if ( tf )	mPool->AtlasFetch ( n );			// CPU atlases take over
+		else		mPool->AtlasCommit ( n );			// hand results back to the GPU
+	}
+	POP_CTX
+}
+
+void VolumeGVDB::ComputeCPU ( int effect, uchar channel, int num_iterations, Vector3DF parameters, bool bUpdateApron, float boundval )
+{
+	DataPtr atlas = mPool->getAtlas ( channel );
+	if ( atlas.cpu == 0x0 ) {
+		gprintf ( "ERROR: ComputeCPU. Channel %d has no CPU atlas.\n", channel );
+		return;
+	}
+	// Operator input type
+	uchar dtype;
+	switch ( effect ) {
+	case FUNC_FILL_F: case FUNC_SMOOTH: case FUNC_NOISE: case FUNC_GROW:	dtype = T_FLOAT;	break;
+	case FUNC_FILL_C: case FUNC_EXPANDC:									dtype = T_UCHAR;	break;
+	case FUNC_FILL_C4: case FUNC_CLR_EXPAND:								dtype = T_UCHAR4;	break;
+	default:
+		gprintf ( "ERROR: ComputeCPU. Effect %d has no CPU implementation.\n", effect );
+		return;
+	}
+	if ( atlas.type != dtype ) {
+		gprintf ( "ERROR: ComputeCPU. Effect %d does not match type of channel %d.\n", effect, channel );
+		return;
+	}
+
+	PERF_PUSH ( "Compute (CPU)" );
+
+	Vector3DI res = mPool->getAtlasRes ( channel );
+	uint64 sy = res.x, sz = uint64(res.x) * res.y;
+	float p1 = parameters.x, p2 = parameters.y, p3 = parameters.z;
+	std::vector<char> copy;
+
+	for (int iter=0; iter < num_iterations; iter++ ) {
+
+		switch ( effect ) {
+		case FUNC_FILL_F: case FUNC_FILL_C: case FUNC_FILL_C4: {
+			// Fills cover the whole atlas, aprons included
+			ParallelChunks ( res.z, NumThreadsCPU(), [&] ( int t, int start, int end ) {
+				for (int z=start; z < end; z++ )
+					for (int y=0; y < res.y; y++ ) {
+						uint64 n = z*sz + y*sy;
+						if ( effect == FUNC_FILL_C ) {
+							memset ( atlas.cpu + n, static_cast<uchar>(p1), res.x );
+						} else if ( effect == FUNC_FILL_C4 ) {
+							uint c = (255u << 24) | (uint(p3*255.0f) << 16) | (uint(p2*255.0f) << 8) | uint(p1*255.0f);
+							uint* dst = (uint*) atlas.cpu + n;
+							for (int x=0; x < res.x; x++ ) dst[x] = c;
+						} else {
+							float* dst = (float*) atlas.cpu + n;
+							for (int x=0; x < res.x; x++ )
+								dst[x] = (p3 < 0) ? sinf( float(x*12 / (3.141592*30.0)) ) + sinf( float(y*12 / (3.141592*30.0)) ) + sinf( float(z*12 / (3.141592*30.0)) ) : p1;
+						}
+					}
+			} );
+		} break;
+		case FUNC_SMOOTH: {
+			copy.assign ( atlas.cpu, atlas.cpu + atlas.size );
+			const float* src = (const float*) copy.data();
+			float* dst = (float*) atlas.cpu;
+			ForAtlasInterior ( mPool, channel, [&] ( int t, const Vector3DI& v, uint64 n ) {
+				uint64 o[6];
+				StencilCPU ( v, res, n, o );
+				float s = p1 * src[n] + src[o[0]] + src[o[1]] + src[o[2]] + src[o[3]] + src[o[4]] + src[o[5]];
+				dst[n] = float( s / (p1 + 6.0) + p2 );
+			} );
+		} break;
+		case FUNC_NOISE: {
+			float* dst = (float*) atlas.cpu;
+			ForAtlasInterior ( mPool, channel, [&] ( int t, const Vector3DI& v, uint64 n ) {
+				if ( dst[n] > 0.01f ) dst[n] += RandomCPU ( float(v.x), float(v.y), float(v.z) ) * p1;
+			} );
+		} break;
+		case FUNC_GROW: {
+			float* dst = (float*) atlas.cpu;
+			ForAtlasInterior ( mPool, channel, [&] ( int t, const Vector3DI& v, uint64 n ) {
+				float s = dst[n];
+				if ( s != 0.0f ) s += p1 * 10.0f;
+				dst[n] = ( s < 0.01f ) ? 0.0f : s;
+			} );
+		} break;
+		case FUNC_CLR_EXPAND: {
+			copy.assign ( atlas.cpu, atlas.cpu + atlas.size );
+			const uchar* src = (const uchar*) copy.data();
+			uchar* dst = (uchar*) atlas.cpu;
+			int w1 = int(p1), w2 = int(p2);
+			ForAtlasInterior ( mPool, channel, [&] ( int t, const Vector3DI& v, uint64 n ) {
+				uint64 o[6];
+				StencilCPU ( v, res, n, o );
+				int cs[3];
+				for (int k=0; k < 3; k++ ) {
+					cs[k] = src[n*4+k] * w1;
+					for (int j=0; j < 6; j++ ) cs[k] += src[o[j]*4+k] * w2;
+				}
+				int cp = std::max ( cs[0], std::max ( cs[1], cs[2] ) );
+				for (int k=0; k < 3; k++ )
+					dst[n*4+k] = uchar( (cp > 255) ? cs[k]*255/cp : cs[k] );
+				dst[n*4+3] = 1;
+			} );
+		} break;
+		case FUNC_EXPANDC: {
+			copy.assign ( atlas.cpu, atlas.cpu + atlas.size );
+			const uchar* src = (const uchar*) copy.data();
+			uchar* dst = (uchar*) atlas.cpu;
+			uchar match = static_cast<uchar>(p1), val = static_cast<uchar>(p2);
+			ForAtlasInterior ( mPool, channel, [&] ( int t, const Vector3DI& v, uint64 n ) {
+				if ( src[n] != 0 ) return;
+				uint64 o[6];
+				StencilCPU ( v, res, n, o );
+				for (int j=0; j < 6; j++ )
+					if ( src[o[j]] == match ) { dst[n] = val; return; }
+			} );
+		} break;
+		}
+
+		if ( bUpdateApron ) UpdateApronCPU ( channel, boundval );
+	}
+
+	PERF_POP ();
+}
+
+// Fill every apron voxel from the brick that owns its position, or with
+// boundval where no brick exists. Unlike the kernel, any apron width works.
+void VolumeGVDB::UpdateApronCPU ( uchar chan, float boundval )
+{
+	DataPtr atlas = mPool->getAtlas ( chan );
+	if ( atlas.cpu == 0x0 ) {
+		gprintf ( "ERROR: UpdateApronCPU. Channel %d has no CPU atlas.\n", chan );
+		return;
+	}
+	int apron = atlas.apron;
+	int bricks = static_cast<int>(mPool->getPoolTotalCnt(0,0));
+	if ( apron == 0 || bricks == 0 || mRoot == ID_UNDEFL ) return;
+
+	PERF_PUSH ( "UpdateApron (CPU)" );
+
+	// Boundary value in the channel format
+	int esize = mPool->getSize ( atlas.type );
+	uchar bound[16];
+	switch ( atlas.type ) {
+	case T_UCHAR: case T_UCHAR3: case T_UCHAR4:
+		memset ( bound, static_cast<uchar>(boundval), esize );
+		break;
+	case T_INT: case T_INT3: case T_INT4: {
+		int ival = int(boundval);
+		for (int i=0; i < esize; i += sizeof(int) ) memcpy ( bound+i, &ival, sizeof(int) );
+	} break;
+	default:
+		for (int i=0; i < esize; i += sizeof(float) ) memcpy ( bound+i, &boundval, sizeof(float) );
+		break;
+	}
+
+	Vector3DI res = mPool->getAtlasRes ( chan );
+	int brickwid = mPool->getAtlasBrickwid ( chan );
+	int brickres = mPool->getAtlasBrickres ( chan );
+	Vector3DI range0 = getRange(0);
+	char* dat = atlas.cpu;
+
+	ParallelChunks ( bricks, NumThreadsCPU(), [&] ( int t, int start, int end ) {
+		Node* nbr[27];
+		Vector3DI l, r, d, a, base;
+		for (int b=start; b < end; b++ ) {
+			Node* node = getNode ( 0, 0, b );
+			if ( !node->mFlags ) continue;
+
+			// Leaves around this brick, indexed by direction
+			for (int k=0; k < 27; k++ ) {
+				d.Set ( k % 3 - 1, (k / 3) % 3 - 1, k / 9 - 1 );
+				Vector3DF p ( float(node->mPos.x + d.x*range0.x) + 0.5f, float(node->mPos.y + d.y*range0.y) + 0.5f, float(node->mPos.z + d.z*range0.z) + 0.5f );
+				uint64 id = getNodeAtPoint ( mRoot, p );
+				nbr[k] = ( id == ID_UNDEFL ) ? 0x0 : getNode ( id );
+				if ( nbr[k] != 0x0 && !nbr[k]->mFlags ) nbr[k] = 0x0;
+			}
+			base.Set ( node->mValue.x - apron, node->mValue.y - apron, node->mValue.z - apron );
+
+			for (l.z=0; l.z < brickres; l.z++ )
+				for (l.y=0; l.y < brickres; l.y++ ) {
+					bool inner = ( l.y >= apron && l.y < apron+brickwid && l.z >= apron && l.z < apron+brickwid );
+					for (l.x=0; l.x < brickres; l.x++ ) {
+						if ( inner && l.x == apron ) l.x += brickwid;		// skip brick interior
+						r.Set ( l.x - apron, l.y - apron, l.z - apron );
+						d.Set ( (r.x < 0) ? -1 : (r.x >= brickwid), (r.y < 0) ? -1 : (r.y >= brickwid), (r.z < 0) ? -1 : (r.z >= brickwid) );
+						Node* src = nbr[ (d.z+1)*9 + (d.y+1)*3 + d.x+1 ];
+						char* dst = dat + esize * ( (uint64(base.z + l.z)*res.y + base.y + l.y)*res.x + base.x + l.x );
+						if ( src == 0x0 ) {
+							memcpy ( dst, bound, esize );
+						} else {
+							a.Set ( src->mValue.x + r.x - d.x*brickwid, src->mValue.y + r.y - d.y*brickwid, src->mValue.z + r.z - d.z*brickwid );
+							memcpy ( dst, dat + esize * ( (uint64(a.z)*res.y + a.y)*res.x + a.x ), esize );
+						}
+					}
+				}
+		}
+	} );
+
+	PERF_POP ();
+}
+
+Vector3DF VolumeGVDB::ReductionCPU ( uchar chan )
+{
+	DataPtr atlas = mPool->getAtlas ( chan );
+	if ( atlas.cpu == 0x0 || atlas.type != T_FLOAT ) {
+		gprintf ( "ERROR: ReductionCPU. Channel %d is not a float CPU atlas.\n", chan );
+		return Vector3DF(0, 0, 0);
+	}
+	if (mbProfile) PERF_PUSH ( "Reduction (CPU)" );
+
+	const float* dat = (const float*) atlas.cpu;
+	std::vector<double> sum ( NumThreadsCPU(), 0.0 );
+	ForAtlasInterior ( mPool, chan, [&] ( int t, const Vector3DI& v, uint64 n ) {
+		sum[t] += dat[n];
+	} );
+	double total = 0.0;
+	for (size_t t=0; t < sum.size(); t++ ) total += sum[t];
+
+	if (mbProfile) PERF_POP ();
+
+	return Vector3DF( float(total), 0, 0 );
+}
+
+void VolumeGVDB::ResampleCPU ( uchar chan, Matrix4F xform, Vector3DI in_res, char in_aux, Vector3DF inr, Vector3DF outr )
+{
+	DataPtr atlas = mPool->getAtlas ( chan );
+	const float* src = (const float*) mAux[in_aux].cpu;
+	if ( atlas.cpu == 0x0 || atlas.type != T_FLOAT || src == 0x0 ) {
+		gprintf ( "ERROR: ResampleCPU. Needs a float CPU atlas and CPU data in aux %d.\n", in_aux );
+		return;
+	}
+	PERF_PUSH ( "Resample (CPU)" );
+
+	const float* m = xform.GetDataF();
+	Vector3DI res = mPool->getAtlasRes ( chan );
+	int apron = atlas.apron;
+	int brickres = mPool->getAtlasBrickres ( chan );
+	int bricks = atlas.subdim.x * atlas.subdim.y * atlas.subdim.z;
+	float* dst = (float*) atlas.cpu;
+
+	ParallelChunks ( bricks, NumThreadsCPU(), [&] ( int t, int start, int end ) {
+		Vector3DI c, l, ndx;
+		Vector3DF w;
+		for (int b=start; b < end; b++ ) {
+			c = mPool->getAtlasPos ( chan, b );
+			AtlasNode* an = (AtlasNode*) mPool->getAtlasMapNode ( chan, c );
+			if ( an->mLeafNode == (int) ID_UNDEFL ) continue;			// brick not in use
+			c.Set ( c.x - apron, c.y - apron, c.z - apron );
+			for (l.z=0; l.z < brickres; l.z++ )
+				for (l.y=0; l.y < brickres; l.y++ )
+					for (l.x=0; l.x < brickres; l.x++ ) {
+						// index-space voxel, transformed to src index
+						w.Set ( float(an->mPos.x + l.x - apron), float(an->mPos.y + l.y - apron), float(an->mPos.z + l.z - apron) );
+						ndx.x = (int) ( w.x * m[0] + w.y * m[4] + w.z * m[8] + m[12] );
+						ndx.y = (int) ( w.x * m[1] + w.y * m[5] + w.z * m[9] + m[13] );
+						ndx.z = (int) ( w.x * m[2] + w.y * m[6] + w.z * m[10] + m[14] );
+						if ( ndx.x < 0 || ndx.y < 0 || ndx.z < 0 || ndx.x >= in_res.x || ndx.y >= in_res.y || ndx.z >= in_res.z )
+							continue;
+						float v = src[ (uint64(ndx.z)*in_res.y + ndx.y)*in_res.x + ndx.x ];
+						v = outr.x + (v-inr.x)*(outr.y-outr.x)/(inr.y-inr.x);		// remap value
+						dst[ (uint64(c.z + l.z)*res.y + c.y + l.y)*res.x + c.x + l.x ] = v;
+					}
+		}
+	} );
+
+	PERF_POP ();
+}
+
 uint64 VolumeGVDB::getNodeAtPoint (uint64 nodeid, Vector3DF pos)
 {
 	// Recurse to find node	
@@ -4665,10 +6193,9 @@ uint64 VolumeGVDB::getNodeAtPoint (uint64 nodeid, Vector3DF pos)
 		} else {
 #ifdef USE_BITMASKS			
 			uint32 i = getBitPos(curr->mLev, p);
-			uint32 b = curr->countOn(i);
 			slong childid;
-			if (curr->isOn(i)) {
-				childid = getChildNode(nodeid, b);
+			if (isOn(curr, i)) {
+				childid = getChildNode(nodeid, i);
 				return getNodeAtPoint( childid, pos);
 			}
 #else
@@ -4735,10 +6262,9 @@ float VolumeGVDB::getValue ( slong nodeid, Vector3DF pos, float* atlas )
 		} else {
 #ifdef USE_BITMASKS			
 			uint32 i = getBitPos ( curr->mLev, p );
-			uint32 b = curr->countOn ( i );
 			slong childid;			
-			if ( curr->isOn ( i ) ) {
-				childid = getChildNode ( nodeid, b );
+			if ( isOn ( curr, i ) ) {
+				childid = getChildNode ( nodeid, i );
 				return getValue ( childid, pos, atlas );
 			}		
 #else
@@ -4754,6 +6280,141 @@ float VolumeGVDB::getValue ( slong nodeid, Vector3DF pos, float* atlas )
 	return 0.0;	
 }
 
+// Voxel accessor
+VoxelAccessor::VoxelAccessor ( VolumeGVDB* gvdb, uchar chan, float* atlas )
+{
+	mGVDB = gvdb;
+	mChan = chan;
+	mAtlas = atlas;
+	if ( mAtlas == 0x0 && chan < gvdb->mPool->getNumAtlas() )			// no channel: topology queries only
+		mAtlas = (float*) gvdb->mPool->getAtlasCPU ( chan );
+	Reset ();
+}
+
+// Re-read tree layout and clear the cached path
+void VoxelAccessor::Reset ()
+{
+	mTop = -1;
+	mLow = MAXLEV;
+	if ( mChan < mGVDB->mPool->getNumAtlas() ) mAtlasRes = mGVDB->mPool->getAtlasRes ( mChan );
+	int shift = 0;
+	for (int lev = 0; lev < mGVDB->GetLevels(); lev++ ) {
+		mLogRes[lev] = mGVDB->getLD ( lev );
+		shift += mLogRes[lev];
+		mShift[lev] = shift;
+	}
+	slong root = mGVDB->getRoot ();
+	if ( root == ID_UNDEFL ) return;
+	mPath[0] = mGVDB->getNode ( root );			// root may sit below the top level
+	mTop = mPath[0]->mLev;
+	mPathID[mTop] = root;
+	mPath[mTop] = mPath[0];
+	mLow = mTop;
+}
+
+slong VoxelAccessor::getLeaf ( Vector3DI pos )
+{
+	if ( mLow > mTop ) return ID_UNDEFL;
+
+	// Walk up to the lowest cached node containing pos
+	int lev = mLow;
+	for (; lev <= mTop; lev++ ) {
+		Vector3DI& np = mPath[lev]->mPos;
+		uint range = uint(1) << mShift[lev];
+		if ( uint(pos.x - np.x) < range && uint(pos.y - np.y) < range && uint(pos.z - np.z) < range ) break;
+	}
+	if ( lev > mTop ) { mLow = mTop; return ID_UNDEFL; }
+
+	// Descend from there, extending the cached path
+	for (; lev > 0; lev-- ) {
+		Node* curr = mPath[lev];
+		int s = mShift[lev-1], r = mLogRes[lev];
+		uint b = ( ( ( uint(pos.z - curr->mPos.z) >> s ) << r | ( uint(pos.y - curr->mPos.y) >> s ) ) << r ) | ( uint(pos.x - curr->mPos.x) >> s );
+#ifdef USE_BITMASKS
+		if ( !mGVDB->isOn ( curr, b ) ) { mLow = lev; return ID_UNDEFL; }
+#endif
+		uint64 child = mGVDB->getChildRefAtBit ( curr, b );
+		if ( child == ID_UNDEF64 ) { mLow = lev; return ID_UNDEFL; }
+		mPathID[lev-1] = child;
+		mPath[lev-1] = mGVDB->getNode ( child );
+	}
+	mLow = 0;
+	return mPathID[0];
+}
+
+bool VoxelAccessor::probeValue ( Vector3DI pos, float& val )
+{
+	if ( getLeaf ( pos ) == ID_UNDEFL ) return false;
+	Node* leaf = mPath[0];
+	if ( leaf->mValue.x == -1 ) return false;				// leaf without a brick
+	Vector3DI a = leaf->mValue + ( pos - leaf->mPos );
+	val = mAtlas [ ( slong(a.z)*mAtlasRes.y + a.y )*mAtlasRes.x + a.x ];
+	return true;
+}
+
+float VoxelAccessor::getValue ( Vector3DF pos )
+{
+	float val;
+	Vector3DI p ( int(floorf(pos.x)), int(floorf(pos.y)), int(floorf(pos.z)) );
+	return probeValue ( p, val ) ? val : 0.0f;
+}
+
+// Spread the low 21 bits of v to every third bit
+static inline uint64 MortonSpread ( uint64 v )
+{
+	v &= 0x1FFFFF;
+	v = ( v | v << 32 ) & 0x1F00000000FFFFULL;
+	v = ( v | v << 16 ) & 0x1F0000FF0000FFULL;
+	v = ( v | v << 8 ) & 0x100F00F00F00F00FULL;
+	v = ( v | v << 4 ) & 0x10C30C30C30C30C3ULL;
+	v = ( v | v << 2 ) & 0x1249249249249249ULL;
+	return v;
+}
+
+// Batch lookup. Queries are visited in Morton order of their leaf brick, so consecutive
+// queries share most of the cached path; results are written in the input order.
+// The order comes from an LSD radix sort that skips bytes shared by every key,
+// as in SortUniqueKeys, so a compact query set costs only a few passes.
+void VoxelAccessor::getValues ( int num, const Vector3DF* pos, float* out )
+{
+	if ( num <= 0 ) return;
+	int s = mShift[0];
+	std::vector<uint64> key ( num ), ktmp ( num );
+	std::vector<int> ndx ( num ), ntmp ( num );
+	for (int n=0; n < num; n++ ) {
+		uint64 x = uint64( int(floorf(pos[n].x)) + TOPO_KEY_BIAS ) >> s;
+		uint64 y = uint64( int(floorf(pos[n].y)) + TOPO_KEY_BIAS ) >> s;
+		uint64 z = uint64( int(floorf(pos[n].z)) + TOPO_KEY_BIAS ) >> s;
+		key[n] = MortonSpread(x) | MortonSpread(y) << 1 | MortonSpread(z) << 2;
+		ndx[n] = n;
+	}
+	uint64 *ksrc = key.data(), *kdst = ktmp.data();
+	int *nsrc = ndx.data(), *ndst = ntmp.data();
+	int hist[256];
+	for (int shift=0; shift < 64; shift += 8 ) {
+		memset ( hist, 0, sizeof(hist) );
+		for (int n=0; n < num; n++ ) hist[ (ksrc[n] >> shift) & 0xFF ]++;
+		if ( hist[ (ksrc[0] >> shift) & 0xFF ] == num ) continue;		// every key shares this byte
+		for (int d=0, total=0; d < 256; d++ ) { int c = hist[d]; hist[d] = total; total += c; }
+		for (int n=0; n < num; n++ ) {
+			int dst = hist[ (ksrc[n] >> shift) & 0xFF ]++;
+			kdst[dst] = ksrc[n];
+			ndst[dst] = nsrc[n];
+		}
+		std::swap ( ksrc, kdst );
+		std::swap ( nsrc, ndst );
+	}
+
+	int threads = ( num < 65536 ) ? 1 : NumThreadsCPU();
+	ParallelChunks ( num, threads, [&] ( int t, int start, int end ) {
+		VoxelAccessor acc = *this;
+		for (int i = start; i < end; i++ ) {
+			int n = nsrc[i];
+			out[n] = acc.getValue ( pos[n] );
+		}
+	} );
+}
+
 #define SCAN_BLOCKSIZE		512				// <--- must match cuda_gvdb_particles.cuh header
 #define ONE_LEVEL			0
 
@@ -5722,16 +7383,16 @@ void VolumeGVDB::PrintPool(uchar grp, uchar lev)
 		
 #ifdef USE_BITMASKS	
 		if ((int)lev > 0) {
-			std::cout << "      mMask: " << nd->countOn() << std::endl;
+			std::cout << "      mMask: " << countOn(nd) << std::endl;
 			uint64* w1 = (uint64*) &nd->mMask;
-			uint64* we = (uint64*) &nd->mMask + nd->getMaskWords();
+			uint64* we = (uint64*) &nd->mMask + getMaskWords(nd);
 			
 		}
 		std::cout << "   Parent ID:" << nd->mParent << std::endl;
 		std::cout << "   Childlist address:" << (int)nd->mChildList << std::endl;
 		std::cout << "   Child ID:" << std::endl;
 		if ((int)nd->mChildList > 0) {
-			int numChild = nd->countOn();
+			int numChild = countOn(nd);
 			uint64* clist = mPool->PoolData64 ( nd->mChildList );
 			std::cout << "   ";
 			for (int i = 0; i < numChild; i++)
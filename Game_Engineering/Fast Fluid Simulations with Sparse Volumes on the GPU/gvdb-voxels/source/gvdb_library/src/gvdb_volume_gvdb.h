@@ -43,6 +43,8 @@
 
 	namespace nvdb {
 
+	class VBXPager;
+
 	struct AtlasNode {
 		Vector3DI	mPos;	
 		int			mLeafNode;
@@ -363,6 +365,22 @@
 			void Resample ( uchar chan, Matrix4F xform, Vector3DI in_res, char in_aux, Vector3DF inr, Vector3DF outr );			
 			Vector3DF Reduction(uchar chan);
 			void DownsampleCPU(Matrix4F xform, Vector3DI in_res, char in_aux, Vector3DI out_res, Vector3DF out_max, char out_aux, Vector3DF inr, Vector3DF outr);
+
+			// CPU reference backend
+			// When enabled, Compute, UpdateApron, Reduction, Resample, SolidVoxelize and
+			// DownsampleCPU run multi-threaded on the CPU atlases (DataPtr::cpu) and launch no kernels.
+			// They read the CPU node pool and atlas map, so topology built on the GPU
+			// must be fetched first (FetchPoolCPU). Enabling fetches existing channels
+			// to the CPU; disabling commits them back to the GPU.
+			// Enabled before SetCudaDevice, GVDB runs host-only: no CUDA context is created,
+			// no kernels are loaded and pools, atlases and aux buffers live in host memory.
+			void UseCPUCompute ( bool tf );
+			bool isCPUCompute ()		{ return mbUseCPUCompute; }
+			void ComputeCPU ( int effect, uchar channel, int num_iterations, Vector3DF parameters, bool bUpdateApron, float boundval );
+			void UpdateApronCPU ( uchar chan, float boundval );
+			Vector3DF ReductionCPU ( uchar chan );
+			void ResampleCPU ( uchar chan, Matrix4F xform, Vector3DI in_res, char in_aux, Vector3DF inr, Vector3DF outr );
+			void SolidVoxelizeCPU ( uchar chan, Model* model, Matrix4F* xform, float val_surf, float val_inside );
 			
 			// File I/O
 			bool LoadBRK ( std::string fname );
@@ -371,14 +389,21 @@
 			// This can also read Vec3 grids, but vectors are converted
 			// to their magnitudes and stored as floats.
 			bool LoadVDB ( std::string fname );
-			bool LoadVBX ( const std::string fname, int force_maj=0, int force_min=0 );
-			void SaveVBX ( const std::string fname );
+			bool LoadVBX ( const std::string fname, int force_maj=0, int force_min=0, VBXPager* lazy=0x0 );		// lazy: topology only, see gvdb_vbx_pager.h
+			void SaveVBX ( const std::string fname, bool compress = false );		// compress: per-brick LZ atlas (grid_compress 2)
 			// Saves channel 0 of the current volume as an OpenVDB file, which must have
 			// the T_FLOAT format. Supports <5, 4, 3> and <3, 3, 3, 4> grids, which are
 			// chosen automatically. 
 			void SaveVDB ( std::string fname );
 			bool ImportVTK ( std::string fname, std::string field, Vector3DI& res );
-			void WriteObj ( char* fname );
+			// Streams a headerless RAW volume (x fastest; bpp 1=uchar, 2=ushort, 4=float) into T_FLOAT
+			// channel chan, remapping values from inr to outr. Reads brick-high z-slabs with the next slab
+			// read ahead, and activates only bricks with a value above thresh. Rebuilds the topology.
+			bool LoadRAW ( const std::string fname, Vector3DI res, int bpp, uchar chan, float thresh, Vector3DF inr, Vector3DF outr );
+			void WriteObj ( char* fname );				// isosurface of channel 0 at the scene iso value
+			// Writes the isosurface of a T_FLOAT channel at 'thresh' as .obj, or binary .ply by extension.
+			// Uses the CPU atlas (read back from the GPU if needed); the apron must be up to date.
+			bool WriteMesh ( std::string fname, uchar chan, float thresh );
 			void AddPath ( const char* path );
 			bool FindFile ( std::string fname, char* path );		
 			void ConvertBitmaskToNonBitmask(int levs);
@@ -410,6 +435,9 @@
 			void SetColorChannel ( uchar chan );
 			// API-facing version of Allocator::AtlasRetrieveBrickXYZ.
 			void AtlasRetrieveBrickXYZ(uchar channel, Vector3DI minimumCorner, DataPtr& dest);
+			// Whole atlas of a channel on the host, x fastest, aprons included. Returns the CPU
+			// atlas in CPU compute mode, else copies the GPU atlas into buf. 0x0 if no channel.
+			const uchar* AtlasRetrieveCPU ( uchar chan, std::vector<uchar>& buf, Vector3DI& res, int& stride );
 
 			void SetBounds(Vector3DF pMin, Vector3DF pMax);
 
@@ -428,11 +456,13 @@
 
 			void RebuildTopology(int pNumPnts, float pRadius, Vector3DF pOrig);
 			void RebuildTopologyCPU(int pNumPnts, Vector3DF pOrig, Vector3DF* pPos);
+			bool BuildTopologyCPU(std::vector<uint64>& leafkeys, int threads);
 			void AccumulateTopology(int pNumPnts, float pRadius, Vector3DF pOrig, int iDepth=1 );
 			void RequestFullRebuild(bool tf) { mRebuildTopo = tf;  }
 			void SetDiv ( DataPtr div );
 
 			int GetLevels() { return mPool->getNumLevels(); }
+			slong getRoot() { return mRoot; }
 
 			void ReadGridVel( int N);
 			void CheckVal ( float slice, int chanVx, int chanVy, int chanVz, int chanVxOld, int chanVyOld, int chanVzOld );
@@ -571,6 +601,10 @@
 			void enableVerts ( int*& vgToVert, std::vector<Vector3DF>& verts, Vector3DF vm, int gv[] );
 			void writeCube ( FILE* fp, unsigned char vpix[], slong& numfaces, int gv[], int*& vgToVert, slong vbase );
 
+			// VBX compressed atlas
+			void WriteAtlasBricks ( FILE* fp, uchar chan );
+			bool ReadAtlasBricks ( FILE* fp, uchar chan );
+
 			// Helpers
 			void CommitTransferFunc ();
 			void TimerStart ();
@@ -580,6 +614,7 @@
 			// VDB Access
 			bool isOn (slong nodeid, uint32 n );
 			uint64 getMaskSize(int lev)	{ uint64 sz = getVoxCnt(lev) / 8; return (lev==0) ? 0 : ((sz < 8 ) ? 8 : sz); }		// Mask Size of level						
+			uint64 getPrefixSize(int lev)	{ return ((getMaskSize(lev) / 8) * sizeof(uint32) + 7) & ~uint64(7); }	// Prefix table size of level
 
 			// VDB Configuration			
 			void SetVDBConfig ( int lev, int i )		{ mVCFG[lev] = i; }
@@ -678,6 +713,26 @@
 			uint64	getMaskWords(Node* node) { int r = getRes(node->mLev); return imax(((uint64)r*r*r) >> 6, 1); }		// divide by bits per 64-bit word (2^6=64)			
 			uint64* getMask(Node* node)		{ return (uint64*) &node->mMask; }
 			int		getNumChild(Node* node) { return (node->mLev == 0) ? 0 : countOn( node ); }
+
+			// Mask prefix table (USE_BITMASKS). Stored after the mask, entry w holds the number
+			// of bits on in mask words [0,w), so the child index of bit b is one table load
+			// plus one popcount. Rebuilt in FinishTopology, kept current by setChildOn.
+			uint32* getMaskPrefix(Node* node)	{ return (uint32*) ((uint64*) &node->mMask + getMaskWords(node)); }
+			void	UpdateMaskPrefix(Node* node)
+			{
+				uint32* pre = getMaskPrefix(node);
+				uint64* w1 = (uint64*)&node->mMask;
+				uint64 words = getMaskWords(node);
+				uint32 sum = 0;
+				for (uint64 w = 0; w < words; w++) { pre[w] = sum; sum += (uint32) numBitsOn(w1[w]); }
+			}
+			void	setChildOn(Node* node, uint32 n)
+			{
+				setOn(node, n);
+				uint32* pre = getMaskPrefix(node);
+				uint64 words = getMaskWords(node);
+				for (uint64 w = (n >> 6) + 1; w < words; w++) pre[w]++;
+			}
 			
 			// Bit operations:
 			// Based on Bithacks (Sean Eron Anderson, http://graphics.stanford.edu/~seander/bithacks.html)
@@ -750,6 +805,9 @@
 			{
 				node->mMask = 0;
 				memset(&node->mMask, 0, getMaskBytes(node) );
+				#ifdef USE_BITMASKS
+					memset(getMaskPrefix(node), 0, getMaskWords(node) * sizeof(uint32) );
+				#endif
 			}
 			// set operator
 			void set ( Node* node, Node* op2) {
@@ -758,6 +816,9 @@
 				uint64* w2 = (uint64*)&op2->mMask;
 				for (; w1 != we; )
 					*w1++ = *w2++;
+				#ifdef USE_BITMASKS
+					UpdateMaskPrefix(node);
+				#endif
 			}			
 			bool isEqual ( Node* node, Node* op2)
 			{
@@ -770,22 +831,32 @@
 			}			
 			uint32 countOn( Node* node )
 			{
-				uint32 sum = 0;
-				uint64* w1 = (uint64*)&node->mMask;
-				uint64* we = (uint64*)&node->mMask + getMaskWords(node);
-				for (; w1 != we; ) sum += (int)numBitsOn(*w1++);
-				return sum;
+				#ifdef USE_BITMASKS
+					uint64 last = getMaskWords(node) - 1;
+					return getMaskPrefix(node)[last] + (uint32) numBitsOn(((uint64*)&node->mMask)[last]);
+				#else
+					uint32 sum = 0;
+					uint64* w1 = (uint64*)&node->mMask;
+					uint64* we = (uint64*)&node->mMask + getMaskWords(node);
+					for (; w1 != we; ) sum += (int)numBitsOn(*w1++);
+					return sum;
+				#endif
 			}
 			uint64 countOn( Node* node, uint32 b)
 			{
-				uint64 sum = 0;
-				uint64* w1 = (uint64*)&node->mMask;
-				uint64* we = (uint64*)&node->mMask + (b >> 6);
-				for (; w1 != we; ) sum += (int)numBitsOn(*w1++);
-				uint64 w2 = *w1;
-				w2 = w2 & ((uint64(1) << (b & 63)) - 1);
-				sum += numBitsOn(w2);
-				return sum;
+				#ifdef USE_BITMASKS
+					uint64 w = ((uint64*)&node->mMask)[b >> 6] & ((uint64(1) << (b & 63)) - 1);
+					return getMaskPrefix(node)[b >> 6] + numBitsOn(w);
+				#else
+					uint64 sum = 0;
+					uint64* w1 = (uint64*)&node->mMask;
+					uint64* we = (uint64*)&node->mMask + (b >> 6);
+					for (; w1 != we; ) sum += (int)numBitsOn(*w1++);
+					uint64 w2 = *w1;
+					w2 = w2 & ((uint64(1) << (b & 63)) - 1);
+					sum += numBitsOn(w2);
+					return sum;
+				#endif
 			}
 			uint64 countOff( Node* node ) { return getMaskBytes(node)*8 - countOn(node); }
 			uint32 countToIndex(Node* node, uint64 count)
@@ -806,6 +877,9 @@
 				uint64* w1 = (uint64*)&node->mMask;
 				uint64* we = (uint64*)&node->mMask + getMaskWords(node);
 				for (; w1 != we; ) *w1++ = val;
+				#ifdef USE_BITMASKS
+					UpdateMaskPrefix(node);
+				#endif
 			}
 			void setOn (Node* node, uint32 n)  { (&node->mMask)[n >> 6] |= uint64(1) << (n & 63); }
 			void setOff(Node* node, uint32 n)  { (&node->mMask)[n >> 6] &= ~(uint64(1) << (n & 63)); }			
@@ -823,6 +897,7 @@
 			Matrix4F		mXForm;
 			bool			mbGlew;
 			bool			mbUseGLAtlas;
+			bool			mbUseCPUCompute;
 			bool			mbDebug;
 			Vector3DI		mAtlasResize;
 			Vector3DI		mDefaultAxiscnt;
@@ -900,6 +975,34 @@
 #endif // #ifdef BUILD_OPENVDB
 		};
 
+	// Voxel accessor
+	// Random-access voxel lookup on the CPU atlas. The node path of the last query
+	// is cached, so a query in the same brick costs no traversal and a query in a
+	// neighboring brick only descends from the lowest shared node. Node pointers
+	// are cached too: call Reset after topology changes or pool growth.
+	// Each thread should use its own accessor.
+	class GVDB_API VoxelAccessor {
+	public:
+		VoxelAccessor ( VolumeGVDB* gvdb, uchar chan = 0, float* atlas = 0x0 );		// atlas defaults to the channel's CPU atlas
+		void	Reset ();
+		slong	getLeaf ( Vector3DI pos );								// leaf containing pos, or ID_UNDEFL
+		bool	probeValue ( Vector3DI pos, float& val );				// false if pos is in no brick
+		float	getValue ( Vector3DF pos );								// 0 outside bricks, as VolumeGVDB::getValue
+		void	getValues ( int num, const Vector3DF* pos, float* out );	// batch, queried in Morton order
+
+	private:
+		VolumeGVDB*	mGVDB;
+		uchar		mChan;
+		float*		mAtlas;
+		Vector3DI	mAtlasRes;
+		int			mTop;						// root level
+		int			mLow;						// lowest valid level in the path, > mTop if empty
+		int			mShift[MAXLEV];				// log2 of node range per level
+		int			mLogRes[MAXLEV];			// log2 of node res per level
+		slong		mPathID[MAXLEV];			// cached path, root to mLow
+		Node*		mPath[MAXLEV];
+	};
+
 	}
 
 #endif
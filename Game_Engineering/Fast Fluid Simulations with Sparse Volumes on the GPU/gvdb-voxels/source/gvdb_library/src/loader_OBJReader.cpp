@@ -11,35 +11,218 @@
 //-----------------------------------------------------------------------------
 
 #include "loader_OBJReader.h"
+#include "string_helper.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <GL/glew.h>
 #include <float.h>
 #include <string.h>
-
-struct OBJTri
-{
-	OBJTri() {}
-	int vIdx[3], nIdx[3];
-};
+#include <math.h>
+#include <thread>
 
 namespace {
 	inline int Max( int x, int y )         { return (x>y)?x:y; }
 	inline int Min( int x, int y )         { return (x<y)?x:y; }
 	inline float Max( float x, float y )   { return (x>y)?x:y; }
 	inline float Min( float x, float y )   { return (x<y)?x:y; }
-}
 
-// prototype from simpleParser.cpp
-char *StripLeadingTokenToBuffer( char *string, char *buf );
+	// One line-aligned piece of the file
+	struct OBJChunk {
+		const char	*start, *end;
+		size_t		numVerts, numNorms, numTris;		// counted in pass 1
+		size_t		baseVert, baseNorm, baseTri;		// offsets for pass 2
+		int			skipped;							// unknown keywords, corrupt faces
+		bool		normals, texCoords;
+	};
+
+	inline bool isSpace( char c )   { return c == ' ' || c == '\t' || c == '\r'; }
+
+	inline const char* SkipSpace( const char* p, const char* end )
+	{
+		while ( p < end && isSpace(*p) ) p++;
+		return p;
+	}
+	inline const char* SkipToken( const char* p, const char* end )
+	{
+		while ( p < end && !isSpace(*p) ) p++;
+		return p;
+	}
+	inline const char* LineEnd( const char* p, const char* end )
+	{
+		const char* e = (const char*) memchr( p, '\n', end - p );
+		return e ? e : end;
+	}
+
+	// Decimal float parser. Mantissas up to 2^53 with exponents within 1e22 are
+	// converted with one exact scaling (same result as strtod); anything else,
+	// including nan/inf, falls back to strtod.
+	const char* ParseFloat( const char* p, const char* end, float& out )
+	{
+		static const double pow10[23] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+		const char* start = p;
+		bool neg = false, any = false;
+		if ( p < end && (*p == '-' || *p == '+') ) neg = (*p++ == '-');
+		uint64 mant = 0;
+		int exp = 0;
+		for ( ; p < end && unsigned(*p - '0') < 10; p++, any = true ) {
+			if ( mant < 100000000000000000ULL ) mant = mant*10 + (*p - '0');
+			else exp++;
+		}
+		if ( p < end && *p == '.' ) {
+			for ( p++; p < end && unsigned(*p - '0') < 10; p++, any = true ) {
+				if ( mant < 100000000000000000ULL ) { mant = mant*10 + (*p - '0'); exp--; }
+			}
+		}
+		if ( any && p < end && (*p == 'e' || *p == 'E') ) {
+			const char* q = p + 1;
+			bool eneg = false;
+			if ( q < end && (*q == '-' || *q == '+') ) eneg = (*q++ == '-');
+			if ( q < end && unsigned(*q - '0') < 10 ) {
+				int e = 0;
+				for ( ; q < end && unsigned(*q - '0') < 10; q++ ) if ( e < 10000 ) e = e*10 + (*q - '0');
+				exp += eneg ? -e : e;
+				p = q;
+			}
+		}
+		if ( !any || (p < end && !isSpace(*p) && *p != '\n') ) {
+			char buf[64];
+			const char* e = SkipToken( start, end );
+			size_t n = Min( int(e - start), 63 );
+			memcpy( buf, start, n );
+			buf[n] = 0;
+			out = float( strtod( buf, 0x0 ) );
+			return e;
+		}
+		double v = double(mant);
+		if ( mant < (uint64(1) << 53) && exp >= -22 && exp <= 22 )
+			v = (exp < 0) ? v / pow10[-exp] : v * pow10[exp];
+		else
+			v = v * pow( 10.0, exp );
+		out = float( neg ? -v : v );
+		return p;
+	}
+
+	inline const char* ParseInt( const char* p, const char* end, int& out )
+	{
+		bool neg = false;
+		if ( p < end && (*p == '-' || *p == '+') ) neg = (*p++ == '-');
+		int v = 0;
+		for ( ; p < end && unsigned(*p - '0') < 10; p++ ) v = v*10 + (*p - '0');
+		out = neg ? -v : v;
+		return p;
+	}
+
+	// OBJ indices are 1-based, or relative to the current count when negative
+	inline int ResolveIndex( int idx, size_t count )
+	{
+		return idx > 0 ? idx - 1 : int(count) + idx;
+	}
+
+	enum { LINE_OTHER, LINE_VERT, LINE_NORM, LINE_FACE, LINE_UNKNOWN };
+
+	// Classify a line by its keyword; p is left after the keyword
+	inline int LineType( const char*& p, const char* le )
+	{
+		p = SkipSpace( p, le );
+		if ( p >= le || *p == '#' ) return LINE_OTHER;
+		const char* k = p;
+		p = SkipToken( p, le );
+		size_t len = p - k;
+		switch ( k[0] ) {
+		case 'v':
+			if ( len == 1 ) return LINE_VERT;
+			if ( len == 2 && k[1] == 'n' ) return LINE_NORM;
+			return LINE_OTHER;				// vt, vp: ignored
+		case 'f':
+			return ( len == 1 ) ? LINE_FACE : LINE_OTHER;		// 'fo' and friends are junk
+		case 'm': case 'o': case 'g': case 'u': case 's': case 'l':
+			return LINE_OTHER;				// materials, objects, groups, smoothing, lines
+		}
+		return LINE_UNKNOWN;
+	}
+
+	// Pass 1: count what the chunk will produce
+	void CountChunk( OBJChunk& c )
+	{
+		c.numVerts = c.numNorms = c.numTris = 0;
+		c.skipped = 0;
+		for ( const char* p = c.start; p < c.end; ) {
+			const char* le = LineEnd( p, c.end );
+			switch ( LineType( p, le ) ) {
+			case LINE_VERT:		c.numVerts++;	break;
+			case LINE_NORM:		c.numNorms++;	break;
+			case LINE_UNKNOWN:	c.skipped++;	break;
+			case LINE_FACE: {
+				int k = 0;
+				for ( p = SkipSpace( p, le ); p < le; p = SkipSpace( SkipToken( p, le ), le ) ) k++;
+				if ( k >= 3 ) c.numTris += k - 2;
+				else c.skipped++;						// fewer than three corners
+			} break;
+			}
+			p = le + 1;
+		}
+	}
+
+	// Pass 2: parse into the shared arrays at the chunk's offsets
+	void ParseChunk( OBJChunk& c, Vector3DF* verts, Vector3DF* norms, OBJTri* tris )
+	{
+		size_t nv = c.baseVert, nn = c.baseNorm, nt = c.baseTri;
+		c.normals = c.texCoords = false;
+		for ( const char* p = c.start; p < c.end; ) {
+			const char* le = LineEnd( p, c.end );
+			int type = LineType( p, le );
+			if ( type == LINE_VERT || type == LINE_NORM ) {
+				Vector3DF v( 0, 0, 0 );
+				p = ParseFloat( SkipSpace( p, le ), le, v.x );
+				p = ParseFloat( SkipSpace( p, le ), le, v.y );
+				p = ParseFloat( SkipSpace( p, le ), le, v.z );
+				if ( type == LINE_VERT )	verts[nv++] = v;
+				else						norms[nn++] = v;
+			} else if ( type == LINE_FACE ) {
+				int k = 0, vi, ti, ni;
+				int v0 = 0, n0 = -1, vp = 0, np = -1;
+				for ( p = SkipSpace( p, le ); p < le; p = SkipSpace( SkipToken( p, le ), le ), k++ ) {
+					// v, v/t, v//n or v/t/n
+					p = ParseInt( p, le, vi );
+					ni = 0;
+					if ( p < le && *p == '/' ) {
+						p++;
+						if ( p < le && *p != '/' && !isSpace(*p) ) { p = ParseInt( p, le, ti ); c.texCoords = true; }
+						if ( p < le && *p == '/' ) { p = ParseInt( p + 1, le, ni ); c.normals = true; }
+					}
+					int v = ResolveIndex( vi == 0 ? 1 : vi, nv );		// 0 is undefined; keep it readable
+					int n = ( ni == 0 ) ? -1 : ResolveIndex( ni, nn );
+					if ( k == 0 ) { v0 = v; n0 = n; }
+					else if ( k >= 2 ) {						// triangle fan
+						OBJTri& t = tris[nt++];
+						t.vIdx[0] = v0; t.vIdx[1] = vp; t.vIdx[2] = v;
+						t.nIdx[0] = n0; t.nIdx[1] = np; t.nIdx[2] = n;
+					}
+					vp = v; np = n;
+				}
+			}
+			p = le + 1;
+		}
+	}
+
+	template <class Func>
+	void ForEachChunk( std::vector<OBJChunk>& chunks, Func func )
+	{
+		std::vector<std::thread> pool;
+		for ( size_t i = 1; i < chunks.size(); i++ )
+			pool.push_back( std::thread( func, std::ref( chunks[i] ) ) );
+		func( chunks[0] );
+		for ( size_t i = 0; i < pool.size(); i++ )
+			pool[i].join();
+	}
+}
 
 OBJReader::OBJReader() :
 	m_hasNormals(false), m_hasVertices(false),                // These flags are set to true when we encounter a facet line in the OBJ that uses normals or verts
-	m_resize( false ), m_center( false ), m_guessNorms( true ), // These are usually parameters, but for this demo we have good defaults to hardcode.
-	m_numVertices(0), m_numNormals(0), m_numTris(0),          // We start having read in 0 normals, vertices, and triangles
-	m_triangles(0), m_normals(0), m_vertices(0),              // Set our arrays to NULL
-	m_allocVert(0), m_allocNorm(0), m_allocTri(0)	
+	m_hasTexCoords(false),
+	m_resize( false ), m_center( false ), m_guessNorms( true ) // These are usually parameters, but for this demo we have good defaults to hardcode.
 {
 }
 
@@ -50,9 +233,9 @@ OBJReader::~OBJReader()
 
 bool OBJReader::Cleanup ()
 {
-	if ( m_normals != 0 ) 	delete[] m_normals;
-	if ( m_vertices != 0 )	delete[] m_vertices;
-	if ( m_triangles != 0 )	free( m_triangles );
+	std::vector<Vector3DF>().swap( m_vertices );
+	std::vector<Vector3DF>().swap( m_normals );
+	std::vector<OBJTri>().swap( m_triangles );
 	return true;
 }
 
@@ -63,99 +246,24 @@ bool OBJReader::isMyFile( const char* filename )
 
 bool OBJReader::LoadFile ( Model* model, const char *filename, std::vector<std::string>& paths )
 {
-	ParseFile ( filename, paths );
-
-	// For clarity (later), we have a pointer to the Read_???_Token() method we will
-	//    use when reading a facet.  This will be set when we first see a 'f' line.
-	FnParserPtr fnFacetParsePtr = NULL;
-
-	// OK, we have a parser.  Now parse through the file
-	int lineCount = 0;
-	OBJTri *curTri = 0;
-	char *linePtr = 0, *mtlFilePtr = 0;
-	char keyword[64], vertToken[128];
-
-	while ( (linePtr = this->ReadNextLine()) != NULL )
-	{
-		// Each OBJ line starts with a keyword/keyletter
-		this->GetLowerCaseToken( keyword );
-		
-		switch( keyword[0] )
-		{
-		case 'v': 
-			if (keyword[1] == 'n')        // We found a normal!
-				AddNormal( this->GetVec3() ); // m_objNorms.Add( this->GetVec3() );
-			else if (keyword[1] == 't')   // Ignore texture coordinates in this demo
-				; 
-			else if (keyword[1] == 0 )    // We found a vertex!
-			{
-				AddVertex( this->GetVec3() ); // m_objVerts.Add( this->GetVec3() );  
-			}
-			break;
-		case 'm':  // For this simple demo... We're ignoring materials, so do nothing.
-		case 'o':  // For this simple demo... We're ignoring object designations, so do nothing.
-		case 'g':  // For this simple demo... We're ignoring group designations, so do nothing.
-		case 'u':  // For this simple demo... We're ignoring materials, so do nothing.
-		case 's':  // There's a smoothing command.  We're ignoring these.
-			break;
-		case 'f': // We found a facet!
-			if (keyword[1] != 0)  // There's some odd models out there with 'fo' or other
-				continue;         //    additional facet types.  Mostly these are junk!
-			
-			//Ensure the 'f' line has at least three entries. 
-			if(!IsValidFLine(&fnFacetParsePtr))
-				continue;
-
-			curTri = new OBJTri();
-
-			// There are multiple different formats for 'f' lines.  Decide which it is,
-			//    and select the appropriate class member we'll use to read this line.
-			SelectReadMethod( &fnFacetParsePtr );
-
-			// Read first three set of indices on this line
-			((*this).*(fnFacetParsePtr))( curTri, 0, NULL );
-			((*this).*(fnFacetParsePtr))( curTri, 1, NULL );
-			((*this).*(fnFacetParsePtr))( curTri, 2, NULL );
-			AddTriangle( curTri );  // m_objTris.Add( curTri );
-
-			// Do we have more vertices in this facet?  Check to see if the 
-			//    next token is non-empty (if empty the [0]'th char == 0)
-			//    If we do, we'll have to triangulate the facet, so make a new tri
-			this->GetToken( vertToken );
-			while ( vertToken[0] ) 
-			{
-				curTri = new OBJTri();
-				CopyForTriangleFan( curTri );
-				((*this).*(fnFacetParsePtr))( curTri, 2, vertToken );
-				AddTriangle( curTri ); // m_objTris.Add( curTri );
-				this->GetToken( vertToken );
-			}
-			break;
-
-		default:  // We have no clue what to do with this line....
-			this->WarningMessage("Found corrupt line in OBJ.  Unknown keyword '%s'", keyword);
-		}
+	// Locate and map the file
+	char fileName[1024];
+	if ( !getFileLocation ( filename, fileName, paths ) ) {
+		gprintf ("Error: OBJReader unable to find '%s'\n", filename );
+		gerror ();
+	}
+	slong size;
+	void* handle;
+	uchar* data = gmapFile ( fileName, size, handle );
+	if ( data == 0x0 ) {
+		gprintf ("Error: Unable to open file '%s'\n", fileName );
+		gerror ();
 	}
 
+	ParseBuffer ( (const char*) data, size );
+
 	// No need to keep the file hanging around open.
-	CloseFile();
-	
-	//AddVertex(Vector4DF( 47.2224* 0.01, 0.0117588* 0.01, 46.8401* 0.01,  0.0f ) );
-	//AddVertex(Vector4DF(47.2224* 0.01, 10.0784* 0.01, 46.8401* 0.01,   0.0f ));
-	//AddVertex(Vector4DF( 47.2224* 0.01, 10.0784* 0.01, 47.8401* 0.01, 0.0f ));
-	//AddVertex(Vector4DF( 47.2224* 0.01, 0.0117588* 0.01, 47.8401* 0.01, 0.0f ));
-
-	//curTri = new OBJTri();
-	//curTri->vIdx[0] = m_numVertices - 1; 
-	//curTri->vIdx[1] = m_numVertices - 2;
-	//curTri->vIdx[2] = m_numVertices - 3;
-	//AddTriangle( curTri );
-
-	//curTri = new OBJTri();
-	//curTri->vIdx[0] = m_numVertices - 4; 
-	//curTri->vIdx[1] = m_numVertices - 2;
-	//curTri->vIdx[2] = m_numVertices - 3;
-	//AddTriangle( curTri );
+	gunmapFile ( data, size, handle );
 
 	// If we already have surface normals, there's no need to use facet normals
 	if (m_hasNormals) m_guessNorms = false;
@@ -163,198 +271,70 @@ bool OBJReader::LoadFile ( Model* model, const char *filename, std::vector<std::
 	// Create the GPU buffers for this object, so we have them laying around later.
 	GetCompactArrayBuffer( model );
 
-
-	// OK.  Now we've created our vertex array.  Enable the attributes so that we're sending the correct
-	//    data to all our shaders.
-
-	//m_vertArr->EnableAttribute( IGLU_ATTRIB_VERTEX, 3, GL_FLOAT, m_vertStride, BUFFER_OFFSET(m_vertOff));
-	//if (HasNormals())  {
-	//	m_vertArr->EnableAttribute( IGLU_ATTRIB_NORMAL, 3, GL_FLOAT, m_vertStride, BUFFER_OFFSET(m_normOff));
-	//}
-
-	// gprintf( " Model reading completed successfully! (%d verts, %d tris)\n", m_numVertices, m_numTris );
+	// gprintf( " Model reading completed successfully! (%d verts, %d tris)\n", m_vertices.size(), m_triangles.size() );
 
 	return true;
 }
 
-unsigned int OBJReader::GetVertexIndex( int relativeIdx )
+void OBJReader::ParseBuffer( const char* data, slong size )
 {
-	if (relativeIdx == 0)
-	{
-		this->WarningMessage("Unexpected OBJ vertex index of 0!");
-		relativeIdx = 1;  // 0 is undefined, and will crash.  Give at least a non-segfaultable value;
+	// Split into line-aligned chunks of at least 1MB
+	int threads = Max( 1, Min( int(std::thread::hardware_concurrency()), int(size >> 20) + 1 ) );
+	std::vector<OBJChunk> chunks( threads );
+	const char* end = data + size;
+	const char* p = data;
+	for ( int i = 0; i < threads; i++ ) {
+		chunks[i].start = p;
+		const char* e = data + slong( double(size) * (i+1) / threads );
+		if ( i == threads-1 || e < p ) e = ( i == threads-1 ) ? end : p;
+		else { e = LineEnd( e, end ); if ( e < end ) e++; }
+		chunks[i].end = e;
+		p = e;
 	}
-	return relativeIdx > 0 ? relativeIdx-1 : m_numVertices+relativeIdx;
-}
-
-unsigned int OBJReader::GetNormalIndex( int relativeIdx )
-{
-	if (relativeIdx == 0)
-		this->WarningMessage("Unexpected OBJ normal index of 0!");
-	// Note the >=, which is different than the > in the vertex index.  An index
-	//    of 0 is invalid.  Our code treats a -1 return value as "no normal".  That' fine
-	//    for nomrals and texture coords
-	return relativeIdx >= 0 ? relativeIdx-1 : m_numNormals+relativeIdx;
-}
 
-void OBJReader::Read_V_Token( OBJTri *tri, int idx, char *token )
-{
-	char vertToken[128], *tPtr = vertToken;
-	int vIdx;
-
-	// If the user didn't pass in a token, read one
-	if (!token)
-		this->GetToken( vertToken );
-	else 
-		tPtr = token;
-
-	// Parse a vertex & normal from the token
-	sscanf( tPtr, "%d", &vIdx );
-
-	// Resolve these into indicies in our data structure (not the OBJ file)
-	tri->vIdx[idx] = GetVertexIndex( vIdx );
-	tri->nIdx[idx] = -1;
-	//tri->tIdx[idx] = -1;
-}
+	ForEachChunk( chunks, CountChunk );
 
-void OBJReader::Read_VN_Token( OBJTri *tri, int idx, char *token )
-{
-	char vertToken[128], *tPtr = vertToken;
-	int vIdx, nIdx;
-
-	// If the user didn't pass in a token, read one
-	if (!token)
-		this->GetToken( vertToken );
-	else 
-		tPtr = token;
-
-	// Parse a vertex & normal from the token
-	sscanf( tPtr, "%d//%d", &vIdx, &nIdx );
-
-	// Resolve these into indicies in our data structure (not the OBJ file)
-	tri->vIdx[idx] = GetVertexIndex( vIdx );
-	tri->nIdx[idx] = GetNormalIndex( nIdx );
-	//tri->tIdx[idx] = -1;
-}
-
-void OBJReader::Read_VT_Token( OBJTri *tri, int idx, char *token )
-{
-	char vertToken[128], *tPtr = vertToken;
-	int vIdx, tIdx;
-
-	// If the user didn't pass in a token, read one
-	if (!token)
-		this->GetToken( vertToken );
-	else 
-		tPtr = token;
-
-	// Parse a vertex & normal from the token
-	sscanf( tPtr, "%d/%d", &vIdx, &tIdx );
-
-	// Resolve these into indicies in our data structure (not the OBJ file)
-	tri->vIdx[idx] = GetVertexIndex( vIdx );
-	tri->nIdx[idx] = -1;
-	// tri->tIdx[idx] = GetTextureIndex( tIdx ); // Ignore texture coordinates
-}
-
-void OBJReader::Read_VTN_Token( OBJTri *tri, int idx, char *token )
-{
-	char vertToken[128], *tPtr = vertToken;
-	int vIdx, tIdx, nIdx;
-
-	// If the user didn't pass in a token, read one
-	if (!token)
-		this->GetToken( vertToken );
-	else 
-		tPtr = token;
-
-	// Parse a vertex & normal from the token
-	sscanf( tPtr, "%d/%d/%d", &vIdx, &tIdx, &nIdx );
-
-	// Resolve these into indicies in our data structure (not the OBJ file)
-	tri->vIdx[idx] = GetVertexIndex( vIdx );
-	tri->nIdx[idx] = GetNormalIndex( nIdx );
-	// tri->tIdx[idx] = GetTextureIndex( tIdx ); // Ignore texture coordinates
-}
-
-void OBJReader::CopyForTriangleFan( OBJTri *newTri )
-{
-	newTri->vIdx[0] = m_triangles[m_numTris-1]->vIdx[0]; 
-	newTri->nIdx[0] = m_triangles[m_numTris-1]->nIdx[0];
-	//newTri->tIdx[0] = m_triangles[m_numTris-1]->tIdx[0];
-	newTri->vIdx[1] = m_triangles[m_numTris-1]->vIdx[2];
-	newTri->nIdx[1] = m_triangles[m_numTris-1]->nIdx[2];
-	//newTri->tIdx[1] = m_triangles[m_numTris-1]->tIdx[2];
-}
-
-void OBJReader::SelectReadMethod( FnParserPtr *pPtr )
-{
-	int v, t, n; // garbage vars
-	char vertToken[128];
-	char *lPtr = this->GetCurrentLinePointer();
-
-	// Non-destructively parse the next token
-	StripLeadingTokenToBuffer( lPtr, vertToken );
-
-	if (strstr(vertToken, "//"))                               // Then it has the v//n format
-	{
-		*pPtr = &OBJReader::Read_VN_Token;
-		m_hasVertices = m_hasNormals = true;
+	size_t nv = 0, nn = 0, nt = 0;
+	int skipped = 0;
+	for ( int i = 0; i < threads; i++ ) {
+		chunks[i].baseVert = nv;	nv += chunks[i].numVerts;
+		chunks[i].baseNorm = nn;	nn += chunks[i].numNorms;
+		chunks[i].baseTri = nt;		nt += chunks[i].numTris;
+		skipped += chunks[i].skipped;
 	}
-
-	else if ( sscanf(vertToken, "%d/%d/%d", &v, &t, &n) == 3 ) // Then it has the v/t/n format
-	{
-		*pPtr = &OBJReader::Read_VTN_Token;
-		m_hasVertices = m_hasNormals = m_hasTexCoords = true;
-	}
-
-	else if ( sscanf(vertToken, "%d/%d", &v, &t) == 2 )        // Then it has the v/t format
-	{
-		*pPtr = &OBJReader::Read_VT_Token;
-		m_hasVertices = m_hasTexCoords = true;
-	}else                                                     // Then it has the v format
-		*pPtr = &OBJReader::Read_V_Token;
-		m_hasVertices = true;
-	}
-	
-bool OBJReader::IsValidFLine(FnParserPtr *pPtr)
-{
-
-	//Garbage variables. This will break if it comes accross an entry on a line
-	//longer than 128 characters. 
-	char c0[128];
-	char c1[128];
-	char c2[128];
-	char vertToken[128]; 
-
-	// Non-destructively parse the next token
-	char *lPtr = this->GetCurrentLinePointer();
-	StripLeadingTokenToBuffer( lPtr, vertToken );
-
-	//Make sure we have at least three entries in this vertex
-	if(sscanf(lPtr, "%s %s %s", c0, c1, c2) >= 3){
-		return true;
-	}else{
-		this->WarningMessage("Corrupt 'f': %s", lPtr);
-		return false; 
+	m_vertices.resize( nv );
+	m_normals.resize( nn );
+	m_triangles.resize( nt );
+
+	Vector3DF* verts = m_vertices.data();
+	Vector3DF* norms = m_normals.data();
+	OBJTri* tris = m_triangles.data();
+	ForEachChunk( chunks, [=] ( OBJChunk& c ) { ParseChunk( c, verts, norms, tris ); } );
+
+	for ( int i = 0; i < threads; i++ ) {
+		m_hasNormals |= chunks[i].normals;
+		m_hasTexCoords |= chunks[i].texCoords;
 	}
+	m_hasVertices = ( nt > 0 );
+	if ( skipped > 0 )
+		gprintf( "Warning: OBJReader skipped %d unknown or corrupt lines.\n", skipped );
 }
 
-void OBJReader::AddDataToArray( float *arr, int startIdx, Vector4DF *vert, Vector4DF *norm )
+void OBJReader::AddDataToArray( float *arr, size_t startIdx, Vector3DF *vert, Vector3DF *norm )
 {	
-	int i = startIdx;
+	size_t i = startIdx;
 
 	// Add the vertex
-	arr[i++] = vert->X();
-	arr[i++] = vert->Y();
-	arr[i++] = vert->Z();
+	arr[i++] = vert->x;
+	arr[i++] = vert->y;
+	arr[i++] = vert->z;
 
 	// If this vertex has a normal, add it.
 	if (norm)
 	{
-		arr[i++] = norm->X();
-		arr[i++] = norm->Y();
-		arr[i++] = norm->Z();
+		arr[i++] = norm->x;
+		arr[i++] = norm->y;
+		arr[i++] = norm->z;
 	}
 }
 
@@ -405,95 +385,73 @@ void OBJReader::CenterAndResize( float *arr, int numVerts )
 
 void OBJReader::GetCompactArrayBuffer( Model* model )
 {
+	const size_t numVerts = m_vertices.size();
+	const size_t numTris = m_triangles.size();
 
 	// Create an OBJ vert ID -> element array vert ID map.  Init all entries to 0xFFFFFFFF.
 	//    Also, create mapping vertID -> last normal ID used for this vertex
-	//          create mapping vertID -> last tex coord used for this vertex
-	unsigned int *vertMapping = (unsigned int *)malloc( m_numVertices * sizeof( unsigned int ) );
-	unsigned int *normMapping = (unsigned int *)malloc( m_numVertices * sizeof( unsigned int ) );
-	memset( vertMapping, 0xFF, m_numVertices * sizeof( unsigned int ) );
-	memset( normMapping, 0xFF, m_numVertices * sizeof( unsigned int ) );
+	std::vector<unsigned int> vertMapping( numVerts, 0xFFFFFFFF );
+	std::vector<int> normMapping( numVerts, -1 );
 
-	//   We'll have 1 float for a material ID
 	//   We'll have 3 floats (x,y,z) for each of the 3 verts of each triangle 
 	//   We'll have 3 floats (x,y,z) for each of the 3 normals of each triangle
-	//   We'll have 2 floats (u,v) for each of the 3 texture coordinates of each triangle
 	unsigned int  numComponents = 3 + (m_hasNormals||m_guessNorms ? 3 : 0);
 
-	int bufSz  = numComponents * sizeof( float ) * (3 * m_numTris);
+	size_t bufSz = numComponents * sizeof( float ) * (3 * numTris);
 	m_vertStride = numComponents * sizeof( float );
 	m_vertOff    = 0 * sizeof( float );
 	m_normOff    = (m_hasNormals||m_guessNorms? 3 : 0) * sizeof( float );
-	// gprintf ("    (*) Stride: %d, Offsets: v %d, m %d, o %d, n %d t %d\n", m_vertStride, m_vertOff, 0, 0, m_normOff, 0);
 
-	// Add a vertex buffer to the model
+	// Add a vertex buffer to the model (sized for the worst case, trimmed below)
 	if ( model->vertBuffer != 0x0 )		free ( model->vertBuffer );
-	model->vertBuffer = (float*)		malloc ( bufSz );
+	model->vertBuffer = (float*)		malloc ( bufSz > 0 ? bufSz : 1 );
 	if (!model->vertBuffer) this->ErrorMessage("Memory allocation error during .obj read!");
 	float* tmpBuf = (float*) model->vertBuffer;							// cast to float* to populate it	
 	
 	// Add an element buffer to the model
-	unsigned int elembufSz = 3 * sizeof( unsigned int ) * m_numTris;
+	size_t elembufSz = 3 * sizeof( unsigned int ) * numTris;
 	if ( model->elemBuffer != 0x0 )		free ( model->elemBuffer );
-	model->elemBuffer = (unsigned int*)	malloc( elembufSz );
+	model->elemBuffer = (unsigned int*)	malloc( elembufSz > 0 ? elembufSz : 1 );
 	unsigned int *tmpElemBuf = (unsigned int *) model->elemBuffer;		// cast to unsigned int* to populate it
 
-	// We'll need to know the size of our two arrays
-	int numArrayElements = 3 * m_numTris;         // Known in advance
-	int numArrayVerts    = 0;                     // Depends on how many verts are reused.  We'll compute
+	size_t numArrayVerts = 0;                     // Depends on how many verts are reused.  We'll compute
+	size_t numElems = 0;                          // Triangles with valid indices
 
 	// A location to store normal guesses
-	Vector4DF tmpNorm;
-	Vector4DF *normGuess = (m_guessNorms ? &tmpNorm : 0);
+	Vector3DF tmpNorm;
+	Vector3DF *normGuess = (m_guessNorms ? &tmpNorm : 0);
 
-
-	for (unsigned int i=0, triNum=0; triNum < m_numTris; i+=3,triNum++ )
+	for ( size_t triNum = 0; triNum < numTris; triNum++ )
 	{
-		int i0 = m_triangles[triNum]->vIdx[0];
-		int i1 = m_triangles[triNum]->vIdx[1];
-		int i2 = m_triangles[triNum]->vIdx[2];
-
-		int *nIdx = m_triangles[triNum]->nIdx;
-		//int *tIdx = m_triangles[triNum]->tIdx;
+		const OBJTri& tri = m_triangles[triNum];
+		if ( unsigned(tri.vIdx[0]) >= numVerts || unsigned(tri.vIdx[1]) >= numVerts || unsigned(tri.vIdx[2]) >= numVerts )
+			continue;
 
-		if ( i0 < 0 || i0 > int(m_numVertices) ) continue;
-		if ( i1 < 0 || i1 > int(m_numVertices) ) continue;
-		if ( i2 < 0 || i2 > int(m_numVertices) ) continue;
+		const Vector3DF& p0 = m_vertices[tri.vIdx[0]];
+		tmpNorm = m_vertices[tri.vIdx[1]] - p0;
+		tmpNorm.Cross( m_vertices[tri.vIdx[2]] - p0 );
+		tmpNorm.Normalize();
 
-		tmpNorm = ((m_vertices[i1]-m_vertices[i0]).Cross(m_vertices[i2]-m_vertices[i0])).Normalize();
-
-		if (    (vertMapping[i0] == 0xFFFFFFFF) // We haven't seen this vertex yet.  Add to list
-		     || (m_hasNormals && normMapping[i0] != m_triangles[triNum]->nIdx[0]) )    // We saw this vertex...  but w/different normal
-		{
-			AddDataToArray( tmpBuf, numArrayVerts*numComponents, &m_vertices[m_triangles[triNum]->vIdx[0]], (m_hasNormals && (nIdx[0]>=0)) ? &m_normals[nIdx[0]] : normGuess );
-			tmpElemBuf[i]   = numArrayVerts;
-			vertMapping[i0] = numArrayVerts++;
-			normMapping[i0] = nIdx[0];
-		}
-		else                               // We've already seen vertex; reuse it.
-			tmpElemBuf[i] = vertMapping[i0];
-
-		if (    (vertMapping[i1] == 0xFFFFFFFF) // We haven't seen this vertex yet.  Add to list
-		     || (m_hasNormals && normMapping[i1] != m_triangles[triNum]->nIdx[1]) )    // We saw this vertex...  but w/different normal
+		for ( int k = 0; k < 3; k++ )
 		{
-			AddDataToArray( tmpBuf, numArrayVerts*numComponents, &m_vertices[m_triangles[triNum]->vIdx[1]], (m_hasNormals && (nIdx[1]>=0)) ? &m_normals[nIdx[1]] : normGuess );
-			tmpElemBuf[i+1]   = numArrayVerts;
-			vertMapping[i1] = numArrayVerts++;
-			normMapping[i1] = nIdx[1];
+			int vi = tri.vIdx[k], ni = tri.nIdx[k];
+			if ( ni >= int(m_normals.size()) ) ni = -1;
+			if (    vertMapping[vi] == 0xFFFFFFFF                    // We haven't seen this vertex yet.  Add to list
+			     || (m_hasNormals && normMapping[vi] != ni) )      // We saw this vertex...  but w/different normal
+			{
+				AddDataToArray( tmpBuf, numArrayVerts*numComponents, &m_vertices[vi], (m_hasNormals && ni >= 0) ? &m_normals[ni] : normGuess );
+				vertMapping[vi] = (unsigned int) numArrayVerts++;
+				normMapping[vi] = ni;
+			}
+			tmpElemBuf[numElems*3 + k] = vertMapping[vi];        // Otherwise we've already seen vertex; reuse it.
 		}
-		else                               // We've already seen vertex; reuse it.
-			tmpElemBuf[i+1] = vertMapping[i1];
+		numElems++;
+	}
 
-		if (    (vertMapping[i2] == 0xFFFFFFFF) // We haven't seen this vertex yet.  Add to list
-		     || (m_hasNormals && normMapping[i2] != m_triangles[triNum]->nIdx[2]) )    // We saw this vertex...  but w/different normal
-		{
-			AddDataToArray( tmpBuf, numArrayVerts*numComponents, &m_vertices[m_triangles[triNum]->vIdx[2]], (m_hasNormals && (nIdx[2]>=0)) ? &m_normals[nIdx[2]] : normGuess );
-			tmpElemBuf[i+2]   = numArrayVerts;
-			vertMapping[i2] = numArrayVerts++;
-			normMapping[i2] = nIdx[2];
-		}
-		else                               // We've already seen vertex; reuse it.
-			tmpElemBuf[i+2] = vertMapping[i2];
+	// Give back the unused part of the worst-case vertex buffer
+	if ( numArrayVerts > 0 && numArrayVerts < 3 * numTris ) {
+		float* trimmed = (float*) realloc( model->vertBuffer, numArrayVerts * m_vertStride );
+		if ( trimmed ) model->vertBuffer = trimmed;
 	}
 
 	// If the user asked us to resize & center the object, do that.
@@ -505,11 +463,11 @@ void OBJReader::GetCompactArrayBuffer( Model* model )
 
 	// Copy our arrays into model GPU buffers
 	model->elemDataType      = GL_TRIANGLES;           // What type of GL-renderable primitive does this model contain (e.g., GL_TRIANGLES)
-	model->elemCount	     = m_numTris;          // How many of the above primitives are there in the model?
+	model->elemCount	     = int(numElems);          // How many of the above primitives are there in the model?
 	model->elemArrayOffset   = 0;                      // In the element index array, what's the byte offset to the index of the first element to use?  
 	model->elemStride		 = 3 * sizeof(unsigned int);
 
-	model->vertCount		 = numArrayVerts;
+	model->vertCount		 = int(numArrayVerts);
 	model->vertDataType       = GL_FLOAT;               // What is the GL data type of each component in the vertex positions?
 	model->vertComponents	 = 3;                      // How many components are in each vertex position attribute?
 	model->vertOffset         = m_vertOff;              // What's the byte offset to the start of the first vertex position in the vertex buffer?
@@ -519,84 +477,6 @@ void OBJReader::GetCompactArrayBuffer( Model* model )
 	model->normComponents	 = 3;                      // How many components are in each vertex normal attribute?
 	model->normOffset        = m_normOff;              // What's the byte offset to the start of the first vertex normal in the vertex buffer?
 
-	// Free our temporary copy of the data
-	free( vertMapping );
-	free( normMapping );
-
 	// If we asked to guess normals, we've done it.  Treat everything hereon as if we had norms:
 	if (m_guessNorms) m_hasNormals = true;
 }
-
-
-
-void OBJReader::AddVertex( const Vector4DF &vert )
-{
-	if ( m_numVertices >= m_allocVert )
-	{
-		unsigned int oldAlloc = m_allocVert;
-		if (oldAlloc <= 0)
-		{
-			m_allocVert = 1000000;
-			m_vertices = new Vector4DF[ m_allocVert ];
-		}
-		else
-		{
-			m_allocVert = oldAlloc + 1000000;
-			Vector4DF *ptr = m_vertices;
-			m_vertices = new Vector4DF[ m_allocVert ];
-			for (unsigned int i=0; i<oldAlloc; i++)
-				m_vertices[i] = ptr[i];
-			delete[] ptr;
-		}
-	}
-	m_vertices[ m_numVertices ] = vert;
-	m_numVertices++;
-}
-
-void OBJReader::AddNormal( const Vector4DF &norm )
-{
-	if ( m_numNormals >= m_allocNorm )
-	{
-		unsigned int oldAlloc = m_allocNorm;
-		if (oldAlloc <= 0)
-		{
-			m_allocNorm = 1000000;
-			m_normals = new Vector4DF[ m_allocNorm ];
-		}
-		else
-		{
-			m_allocNorm = oldAlloc + 1000000;
-			Vector4DF *ptr = m_normals;
-			m_normals = new Vector4DF[ m_allocNorm ];
-			for (unsigned int i=0; i<oldAlloc; i++)
-				m_normals[i] = ptr[i];
-			delete[] ptr;
-		}
-	}
-	m_normals[ m_numNormals ] = norm;
-	m_numNormals++;
-}
-
-void OBJReader::AddTriangle( OBJTri *tri )
-{
-	if ( m_numTris >= m_allocTri )
-	{
-		unsigned int oldAlloc = m_allocTri;
-		if (oldAlloc <= 0)
-		{
-			m_allocTri = 1000000;
-			m_triangles = (OBJTri **)malloc( m_allocTri * sizeof (OBJTri *) );
-		}
-		else
-		{
-			m_allocTri = oldAlloc + 1000000;
-			OBJTri **ptr = m_triangles;
-			m_triangles = (OBJTri **)malloc( m_allocTri * sizeof (OBJTri *) );
-			for (unsigned int i=0; i<oldAlloc; i++)
-				m_triangles[i] = ptr[i];
-			free( ptr );
-		}
-	}
-	m_triangles[ m_numTris ] = tri;
-	m_numTris++;
-}
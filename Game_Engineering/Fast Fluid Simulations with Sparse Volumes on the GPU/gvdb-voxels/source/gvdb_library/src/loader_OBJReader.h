@@ -20,8 +20,15 @@ using namespace nvdb;
 
 #pragma warning( disable: 4996 )
 
-struct OBJTri;
+struct OBJTri
+{
+	int vIdx[3], nIdx[3];				// nIdx -1 = no normal
+};
 
+// The file is memory-mapped and split into line-aligned chunks that are parsed
+// in parallel: a counting pass sizes the arrays and gives each chunk its offsets
+// (relative indices need the vertex count before each line), then a second pass
+// writes vertices, normals and triangles directly into place.
 class OBJReader : public Parser
 {
 public:
@@ -36,54 +43,23 @@ public:
 	friend Model;
 
 private:
-	// Indicies in OBJ files may be relative (i.e., negative).  OBJ files also
-	//    use a Pascal array indexing scheme (i.e., start from 1).  These methods
-	//    fixes these issues to give an array index we can actually use.
-	unsigned int GetVertexIndex( int relativeIdx );
-	unsigned int GetNormalIndex( int relativeIdx );
-	// unsigned int GetTextureIndex( int relativeIdx );
+	// Parse an in-memory OBJ into m_vertices, m_normals and m_triangles
+	void ParseBuffer( const char* data, slong size );
 
 	// These methods make sure the vertex array and element array buffers are set up correctly
 	void GetCompactArrayBuffer( Model* model );
 
-	// Read appropriate facet tokens
-	void Read_V_Token( OBJTri *tri, int idx, char *token=0 );
-	void Read_VT_Token( OBJTri *tri, int idx, char *token=0 );
-	void Read_VN_Token( OBJTri *tri, int idx, char *token=0 );
-	void Read_VTN_Token( OBJTri *tri, int idx, char *token=0 );
-
 	// Helper function for adding data to a float array for our GPU-packed array
-	void AddDataToArray( float *arr, int startIdx, Vector4DF *vert, Vector4DF *norm );
+	void AddDataToArray( float *arr, size_t startIdx, Vector3DF *vert, Vector3DF *norm );
 
 	// Helper for centering & resizing the geometry in the array before sending it to OpenGL
 	void CenterAndResize( float *arr, int numVerts );
 
-	// This declares an ugly type FnParserPtr that points to one of the Read_???_Token methods
-	typedef void (OBJReader::*FnParserPtr)(OBJTri *, int, char *); 
-
-	// Copy from prior triangle facets when triangulating
-	void CopyForTriangleFan( OBJTri *newTri );
-
-	// A method that is called after finding an 'f' line that identifies
-	//    the appropriate Read_???_Token() method to call when parsing
-	void SelectReadMethod( FnParserPtr *pPtr );
-
-	//Checks that an f line has enough vertices to be parsed as a triangle.
-	//For example, it returns false if the f line has only two entries on it
-	bool IsValidFLine( FnParserPtr *pPtr);
-
-	// Simple drop in for expandable arrays.  Sort of dumb.
-	void AddVertex( const Vector4DF &vert );
-	void AddNormal( const Vector4DF &norm );
-	void AddTriangle( OBJTri *tri );
-	
 protected:
 	// Basic geometric definitions read from the file
-	unsigned int m_numVertices, m_numNormals, m_numTris;
-	unsigned int m_allocVert, m_allocNorm, m_allocTri;
-	OBJTri **m_triangles;
-	Vector4DF *m_normals;
-	Vector4DF *m_vertices;
+	std::vector<OBJTri>		m_triangles;
+	std::vector<Vector3DF>	m_normals;
+	std::vector<Vector3DF>	m_vertices;
 
 	// Does the user want us to resize and center the object around the origin?
 	//    Some/many models use completely arbitrary coordinates, so it's difficult
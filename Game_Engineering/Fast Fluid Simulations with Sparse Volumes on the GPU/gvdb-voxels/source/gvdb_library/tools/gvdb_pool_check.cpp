@@ -0,0 +1,205 @@
+//-----------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+//-----------------------------------------------------------------------------
+// gvdbPoolCheck: stress test of concurrent pool allocation (PoolBeginConcurrent).
+// Threads allocate and free elements at random, then the pool is checked for
+// elements handed out twice and for its counts after PoolEndConcurrent.
+// Also round-trips pools through PoolWrite/PoolRead with file rows wider and
+// narrower than the pool rows, as when VBX files move between bitmask builds.
+// Usage: gvdbPoolCheck [threads ops]
+
+#include "gvdb_allocator.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+using namespace nvdb;
+
+#define NODE_WID		64
+#define LIST_WID		40
+
+static int fail ( const char* msg, uint64 a, uint64 b )
+{
+	printf ( "  FAIL: %s (%llu, %llu)\n", msg, (unsigned long long) a, (unsigned long long) b );
+	return 1;
+}
+
+// Many threads allocating, writing and freeing at once
+static int CheckStress ( int threads, int ops )
+{
+	Allocator a ( true );
+	a.PoolCreate ( 0, 0, NODE_WID, 16, false );
+	a.PoolCreate ( 1, 0, LIST_WID, 4, false );
+	int bad = 0;
+
+	// elements from before the concurrent section must survive it
+	std::vector<uint64> pre;
+	for (int n=0; n < 100; n++ ) {
+		pre.push_back ( a.PoolAlloc ( 0, 0, false ) );
+		*(uint64*) a.PoolData ( pre.back() ) = pre.back() + 1;
+	}
+	a.PoolBeginConcurrent ( uint64(1) << 30 );
+	char* base = a.getPoolCPU ( 0, 0 );
+
+	std::vector< std::vector<uint64> > live ( threads );
+	std::vector<int> dirty ( threads, 0 );
+	std::vector<uint64> lists ( threads, 0 );
+	std::vector<std::thread> pool;
+	for (int t=0; t < threads; t++ ) {
+		pool.push_back ( std::thread ( [&, t] () {
+			uint64 seed = 0x9E3779B97F4A7C15ULL * (t+1);
+			for (int i=0; i < ops; i++ ) {
+				seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+				uint64 cnt = ( (seed >> 33) % 97 == 0 ) ? 8 : 1;
+				uint64 id = a.PoolAllocMulti ( 0, 0, cnt, false );
+				if ( id == ID_UNDEFL ) { dirty[t]++; continue; }
+				for (uint64 k=0; k < cnt; k++ ) {
+					uint64* d = (uint64*) a.PoolData ( id + (k << 16) );
+					if ( d[0] != 0 ) dirty[t]++;					// fresh and recycled elements read as zero
+					d[0] = id + (k << 16) + 1;
+				}
+				if ( cnt == 1 && (seed >> 40) % 3 == 0 ) a.PoolFree ( id );
+				else for (uint64 k=0; k < cnt; k++ ) live[t].push_back ( id + (k << 16) );
+				if ( i % 1000 == 0 && a.PoolAlloc ( 1, 0, false ) != ID_UNDEFL ) lists[t]++;
+			}
+		} ) );
+	}
+	for (size_t t=0; t < pool.size(); t++ )
+		pool[t].join ();
+	a.PoolEndConcurrent ();
+
+	// no element handed out twice, and every live element kept its data
+	std::vector<uint64> all ( pre.begin(), pre.end() );
+	for (int t=0; t < threads; t++ ) {
+		all.insert ( all.end(), live[t].begin(), live[t].end() );
+		if ( dirty[t] > 0 ) bad += fail ( "dirty or failed allocations in thread", t, dirty[t] );
+	}
+	for (size_t n=0; n < all.size(); n++ )
+		if ( *(uint64*) a.PoolData ( all[n] ) != all[n] + 1 ) { bad += fail ( "element overwritten", ElemNdx(all[n]), 0 ); break; }
+	std::sort ( all.begin(), all.end() );
+	for (size_t n=1; n < all.size(); n++ )
+		if ( all[n] == all[n-1] ) { bad += fail ( "element handed out twice", ElemNdx(all[n]), 0 ); break; }
+	if ( a.getPoolCPU ( 0, 0 ) != base ) bad += fail ( "pool moved while concurrent", 0, 0 );
+
+	// counts: used = live, every slot below lastEle is live or free, lastEle is committed
+	uint64 used = a.getPoolUsedCnt ( 0, 0 ), last = a.getPoolTotalCnt ( 0, 0 ), max = a.getPoolMax ( 0, 0 );
+	if ( used != all.size() ) bad += fail ( "usedNum", used, all.size() );
+	if ( last > max ) bad += fail ( "lastEle beyond max", last, max );
+	if ( !all.empty() && ElemNdx(all.back()) >= last ) bad += fail ( "live element beyond lastEle", ElemNdx(all.back()), last );
+	uint64 nlists = 0;
+	for (int t=0; t < threads; t++ ) nlists += lists[t];
+	if ( a.getPoolUsedCnt ( 1, 0 ) != nlists ) bad += fail ( "usedNum of second pool", a.getPoolUsedCnt ( 1, 0 ), nlists );
+
+	// the free slots are reused serially, zeroed, without growing the pool
+	for (uint64 n=used; n < last; n++ ) {
+		uint64 id = a.PoolAlloc ( 0, 0, false );
+		if ( id == ID_UNDEFL || ElemNdx(id) >= last || *(uint64*) a.PoolData ( id ) != 0 || std::binary_search ( all.begin(), all.end(), id ) ) {
+			bad += fail ( "free slot reuse", ElemNdx(id), last );
+			break;
+		}
+	}
+	if ( a.getPoolTotalCnt ( 0, 0 ) != last ) bad += fail ( "lastEle after reuse", a.getPoolTotalCnt ( 0, 0 ), last );
+	if ( a.getPoolUsedCnt ( 0, 0 ) != last ) bad += fail ( "usedNum after reuse", a.getPoolUsedCnt ( 0, 0 ), last );
+
+	printf ( "  stress: %d threads x %d ops, %llu live of %llu, %s\n", threads, ops, (unsigned long long) all.size(), (unsigned long long) last, bad ? "FAILED" : "ok" );
+	a.PoolReleaseAll ();
+	return bad;
+}
+
+// Requests past the reservation fail without leaving lastEle past committed memory
+static int CheckReserve ( int threads )
+{
+	Allocator a ( true );
+	a.PoolCreate ( 0, 0, NODE_WID, 16, false );
+	int bad = 0;
+	for (int n=0; n < 10; n++ ) a.PoolAlloc ( 0, 0, false );
+	a.PoolBeginConcurrent ( uint64(1) << 20 );
+	uint64 reserve = ( uint64(1) << 20 ) / NODE_WID;
+
+	std::vector<int> got ( threads, 0 );
+	std::vector<std::thread> pool;
+	for (int t=0; t < threads; t++ ) {
+		pool.push_back ( std::thread ( [&, t] () {
+			for (int i=0; i < 2; i++ ) {
+				if ( a.PoolAllocMulti ( 0, 0, reserve / 4, false ) != ID_UNDEFL ) got[t]++;
+				a.PoolAllocMulti ( 0, 0, reserve, false );			// always fails
+			}
+		} ) );
+	}
+	for (size_t t=0; t < pool.size(); t++ )
+		pool[t].join ();
+	a.PoolEndConcurrent ();
+
+	uint64 ok = 0;
+	for (int t=0; t < threads; t++ ) ok += got[t];
+	uint64 used = a.getPoolUsedCnt ( 0, 0 ), last = a.getPoolTotalCnt ( 0, 0 ), max = a.getPoolMax ( 0, 0 );
+	if ( ok > 3 ) bad += fail ( "more requests granted than fit", ok, 3 );
+	if ( used < 10 + ok * (reserve / 4) ) bad += fail ( "usedNum", used, 10 + ok * (reserve / 4) );
+	if ( used > last ) bad += fail ( "usedNum beyond lastEle", used, last );
+	if ( last > max ) bad += fail ( "lastEle beyond max", last, max );
+	else memset ( a.getPoolCPU ( 0, 0 ), 0, last * NODE_WID );		// every counted element is committed
+
+	printf ( "  reserve: %llu of %llu elements used, %s\n", (unsigned long long) last, (unsigned long long) reserve, bad ? "FAILED" : "ok" );
+	a.PoolReleaseAll ();
+	return bad;
+}
+
+// Rows written at one width and read into a pool of another keep their shared front
+static int CheckReadWidth ( int wid_file, int wid_pool )
+{
+	const int cnt = 100;
+	const uint64 sentinel = 0x5EB71E1ULL;
+	int bad = 0;
+	FILE* fp = tmpfile ();
+	if ( fp == 0x0 ) return fail ( "tmpfile", 0, 0 );
+
+	Allocator src ( true );
+	src.PoolCreate ( 0, 0, wid_file, cnt, false );
+	for (int n=0; n < cnt; n++ ) {
+		uchar* d = (uchar*) src.PoolData ( src.PoolAlloc ( 0, 0, false ) );
+		for (int b=0; b < wid_file; b++ ) d[b] = uchar( n*7 + b );
+	}
+	src.PoolWrite ( fp, 0, 0 );
+	fwrite ( &sentinel, sizeof(uint64), 1, fp );
+	src.PoolReleaseAll ();
+
+	Allocator dst ( true );
+	dst.PoolCreate ( 0, 0, wid_pool, cnt, false );
+	rewind ( fp );
+	dst.PoolRead ( fp, 0, 0, cnt, wid_file );
+	uint64 tail = 0;
+	if ( fread ( &tail, sizeof(uint64), 1, fp ) != 1 || tail != sentinel ) bad += fail ( "file position after read", tail, sentinel );
+	fclose ( fp );
+
+	if ( dst.getPoolWidth ( 0, 0 ) != uint64(wid_pool) ) bad += fail ( "stride changed", dst.getPoolWidth ( 0, 0 ), wid_pool );
+	if ( dst.getPoolTotalCnt ( 0, 0 ) != cnt ) bad += fail ( "lastEle", dst.getPoolTotalCnt ( 0, 0 ), cnt );
+	for (int n=0; n < cnt && !bad; n++ ) {
+		uchar* d = (uchar*) dst.getPoolCPU ( 0, 0 ) + uint64(n) * wid_pool;
+		for (int b=0; b < wid_pool; b++ ) {
+			uchar expect = ( b < wid_file ) ? uchar( n*7 + b ) : 0;
+			if ( d[b] != expect ) { bad += fail ( "row data", n, b ); break; }
+		}
+	}
+	printf ( "  read: file rows %d into pool rows %d, %s\n", wid_file, wid_pool, bad ? "FAILED" : "ok" );
+	dst.PoolReleaseAll ();
+	return bad;
+}
+
+int main ( int argc, char** argv )
+{
+	int threads = ( argc > 1 ) ? atoi ( argv[1] ) : 8;
+	int ops = ( argc > 2 ) ? atoi ( argv[2] ) : 200000;
+	if ( threads < 1 || ops < 1 ) {
+		printf ( "Usage: gvdbPoolCheck [threads ops]\n" );
+		return 2;
+	}
+	printf ( "POOL CHECK\n" );
+	int bad = CheckStress ( threads, ops ) + CheckReserve ( threads );
+	bad += CheckReadWidth ( NODE_WID, NODE_WID ) + CheckReadWidth ( NODE_WID + 24, NODE_WID ) + CheckReadWidth ( NODE_WID, NODE_WID + 24 );
+	printf ( "%s\n", bad ? "POOL CHECK FAILED" : "POOL CHECK PASSED" );
+	return bad ? 1 : 0;
+}
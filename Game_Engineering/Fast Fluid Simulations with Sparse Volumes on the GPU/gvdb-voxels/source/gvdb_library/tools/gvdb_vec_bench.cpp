@@ -0,0 +1,171 @@
+//-----------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+//-----------------------------------------------------------------------------
+// gvdbVecBench: CPU batch math kernels (gvdb_vec.h) vs. per-element Vector3DF loops.
+// Usage: gvdbVecBench [elements reps]
+
+#include "gvdb_vec.h"
+#include "app_perf.h"
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+using namespace nvdb;
+
+// Normal matrix rows as TransformNormals uses them: cofactors of the upper 3x3
+static void getNormalRows ( const Matrix4F& m, float* r )
+{
+	double a[3][3], c[3][3];
+	for (int i = 0; i < 3; i++ )
+		for (int j = 0; j < 3; j++ )
+			a[i][j] = m.data[j*4 + i];
+	for (int i = 0; i < 3; i++ )
+		for (int j = 0; j < 3; j++ )
+			c[i][j] = a[(i+1)%3][(j+1)%3] * a[(i+2)%3][(j+2)%3] - a[(i+1)%3][(j+2)%3] * a[(i+2)%3][(j+1)%3];
+	double det = a[0][0]*c[0][0] + a[0][1]*c[0][1] + a[0][2]*c[0][2];
+	double s = (det < 0) ? -1.0 : 1.0;
+	for (int i = 0; i < 3; i++ ) {
+		for (int j = 0; j < 3; j++ )
+			r[i*4 + j] = float( c[i][j] * s );
+		r[i*4 + 3] = 0;
+	}
+}
+
+static float maxDiff ( const float* a, const float* b, size_t num )
+{
+	float d = 0;
+	for (size_t i = 0; i < num; i++ ) d = std::max ( d, fabsf ( a[i] - b[i] ) );
+	return d;
+}
+
+static void reportBench ( const char* name, float ms_scalar, float ms_batch, int reps, size_t num, float err )
+{
+	printf ( "  %-18s %9.3f ms scalar  %9.3f ms batch  %6.2fx  %8.1f M/sec  max diff %g\n", name,
+		ms_scalar / reps, ms_batch / reps, ms_scalar / std::max ( ms_batch, 1.0e-6f ), double(num) * reps / (ms_batch * 1000.0), err );
+}
+
+// Times each batch kernel against the equivalent per-element Vector3DF loop
+static void BenchmarkVecKernels ( size_t num, int reps )
+{
+	std::vector<Vector3DF> pnt ( num ), ref ( num ), out ( num );
+	std::vector<float> sa ( num * 3 ), sb ( num * 3 ), so ( num * 3 ), sr ( num * 3 ), dot ( num ), dref ( num );
+	unsigned int seed = 2564;
+	for (size_t i = 0; i < num * 3; i++ ) {
+		seed = seed * 1664525u + 1013904223u;
+		float v = float(seed >> 8) / float(1 << 24) * 200.0f - 100.0f;
+		(&pnt[0].x)[i] = v;
+		sa[i] = v;
+		sb[ (i + 7) % (num * 3) ] = v * 0.5f + 1.0f;
+	}
+	float* ax = &sa[0]; float* ay = ax + num; float* az = ay + num;
+	float* bx = &sb[0]; float* by = bx + num; float* bz = by + num;
+	float* ox = &so[0]; float* oy = ox + num; float* oz = oy + num;
+	float* rx = &sr[0]; float* ry = rx + num; float* rz = ry + num;
+
+	Matrix4F xform;
+	xform.RotateTZYXS ( Vector3DF(30, 45, 10), Vector3DF(1, 2, 3), Vector3DF(2, 0.5f, 1.5f) );
+	float nr[12];
+	getNormalRows ( xform, nr );
+	Matrix4F nrm ( nr[0], nr[4], nr[8], 0, nr[1], nr[5], nr[9], 0, nr[2], nr[6], nr[10], 0, 0, 0, 0, 1 );
+	float ms[2];
+
+	printf ( "VEC BENCHMARK: %llu elements, %d reps, %s\n", (unsigned long long) num, reps, getVecSIMDName() );
+
+	PERF_START ();
+	for (int r = 0; r < reps; r++ )
+		for (size_t i = 0; i < num; i++ ) { ref[i] = pnt[i]; ref[i] *= xform; }
+	ms[0] = PERF_STOP ();
+	PERF_START ();
+	for (int r = 0; r < reps; r++ )
+		TransformPoints ( xform, &pnt[0], &out[0], num );
+	ms[1] = PERF_STOP ();
+	reportBench ( "TransformPoints", ms[0], ms[1], reps, num, maxDiff ( &ref[0].x, &out[0].x, num * 3 ) );
+
+	PERF_START ();
+	for (int r = 0; r < reps; r++ )
+		for (size_t i = 0; i < num; i++ ) { ref[i] = pnt[i]; ref[i] *= nrm; ref[i].Normalize (); }
+	ms[0] = PERF_STOP ();
+	PERF_START ();
+	for (int r = 0; r < reps; r++ )
+		TransformNormals ( xform, &pnt[0], &out[0], num );
+	ms[1] = PERF_STOP ();
+	reportBench ( "TransformNormals", ms[0], ms[1], reps, num, maxDiff ( &ref[0].x, &out[0].x, num * 3 ) );
+
+	Vector3DF lo[2], hi[2];
+	PERF_START ();
+	for (int r = 0; r < reps; r++ ) {
+		Vector3DF p = pnt[0]; p *= xform;
+		lo[0] = p; hi[0] = p;
+		for (size_t i = 1; i < num; i++ ) {
+			p = pnt[i]; p *= xform;
+			if ( p.x < lo[0].x ) lo[0].x = p.x;
+			if ( p.y < lo[0].y ) lo[0].y = p.y;
+			if ( p.z < lo[0].z ) lo[0].z = p.z;
+			if ( p.x > hi[0].x ) hi[0].x = p.x;
+			if ( p.y > hi[0].y ) hi[0].y = p.y;
+			if ( p.z > hi[0].z ) hi[0].z = p.z;
+		}
+	}
+	ms[0] = PERF_STOP ();
+	PERF_START ();
+	for (int r = 0; r < reps; r++ )
+		BoundPoints ( &pnt[0], num, lo[1], hi[1], 0, &xform );
+	ms[1] = PERF_STOP ();
+	reportBench ( "BoundPoints", ms[0], ms[1], reps, num, std::max ( maxDiff ( &lo[0].x, &lo[1].x, 3 ), maxDiff ( &hi[0].x, &hi[1].x, 3 ) ) );
+
+	PERF_START ();
+	for (int r = 0; r < reps; r++ )
+		for (size_t i = 0; i < num; i++ ) dref[i] = (float) Vector3DF(ax[i], ay[i], az[i]).Dot ( Vector3DF(bx[i], by[i], bz[i]) );
+	ms[0] = PERF_STOP ();
+	PERF_START ();
+	for (int r = 0; r < reps; r++ )
+		DotSoA ( ax, ay, az, bx, by, bz, &dot[0], num );
+	ms[1] = PERF_STOP ();
+	reportBench ( "DotSoA", ms[0], ms[1], reps, num, maxDiff ( &dref[0], &dot[0], num ) );
+
+	PERF_START ();
+	for (int r = 0; r < reps; r++ )
+		for (size_t i = 0; i < num; i++ ) {
+			Vector3DF c ( ax[i], ay[i], az[i] );
+			c.Cross ( Vector3DF(bx[i], by[i], bz[i]) );
+			rx[i] = c.x; ry[i] = c.y; rz[i] = c.z;
+		}
+	ms[0] = PERF_STOP ();
+	PERF_START ();
+	for (int r = 0; r < reps; r++ )
+		CrossSoA ( ax, ay, az, bx, by, bz, ox, oy, oz, num );
+	ms[1] = PERF_STOP ();
+	reportBench ( "CrossSoA", ms[0], ms[1], reps, num, maxDiff ( &sr[0], &so[0], num * 3 ) );
+
+	PERF_START ();
+	for (int r = 0; r < reps; r++ )
+		for (size_t i = 0; i < num; i++ ) {
+			Vector3DF c ( ax[i], ay[i], az[i] );
+			c.Normalize ();
+			rx[i] = c.x; ry[i] = c.y; rz[i] = c.z;
+		}
+	ms[0] = PERF_STOP ();
+	ms[1] = 0;
+	for (int r = 0; r < reps; r++ ) {
+		memcpy ( ox, ax, num * 3 * sizeof(float) );		// normalize in place, copy not timed
+		PERF_START ();
+		NormalizeSoA ( ox, oy, oz, num );
+		ms[1] += PERF_STOP ();
+	}
+	reportBench ( "NormalizeSoA", ms[0], ms[1], reps, num, maxDiff ( &sr[0], &so[0], num * 3 ) );
+}
+
+int main ( int argc, char** argv )
+{
+	if ( argc >= 3 ) {
+		BenchmarkVecKernels ( (size_t) atoll ( argv[1] ), atoi ( argv[2] ) );
+	} else {
+		BenchmarkVecKernels ( 1000000, 20 );
+		BenchmarkVecKernels ( 16000000, 5 );
+	}
+	return 0;
+}